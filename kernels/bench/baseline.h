@@ -0,0 +1,91 @@
+/*
+the regression gate of main's --baseline, a report written by --json is read
+back and every run of the current report matched to the one of it with the
+same kernel, device, dtype, shape and threads, a run whose p50 grew by more
+than the threshold over the baseline's is a regression, runs missing from
+either side are left out
+*/
+
+#pragma once
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+
+namespace bench {
+
+namespace detail {
+    // the value of key in a run line of write_json, without its quotes
+    inline std::string json_field(const std::string &line, const std::string &key) {
+        const std::string k = "\"" + key + "\": ";
+        size_t i = line.find(k);
+        if (i == std::string::npos)
+            throw std::invalid_argument("baseline run without " + key + ": " + line);
+        i += k.size();
+        if (line[i] == '"')
+            return line.substr(i + 1, line.find('"', i + 1) - i - 1);
+        return line.substr(i, line.find_first_of(",}", i) - i);
+    }
+
+    inline bool same_run(const Result &a, const Result &b) {
+        return a.kernel == b.kernel && a.device == b.device && a.dtype == b.dtype && a.dim == b.dim && a.D == b.D &&
+               a.L == b.L && a.batch == b.batch && a.threads == b.threads;
+    }
+}
+
+// the runs of a report, with the fields Result keeps
+inline std::vector<Result> read_json(const std::string &path) {
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("cannot read the baseline " + path);
+    std::vector<Result> runs;
+    for (std::string line; std::getline(in, line);) {
+        if (line.find("{\"kernel\"") == std::string::npos)
+            continue;
+        const auto f = [&](const char *key) { return detail::json_field(line, key); };
+        Result r{f("kernel"), f("device"), f("dtype"), std::stoi(f("dim")), std::stoi(f("D")), std::stoi(f("L")),
+                 std::stoi(f("batch")), std::stoi(f("threads")), 0, 0, {}};
+        r.t.p50 = std::stod(f("p50_us")) * 1e-6;
+        r.t.p99 = std::stod(f("p99_us")) * 1e-6;
+        r.t.mean = std::stod(f("mean_us")) * 1e-6;
+        runs.push_back(r);
+    }
+    return runs;
+}
+
+struct Regression {
+    Result run;
+    // p50 seconds of the same run in the baseline
+    double before;
+
+    double growth() const { return run.t.p50 / before - 1; }
+};
+
+// the runs slower than their baseline by more than threshold, 0.1 for 10%
+inline std::vector<Regression> regressions(const std::vector<Result> &runs, const std::vector<Result> &baseline,
+                                           double threshold) {
+    std::vector<Regression> out;
+    for (const Result &r : runs)
+        for (const Result &b : baseline)
+            if (detail::same_run(r, b)) {
+                if (r.t.p50 > b.t.p50 * (1 + threshold))
+                    out.push_back({r, b.t.p50});
+                break;
+            }
+    return out;
+}
+
+inline void write_regression(std::ostream &os, const Regression &g) {
+    const Result &r = g.run;
+    char line[256];
+    std::snprintf(line, sizeof(line), "regressed %-12s %-4s %-2s dim %3d D %4d L %4d batch %5d threads %3d  p50 %10.1fus from %10.1fus, %+.1f%%",
+                  r.kernel.c_str(), r.device.c_str(), r.dtype.c_str(), r.dim, r.D, r.L, r.batch, r.threads,
+                  r.t.p50 * 1e6, g.before * 1e6, 100 * g.growth());
+    os << line << "\n";
+}
+
+} // bench
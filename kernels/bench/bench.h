@@ -0,0 +1,252 @@
+/*
+timing, buffers and report output for the benchmark driver in main.cc
+
+every run records its latency distribution and an analytic count of the
+flops and the minimum bytes the kernel has to move, from which the rates
+and the fraction of the machine peaks passed on the command line follow
+*/
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../utils/half.h"
+
+#ifdef GROWNET_CUDA
+#include <cuda_runtime.h>
+#endif
+
+namespace bench {
+
+// bytes per element of a type code from type_repr::type_code
+inline size_t elem_size(const std::string &code) {
+    if (code == "f")
+        return 4;
+    if (code == "d")
+        return 8;
+    if (code == "h" || code == "bf")
+        return 2;
+    if (code == "q8")
+        return 1;
+    throw std::invalid_argument("no element size for type code " + code);
+}
+
+// bytes per element of what kernels over a type code accumulate in, the
+// statistics and gradients of the 16 bit types being float, as is all but
+// the cells of the int8 ones
+inline size_t accumulate_size(const std::string &code) {
+    return elem_size(code) <= 2 ? 4 : elem_size(code);
+}
+
+// the type code of that accumulate type
+inline std::string accumulate_code(const std::string &code) {
+    return elem_size(code) <= 2 ? "f" : code;
+}
+
+// zero initialized memory on the host or on the current cuda device
+class Buffer {
+public:
+    Buffer(size_t bytes, bool device) : bytes(bytes), device(device) {
+        if (device) {
+#ifdef GROWNET_CUDA
+            if (cudaMalloc(&ptr, bytes) != cudaSuccess)
+                throw std::runtime_error("cudaMalloc of " + std::to_string(bytes) + " bytes failed");
+            cudaMemset(ptr, 0, bytes);
+#else
+            throw std::runtime_error("built without cuda");
+#endif
+        } else {
+            ptr = ::operator new(bytes, std::align_val_t(64));
+            std::memset(ptr, 0, bytes);
+        }
+    }
+
+    ~Buffer() {
+#ifdef GROWNET_CUDA
+        if (device)
+            cudaFree(ptr);
+#endif
+        if (!device)
+            ::operator delete(ptr, std::align_val_t(64));
+    }
+
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+
+    // uniform in [-scale, scale), of the type named by code
+    void fill(const std::string &code, double scale, std::mt19937 &rng) {
+        std::vector<double> v(bytes / elem_size(code));
+        std::uniform_real_distribution<double> u(-scale, scale);
+        for (auto &e : v)
+            e = u(rng);
+        write(code, v);
+    }
+
+    // every element as the type named by code, rounded to it
+    void write(const std::string &code, const std::vector<double> &v) {
+        std::vector<char> host(bytes);
+        for (size_t i = 0; i < std::min(v.size(), bytes / elem_size(code)); ++i) {
+            if (code == "f")
+                reinterpret_cast<float *>(host.data())[i] = (float)v[i];
+            else if (code == "h")
+                reinterpret_cast<utils::half *>(host.data())[i] = utils::half::of((float)v[i]);
+            else if (code == "bf")
+                reinterpret_cast<utils::bfloat16 *>(host.data())[i] = utils::bfloat16::of((float)v[i]);
+            else
+                reinterpret_cast<double *>(host.data())[i] = v[i];
+        }
+        if (device) {
+#ifdef GROWNET_CUDA
+            cudaMemcpy(ptr, host.data(), bytes, cudaMemcpyHostToDevice);
+#endif
+        } else {
+            std::memcpy(ptr, host.data(), bytes);
+        }
+    }
+
+    // every element of the type named by code, widened, for the checks
+    std::vector<double> read(const std::string &code) const {
+        std::vector<char> host(bytes);
+        if (device) {
+#ifdef GROWNET_CUDA
+            cudaMemcpy(host.data(), ptr, bytes, cudaMemcpyDeviceToHost);
+#endif
+        } else {
+            std::memcpy(host.data(), ptr, bytes);
+        }
+        std::vector<double> v(bytes / elem_size(code));
+        for (size_t i = 0; i < v.size(); ++i) {
+            if (code == "f")
+                v[i] = reinterpret_cast<const float *>(host.data())[i];
+            else if (code == "h")
+                v[i] = (float)reinterpret_cast<const utils::half *>(host.data())[i];
+            else if (code == "bf")
+                v[i] = (float)reinterpret_cast<const utils::bfloat16 *>(host.data())[i];
+            else
+                v[i] = reinterpret_cast<const double *>(host.data())[i];
+        }
+        return v;
+    }
+
+    void *data() const { return ptr; }
+
+private:
+    void *ptr = nullptr;
+    size_t bytes;
+    bool device;
+};
+
+inline void sync(bool device) {
+#ifdef GROWNET_CUDA
+    if (device)
+        cudaDeviceSynchronize();
+#endif
+}
+
+struct Stats {
+    // seconds
+    double p50, p99, mean, min;
+};
+
+inline double percentile(const std::vector<double> &sorted, double p) {
+    const size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+// wall time of each of reps calls of f after warmup untimed ones, device
+// runs are synchronized per call so every sample covers one whole kernel
+template <typename F>
+Stats measure(F &&f, bool device, int warmup, int reps) {
+    using clock = std::chrono::steady_clock;
+    for (int i = 0; i < warmup; ++i)
+        f();
+    sync(device);
+    std::vector<double> t(reps);
+    for (int i = 0; i < reps; ++i) {
+        const auto start = clock::now();
+        f();
+        sync(device);
+        t[i] = std::chrono::duration<double>(clock::now() - start).count();
+    }
+    std::sort(t.begin(), t.end());
+    double sum = 0;
+    for (double v : t)
+        sum += v;
+    return Stats{percentile(t, 0.5), percentile(t, 0.99), sum / reps, t.front()};
+}
+
+struct Result {
+    std::string kernel;
+    std::string device;
+    std::string dtype;
+    int dim, D, L, batch, threads;
+    double flops;
+    double bytes;
+    Stats t;
+    // p50 seconds of the Reference of reference.h on the same problem, 0 if
+    // it was not timed
+    double reference = 0;
+};
+
+// machine peaks for the fraction of peak columns, 0 leaves them out
+struct Peaks {
+    double gflops = 0;
+    double gbps = 0;
+};
+
+inline double gflops(const Result &r) { return r.flops / r.t.p50 * 1e-9; }
+inline double gbps(const Result &r) { return r.bytes / r.t.p50 * 1e-9; }
+// times faster than the reference
+inline double speedup(const Result &r) { return r.reference / r.t.p50; }
+
+inline void write_json(std::ostream &os, const std::vector<Result> &results, const Peaks &peaks) {
+    os << "{\n  \"peak_gflops\": " << peaks.gflops << ",\n  \"peak_gbps\": " << peaks.gbps << ",\n  \"runs\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        os << (i ? ",\n" : "\n") << "    {\"kernel\": \"" << r.kernel << "\", \"device\": \"" << r.device
+           << "\", \"dtype\": \"" << r.dtype << "\", \"dim\": " << r.dim << ", \"D\": " << r.D
+           << ", \"L\": " << r.L << ", \"batch\": " << r.batch << ", \"threads\": " << r.threads
+           << ", \"p50_us\": " << r.t.p50 * 1e6 << ", \"p99_us\": " << r.t.p99 * 1e6
+           << ", \"mean_us\": " << r.t.mean * 1e6 << ", \"gflops\": " << gflops(r) << ", \"gbps\": " << gbps(r);
+        if (peaks.gflops > 0)
+            os << ", \"flops_fraction\": " << gflops(r) / peaks.gflops;
+        if (peaks.gbps > 0)
+            os << ", \"bytes_fraction\": " << gbps(r) / peaks.gbps;
+        if (r.reference > 0)
+            os << ", \"reference_us\": " << r.reference * 1e6 << ", \"speedup\": " << speedup(r);
+        os << "}";
+    }
+    os << "\n  ]\n}\n";
+}
+
+// one line per run, for reading at the terminal
+inline void write_table(std::ostream &os, const Result &r, const Peaks &peaks) {
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-12s %-4s %-2s dim %3d D %4d L %4d batch %5d  p50 %10.1fus  p99 %10.1fus  %8.2f GFLOP/s  %8.2f GB/s",
+                  r.kernel.c_str(), r.device.c_str(), r.dtype.c_str(), r.dim, r.D, r.L, r.batch,
+                  r.t.p50 * 1e6, r.t.p99 * 1e6, gflops(r), gbps(r));
+    os << line;
+    if (peaks.gflops > 0) {
+        std::snprintf(line, sizeof(line), "  %5.1f%% of peak flops", 100 * gflops(r) / peaks.gflops);
+        os << line;
+    }
+    if (peaks.gbps > 0) {
+        std::snprintf(line, sizeof(line), "  %5.1f%% of peak bytes", 100 * gbps(r) / peaks.gbps);
+        os << line;
+    }
+    if (r.reference > 0) {
+        std::snprintf(line, sizeof(line), "  %7.1fx the reference", speedup(r));
+        os << line;
+    }
+    os << "\n";
+}
+
+} // bench
@@ -0,0 +1,832 @@
+/*
+correctness checks of the kernels computing the grid of simple_grid.jl, run
+by main before anything is timed, each kernel is called at the (device,
+dtype, dim) of a registered signature on a grid small enough that the
+reference of reference.h and its finite differences cost nothing
+
+forward kernels are compared with the reference output, every element of
+it, backward kernels with central differences of the loss sum(grad * y) of
+the reference at a sample of the coordinates of dx, dw and db, or of the
+kernel's own forward in double for the grids the reference does not
+compute, such as a pruned sparse one, all of it on the inputs the kernel
+saw, rounded to its dtype, with the tolerances of ops::grad_check for
+double and looser ones for the rounding of the others
+*/
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <numeric>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "grid_bench.h"
+#include "reference.h"
+
+namespace bench {
+
+struct Check {
+    std::string kernel;
+    std::string device;
+    std::string dtype;
+    int dim;
+    // the largest |kernel - reference| of everything compared
+    double error = 0;
+    bool ok = true;
+    // the first element out of tolerance, empty while ok
+    std::string mismatch;
+};
+
+// a few samples through a few columns, the two checkpoint segments of the
+// checkpointed grid and a column long enough for cells without edge padding
+constexpr Problem check_problem{5, 3, 3};
+
+// double is rounded as the reference is, float and the 16 bit types once
+// per column, their y being stored in the dtype between columns, the int8
+// cells are off by about 0.5% of their largest output, which the
+// normalization of every column scales up to about 0.08 on outputs of unit
+// variance over the columns of check_problem, a wrong weight or offset is
+// off by the output itself
+inline Tolerance output_tolerance(const std::string &code) {
+    if (code == "d")
+        return {1e-9, 1e-9};
+    if (code == "f")
+        return {1e-4, 1e-4};
+    if (code == "q8")
+        return {1.5e-1, 5e-2};
+    return {5e-2, 5e-2};
+}
+
+inline Tolerance grad_tolerance(const std::string &code) {
+    if (code == "d")
+        return {};
+    if (code == "f")
+        return {1e-3, 1e-2};
+    return {1e-1, 1e-1};
+}
+
+// the dim the runtime dim kernels are checked at, one without a
+// specialization and not a multiple of any simd width
+constexpr int check_any_dim = 12;
+
+namespace detail {
+    inline int check_dim(const Spec &sp) {
+        return sp.any_dim ? check_any_dim : sp.dim;
+    }
+
+    inline grid::Shape check_shape(const Spec &sp) {
+        return grid::Shape{check_dim(sp), check_problem.D, check_problem.L, check_problem.batch};
+    }
+
+    inline Check check(const char *kernel, const Spec &sp) {
+        return Check{name(kernel, sp), sp.device, sp.dtype, check_dim(sp), 0, true, {}};
+    }
+
+    inline void compare(Check &c, const char *what, size_t i, double got, double expect, const Tolerance &tol) {
+        c.error = std::max(c.error, std::fabs(got - expect));
+        if (c.ok && !tol.close(got, expect)) {
+            char line[128];
+            std::snprintf(line, sizeof(line), "%s[%zu] is %.6g, expected %.6g", what, i, got, expect);
+            c.ok = false;
+            c.mismatch = line;
+        }
+    }
+
+    // every element of the last column of y against the reference
+    inline void compare_output(Check &c, const grid::Shape &sh, const std::vector<double> &w,
+                               const std::vector<double> &b, const std::vector<double> &x,
+                               const std::vector<double> &y) {
+        std::vector<double> expect(sh.column_size());
+        Reference(sh).forward(w.data(), b.data(), x.data(), expect.data());
+        const Tolerance tol = output_tolerance(c.dtype);
+        for (size_t i = 0; i < expect.size(); ++i)
+            compare(c, "y", i, y[y.size() - expect.size() + i], expect[i], tol);
+    }
+
+    inline void compare_output(Check &c, const grid::Shape &sh, const Buffer &w, const Buffer &b, const Buffer &x,
+                               const std::vector<double> &y) {
+        // the int8 cells against the float w they were quantized from, and
+        // the float b and x the kernel read
+        const std::string code = c.dtype == "q8" ? "f" : c.dtype;
+        compare_output(c, sh, w.read(code), b.read(code), x.read(code), y);
+    }
+
+    // n coordinates of a tensor of size elements, each once, all of them
+    // when there are no more than n
+    inline std::vector<size_t> sample(size_t size, int n, std::mt19937 &rng) {
+        std::vector<size_t> all(size);
+        std::iota(all.begin(), all.end(), 0);
+        if (size <= (size_t)n)
+            return all;
+        std::shuffle(all.begin(), all.end(), rng);
+        all.resize(n);
+        return all;
+    }
+
+    // sum(grad * y) over the last column_size elements of y, its output
+    inline double output_loss(const std::vector<double> &grad, const std::vector<double> &y) {
+        double l = 0;
+        for (size_t i = 0; i < grad.size(); ++i)
+            l += grad[i] * y[y.size() - grad.size() + i];
+        return l;
+    }
+
+    // an input the loss reads, moved by the differences, and the kernel's
+    // gradient of it
+    struct Param {
+        const char *name;
+        std::vector<double> &p;
+        const std::vector<double> &d;
+    };
+
+    inline void compare_differences(Check &c, std::initializer_list<Param> params, const std::function<double()> &loss,
+                                    int samples, std::mt19937 &rng) {
+        const Tolerance tol = grad_tolerance(c.dtype);
+        for (const Param &q : params)
+            for (size_t i : sample(q.p.size(), samples, rng))
+                compare(c, q.name, i, q.d[i], central_difference(q.p.data(), i, loss), tol);
+    }
+
+    struct Grads {
+        std::vector<double> dx, dw, db;
+    };
+
+    inline void compare_grads(Check &c, const grid::Shape &sh, const Buffer &w, const Buffer &b, const Buffer &x,
+                              const Buffer &grad, const Grads &g, int samples, std::mt19937 &rng) {
+        std::vector<double> wv = w.read(c.dtype), bv = b.read(c.dtype), xv = x.read(c.dtype);
+        const std::vector<double> gv = grad.read(c.dtype);
+        Reference ref(sh);
+        std::vector<double> y(sh.column_size());
+        const auto loss = [&] {
+            ref.forward(wv.data(), bv.data(), xv.data(), y.data());
+            return output_loss(gv, y);
+        };
+        compare_differences(c, {{"dx", xv, g.dx}, {"dw", wv, g.dw}, {"db", bv, g.db}}, loss, samples, rng);
+    }
+
+    // the double kernels of sp's device and dim, the gradients of the
+    // kernels the reference has no grid for are differenced through their
+    // own forward in double, on the inputs the kernel saw
+    inline Spec double_spec(const Spec &sp) {
+        for (const auto &sig : grid::signatures()) {
+            const Spec d = Spec::of(sig);
+            if (d.device == sp.device && d.dtype == "d" && d.dim == sp.dim)
+                return d;
+        }
+        throw std::runtime_error("no double kernels on " + sp.device + " at dim " + std::to_string(sp.dim));
+    }
+}
+
+inline Check check_forward(const Spec &sp, const Options &opt, int) {
+    const grid::Shape sh = detail::check_shape(sp);
+    std::mt19937 rng(opt.seed);
+    detail::ForwardState st(sp, sh, rng);
+    utils::Arena arena(detail::ForwardState::scratch_bytes(sp, sh));
+    grid::ForwardArgs a = st.args(sh, opt);
+    a.arena = &arena;
+    grid::forward_table().find(sp.key)(a);
+    sync(sp.on_device());
+
+    Check c = detail::check("forward", sp);
+    detail::compare_output(c, sh, st.w, st.b, st.x, st.y.read(sp.dtype));
+    return c;
+}
+
+inline Check check_backward(const Spec &sp, const Options &opt, int samples) {
+    const grid::Shape sh = detail::check_shape(sp);
+    const size_t es = elem_size(sp.dtype), as = accumulate_size(sp.dtype);
+    const bool dev = sp.on_device();
+    std::mt19937 rng(opt.seed);
+    detail::ForwardState st(sp, sh, rng);
+    utils::Arena arena(detail::ForwardState::scratch_bytes(sp, sh));
+    grid::ForwardArgs fa = st.args(sh, opt);
+    fa.arena = &arena;
+    grid::forward_table().find(sp.key)(fa);
+
+    Buffer grad(es * sh.column_size(), dev), dx(es * sh.column_size(), dev);
+    Buffer dw(as * sh.L * sh.D * sh.dim * sh.dim, dev), db(as * sh.L * sh.D * sh.dim, dev);
+    Buffer dz(es * sh.padded_column_size(), dev);
+    grad.fill(sp.dtype, 1, rng);
+    grid::BackwardArgs a{st.w.data(), st.x.data(), st.h.data(), st.y.data(), st.sd.data(), grad.data(),
+                         dx.data(), dw.data(), db.data(), dz.data(), sh};
+    a.pool = opt.pool;
+    a.arena = &arena;
+    grid::backward_table().find(sp.key)(a);
+    sync(dev);
+
+    Check c = detail::check("backward", sp);
+    const std::string ac = accumulate_code(sp.dtype);
+    detail::compare_grads(c, sh, st.w, st.b, st.x, grad, {dx.read(sp.dtype), dw.read(ac), db.read(ac)}, samples,
+                          rng);
+    return c;
+}
+
+inline Check check_checkpoint_forward(const Spec &sp, const Options &opt, int) {
+    const grid::Shape sh = detail::check_shape(sp);
+    std::mt19937 rng(opt.seed);
+    detail::CheckpointState st(sp, sh, rng);
+    grid::checkpoint_forward_table().find(sp.key)(st.args(sh, opt));
+    sync(sp.on_device());
+
+    Check c = detail::check("ckpt_fwd", sp);
+    detail::compare_output(c, sh, st.w, st.b, st.x, st.out.read(sp.dtype));
+    return c;
+}
+
+inline Check check_checkpoint_backward(const Spec &sp, const Options &opt, int samples) {
+    const grid::Shape sh = detail::check_shape(sp);
+    const size_t es = elem_size(sp.dtype);
+    const bool dev = sp.on_device();
+    std::mt19937 rng(opt.seed);
+    detail::CheckpointState st(sp, sh, rng);
+    grid::checkpoint_forward_table().find(sp.key)(st.args(sh, opt));
+
+    Buffer grad(es * sh.column_size(), dev), dx(es * sh.column_size(), dev);
+    Buffer dw(es * sh.L * sh.D * sh.dim * sh.dim, dev), db(es * sh.L * sh.D * sh.dim, dev);
+    grad.fill(sp.dtype, 1, rng);
+    grid::CheckpointBackwardArgs a{st.w.data(), st.b.data(), st.x.data(), st.ckpt.data(), grad.data(),
+                                   dx.data(), dw.data(), db.data(), sh, st.stride};
+    a.pool = opt.pool;
+    a.arena = &st.arena;
+    grid::checkpoint_backward_table().find(sp.key)(a);
+    sync(dev);
+
+    Check c = detail::check("ckpt_bwd", sp);
+    detail::compare_grads(c, sh, st.w, st.b, st.x, grad,
+                          {dx.read(sp.dtype), dw.read(sp.dtype), db.read(sp.dtype)}, samples, rng);
+    return c;
+}
+
+// the full stencil is the dense grid, so the sparse forward is compared
+// with the reference
+inline Check check_sparse_forward(const Spec &sp, const Options &opt, int) {
+    const grid::Shape sh = detail::check_shape(sp);
+    std::mt19937 rng(opt.seed);
+    const grid::Graph graph = grid::Graph::stencil(sh, nullptr);
+    detail::ForwardState st(sp, sh, rng);
+    grid::SparseForwardArgs a{st.w.data(), st.b.data(), st.x.data(), st.h.data(), st.y.data(), st.sd.data(),
+                              graph.view(), sh};
+    a.pool = opt.pool;
+    grid::sparse_forward_table().find(sp.key)(a);
+
+    Check c = detail::check("sparse_fwd", sp);
+    detail::compare_output(c, sh, st.w, st.b, st.x, st.y.read(sp.dtype));
+    return c;
+}
+
+// on the full stencil and on one with a --prune fraction of its edges
+// pruned, as run_sparse prunes it, differenced through the double sparse
+// forward over the same graph
+inline Check check_sparse_backward(const Spec &sp, const Options &opt, int samples) {
+    const grid::Shape sh = detail::check_shape(sp);
+    const size_t es = elem_size(sp.dtype);
+    const Spec ds = detail::double_spec(sp);
+    Check c = detail::check("sparse_bwd", sp);
+    for (double prune : {0.0, opt.prune}) {
+        std::mt19937 rng(opt.seed);
+        std::bernoulli_distribution kept(1 - prune);
+        std::vector<uint8_t> keep((size_t)sh.L * sh.D * 3);
+        for (auto &k : keep)
+            k = kept(rng);
+        const grid::Graph graph = grid::Graph::stencil(sh, keep.data());
+
+        detail::ForwardState st(sp, sh, rng);
+        grid::SparseForwardArgs fa{st.w.data(), st.b.data(), st.x.data(), st.h.data(), st.y.data(),
+                                   st.sd.data(), graph.view(), sh};
+        fa.pool = opt.pool;
+        grid::sparse_forward_table().find(sp.key)(fa);
+
+        Buffer grad(es * sh.column_size(), false), dx(es * sh.column_size(), false);
+        Buffer dw(es * sh.L * sh.D * sh.dim * sh.dim, false), db(es * sh.L * sh.D * sh.dim, false);
+        Buffer dz(es * sh.column_size(), false);
+        grad.fill(sp.dtype, 1, rng);
+        grid::SparseBackwardArgs a{st.w.data(), st.x.data(), st.h.data(), st.y.data(), st.sd.data(), grad.data(),
+                                   dx.data(), dw.data(), db.data(), dz.data(), graph.view(), sh};
+        a.pool = opt.pool;
+        grid::sparse_backward_table().find(sp.key)(a);
+
+        std::vector<double> wv = st.w.read(sp.dtype), bv = st.b.read(sp.dtype), xv = st.x.read(sp.dtype);
+        const std::vector<double> gv = grad.read(sp.dtype);
+        detail::ForwardState d(ds, sh, rng);
+        grid::SparseForwardArgs da{d.w.data(), d.b.data(), d.x.data(), d.h.data(), d.y.data(), d.sd.data(),
+                                   graph.view(), sh};
+        const auto fwd = grid::sparse_forward_table().find(ds.key);
+        const auto loss = [&] {
+            d.w.write("d", wv);
+            d.b.write("d", bv);
+            d.x.write("d", xv);
+            fwd(da);
+            return detail::output_loss(gv, d.y.read("d"));
+        };
+        const std::vector<double> gx = dx.read(sp.dtype), gw = dw.read(sp.dtype), gb = db.read(sp.dtype);
+        detail::compare_differences(c, {{"dx", xv, gx}, {"dw", wv, gw}, {"db", bv, gb}}, loss, samples, rng);
+    }
+    return c;
+}
+
+namespace detail {
+    // the couplings of grid/reversible.h over single column reference grids
+    // of half width, as F and G
+    inline std::vector<double> reversible_reference(const grid::Shape &sh, const std::vector<double> &w,
+                                                    const std::vector<double> &b, const std::vector<double> &x) {
+        const int half = sh.dim / 2;
+        const grid::Shape hs{half, sh.D, 1, sh.batch};
+        const size_t n = hs.column_size();
+        Reference ref(hs);
+        std::vector<double> y = x, t(n);
+        double *y1 = y.data(), *y2 = y1 + n;
+        for (int l = 0; l < sh.L; ++l) {
+            for (int k = 0; k < 2; ++k) {
+                const size_t layer = (size_t)(2 * l + k) * sh.D;
+                ref.forward(w.data() + layer * half * half, b.data() + layer * half, k == 0 ? y2 : y1, t.data());
+                double *out = k == 0 ? y1 : y2;
+                for (size_t i = 0; i < n; ++i)
+                    out[i] += t[i];
+            }
+        }
+        return y;
+    }
+}
+
+inline Check check_reversible_forward(const Spec &sp, const Options &opt, int) {
+    const grid::Shape sh = detail::check_shape(sp);
+    std::mt19937 rng(opt.seed);
+    detail::ReversibleState st(sp, sh, rng);
+    grid::reversible_forward_table().find(sp.key)(st.args(sh, opt));
+    sync(sp.on_device());
+
+    Check c = detail::check("rev_fwd", sp);
+    const std::vector<double> y = st.y.read(sp.dtype);
+    const std::vector<double> expect =
+        detail::reversible_reference(sh, st.w.read(sp.dtype), st.b.read(sp.dtype), st.x.read(sp.dtype));
+    const Tolerance tol = output_tolerance(sp.dtype);
+    for (size_t i = 0; i < expect.size(); ++i)
+        detail::compare(c, "y", i, y[i], expect[i], tol);
+    return c;
+}
+
+// differenced through the double reversible forward, which rebuilds nothing,
+// so the drift of the rebuilt inputs shows up as an error in the gradients
+inline Check check_reversible_backward(const Spec &sp, const Options &opt, int samples) {
+    const grid::Shape sh = detail::check_shape(sp);
+    const size_t es = elem_size(sp.dtype);
+    const bool dev = sp.on_device();
+    std::mt19937 rng(opt.seed);
+    detail::ReversibleState st(sp, sh, rng);
+    grid::reversible_forward_table().find(sp.key)(st.args(sh, opt));
+
+    const size_t nw = (size_t)sh.L * 2 * sh.D * (sh.dim / 2);
+    Buffer grad(es * sh.column_size(), dev), dx(es * sh.column_size(), dev);
+    Buffer dw(es * nw * (sh.dim / 2), dev), db(es * nw, dev);
+    grad.fill(sp.dtype, 1, rng);
+    grid::ReversibleBackwardArgs a{st.w.data(), st.b.data(), st.y.data(), grad.data(), dx.data(),
+                                   dw.data(), db.data(), sh};
+    a.pool = opt.pool;
+    a.arena = &st.arena;
+    grid::reversible_backward_table().find(sp.key)(a);
+    sync(dev);
+
+    std::vector<double> wv = st.w.read(sp.dtype), bv = st.b.read(sp.dtype), xv = st.x.read(sp.dtype);
+    const std::vector<double> gv = grad.read(sp.dtype);
+    const Spec ds = detail::double_spec(sp);
+    detail::ReversibleState d(ds, sh, rng);
+    const grid::ReversibleForwardArgs da = d.args(sh, opt);
+    const auto fwd = grid::reversible_forward_table().find(ds.key);
+    const auto loss = [&] {
+        d.w.write("d", wv);
+        d.b.write("d", bv);
+        d.x.write("d", xv);
+        fwd(da);
+        return detail::output_loss(gv, d.y.read("d"));
+    };
+    Check c = detail::check("rev_bwd", sp);
+    const std::vector<double> gx = dx.read(sp.dtype), gw = dw.read(sp.dtype), gb = db.read(sp.dtype);
+    detail::compare_differences(c, {{"dx", xv, gx}, {"dw", wv, gw}, {"db", bv, gb}}, loss, samples, rng);
+    return c;
+}
+
+namespace detail {
+    // the cells run_gated gates off, a --prune fraction of them, with a cell
+    // of every column left open, a column shut whole leaving the output of
+    // the small check grids constant
+    inline std::vector<uint8_t> gated_off(const grid::Shape &sh, const Options &opt, std::mt19937 &rng) {
+        std::bernoulli_distribution gated(opt.prune);
+        std::uniform_int_distribution<int> cell(0, sh.D - 1);
+        std::vector<uint8_t> off((size_t)sh.L * sh.D);
+        for (int l = 0; l < sh.L; ++l) {
+            uint8_t *o = &off[(size_t)l * sh.D];
+            for (int j = 0; j < sh.D; ++j)
+                o[j] = gated(rng);
+            if (std::all_of(o, o + sh.D, [](uint8_t v) { return v != 0; }))
+                o[cell(rng)] = 0;
+        }
+        return off;
+    }
+
+    // gates, as set_gates sets them, for the dtype of sp
+    inline void set_gates(const Spec &sp, Buffer &gate, const grid::Shape &sh, const std::vector<uint8_t> &off) {
+        if (sp.dtype == "f")
+            set_gates<float>(gate.data(), sh, off);
+        else
+            set_gates<double>(gate.data(), sh, off);
+    }
+}
+
+// gates either shut, their cutoff far above any magnitude, or fully open,
+// the sigmoid rounding to exactly 1, so the gated grid is the reference's
+// with the w and b of the shut cells zeroed, their h being 0 either way
+inline Check check_gated_forward(const Spec &sp, const Options &opt, int) {
+    const grid::Shape sh = detail::check_shape(sp);
+    const size_t es = elem_size(sp.dtype);
+    std::mt19937 rng(opt.seed);
+    const std::vector<uint8_t> off = detail::gated_off(sh, opt, rng);
+    detail::ForwardState st(sp, sh, rng);
+    Buffer gate(es * 2 * off.size(), false), mag(es * sh.L * sh.D * sh.batch, false);
+    std::vector<double> gv(2 * off.size());
+    for (size_t i = 0; i < off.size(); ++i) {
+        gv[2 * i] = off[i] ? 1e3 : -1e3;
+        gv[2 * i + 1] = -1;
+    }
+    gate.write(sp.dtype, gv);
+    utils::Arena arena(grid::gated_scratch_bytes(sh, es));
+    grid::GatedForwardArgs a{st.args(sh, opt), gate.data(), mag.data(), 0.0};
+    a.grid.arena = &arena;
+    grid::gated_forward_table().find(sp.key)(a);
+
+    std::vector<double> wv = st.w.read(sp.dtype), bv = st.b.read(sp.dtype);
+    const size_t cw = (size_t)sh.dim * sh.dim;
+    for (size_t i = 0; i < off.size(); ++i) {
+        if (!off[i])
+            continue;
+        std::fill_n(wv.begin() + i * cw, cw, 0.0);
+        std::fill_n(bv.begin() + i * sh.dim, sh.dim, 0.0);
+    }
+    Check c = detail::check("gated_fwd", sp);
+    detail::compare_output(c, sh, wv, bv, st.x.read(sp.dtype), st.y.read(sp.dtype));
+    return c;
+}
+
+// with the gates of run_gated, differenced through the double gated forward,
+// dgate included, no magnitude being within a difference of its cutoff
+inline Check check_gated_backward(const Spec &sp, const Options &opt, int samples) {
+    const grid::Shape sh = detail::check_shape(sp);
+    const size_t es = elem_size(sp.dtype);
+    std::mt19937 rng(opt.seed);
+    const std::vector<uint8_t> off = detail::gated_off(sh, opt, rng);
+    detail::ForwardState st(sp, sh, rng);
+    Buffer gate(es * 2 * off.size(), false), mag(es * sh.L * sh.D * sh.batch, false);
+    detail::set_gates(sp, gate, sh, off);
+    utils::Arena arena(grid::gated_scratch_bytes(sh, es));
+    grid::GatedForwardArgs fa{st.args(sh, opt), gate.data(), mag.data(), 0.0};
+    fa.grid.arena = &arena;
+    grid::gated_forward_table().find(sp.key)(fa);
+
+    Buffer grad(es * sh.column_size(), false), dx(es * sh.column_size(), false);
+    Buffer dw(es * sh.L * sh.D * sh.dim * sh.dim, false), db(es * sh.L * sh.D * sh.dim, false);
+    Buffer dgate(es * 2 * off.size(), false);
+    grad.fill(sp.dtype, 1, rng);
+    grid::GatedBackwardArgs a{{st.w.data(), st.x.data(), st.h.data(), st.y.data(), st.sd.data(), grad.data(),
+                               dx.data(), dw.data(), db.data(), nullptr, sh},
+                              gate.data(), mag.data(), dgate.data(), 0.0};
+    a.grid.pool = opt.pool;
+    a.grid.arena = &arena;
+    grid::gated_backward_table().find(sp.key)(a);
+
+    std::vector<double> wv = st.w.read(sp.dtype), bv = st.b.read(sp.dtype), xv = st.x.read(sp.dtype);
+    std::vector<double> sv = gate.read(sp.dtype);
+    const std::vector<double> gv = grad.read(sp.dtype);
+    const Spec ds = detail::double_spec(sp);
+    detail::ForwardState d(ds, sh, rng);
+    const size_t des = elem_size(ds.dtype);
+    Buffer dgv(des * 2 * off.size(), false), dmag(des * sh.L * sh.D * sh.batch, false);
+    utils::Arena darena(grid::gated_scratch_bytes(sh, des));
+    grid::GatedForwardArgs da{d.args(sh, opt), dgv.data(), dmag.data(), 0.0};
+    da.grid.arena = &darena;
+    const auto fwd = grid::gated_forward_table().find(ds.key);
+    const auto loss = [&] {
+        d.w.write("d", wv);
+        d.b.write("d", bv);
+        d.x.write("d", xv);
+        dgv.write("d", sv);
+        fwd(da);
+        return detail::output_loss(gv, d.y.read("d"));
+    };
+    Check c = detail::check("gated_bwd", sp);
+    const std::vector<double> gx = dx.read(sp.dtype), gw = dw.read(sp.dtype), gb = db.read(sp.dtype);
+    const std::vector<double> gg = dgate.read(sp.dtype);
+    detail::compare_differences(c, {{"dx", xv, gx}, {"dw", wv, gw}, {"db", bv, gb}, {"dgate", sv, gg}}, loss,
+                                samples, rng);
+    return c;
+}
+
+namespace detail {
+    // a group and a part of another, so the zeroed lanes past the last cell
+    // are run too, unpacked and compared with the loop of BatchedGemm's doc
+    template <typename T>
+    void check_gemm(Check &c, const Spec &sp, std::mt19937 &rng) {
+        const int dim = sp.dim, cells = grid::cell_lanes<T> + 3, batch = check_problem.batch;
+        const size_t nx = (size_t)batch * dim, nw = (size_t)dim * dim;
+        std::uniform_real_distribution<double> u(-1, 1);
+        std::vector<T> x(cells * nx), w(cells * nw), b(cells * dim), y(cells * nx);
+        for (auto &e : x)
+            e = T(u(rng));
+        for (auto &e : w)
+            e = T(u(rng) / std::sqrt((double)dim));
+        for (auto &e : b)
+            e = T(0.1 * u(rng));
+
+        std::vector<T> px(grid::packed_size<T>(cells, nx)), pw(grid::packed_size<T>(cells, nw));
+        std::vector<T> pb(grid::packed_size<T>(cells, dim)), py(px.size());
+        grid::pack_cells(x.data(), px.data(), cells, nx);
+        grid::pack_cells(w.data(), pw.data(), cells, nw);
+        grid::pack_cells(b.data(), pb.data(), cells, dim);
+        grid::gemm_table().find(sp.key)(grid::GemmArgs{px.data(), pw.data(), pb.data(), py.data(), cells, batch});
+        grid::unpack_cells(py.data(), y.data(), cells, nx);
+
+        const Tolerance tol = output_tolerance(sp.dtype);
+        for (int k = 0; k < cells; ++k) {
+            for (int s = 0; s < batch; ++s) {
+                for (int o = 0; o < dim; ++o) {
+                    double acc = b[(size_t)k * dim + o];
+                    for (int i = 0; i < dim; ++i)
+                        acc += (double)x[k * nx + (size_t)s * dim + i] * w[k * nw + (size_t)i * dim + o];
+                    const size_t e = k * nx + (size_t)s * dim + o;
+                    compare(c, "y", e, y[e], acc, tol);
+                }
+            }
+        }
+    }
+}
+
+inline Check check_gemm(const Spec &sp, const Options &opt, int) {
+    std::mt19937 rng(opt.seed);
+    Check c = detail::check("gemm", sp);
+    if (sp.dtype == "f")
+        detail::check_gemm<float>(c, sp, rng);
+    else
+        detail::check_gemm<double>(c, sp, rng);
+    return c;
+}
+
+// a few steps against the bias corrected update of the adam paper, with m
+// and v divided by 1 - beta^t rather than folded into the step size, over
+// two of the chunks the pool is handed and a tail short of a vector
+inline Check check_adam(const Spec &sp, const Options &opt, int) {
+    const size_t n = 2 * optim::Adam<double>::chunk + 5;
+    const size_t es = elem_size(sp.dtype);
+    const bool dev = sp.on_device();
+    std::mt19937 rng(opt.seed);
+    Buffer param(es * n, dev), grad(es * n, dev), m(es * n, dev), v(es * n, dev);
+    param.fill(sp.dtype, 1, rng);
+    std::vector<double> p = param.read(sp.dtype), mv(n), vv(n);
+
+    optim::AdamArgs a{param.data(), grad.data(), m.data(), v.data(), n, 1e-2, 0.9, 0.999, 1e-8, 1};
+    a.pool = opt.pool;
+    const auto fn = optim::adam_table().find(sp.key);
+    Check c = detail::check("adam", sp);
+    const Tolerance tol = output_tolerance(sp.dtype);
+    for (; a.step <= 3; ++a.step) {
+        grad.fill(sp.dtype, 1, rng);
+        const std::vector<double> g = grad.read(sp.dtype);
+        fn(a);
+        sync(dev);
+
+        const double c1 = 1 - std::pow(a.beta1, (double)a.step), c2 = 1 - std::pow(a.beta2, (double)a.step);
+        for (size_t i = 0; i < n; ++i) {
+            mv[i] = a.beta1 * mv[i] + (1 - a.beta1) * g[i];
+            vv[i] = a.beta2 * vv[i] + (1 - a.beta2) * g[i] * g[i];
+            p[i] -= a.lr * (mv[i] / c1) / (std::sqrt(vv[i] / c2) + a.eps);
+        }
+        const std::vector<double> got = param.read(sp.dtype), cleared = grad.read(sp.dtype);
+        for (size_t i = 0; i < n; ++i) {
+            detail::compare(c, "param", i, got[i], p[i], tol);
+            detail::compare(c, "grad", i, cleared[i], 0, tol);
+        }
+    }
+    return c;
+}
+
+inline Check check_infer(const Spec &sp, const Options &opt, int) {
+    const grid::Shape sh = detail::check_shape(sp);
+    std::mt19937 rng(opt.seed);
+    detail::InferState st(sp, sh, opt, rng);
+    grid::infer_table().find(sp.key)(st.args(sp, sh, opt));
+
+    Check c = detail::check(detail::InferState::quantized(sp) ? "infer_q8" : "infer", sp);
+    detail::compare_output(c, sh, st.w, st.b, st.x, st.y.read(accumulate_code(sp.dtype)));
+    return c;
+}
+
+// the 3d grid at radius 1 on plates of a single column and of a single row,
+// where the stencil is left the cells at offsets of the dense grid along
+// the other axis, and the grid is that of the reference with its column
+// along that axis, w, b, x and y being laid out the same
+inline std::vector<grid::Shape3D> check_plates(const Spec &sp) {
+    const grid::Shape sh = detail::check_shape(sp);
+    return {grid::Shape3D{sh.dim, sh.D, 1, sh.L, sh.batch, 1}, grid::Shape3D{sh.dim, 1, sh.D, sh.L, sh.batch, 1}};
+}
+
+inline Check check_forward3d(const Spec &sp, const Options &opt, int) {
+    Check c = detail::check("3d_fwd", sp);
+    for (const grid::Shape3D &sh : check_plates(sp)) {
+        std::mt19937 rng(opt.seed);
+        detail::Forward3DState st(sp, sh, rng);
+        grid::forward3d_table().find(sp.key)(st.args(sh, opt));
+        detail::compare_output(c, detail::check_shape(sp), st.w, st.b, st.x, st.y.read(sp.dtype));
+    }
+    return c;
+}
+
+inline Check check_backward3d(const Spec &sp, const Options &opt, int samples) {
+    const size_t es = elem_size(sp.dtype);
+    Check c = detail::check("3d_bwd", sp);
+    for (const grid::Shape3D &sh : check_plates(sp)) {
+        std::mt19937 rng(opt.seed);
+        detail::Forward3DState st(sp, sh, rng);
+        grid::forward3d_table().find(sp.key)(st.args(sh, opt));
+
+        Buffer grad(es * sh.layer_size(), false), dx(es * sh.layer_size(), false);
+        Buffer dw(es * sh.L * sh.cells() * sh.dim * sh.dim, false), db(es * sh.L * sh.cells() * sh.dim, false);
+        Buffer dz(es * sh.padded_layer_size(), false);
+        grad.fill(sp.dtype, 1, rng);
+        grid::Backward3DArgs a{st.w.data(), st.x.data(), st.h.data(), st.y.data(), st.sd.data(), grad.data(),
+                               dx.data(), dw.data(), db.data(), dz.data(), sh};
+        a.pool = opt.pool;
+        grid::backward3d_table().find(sp.key)(a);
+        detail::compare_grads(c, detail::check_shape(sp), st.w, st.b, st.x, grad,
+                              {dx.read(sp.dtype), dw.read(sp.dtype), db.read(sp.dtype)}, samples, rng);
+    }
+    return c;
+}
+
+namespace detail {
+    // cells [j0, j0 + n) of each of the rows of a [rows, D, elems] tensor
+    inline std::vector<double> slab_rows(const std::vector<double> &v, int rows, int D, int j0, int n,
+                                         size_t elems) {
+        std::vector<double> out;
+        for (int r = 0; r < rows; ++r) {
+            const auto first = v.begin() + ((size_t)r * D + j0) * elems;
+            out.insert(out.end(), first, first + n * elems);
+        }
+        return out;
+    }
+
+    // the check grid split along D into slabs of 2 and D - 2 cells, both on
+    // the current device, which the partitioned kernels run as two peers, w,
+    // b and x being those of the whole grid
+    struct Slabs {
+        std::deque<ForwardState> st;
+        std::vector<grid::Shape> shapes;
+        std::vector<int> first, devices;
+        std::vector<grid::ForwardArgs> fwd;
+
+        Slabs(const Spec &sp, const grid::Shape &sh, const ForwardState &whole, std::mt19937 &rng) {
+            int device = 0;
+#ifdef GROWNET_CUDA
+            cudaGetDevice(&device);
+#endif
+            const std::vector<double> w = whole.w.read(sp.dtype), b = whole.b.read(sp.dtype);
+            const std::vector<double> x = whole.x.read(sp.dtype);
+            int j0 = 0;
+            for (int n : {2, sh.D - 2}) {
+                const grid::Shape s{sh.dim, n, sh.L, sh.batch};
+                ForwardState &f = st.emplace_back(sp, s, rng);
+                f.w.write(sp.dtype, slab_rows(w, sh.L, sh.D, j0, n, (size_t)sh.dim * sh.dim));
+                f.b.write(sp.dtype, slab_rows(b, sh.L, sh.D, j0, n, sh.dim));
+                f.x.write(sp.dtype, slab_rows(x, 1, sh.D, j0, n, sh.cell_size()));
+                fwd.push_back(grid::ForwardArgs{f.w.data(), f.b.data(), f.x.data(), f.h.data(), f.y.data(),
+                                                f.sd.data(), s});
+                shapes.push_back(s);
+                first.push_back(j0);
+                devices.push_back(device);
+                j0 += n;
+            }
+        }
+
+        grid::PartitionedForwardArgs forward() const {
+            return grid::PartitionedForwardArgs{fwd.data(), devices.data(), (int)fwd.size()};
+        }
+    };
+
+    // the backward buffers of a slab, dz holding its partitioned_scratch
+    struct SlabGrads {
+        Buffer grad, dx, dw, db, dz;
+
+        SlabGrads(const grid::Shape &ss, size_t es, bool dev)
+            : grad(es * ss.column_size(), dev), dx(es * ss.column_size(), dev),
+              dw(es * ss.L * ss.D * ss.dim * ss.dim, dev), db(es * ss.L * ss.D * ss.dim, dev),
+              dz(es * grid::partitioned_scratch(ss), dev) {}
+    };
+
+    // slab s of got against its cells of the [rows, D, elems] whole
+    inline void compare_slab(Check &c, const char *what, const Slabs &sl, size_t s, const std::vector<double> &got,
+                             const std::vector<double> &whole, int rows, size_t elems, const Tolerance &tol) {
+        const int D = sl.shapes[0].D + sl.shapes[1].D;
+        const std::vector<double> expect = slab_rows(whole, rows, D, sl.first[s], sl.shapes[s].D, elems);
+        for (size_t i = 0; i < expect.size(); ++i)
+            compare(c, what, i, got[i], expect[i], tol);
+    }
+}
+
+// the y and sd of every column of each slab against those of the single
+// device forward over the whole grid
+inline Check check_partitioned_forward(const Spec &sp, const Options &opt, int) {
+    const grid::Shape sh = detail::check_shape(sp);
+    std::mt19937 rng(opt.seed);
+    detail::ForwardState whole(sp, sh, rng);
+    grid::forward_table().find(sp.key)(whole.args(sh, opt));
+    detail::Slabs sl(sp, sh, whole, rng);
+    grid::partitioned_forward_table().find(sp.key)(sl.forward());
+    sync(sp.on_device());
+
+    Check c = detail::check("part_fwd", sp);
+    const Tolerance tol = output_tolerance(sp.dtype);
+    const std::vector<double> y = whole.y.read(sp.dtype), sd = whole.sd.read(sp.dtype);
+    for (size_t s = 0; s < sl.st.size(); ++s) {
+        detail::compare_slab(c, "y", sl, s, sl.st[s].y.read(sp.dtype), y, sh.L, sh.cell_size(), tol);
+        detail::compare_slab(c, "sd", sl, s, sl.st[s].sd.read(sp.dtype), sd, sh.L, sh.batch, tol);
+    }
+    return c;
+}
+
+// dx, dw and db of each slab, after the partitioned forward, against those
+// of the single device backward over the whole grid
+inline Check check_partitioned_backward(const Spec &sp, const Options &opt, int) {
+    const grid::Shape sh = detail::check_shape(sp);
+    const size_t es = elem_size(sp.dtype);
+    const bool dev = sp.on_device();
+    std::mt19937 rng(opt.seed);
+    detail::ForwardState whole(sp, sh, rng);
+    grid::forward_table().find(sp.key)(whole.args(sh, opt));
+    detail::Slabs sl(sp, sh, whole, rng);
+    grid::partitioned_forward_table().find(sp.key)(sl.forward());
+
+    Buffer grad(es * sh.column_size(), dev), dx(es * sh.column_size(), dev);
+    Buffer dw(es * sh.L * sh.D * sh.dim * sh.dim, dev), db(es * sh.L * sh.D * sh.dim, dev);
+    Buffer dz(es * sh.padded_column_size(), dev);
+    grad.fill(sp.dtype, 1, rng);
+    utils::Arena arena(detail::ForwardState::scratch_bytes(sp, sh));
+    grid::BackwardArgs a{whole.w.data(), whole.x.data(), whole.h.data(), whole.y.data(), whole.sd.data(),
+                         grad.data(), dx.data(), dw.data(), db.data(), dz.data(), sh};
+    a.arena = &arena;
+    grid::backward_table().find(sp.key)(a);
+
+    const std::vector<double> gv = grad.read(sp.dtype);
+    std::deque<detail::SlabGrads> sg;
+    std::vector<grid::BackwardArgs> slabs;
+    for (size_t s = 0; s < sl.st.size(); ++s) {
+        const grid::Shape &ss = sl.shapes[s];
+        const detail::ForwardState &f = sl.st[s];
+        detail::SlabGrads &g = sg.emplace_back(ss, es, dev);
+        g.grad.write(sp.dtype, detail::slab_rows(gv, 1, sh.D, sl.first[s], ss.D, sh.cell_size()));
+        slabs.push_back(grid::BackwardArgs{f.w.data(), f.x.data(), f.h.data(), f.y.data(), f.sd.data(),
+                                           g.grad.data(), g.dx.data(), g.dw.data(), g.db.data(), g.dz.data(), ss});
+    }
+    grid::partitioned_backward_table().find(sp.key)(
+        grid::PartitionedBackwardArgs{slabs.data(), sl.devices.data(), (int)slabs.size()});
+    sync(dev);
+
+    Check c = detail::check("part_bwd", sp);
+    const Tolerance tol = grad_tolerance(sp.dtype);
+    const std::vector<double> gx = dx.read(sp.dtype), gw = dw.read(sp.dtype), gb = db.read(sp.dtype);
+    for (size_t s = 0; s < sg.size(); ++s) {
+        detail::compare_slab(c, "dx", sl, s, sg[s].dx.read(sp.dtype), gx, 1, sh.cell_size(), tol);
+        detail::compare_slab(c, "dw", sl, s, sg[s].dw.read(sp.dtype), gw, sh.L, (size_t)sh.dim * sh.dim, tol);
+        detail::compare_slab(c, "db", sl, s, sg[s].db.read(sp.dtype), gb, sh.L, sh.dim, tol);
+    }
+    return c;
+}
+
+// p50 of the reference on a problem, single threaded, inputs filled as the
+// kernels' are
+inline double time_reference(const grid::Shape &sh, const Options &opt, int reps) {
+    std::mt19937 rng(opt.seed);
+    std::uniform_real_distribution<double> u(-1, 1);
+    std::vector<double> w((size_t)sh.L * sh.D * sh.dim * sh.dim), b((size_t)sh.L * sh.D * sh.dim);
+    std::vector<double> x(sh.column_size()), y(sh.column_size());
+    const double ws = 1 / std::sqrt((double)sh.dim);
+    for (auto &e : w)
+        e = ws * u(rng);
+    for (auto &e : b)
+        e = 0.1 * u(rng);
+    for (auto &e : x)
+        e = u(rng);
+    Reference ref(sh);
+    return measure([&] { ref.forward(w.data(), b.data(), x.data(), y.data()); }, false, 0, reps).p50;
+}
+
+inline void write_check(std::ostream &os, const Check &c) {
+    char line[256];
+    std::snprintf(line, sizeof(line), "check %-12s %-4s %-2s dim %3d  %-6s  max error %9.3g  %s", c.kernel.c_str(),
+                  c.device.c_str(), c.dtype.c_str(), c.dim, c.ok ? "ok" : "FAILED", c.error, c.mismatch.c_str());
+    os << line << "\n";
+}
+
+} // bench
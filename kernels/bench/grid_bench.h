@@ -0,0 +1,601 @@
+/*
+benchmark cases for the grid kernels, one per table in lib.h, each takes a
+registered signature and a problem size, sets up inputs of that size on the
+signature's device and times the kernel the table holds under its key
+*/
+
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "../lib.h"
+#include "../utils/arena.h"
+#include "../utils/thread_pool.h"
+#include "bench.h"
+
+namespace bench {
+
+struct Problem {
+    int D, L, batch;
+};
+
+struct Options {
+    int warmup = 3;
+    int reps = 20;
+    utils::ThreadPool *pool = nullptr;
+    uint32_t seed = 0;
+    // fraction of edges pruned for the sparse grid, and of cells gated off
+    // for the gated one
+    double prune = 0.5;
+};
+
+// the (device, dtype, dim) a signature was built from, dim is 0 for kernels
+// that are not specialized on it, and for the runtime dim ones keyed on
+// grid::any_dim, which run at any dim
+struct Spec {
+    std::string device;
+    std::string dtype;
+    int dim;
+    uint64_t key;
+    bool any_dim = false;
+
+    static Spec of(const fn_builder::Signature &sig) {
+        const int dim = sig.args.size() > 2 ? std::stoi(sig.args[2]) : 0;
+        return Spec{sig.args.at(0), sig.args.at(1), dim, sig.key, sig.args.size() > 2 && dim == grid::any_dim};
+    }
+
+    bool on_device() const { return device != "cpu"; }
+};
+
+namespace detail {
+    // the name of a kernel, the runtime dim fallbacks apart from the
+    // specializations at the same dim
+    inline std::string name(const char *kernel, const Spec &sp) {
+        return sp.any_dim ? std::string(kernel) + "_any" : kernel;
+    }
+
+    inline Result result(const char *kernel, const Spec &sp, const grid::Shape &sh, const Options &opt) {
+        const int threads = sp.on_device() || opt.pool == nullptr ? 1 : opt.pool->size();
+        return Result{name(kernel, sp), sp.device, sp.dtype, sh.dim, sh.D, sh.L, sh.batch, threads, 0, 0, {}};
+    }
+
+    // forward buffers, filled so the activations stay in range over many columns
+    struct ForwardState {
+        Buffer w, b, x, h, y, sd;
+
+        ForwardState(const Spec &sp, const grid::Shape &sh, std::mt19937 &rng)
+            : w(es(sp) * sh.L * sh.D * sh.dim * sh.dim, sp.on_device()),
+              b(es(sp) * sh.L * sh.D * sh.dim, sp.on_device()),
+              x(es(sp) * sh.column_size(), sp.on_device()),
+              h(es(sp) * sh.L * sh.padded_column_size(), sp.on_device()),
+              y(es(sp) * sh.L * sh.column_size(), sp.on_device()),
+              sd(accumulate_size(sp.dtype) * sh.L * sh.D * sh.batch, sp.on_device()) {
+            w.fill(sp.dtype, 1 / std::sqrt((double)sh.dim), rng);
+            b.fill(sp.dtype, 0.1, rng);
+            x.fill(sp.dtype, 1, rng);
+        }
+
+        grid::ForwardArgs args(const grid::Shape &sh, const Options &opt) const {
+            grid::ForwardArgs a{w.data(), b.data(), x.data(), h.data(), y.data(), sd.data(), sh};
+            a.pool = opt.pool;
+            return a;
+        }
+
+        // scratch for the kernels that need it, the mixed precision ones
+        // over the 16 bit types
+        static size_t scratch_bytes(const Spec &sp, const grid::Shape &sh) {
+            return elem_size(sp.dtype) == 2 ? grid::mixed_scratch_bytes(sh) : 0;
+        }
+
+        static size_t es(const Spec &sp) { return elem_size(sp.dtype); }
+    };
+}
+
+// flops of the cell matmuls and relus and of the normalized sums, bytes
+// are the weights once and every column's input, h, y and sd once each
+inline Result run_forward(const Spec &sp, const Problem &p, const Options &opt) {
+    auto fn = grid::forward_table().find(sp.key);
+    const grid::Shape sh{sp.dim, p.D, p.L, p.batch};
+    std::mt19937 rng(opt.seed);
+    detail::ForwardState st(sp, sh, rng);
+    utils::Arena arena(detail::ForwardState::scratch_bytes(sp, sh));
+    grid::ForwardArgs a = st.args(sh, opt);
+    a.arena = &arena;
+
+    Result r = detail::result("forward", sp, sh, opt);
+    const double cells = (double)sh.L * sh.D * sh.batch;
+    r.flops = cells * (2.0 * sh.dim * sh.dim + 9.0 * sh.dim);
+    r.bytes = (double)elem_size(sp.dtype) *
+              ((double)sh.L * sh.D * (sh.dim * sh.dim + sh.dim) +
+               (double)sh.L * (2 * sh.column_size() + sh.padded_column_size() + (size_t)sh.D * sh.batch));
+    r.t = measure([&] { fn(a); }, sp.on_device(), opt.warmup, opt.reps);
+    return r;
+}
+
+// flops of dx, dw and db per cell plus the normalization gradient, bytes
+// are w read and dw, db updated once and every column's saved state read once
+inline Result run_backward(const Spec &sp, const Problem &p, const Options &opt) {
+    auto fwd = grid::forward_table().find(sp.key);
+    auto fn = grid::backward_table().find(sp.key);
+    const grid::Shape sh{sp.dim, p.D, p.L, p.batch};
+    const size_t es = elem_size(sp.dtype);
+    const bool dev = sp.on_device();
+    const size_t as = accumulate_size(sp.dtype);
+    std::mt19937 rng(opt.seed);
+    detail::ForwardState st(sp, sh, rng);
+    utils::Arena arena(detail::ForwardState::scratch_bytes(sp, sh));
+    grid::ForwardArgs fa = st.args(sh, opt);
+    fa.arena = &arena;
+    fwd(fa);
+
+    Buffer grad(es * sh.column_size(), dev), dx(es * sh.column_size(), dev);
+    Buffer dw(as * sh.L * sh.D * sh.dim * sh.dim, dev), db(as * sh.L * sh.D * sh.dim, dev);
+    Buffer dz(es * sh.padded_column_size(), dev);
+    grad.fill(sp.dtype, 1, rng);
+    grid::BackwardArgs a{st.w.data(), st.x.data(), st.h.data(), st.y.data(), st.sd.data(), grad.data(),
+                         dx.data(), dw.data(), db.data(), dz.data(), sh};
+    a.pool = opt.pool;
+    a.arena = &arena;
+
+    Result r = detail::result("backward", sp, sh, opt);
+    const double cells = (double)sh.L * sh.D * sh.batch;
+    r.flops = cells * (4.0 * sh.dim * sh.dim + 14.0 * sh.dim);
+    r.bytes = (double)es *
+              (3.0 * sh.L * sh.D * (sh.dim * sh.dim + sh.dim) +
+               (double)sh.L * (2 * sh.column_size() + sh.padded_column_size() + (size_t)sh.D * sh.batch) +
+               2.0 * sh.column_size());
+    r.t = measure([&] { fn(a); }, dev, opt.warmup, opt.reps);
+    return r;
+}
+
+// one column worth of cells, D of them, in the packed layout
+inline Result run_gemm(const Spec &sp, const Problem &p, const Options &opt) {
+    auto fn = grid::gemm_table().find(sp.key);
+    const int dim = sp.dim;
+    const size_t es = elem_size(sp.dtype);
+    const auto packed = [&](size_t elems) {
+        return sp.dtype == "f" ? grid::packed_size<float>(p.D, elems) : grid::packed_size<double>(p.D, elems);
+    };
+    std::mt19937 rng(opt.seed);
+    Buffer x(es * packed((size_t)p.batch * dim), false), w(es * packed((size_t)dim * dim), false);
+    Buffer b(es * packed(dim), false), y(es * packed((size_t)p.batch * dim), false);
+    x.fill(sp.dtype, 1, rng);
+    w.fill(sp.dtype, 1 / std::sqrt((double)dim), rng);
+    b.fill(sp.dtype, 0.1, rng);
+    const grid::GemmArgs a{x.data(), w.data(), b.data(), y.data(), p.D, p.batch};
+
+    Result r = detail::result("gemm", sp, grid::Shape{dim, p.D, 1, p.batch}, opt);
+    r.threads = 1;
+    r.flops = 2.0 * p.D * p.batch * dim * dim;
+    r.bytes = (double)es * p.D * ((double)dim * dim + dim + 2.0 * p.batch * dim);
+    r.t = measure([&] { fn(a); }, false, opt.warmup, opt.reps);
+    return r;
+}
+
+namespace detail {
+    // reversible grid buffers, w and b of both half layers of each column
+    struct ReversibleState {
+        Buffer w, b, x, y, scratch;
+        utils::Arena arena;
+
+        ReversibleState(const Spec &sp, const grid::Shape &sh, std::mt19937 &rng)
+            : w(es(sp) * sh.L * 2 * sh.D * (sh.dim / 2) * (sh.dim / 2), sp.on_device()),
+              b(es(sp) * sh.L * 2 * sh.D * (sh.dim / 2), sp.on_device()),
+              x(es(sp) * sh.column_size(), sp.on_device()),
+              y(es(sp) * sh.column_size(), sp.on_device()),
+              scratch(grid::reversible_scratch_bytes(sh, es(sp)), sp.on_device()),
+              arena(scratch.data(), grid::reversible_scratch_bytes(sh, es(sp))) {
+            w.fill(sp.dtype, 1 / std::sqrt(sh.dim / 2.0), rng);
+            b.fill(sp.dtype, 0.1, rng);
+            x.fill(sp.dtype, 1, rng);
+        }
+
+        grid::ReversibleForwardArgs args(const grid::Shape &sh, const Options &opt) {
+            grid::ReversibleForwardArgs a{w.data(), b.data(), x.data(), y.data(), sh};
+            a.pool = opt.pool;
+            a.arena = &arena;
+            return a;
+        }
+
+        static size_t es(const Spec &sp) { return elem_size(sp.dtype); }
+    };
+
+    // flops of one half width column, as counted for the forward
+    inline double half_column_flops(const grid::Shape &sh) {
+        const double h = sh.dim / 2;
+        return (double)sh.D * sh.batch * (2 * h * h + 9 * h);
+    }
+}
+
+// two half width columns per column, bytes are the weights once and the
+// state read and written by both couplings of every column
+inline Result run_reversible_forward(const Spec &sp, const Problem &p, const Options &opt) {
+    auto fn = grid::reversible_forward_table().find(sp.key);
+    const grid::Shape sh{sp.dim, p.D, p.L, p.batch};
+    std::mt19937 rng(opt.seed);
+    detail::ReversibleState st(sp, sh, rng);
+    const grid::ReversibleForwardArgs a = st.args(sh, opt);
+
+    Result r = detail::result("rev_fwd", sp, sh, opt);
+    r.flops = 2.0 * sh.L * detail::half_column_flops(sh);
+    r.bytes = (double)elem_size(sp.dtype) *
+              ((double)sh.L * 2 * sh.D * (sh.dim / 2) * (sh.dim / 2 + 1) + 4.0 * sh.L * sh.column_size());
+    r.t = measure([&] { fn(a); }, sp.on_device(), opt.warmup, opt.reps);
+    return r;
+}
+
+// rebuilding each column costs a forward on top of the usual backward
+inline Result run_reversible_backward(const Spec &sp, const Problem &p, const Options &opt) {
+    auto fwd = grid::reversible_forward_table().find(sp.key);
+    auto fn = grid::reversible_backward_table().find(sp.key);
+    const grid::Shape sh{sp.dim, p.D, p.L, p.batch};
+    const size_t es = elem_size(sp.dtype);
+    const bool dev = sp.on_device();
+    std::mt19937 rng(opt.seed);
+    detail::ReversibleState st(sp, sh, rng);
+    fwd(st.args(sh, opt));
+
+    const size_t nw = (size_t)sh.L * 2 * sh.D * (sh.dim / 2);
+    Buffer grad(es * sh.column_size(), dev), dx(es * sh.column_size(), dev);
+    Buffer dw(es * nw * (sh.dim / 2), dev), db(es * nw, dev);
+    grad.fill(sp.dtype, 1, rng);
+    grid::ReversibleBackwardArgs a{st.w.data(), st.b.data(), st.y.data(), grad.data(), dx.data(),
+                                   dw.data(), db.data(), sh};
+    a.pool = opt.pool;
+    a.arena = &st.arena;
+
+    Result r = detail::result("rev_bwd", sp, sh, opt);
+    const double h = sh.dim / 2;
+    r.flops = 2.0 * sh.L * (detail::half_column_flops(sh) + (double)sh.D * sh.batch * (4 * h * h + 14 * h));
+    r.bytes = (double)es * (3.0 * nw * (h + 1) + 8.0 * sh.L * sh.column_size());
+    r.t = measure([&] { fn(a); }, dev, opt.warmup, opt.reps);
+    return r;
+}
+
+namespace detail {
+    // checkpoints every sqrt(L) columns, the stride using the least memory
+    struct CheckpointState {
+        Buffer w, b, x, ckpt, out, scratch;
+        utils::Arena arena;
+        int stride;
+
+        CheckpointState(const Spec &sp, const grid::Shape &sh, std::mt19937 &rng)
+            : w(es(sp) * sh.L * sh.D * sh.dim * sh.dim, sp.on_device()),
+              b(es(sp) * sh.L * sh.D * sh.dim, sp.on_device()),
+              x(es(sp) * sh.column_size(), sp.on_device()),
+              ckpt(es(sp) * sh.column_size() * sh.L, sp.on_device()),
+              out(es(sp) * sh.column_size(), sp.on_device()),
+              scratch(grid::checkpoint_scratch_bytes(sh, stride_for(sh), es(sp)), sp.on_device()),
+              arena(scratch.data(), grid::checkpoint_scratch_bytes(sh, stride_for(sh), es(sp))),
+              stride(stride_for(sh)) {
+            w.fill(sp.dtype, 1 / std::sqrt((double)sh.dim), rng);
+            b.fill(sp.dtype, 0.1, rng);
+            x.fill(sp.dtype, 1, rng);
+        }
+
+        grid::CheckpointForwardArgs args(const grid::Shape &sh, const Options &opt) {
+            grid::CheckpointForwardArgs a{w.data(), b.data(), x.data(), ckpt.data(), out.data(), sh, stride};
+            a.pool = opt.pool;
+            a.arena = &arena;
+            return a;
+        }
+
+        static int stride_for(const grid::Shape &sh) {
+            return std::max(1, (int)std::lround(std::sqrt((double)sh.L)));
+        }
+
+        static size_t es(const Spec &sp) { return elem_size(sp.dtype); }
+    };
+}
+
+// the same work as the plain forward, only the checkpoints are written out
+inline Result run_checkpoint_forward(const Spec &sp, const Problem &p, const Options &opt) {
+    auto fn = grid::checkpoint_forward_table().find(sp.key);
+    const grid::Shape sh{sp.dim, p.D, p.L, p.batch};
+    std::mt19937 rng(opt.seed);
+    detail::CheckpointState st(sp, sh, rng);
+    const grid::CheckpointForwardArgs a = st.args(sh, opt);
+
+    Result r = detail::result("ckpt_fwd", sp, sh, opt);
+    const double cells = (double)sh.L * sh.D * sh.batch;
+    r.flops = cells * (2.0 * sh.dim * sh.dim + 9.0 * sh.dim);
+    r.bytes = (double)elem_size(sp.dtype) *
+              ((double)sh.L * sh.D * (sh.dim * sh.dim + sh.dim) +
+               (double)sh.L * (2 * sh.column_size() + sh.padded_column_size() + (size_t)sh.D * sh.batch));
+    r.t = measure([&] { fn(a); }, sp.on_device(), opt.warmup, opt.reps);
+    return r;
+}
+
+// a forward recompute of every column on top of the plain backward
+inline Result run_checkpoint_backward(const Spec &sp, const Problem &p, const Options &opt) {
+    auto fwd = grid::checkpoint_forward_table().find(sp.key);
+    auto fn = grid::checkpoint_backward_table().find(sp.key);
+    const grid::Shape sh{sp.dim, p.D, p.L, p.batch};
+    const size_t es = elem_size(sp.dtype);
+    const bool dev = sp.on_device();
+    std::mt19937 rng(opt.seed);
+    detail::CheckpointState st(sp, sh, rng);
+    fwd(st.args(sh, opt));
+
+    Buffer grad(es * sh.column_size(), dev), dx(es * sh.column_size(), dev);
+    Buffer dw(es * sh.L * sh.D * sh.dim * sh.dim, dev), db(es * sh.L * sh.D * sh.dim, dev);
+    grad.fill(sp.dtype, 1, rng);
+    grid::CheckpointBackwardArgs a{st.w.data(), st.b.data(), st.x.data(), st.ckpt.data(), grad.data(),
+                                   dx.data(), dw.data(), db.data(), sh, st.stride};
+    a.pool = opt.pool;
+    a.arena = &st.arena;
+
+    Result r = detail::result("ckpt_bwd", sp, sh, opt);
+    const double cells = (double)sh.L * sh.D * sh.batch;
+    r.flops = cells * (6.0 * sh.dim * sh.dim + 23.0 * sh.dim);
+    r.bytes = (double)es *
+              (4.0 * sh.L * sh.D * (sh.dim * sh.dim + sh.dim) +
+               2.0 * sh.L * (2 * sh.column_size() + sh.padded_column_size() + (size_t)sh.D * sh.batch));
+    r.t = measure([&] { fn(a); }, dev, opt.warmup, opt.reps);
+    return r;
+}
+
+// the dense stencil with each edge pruned with probability Options::prune,
+// flops and bytes count live cells and edges only
+inline Result run_sparse(const Spec &sp, const Problem &p, const Options &opt, bool backward) {
+    const grid::Shape sh{sp.dim, p.D, p.L, p.batch};
+    const size_t es = elem_size(sp.dtype);
+    std::mt19937 rng(opt.seed);
+    std::bernoulli_distribution kept(1 - opt.prune);
+    std::vector<uint8_t> keep((size_t)sh.L * sh.D * 3);
+    for (auto &k : keep)
+        k = kept(rng);
+    const grid::Graph graph = grid::Graph::stencil(sh, keep.data());
+
+    detail::ForwardState st(sp, sh, rng);
+    grid::SparseForwardArgs fa{st.w.data(), st.b.data(), st.x.data(), st.h.data(), st.y.data(), st.sd.data(),
+                               graph.view(), sh};
+    fa.pool = opt.pool;
+    auto fwd = grid::sparse_forward_table().find(sp.key);
+
+    Result r = detail::result(backward ? "sparse_bwd" : "sparse_fwd", sp, sh, opt);
+    const double live = (double)graph.live_cells() * sh.batch;
+    const double edges = (double)graph.edges() * sh.batch;
+    const double sums = (double)sh.L * sh.D * sh.batch;
+    const double weights = (double)graph.live_cells() * (sh.dim * sh.dim + sh.dim);
+    if (!backward) {
+        r.flops = live * (2.0 * sh.dim * sh.dim + sh.dim) + edges * sh.dim + sums * 8.0 * sh.dim;
+        r.bytes = (double)es * (weights + (live + 2 * sums) * sh.dim + sums);
+        r.t = measure([&] { fwd(fa); }, false, opt.warmup, opt.reps);
+        return r;
+    }
+
+    fwd(fa);
+    Buffer grad(es * sh.column_size(), false), dx(es * sh.column_size(), false);
+    Buffer dw(es * sh.L * sh.D * sh.dim * sh.dim, false), db(es * sh.L * sh.D * sh.dim, false);
+    Buffer dz(es * sh.column_size(), false);
+    grad.fill(sp.dtype, 1, rng);
+    grid::SparseBackwardArgs a{st.w.data(), st.x.data(), st.h.data(), st.y.data(), st.sd.data(), grad.data(),
+                               dx.data(), dw.data(), db.data(), dz.data(), graph.view(), sh};
+    a.pool = opt.pool;
+    auto fn = grid::sparse_backward_table().find(sp.key);
+    r.flops = live * (4.0 * sh.dim * sh.dim + 2.0 * sh.dim) + edges * sh.dim + sums * 12.0 * sh.dim;
+    r.bytes = (double)es * (3 * weights + (2 * live + 2 * sums) * sh.dim + sums);
+    r.t = measure([&] { fn(a); }, false, opt.warmup, opt.reps);
+    return r;
+}
+
+inline Result run_sparse_forward(const Spec &sp, const Problem &p, const Options &opt) {
+    return run_sparse(sp, p, opt, false);
+}
+
+inline Result run_sparse_backward(const Spec &sp, const Problem &p, const Options &opt) {
+    return run_sparse(sp, p, opt, true);
+}
+
+namespace detail {
+    // gates of the gated grid, cell c is off, its cutoff above the norm of
+    // any normalized input, when off[c] and open with g close to 1 otherwise
+    template <typename T>
+    void set_gates(void *gate, const grid::Shape &sh, const std::vector<uint8_t> &off) {
+        const T norm = std::sqrt((T)sh.dim);
+        for (size_t c = 0; c < off.size(); ++c) {
+            static_cast<T *>(gate)[2 * c] = off[c] ? 2 * norm : norm / 4;
+            static_cast<T *>(gate)[2 * c + 1] = -4 / norm;
+        }
+    }
+}
+
+// the dense grid with each cell gated off with probability Options::prune,
+// flops and bytes count the open cells only, besides the gather and the
+// magnitudes which are paid for every sample
+inline Result run_gated(const Spec &sp, const Problem &p, const Options &opt, bool backward) {
+    const grid::Shape sh{sp.dim, p.D, p.L, p.batch};
+    const size_t es = elem_size(sp.dtype);
+    std::mt19937 rng(opt.seed);
+    std::bernoulli_distribution gated(opt.prune);
+    std::vector<uint8_t> off((size_t)sh.L * sh.D);
+    size_t open = 0;
+    for (auto &o : off)
+        open += (o = gated(rng)) == 0;
+
+    detail::ForwardState st(sp, sh, rng);
+    Buffer gate(es * 2 * off.size(), false), mag(es * sh.L * sh.D * sh.batch, false);
+    if (sp.dtype == "f")
+        detail::set_gates<float>(gate.data(), sh, off);
+    else
+        detail::set_gates<double>(gate.data(), sh, off);
+    utils::Arena arena(grid::gated_scratch_bytes(sh, es));
+    grid::GatedForwardArgs fa{st.args(sh, opt), gate.data(), mag.data(), 0.0};
+    fa.grid.arena = &arena;
+    auto fwd = grid::gated_forward_table().find(sp.key);
+
+    Result r = detail::result(backward ? "gated_bwd" : "gated_fwd", sp, sh, opt);
+    const double live = (double)open * sh.batch;
+    const double sums = (double)sh.L * sh.D * sh.batch;
+    const double weights = (double)open * (sh.dim * sh.dim + sh.dim);
+    if (!backward) {
+        r.flops = live * (2.0 * sh.dim * sh.dim + 2.0 * sh.dim) + sums * 11.0 * sh.dim;
+        r.bytes = (double)es * (weights + (live + 3 * sums) * sh.dim + 2 * sums);
+        r.t = measure([&] { fwd(fa); }, false, opt.warmup, opt.reps);
+        return r;
+    }
+
+    fwd(fa);
+    Buffer grad(es * sh.column_size(), false), dx(es * sh.column_size(), false);
+    Buffer dw(es * sh.L * sh.D * sh.dim * sh.dim, false), db(es * sh.L * sh.D * sh.dim, false);
+    Buffer dgate(es * 2 * off.size(), false);
+    grad.fill(sp.dtype, 1, rng);
+    grid::GatedBackwardArgs a{{st.w.data(), st.x.data(), st.h.data(), st.y.data(), st.sd.data(), grad.data(),
+                               dx.data(), dw.data(), db.data(), nullptr, sh},
+                              gate.data(), mag.data(), dgate.data(), 0.0};
+    a.grid.pool = opt.pool;
+    a.grid.arena = &arena;
+    auto fn = grid::gated_backward_table().find(sp.key);
+    r.flops = live * (4.0 * sh.dim * sh.dim + 8.0 * sh.dim) + sums * 14.0 * sh.dim;
+    r.bytes = (double)es * (3 * weights + (3 * live + 3 * sums) * sh.dim + 2 * sums);
+    r.t = measure([&] { fn(a); }, false, opt.warmup, opt.reps);
+    return r;
+}
+
+inline Result run_gated_forward(const Spec &sp, const Problem &p, const Options &opt) {
+    return run_gated(sp, p, opt, false);
+}
+
+inline Result run_gated_backward(const Spec &sp, const Problem &p, const Options &opt) {
+    return run_gated(sp, p, opt, true);
+}
+
+namespace detail {
+    // inference buffers, filled as ForwardState fills them, with the scratch
+    // of a pool of the options' size, under the int8 cells all but w is
+    // float, and w is quantized from a float one kept for the checks
+    struct InferState {
+        Buffer w, b, x, y, work, cells;
+
+        InferState(const Spec &sp, const grid::Shape &sh, const Options &opt, std::mt19937 &rng)
+            : w(es(sp) * sh.L * sh.D * sh.dim * sh.dim, false),
+              b(es(sp) * sh.L * sh.D * sh.dim, false),
+              x(es(sp) * sh.column_size(), false),
+              y(es(sp) * sh.column_size(), false),
+              work(es(sp) * grid::inference_scratch(sh, opt.pool != nullptr ? opt.pool->size() : 1), false),
+              cells(quantized(sp) ? grid::quant_bytes(sh) : 0, false) {
+            const std::string code = accumulate_code(sp.dtype);
+            w.fill(code, 1 / std::sqrt((double)sh.dim), rng);
+            b.fill(code, 0.1, rng);
+            x.fill(code, 1, rng);
+            if (quantized(sp))
+                grid::quantize_cells(static_cast<const float *>(w.data()), sh, cells.data());
+        }
+
+        grid::InferArgs args(const Spec &sp, const grid::Shape &sh, const Options &opt) const {
+            grid::InferArgs a{quantized(sp) ? cells.data() : w.data(), b.data(), x.data(), y.data(), work.data(), sh};
+            a.pool = opt.pool;
+            return a;
+        }
+
+        static bool quantized(const Spec &sp) { return sp.dtype == "q8"; }
+        static size_t es(const Spec &sp) { return accumulate_size(sp.dtype); }
+    };
+}
+
+// the flops of the forward, bytes are the parameters and the input read and
+// the output written once, nothing of the columns between being kept, the
+// int8 cells count as the float ones do
+inline Result run_infer(const Spec &sp, const Problem &p, const Options &opt) {
+    auto fn = grid::infer_table().find(sp.key);
+    const grid::Shape sh{sp.dim, p.D, p.L, p.batch};
+    std::mt19937 rng(opt.seed);
+    detail::InferState st(sp, sh, opt, rng);
+    const grid::InferArgs a = st.args(sp, sh, opt);
+
+    Result r = detail::result(detail::InferState::quantized(sp) ? "infer_q8" : "infer", sp, sh, opt);
+    const double cells = (double)sh.L * sh.D * sh.batch;
+    r.flops = cells * (2.0 * sh.dim * sh.dim + 9.0 * sh.dim);
+    r.bytes = (double)grid::bytes_moved(a, elem_size(sp.dtype));
+    r.t = measure([&] { fn(a); }, false, opt.warmup, opt.reps);
+    return r;
+}
+
+namespace detail {
+    // a square plate of about as many cells as a column of D, radius 1
+    inline grid::Shape3D plate_shape(const Spec &sp, const Problem &p) {
+        const int Dy = std::max(1, (int)std::lround(std::sqrt((double)p.D)));
+        return grid::Shape3D{sp.dim, Dy, std::max(1, p.D / Dy), p.L, p.batch, 1};
+    }
+
+    // the report of a 3d grid, with the cells of a plate as D
+    inline Result result3d(const char *kernel, const Spec &sp, const grid::Shape3D &sh, const Options &opt) {
+        return result(kernel, sp, grid::Shape{sh.dim, sh.cells(), sh.L, sh.batch}, opt);
+    }
+
+    // 3d grid buffers, filled as ForwardState fills them
+    struct Forward3DState {
+        Buffer w, b, x, h, y, sd;
+
+        Forward3DState(const Spec &sp, const grid::Shape3D &sh, std::mt19937 &rng)
+            : w(es(sp) * sh.L * sh.cells() * sh.dim * sh.dim, false),
+              b(es(sp) * sh.L * sh.cells() * sh.dim, false),
+              x(es(sp) * sh.layer_size(), false),
+              h(es(sp) * sh.L * sh.padded_layer_size(), false),
+              y(es(sp) * sh.L * sh.layer_size(), false),
+              sd(es(sp) * sh.L * sh.cells() * sh.batch, false) {
+            w.fill(sp.dtype, 1 / std::sqrt((double)sh.dim), rng);
+            b.fill(sp.dtype, 0.1, rng);
+            x.fill(sp.dtype, 1, rng);
+        }
+
+        grid::Forward3DArgs args(const grid::Shape3D &sh, const Options &opt) const {
+            grid::Forward3DArgs a{w.data(), b.data(), x.data(), h.data(), y.data(), sd.data(), sh};
+            a.pool = opt.pool;
+            return a;
+        }
+
+        static size_t es(const Spec &sp) { return elem_size(sp.dtype); }
+    };
+
+    // the neighbours a sum of a 3d grid adds, 3 for a column
+    inline double stencil_cells(const grid::Shape3D &sh) {
+        return (2.0 * sh.radius + 1) * (2 * sh.radius + 1);
+    }
+}
+
+// counted as for the dense grid, with a sum adding stencil_cells neighbours
+inline Result run_forward3d(const Spec &sp, const Problem &p, const Options &opt) {
+    auto fn = grid::forward3d_table().find(sp.key);
+    const grid::Shape3D sh = detail::plate_shape(sp, p);
+    std::mt19937 rng(opt.seed);
+    detail::Forward3DState st(sp, sh, rng);
+    const grid::Forward3DArgs a = st.args(sh, opt);
+
+    Result r = detail::result3d("3d_fwd", sp, sh, opt);
+    const double cells = (double)sh.L * sh.cells() * sh.batch;
+    r.flops = cells * (2.0 * sh.dim * sh.dim + (detail::stencil_cells(sh) + 6) * sh.dim);
+    r.bytes = (double)grid::bytes_moved(a, elem_size(sp.dtype));
+    r.t = measure([&] { fn(a); }, false, opt.warmup, opt.reps);
+    return r;
+}
+
+inline Result run_backward3d(const Spec &sp, const Problem &p, const Options &opt) {
+    auto fwd = grid::forward3d_table().find(sp.key);
+    auto fn = grid::backward3d_table().find(sp.key);
+    const grid::Shape3D sh = detail::plate_shape(sp, p);
+    const size_t es = elem_size(sp.dtype);
+    std::mt19937 rng(opt.seed);
+    detail::Forward3DState st(sp, sh, rng);
+    fwd(st.args(sh, opt));
+
+    Buffer grad(es * sh.layer_size(), false), dx(es * sh.layer_size(), false);
+    Buffer dw(es * sh.L * sh.cells() * sh.dim * sh.dim, false), db(es * sh.L * sh.cells() * sh.dim, false);
+    Buffer dz(es * sh.padded_layer_size(), false);
+    grad.fill(sp.dtype, 1, rng);
+    grid::Backward3DArgs a{st.w.data(), st.x.data(), st.h.data(), st.y.data(), st.sd.data(), grad.data(),
+                           dx.data(), dw.data(), db.data(), dz.data(), sh};
+    a.pool = opt.pool;
+
+    Result r = detail::result3d("3d_bwd", sp, sh, opt);
+    const double cells = (double)sh.L * sh.cells() * sh.batch;
+    r.flops = cells * (4.0 * sh.dim * sh.dim + (2 * detail::stencil_cells(sh) + 8) * sh.dim);
+    r.bytes = (double)grid::bytes_moved(a, es);
+    r.t = measure([&] { fn(a); }, false, opt.warmup, opt.reps);
+    return r;
+}
+
+} // bench
@@ -0,0 +1,32 @@
+/*
+benchmark cases for the optimizer steps, over an arena holding every weight
+and bias of a grid of the requested size
+*/
+
+#pragma once
+#include "grid_bench.h"
+
+namespace bench {
+
+// 2 flops for each moment, 4 for the update, bytes are param, m and v read
+// and written and grad read and cleared
+inline Result run_adam(const Spec &sp, const Problem &p, const Options &opt) {
+    auto fn = optim::adam_table().find(sp.key);
+    const size_t n = (size_t)p.L * p.D * ((size_t)sp.dim * sp.dim + sp.dim);
+    const size_t es = elem_size(sp.dtype);
+    const bool dev = sp.on_device();
+    std::mt19937 rng(opt.seed);
+    Buffer param(es * n, dev), grad(es * n, dev), m(es * n, dev), v(es * n, dev);
+    param.fill(sp.dtype, 1, rng);
+
+    optim::AdamArgs a{param.data(), grad.data(), m.data(), v.data(), n, 1e-3, 0.9, 0.999, 1e-8, 1};
+    a.pool = opt.pool;
+
+    Result r = detail::result("adam", sp, grid::Shape{sp.dim, p.D, p.L, 0}, opt);
+    r.flops = 10.0 * n;
+    r.bytes = 8.0 * es * n;
+    r.t = measure([&] { fn(a); ++a.step; }, dev, opt.warmup, opt.reps);
+    return r;
+}
+
+} // bench
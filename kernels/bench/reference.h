@@ -0,0 +1,110 @@
+/*
+the grid of simple_grid.jl as the kernels are checked and timed against,
+forward_kernel! ported loop for loop in double over the same memory order,
+sum_buf1 and sum_buf2 being [D + 2, batch, dim], so every kernel's output
+can be compared with it and its throughput put against it
+
+there is no backward to port, backward_kernel! in simple_grid.jl being the
+forward again in another order, so gradients are checked the way
+ops::grad_check in grownet_models checks the rust ones, by central
+differences of the reference, see central_difference
+*/
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "../grid/grid.h"
+
+namespace bench {
+
+class Reference {
+public:
+    explicit Reference(const grid::Shape &sh)
+        : sh(sh), buf1(sh.padded_column_size()), buf2(sh.padded_column_size()) {}
+
+    // the grid output for x into y [D, batch, dim], w and b as the kernels take them
+    void forward(const double *w, const double *b, const double *x, double *y) {
+        const int dim = sh.dim, D = sh.D;
+        const size_t cell = sh.cell_size();
+        std::fill(buf1.begin(), buf1.end(), 0.0);
+        std::fill(buf2.begin(), buf2.end(), 0.0);
+        std::copy(x, x + sh.column_size(), buf1.begin() + cell);
+        for (int i = 0; i < sh.L; ++i) {
+            for (int j = 0; j < D; ++j) {
+                const double *wj = w + ((size_t)i * D + j) * dim * dim;
+                const double *bj = b + ((size_t)i * D + j) * dim;
+                for (int s = 0; s < sh.batch; ++s) {
+                    const double *in = &buf1[(j + 1) * cell + (size_t)s * dim];
+                    double *out = &buf2[(j + 1) * cell + (size_t)s * dim];
+                    for (int o = 0; o < dim; ++o) {
+                        double acc = 0;
+                        for (int k = 0; k < dim; ++k)
+                            acc += wj[(size_t)k * dim + o] * in[k];
+                        out[o] = std::max(bj[o] + acc, 0.0);
+                    }
+                }
+            }
+            std::fill(buf1.begin(), buf1.end(), 0.0);
+            for (int j = 1; j <= D; ++j) {
+                for (int k : grid::offsets)
+                    for (size_t e = 0; e < cell; ++e)
+                        buf1[j * cell + e] += buf2[(j + k) * cell + e];
+                for (int s = 0; s < sh.batch; ++s)
+                    normalize(&buf1[j * cell + (size_t)s * dim], dim);
+            }
+        }
+        std::copy(buf1.begin() + cell, buf1.begin() + cell + sh.column_size(), y);
+    }
+
+    // flops forward takes, as counted for the forward kernels
+    double flops() const {
+        return (double)sh.L * sh.D * sh.batch * (2.0 * sh.dim * sh.dim + 9.0 * sh.dim);
+    }
+
+private:
+    // normalize! of one sample, the deviation over d - 1
+    static void normalize(double *a, int d) {
+        double mu = 0;
+        for (int i = 0; i < d; ++i)
+            mu += a[i];
+        mu /= d;
+        double sd = 0;
+        for (int i = 0; i < d; ++i)
+            sd += (a[i] - mu) * (a[i] - mu);
+        sd = std::sqrt(sd / (d - 1));
+        for (int i = 0; i < d; ++i)
+            a[i] = (a[i] - mu) / (sd + grid::norm_eps);
+    }
+
+    grid::Shape sh;
+    std::vector<double> buf1, buf2;
+};
+
+// the tolerances of ops::grad_check, an analytical x is close to a perturbed
+// y when |x - y| <= atol + rtol * |y|
+struct Tolerance {
+    double atol = 1e-5;
+    double rtol = 1e-3;
+
+    bool close(double x, double y) const { return std::fabs(x - y) <= atol + rtol * std::fabs(y); }
+};
+
+constexpr double grad_eps = 1e-6;
+
+// compute_jacobian of ops.rs for a scalar loss of p[i], the central
+// difference of loss() with p[i] moved by eps each way, p left as it was
+template <typename F>
+double central_difference(double *p, size_t i, F &&loss, double eps = grad_eps) {
+    const double old = p[i];
+    p[i] = old + eps;
+    const double up = loss();
+    p[i] = old - eps;
+    const double down = loss();
+    p[i] = old;
+    return (up - down) / (2 * eps);
+}
+
+} // bench
@@ -0,0 +1,270 @@
+/*
+double buffered batch streaming, so that loading batch n + 1 overlaps the
+compute on batch n instead of stalling every step the way copying whole
+tensors up front does in grownet_models/src/datasets
+
+a loader thread fills one of two host slots, pinned when the batches go to
+a cuda device, and queues its copy to the device on a stream of its own, the
+consumer waits for a batch on the stream it computes on, without blocking the
+host, and hands the slot back when it asks for the next one, the copy into a
+slot is ordered after the compute that last read it by an event, so neither
+side ever waits on more than the slot it needs
+
+on the host the loader thread alone does the overlapping, batches are handed
+out in the slot they were filled in
+*/
+
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#ifdef GROWNET_CUDA
+#include <cuda_runtime.h>
+#endif
+
+namespace data {
+
+// writes batch i into dst, at most the pipeline's batch bytes, and returns
+// how many bytes it wrote, called on the loader thread
+using fill_fn = std::function<size_t(int64_t i, void *dst)>;
+
+struct Batch {
+    // on the pipeline's device, valid until the next call of next
+    const void *data;
+    size_t bytes;
+    int64_t index;
+};
+
+class Pipeline {
+public:
+    static constexpr int slots = 2;
+
+    // batches of at most bytes each, onto the current cuda device if device
+    Pipeline(size_t bytes, int64_t batches, fill_fn fill, bool device)
+        : bytes(bytes), batches(batches), fill(std::move(fill)), device(device) {
+        for (int s = 0; s < slots; ++s) {
+            host[s] = alloc_host(bytes);
+            if (device)
+                dev[s] = alloc_device(bytes);
+        }
+#ifdef GROWNET_CUDA
+        if (device) {
+            check(cudaGetDevice(&ordinal), "cudaGetDevice");
+            check(cudaStreamCreateWithFlags(&copy, cudaStreamNonBlocking), "cudaStreamCreate");
+            for (int s = 0; s < slots; ++s) {
+                check(cudaEventCreateWithFlags(&ready[s], cudaEventDisableTiming), "cudaEventCreate");
+                check(cudaEventCreateWithFlags(&done[s], cudaEventDisableTiming), "cudaEventCreate");
+            }
+        }
+#endif
+        loader = std::thread([this] { load(); });
+    }
+
+    ~Pipeline() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stop = true;
+        }
+        changed.notify_all();
+        loader.join();
+#ifdef GROWNET_CUDA
+        if (device) {
+            cudaStreamSynchronize(copy);
+            for (int s = 0; s < slots; ++s) {
+                cudaEventDestroy(ready[s]);
+                cudaEventDestroy(done[s]);
+                cudaFree(dev[s]);
+            }
+            cudaStreamDestroy(copy);
+        }
+#endif
+        for (int s = 0; s < slots; ++s)
+            free_host(host[s]);
+    }
+
+    Pipeline(const Pipeline &) = delete;
+    Pipeline &operator=(const Pipeline &) = delete;
+
+    // hands back the previous batch, once everything queued on stream so far
+    // is done with it, and waits for the next one to be ready on stream, a
+    // cudaStream_t or null for the default one, unused on the host, returns
+    // false once every batch has been handed out, rethrows what fill threw
+    bool next(Batch &out, void *stream = nullptr) {
+        std::unique_lock<std::mutex> lock(m);
+        if (taken >= batches)
+            return false;
+        if (taken >= 0) {
+            const int s = taken % slots;
+#ifdef GROWNET_CUDA
+            if (device)
+                check(cudaEventRecord(done[s], static_cast<cudaStream_t>(stream)), "cudaEventRecord");
+#endif
+            state[s] = State::free;
+            changed.notify_all();
+        }
+        const int64_t i = ++taken;
+        if (i >= batches)
+            return false;
+        const int s = i % slots;
+        changed.wait(lock, [&] { return state[s] == State::ready || error; });
+        if (error)
+            std::rethrow_exception(error);
+#ifdef GROWNET_CUDA
+        if (device)
+            check(cudaStreamWaitEvent(static_cast<cudaStream_t>(stream), ready[s], 0), "cudaStreamWaitEvent");
+#endif
+        out = Batch{device ? dev[s] : host[s], filled[s], i};
+        return true;
+    }
+
+    int64_t size() const { return batches; }
+    size_t batch_bytes() const { return bytes; }
+
+private:
+    enum class State { free, ready };
+
+    void load() {
+        try {
+#ifdef GROWNET_CUDA
+            // a new thread starts out on device 0, its copies and events have
+            // to go to the device the slots were allocated on
+            if (device)
+                check(cudaSetDevice(ordinal), "cudaSetDevice");
+#endif
+            for (int64_t i = 0; i < batches; ++i) {
+                const int s = i % slots;
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    changed.wait(lock, [&] { return state[s] == State::free || stop; });
+                    if (stop)
+                        return;
+                }
+#ifdef GROWNET_CUDA
+                // the last copy out of this host slot has to be done before it is
+                // refilled, the copy of batch i - 2 was queued long ago
+                if (device && i >= slots)
+                    check(cudaEventSynchronize(ready[s]), "cudaEventSynchronize");
+#endif
+                const size_t n = fill(i, host[s]);
+                if (n > bytes)
+                    throw std::length_error("batch " + std::to_string(i) + " filled " + std::to_string(n) +
+                                            " bytes of a " + std::to_string(bytes) + " byte slot");
+#ifdef GROWNET_CUDA
+                if (device) {
+                    // after whatever read the slot's last batch, on the consumer stream
+                    if (i >= slots)
+                        check(cudaStreamWaitEvent(copy, done[s], 0), "cudaStreamWaitEvent");
+                    check(cudaMemcpyAsync(dev[s], host[s], n, cudaMemcpyHostToDevice, copy), "cudaMemcpyAsync");
+                    check(cudaEventRecord(ready[s], copy), "cudaEventRecord");
+                }
+#endif
+                {
+                    std::lock_guard<std::mutex> lock(m);
+                    filled[s] = n;
+                    state[s] = State::ready;
+                }
+                changed.notify_all();
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m);
+            error = std::current_exception();
+            changed.notify_all();
+        }
+    }
+
+    void *alloc_host(size_t n) {
+#ifdef GROWNET_CUDA
+        // pinned, so the copies run asynchronously at full bandwidth
+        void *p = nullptr;
+        if (device) {
+            check(cudaHostAlloc(&p, n, cudaHostAllocDefault), "cudaHostAlloc");
+            return p;
+        }
+#endif
+        return ::operator new(n, std::align_val_t(64));
+    }
+
+    void free_host(void *p) {
+#ifdef GROWNET_CUDA
+        if (device)
+            return (void)cudaFreeHost(p);
+#endif
+        ::operator delete(p, std::align_val_t(64));
+    }
+
+    void *alloc_device(size_t n) {
+#ifdef GROWNET_CUDA
+        void *p = nullptr;
+        check(cudaMalloc(&p, n), "cudaMalloc");
+        return p;
+#else
+        throw std::runtime_error("built without cuda");
+#endif
+    }
+
+#ifdef GROWNET_CUDA
+    static void check(cudaError_t e, const char *what) {
+        if (e != cudaSuccess)
+            throw std::runtime_error(std::string(what) + " failed, " + cudaGetErrorString(e));
+    }
+
+    // the current device at construction, which the slots live on
+    int ordinal = 0;
+    cudaStream_t copy = nullptr;
+    cudaEvent_t ready[slots] = {};
+    // recorded on the consumer stream when a slot is handed back
+    cudaEvent_t done[slots] = {};
+#endif
+
+    const size_t bytes;
+    const int64_t batches;
+    const fill_fn fill;
+    const bool device;
+    void *host[slots] = {};
+    void *dev[slots] = {};
+    size_t filled[slots] = {};
+
+    std::mutex m;
+    std::condition_variable changed;
+    State state[slots] = {State::free, State::free};
+    // the last batch handed out
+    int64_t taken = -1;
+    std::exception_ptr error;
+    bool stop = false;
+    std::thread loader;
+};
+
+// fill for batches of rows of a host array, row r of row_bytes starting at
+// src + r * row_stride, batch i gathering the rows order[i * rows, (i + 1) *
+// rows) densely, the last batch holding whatever is left, as when streaming a
+// shuffled epoch of a dataset
+inline fill_fn gather_rows(const void *src, size_t row_bytes, const int64_t *order, int64_t n, int64_t rows,
+                           size_t row_stride = 0) {
+    const char *base = static_cast<const char *>(src);
+    if (row_stride == 0)
+        row_stride = row_bytes;
+    return [=](int64_t i, void *dst) {
+        const int64_t r0 = i * rows;
+        const int64_t r1 = r0 + rows < n ? r0 + rows : n;
+        char *out = static_cast<char *>(dst);
+        for (int64_t r = r0; r < r1; ++r)
+            std::memcpy(out + (r - r0) * row_bytes, base + order[r] * row_stride, row_bytes);
+        return (size_t)(r1 - r0) * row_bytes;
+    };
+}
+
+// batches gather_rows makes of n rows
+inline int64_t batch_count(int64_t n, int64_t rows) {
+    return (n + rows - 1) / rows;
+}
+
+} // data
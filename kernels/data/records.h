@@ -0,0 +1,168 @@
+/*
+a preprocessed dataset on disk, decoded and normalized once, so that loading
+it is an mmap instead of decoding every image at startup the way
+grownet_models/src/datasets/mnist.rs and cifar.rs do, then copying the
+tensors again in ops::ts_to_vec
+
+    header  : RecordHeader, padded to a page
+    records : count records of record_bytes each, record_align apart
+    labels  : count int64 labels, if the file has them, record aligned
+
+a record is one sample, such as a [28, 28] uint8 image or a [32, 32, 3] float
+one, stored little endian as the host has it, the records being aligned
+their rows can be read by the simd loads of the kernels straight from the
+mapping, and every process mapping the file shares its pages in the page
+cache, so workers reading the same dataset add no memory of their own
+
+files are written and mapped through utils/files.h
+*/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "../utils/files.h"
+
+namespace data {
+
+enum class RecordType : uint32_t { u8 = 0, f32 = 1 };
+
+inline size_t record_type_size(RecordType t) {
+    switch (t) {
+    case RecordType::u8: return 1;
+    case RecordType::f32: return 4;
+    }
+    throw std::invalid_argument("records: unknown record type " + std::to_string((uint32_t)t));
+}
+
+constexpr char record_magic[8] = {'G', 'N', 'R', 'E', 'C', 'O', 'R', 'D'};
+constexpr uint32_t record_version = 1;
+// records start this far apart, a cache line, so every record is simd aligned
+constexpr size_t record_align = 64;
+// the header takes a page, so the records are page aligned too
+constexpr size_t record_header_bytes = 4096;
+constexpr int record_max_rank = 4;
+
+struct RecordHeader {
+    char magic[8];
+    uint32_t version;
+    RecordType type;
+    uint64_t count;
+    uint32_t rank;
+    uint32_t has_labels;
+    // of one record, the first rank entries are used
+    uint64_t shape[record_max_rank];
+    uint64_t record_bytes;
+    // from one record to the next, a multiple of record_align
+    uint64_t stride;
+    // from the start of the file
+    uint64_t records_at;
+    uint64_t labels_at;
+
+    static RecordHeader make(RecordType type, uint64_t count, const uint64_t *shape, int rank, bool labels) {
+        if (rank < 0 || rank > record_max_rank)
+            throw std::invalid_argument("records: rank " + std::to_string(rank) + " is above " +
+                                        std::to_string(record_max_rank));
+        RecordHeader h{};
+        std::memcpy(h.magic, record_magic, sizeof(h.magic));
+        h.version = record_version;
+        h.type = type;
+        h.count = count;
+        h.rank = (uint32_t)rank;
+        h.has_labels = labels;
+        h.record_bytes = record_type_size(type);
+        for (int i = 0; i < rank; ++i) {
+            h.shape[i] = shape[i];
+            h.record_bytes *= shape[i];
+        }
+        h.stride = utils::align_up(h.record_bytes, record_align);
+        h.records_at = record_header_bytes;
+        h.labels_at = labels ? utils::align_up(h.records_at + count * h.stride, record_align) : 0;
+        return h;
+    }
+};
+
+static_assert(sizeof(RecordHeader) <= record_header_bytes);
+
+// a record file mapped copy on write, its records and labels are read
+// straight from the page cache and writes through a view only change this
+// process's copy of the pages written
+class Records {
+public:
+    explicit Records(const std::string &path) : file(path) {
+        if (file.size() < record_header_bytes)
+            utils::file_error(path, "is " + std::to_string(file.size()) + " bytes, too short for a record header");
+        std::memcpy(&h, file.data(), sizeof(h));
+        validate();
+    }
+
+    const RecordHeader &header() const { return h; }
+    int64_t size() const { return (int64_t)h.count; }
+
+    void *records() const { return file.data() + h.records_at; }
+    void *record(int64_t i) const { return static_cast<char *>(records()) + i * h.stride; }
+
+    // null without labels
+    int64_t *labels() const {
+        return h.has_labels ? reinterpret_cast<int64_t *>(file.data() + h.labels_at) : nullptr;
+    }
+
+    // hints that records will be read in order, as for an unshuffled epoch
+    void advise_sequential() const { file.advise_sequential(); }
+
+private:
+    void validate() const {
+        const std::string &path = file.path;
+        if (std::memcmp(h.magic, record_magic, sizeof(h.magic)) != 0)
+            utils::file_error(path, "is not a record file");
+        if (h.version != record_version)
+            utils::file_error(path, "has record version " + std::to_string(h.version) + ", expected " +
+                                        std::to_string(record_version));
+        if (h.rank > (uint32_t)record_max_rank)
+            utils::file_error(path, "has rank " + std::to_string(h.rank));
+        // every product is checked, a header read from disk can make any of them wrap
+        uint64_t n = record_type_size(h.type);
+        bool ok = true;
+        for (uint32_t i = 0; i < h.rank; ++i)
+            ok = ok && utils::checked_mul(n, h.shape[i], n);
+        if (!ok || n != h.record_bytes || h.stride < n || h.stride % record_align != 0 ||
+            h.records_at < sizeof(RecordHeader) || h.records_at % record_align != 0 ||
+            (h.has_labels && h.labels_at % alignof(int64_t) != 0))
+            utils::file_error(path, "has an inconsistent record header");
+        uint64_t records = 0, labels = 0;
+        ok = utils::checked_mul(h.count, h.stride, records) && utils::within(h.records_at, records, file.size());
+        if (ok && h.has_labels)
+            ok = utils::checked_mul(h.count, sizeof(int64_t), labels) &&
+                 utils::within(h.labels_at, labels, file.size());
+        if (!ok)
+            utils::file_error(path, "is " + std::to_string(file.size()) + " bytes, its header asks for " +
+                                        std::to_string(h.count) + " records past its end");
+    }
+
+    utils::MappedFile file;
+    RecordHeader h;
+};
+
+// writes a record file of h.count records, record i read from src + i *
+// src_stride, and labels if h.has_labels, into path, replacing what was there
+inline void write_records(const std::string &path, const RecordHeader &h, const void *src, size_t src_stride,
+                          const int64_t *labels) {
+    utils::FileWriter f(path);
+    f.put(&h, sizeof(h));
+    f.pad_to(h.records_at);
+    const char *s = static_cast<const char *>(src);
+    for (uint64_t i = 0; i < h.count; ++i) {
+        f.put(s + i * src_stride, h.record_bytes);
+        f.pad_to(h.records_at + (i + 1) * h.stride);
+    }
+    if (h.has_labels) {
+        f.pad_to(h.labels_at);
+        f.put(labels, h.count * sizeof(int64_t));
+    }
+    f.commit();
+}
+
+} // data
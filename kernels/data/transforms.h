@@ -0,0 +1,211 @@
+/*
+the augmentations of grownet_models/src/datasets/transforms.rs over whole
+batches, a random crop from the image padded by zeros, a horizontal flip and
+a cutout, as tch::vision::dataset::augmentation does them, and a per channel
+normalization, fused into one pass that gathers each sample of a batch
+straight into a slot of data::Pipeline
+
+images are [height, width, channels] uint8 or float records, as of
+data/records.h, and come out float, a row of a sample is scaled and shifted
+with simd over width * channels lanes in one go, channels interleaved, the
+samples of a batch are split over a pool of the transform's own, so it runs
+on the loader thread of the pipeline next to the kernels and their pool
+
+the random draws of a sample only depend on the seed and its position in the
+epoch, so a batch comes out the same whatever the number of threads
+*/
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../utils/simd.h"
+#include "../utils/thread_pool.h"
+#include "pipeline.h"
+#include "records.h"
+
+namespace data {
+
+struct ImageShape {
+    int height;
+    int width;
+    int channels;
+
+    size_t row_size() const { return (size_t)width * channels; }
+    size_t size() const { return height * row_size(); }
+};
+
+struct Augment {
+    // zero padding on each side of the image before a random crop back to
+    // its size, no crop when 0
+    int crop = 0;
+    // flips horizontally with probability 1/2
+    bool flip = false;
+    // side of a square zeroed at a random center, clipped to the image
+    int cutout = 0;
+    // per channel, x is normalized to (x * input_scale - mean) / std, empty
+    // for no normalization
+    std::vector<float> mean;
+    std::vector<float> std;
+    // 1 / 255 maps uint8 images to [0, 1] first
+    float input_scale = 1;
+    uint64_t seed = 0;
+};
+
+namespace detail {
+    // splitmix64, a counter based generator, draw k of a sample is a pure
+    // function of its key and k
+    inline uint64_t mix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    // uniform in [0, n)
+    inline int draw(uint64_t key, int k, int n) {
+        return (int)((mix(key + (uint64_t)k * 0x632be59bd9b4e019ull) >> 33) % (uint64_t)n);
+    }
+
+    using Row = simd::Pack<float, simd::max_width<float>>;
+
+    template <typename S>
+    Row load_row(const S *p) {
+        return Row::load(p);
+    }
+
+    template <>
+    inline Row load_row<uint8_t>(const uint8_t *p) {
+#if defined(__AVX512F__)
+        // the masked convert, the plain one warns under gcc 12, see simd.h
+        const __m512i v = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+        return Row{_mm512_maskz_cvtepi32_ps(0xffff, v)};
+#elif defined(__AVX2__)
+        return Row{_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))))};
+#else
+        float v[Row::width];
+        for (int i = 0; i < Row::width; ++i)
+            v[i] = p[i];
+        return Row::load(v);
+#endif
+    }
+
+    // out = in * scale + shift over n lanes
+    template <typename S>
+    void affine_row(const S *in, const float *scale, const float *shift, float *out, size_t n) {
+        constexpr int W = Row::width;
+        size_t i = 0;
+        for (; i + W <= n; i += W)
+            fmadd(load_row(in + i), Row::load(scale + i), Row::load(shift + i)).store(out + i);
+        for (; i < n; ++i)
+            out[i] = (float)in[i] * scale[i] + shift[i];
+    }
+} // detail
+
+class BatchTransform {
+public:
+    // threads as for utils::ThreadPool, 1 runs on the loader thread alone,
+    // the default, as the kernels' pool already takes every core
+    BatchTransform(ImageShape shape, RecordType type, Augment aug, int threads = 1)
+        : shape(shape), type(type), aug(std::move(aug)), pool(threads == 1 ? nullptr : new utils::ThreadPool(threads)) {
+        const int c = shape.channels;
+        if (shape.height <= 0 || shape.width <= 0 || c <= 0)
+            throw std::invalid_argument("transform: empty image shape");
+        if (this->aug.crop < 0 || this->aug.cutout < 0)
+            throw std::invalid_argument("transform: negative crop or cutout");
+        const Augment &a = this->aug;
+        if (a.mean.size() != a.std.size() || (!a.mean.empty() && a.mean.size() != (size_t)c))
+            throw std::invalid_argument("transform: mean and std need one entry per channel, of " +
+                                        std::to_string(c));
+        scale.resize(shape.row_size());
+        shift.resize(shape.row_size());
+        for (size_t j = 0; j < scale.size(); ++j) {
+            const int k = (int)(j % c);
+            const float s = a.mean.empty() ? 1 : 1 / a.std[k];
+            scale[j] = a.input_scale * s;
+            shift[j] = a.mean.empty() ? 0 : -a.mean[k] * s;
+        }
+    }
+
+    const ImageShape &image() const { return shape; }
+    size_t out_bytes() const { return shape.size() * sizeof(float); }
+
+    // writes the augmented image at src into out, key picks its random draws
+    void sample(const void *src, float *out, uint64_t key) const {
+        switch (type) {
+        case RecordType::u8: return apply(static_cast<const uint8_t *>(src), out, key);
+        case RecordType::f32: return apply(static_cast<const float *>(src), out, key);
+        }
+    }
+
+    // as gather_rows, each row transformed into a float image, the samples of
+    // a batch split over the pool, samples are keyed on their position in
+    // order
+    fill_fn gather(const void *src, size_t src_stride, const int64_t *order, int64_t n, int64_t rows) const {
+        const char *base = static_cast<const char *>(src);
+        return [=, this](int64_t i, void *dst) {
+            const int64_t r0 = i * rows;
+            const int64_t r1 = r0 + rows < n ? r0 + rows : n;
+            float *out = static_cast<float *>(dst);
+            auto one = [&](int t) {
+                const int64_t r = r0 + t;
+                sample(base + order[r] * src_stride, out + t * shape.size(), detail::mix(aug.seed ^ (uint64_t)r));
+            };
+            if (pool)
+                pool->run((int)(r1 - r0), one);
+            else
+                for (int t = 0; t < (int)(r1 - r0); ++t)
+                    one(t);
+            return (size_t)(r1 - r0) * out_bytes();
+        };
+    }
+
+private:
+    template <typename S>
+    void apply(const S *src, float *out, uint64_t key) const {
+        const int H = shape.height, W = shape.width, C = shape.channels, p = aug.crop;
+        const size_t row = shape.row_size();
+        // the crop's top left corner in the padded image
+        const int dy = p ? detail::draw(key, 0, 2 * p + 1) : 0, dx = p ? detail::draw(key, 1, 2 * p + 1) : 0;
+        const int x0 = std::max(0, p - dx), x1 = std::min(W, W + p - dx);
+        const bool flip = aug.flip && detail::draw(key, 2, 2) == 1;
+        for (int y = 0; y < H; ++y) {
+            float *o = out + y * row;
+            const int sy = y + dy - p;
+            if (sy < 0 || sy >= H || x0 >= x1) {
+                std::fill(o, o + row, 0.0f);
+                continue;
+            }
+            std::fill(o, o + (size_t)x0 * C, 0.0f);
+            std::fill(o + (size_t)x1 * C, o + row, 0.0f);
+            detail::affine_row(src + sy * row + (size_t)(x0 + dx - p) * C, scale.data() + (size_t)x0 * C,
+                               shift.data() + (size_t)x0 * C, o + (size_t)x0 * C, (size_t)(x1 - x0) * C);
+            if (flip)
+                for (int a = 0, b = W - 1; a < b; ++a, --b)
+                    std::swap_ranges(o + (size_t)a * C, o + (size_t)(a + 1) * C, o + (size_t)b * C);
+        }
+        if (aug.cutout > 0) {
+            const int cy = detail::draw(key, 3, H), cx = detail::draw(key, 4, W), h = aug.cutout / 2;
+            const int y0 = std::max(0, cy - h), y1 = std::min(H, cy - h + aug.cutout);
+            const int c0 = std::max(0, cx - h), c1 = std::min(W, cx - h + aug.cutout);
+            for (int y = y0; y < y1; ++y)
+                std::fill(out + y * row + (size_t)c0 * C, out + y * row + (size_t)c1 * C, 0.0f);
+        }
+    }
+
+    const ImageShape shape;
+    const RecordType type;
+    const Augment aug;
+    // the row's scale and shift per lane, channels interleaved
+    std::vector<float> scale, shift;
+    // the loader thread's own, the kernels' pool is busy meanwhile
+    const std::unique_ptr<utils::ThreadPool> pool;
+};
+
+} // data
@@ -1,9 +1,1447 @@
+/*
+Python bindings for the grid kernels and optimizers, every entry point takes
+torch tensors, dispatches on (device, dtype[, dim]) through the tables in
+lib.cc and hands the kernel the tensors' own storage whenever it is already
+dense, releasing the GIL while the kernel runs
+*/
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <torch/csrc/distributed/c10d/ProcessGroup.hpp>
 #include <torch/python.h>
+#ifdef GROWNET_CUDA
+#include <c10/cuda/CUDAGuard.h>
+#include <c10/cuda/CUDAStream.h>
+#endif
+
+#include "lib.h"
+#include "data/pipeline.h"
+#include "data/records.h"
+#include "data/transforms.h"
+#include "optim/buckets.h"
+#include "optim/snapshot.h"
+#include "utils/arena.h"
+#include "utils/counters.h"
+#include "utils/thread_pool.h"
+#include "utils/torch_utils.h"
+
+namespace py = pybind11;
+
+namespace {
+
+// shared by every entry point, only read or replaced with the GIL held, each
+// call keeps its own reference while the GIL is dropped, so set_num_threads
+// never frees a pool a kernel still runs on
+std::shared_ptr<utils::ThreadPool> kernel_pool;
+
+std::shared_ptr<utils::ThreadPool> cpu_pool(const torch::Tensor &t) {
+    return t.is_cuda() ? nullptr : kernel_pool;
+}
+
+void *current_stream(const torch::Tensor &t) {
+#ifdef GROWNET_CUDA
+    if (t.is_cuda())
+        return c10::cuda::getCurrentCUDAStream(t.device().index()).stream();
+#endif
+    return nullptr;
+}
+
+void check_tensor(const torch::Tensor &t, const torch::Tensor &like, torch::ScalarType dtype, std::vector<int64_t> sizes,
+                  const char *name) {
+    TORCH_CHECK(t.sizes() == torch::IntArrayRef(sizes), name, " has shape ", t.sizes(), ", expected ", torch::IntArrayRef(sizes));
+    TORCH_CHECK(t.scalar_type() == dtype, name, " has dtype ", t.scalar_type(), ", expected ", dtype);
+    TORCH_CHECK(t.device() == like.device(), name, " is on ", t.device(), ", expected ", like.device());
+}
+
+void check_tensor(const torch::Tensor &t, const torch::Tensor &like, std::vector<int64_t> sizes, const char *name) {
+    check_tensor(t, like, like.scalar_type(), std::move(sizes), name);
+}
+
+// the 16 bit dtypes run the mixed precision kernels of grid/mixed.h, which
+// keep statistics and gradients in float
+bool is_mixed(const torch::Tensor &t) {
+    return t.scalar_type() == torch::kF16 || t.scalar_type() == torch::kBFloat16;
+}
+
+torch::ScalarType accumulate_type(const torch::Tensor &t) {
+    return is_mixed(t) ? torch::kF32 : t.scalar_type();
+}
+
+// arena over a byte tensor on w's device, kept alive by storage for the call
+utils::Arena scratch_arena(const torch::Tensor &w, size_t bytes, torch::Tensor &storage) {
+    storage = torch::empty({(int64_t)bytes}, w.options().dtype(torch::kUInt8));
+    return utils::Arena(storage.data_ptr(), bytes);
+}
+
+// inputs already dense in row major order are passed as is, anything else
+// is copied once into keep, which outlives the kernel call
+const void *input_ptr(const torch::Tensor &t, std::vector<torch::Tensor> &keep) {
+    if (t.is_contiguous())
+        return t.data_ptr();
+    keep.push_back(t.contiguous());
+    return keep.back().data_ptr();
+}
+
+// outputs are written in place, so they have to be dense already
+void *output_ptr(const torch::Tensor &t, const char *name) {
+    TORCH_CHECK(t.is_contiguous(), name, " must be contiguous, it is written in place");
+    return t.data_ptr();
+}
+
+// t as is if each of its rows is dense, such as the record views of
+// load_records, which are gathered in place, a dense copy otherwise
+torch::Tensor dense_rows(const torch::Tensor &t) {
+    if (t.dim() == 0 || t.size(0) == 0 || t.is_contiguous())
+        return t.contiguous();
+    const bool rows = t[0].is_contiguous() && t.stride(0) >= t[0].numel();
+    return rows ? t : t.contiguous();
+}
+
+// dims without a specialization run the table's runtime dim kernel if it has
+// one, the miss is counted in fn_builder::misses either way
+template <typename Table>
+typename Table::fn_type lookup(const Table &table, torch::DeviceType dev, torch::ScalarType dtype, int dim,
+                               const char *name) {
+    TORCH_CHECK(dim > 1, name, " needs a dim of at least 2, got ", dim);
+    auto fn = fn_builder::find_or_fallback(
+        table, type_repr::construct_runtime_id(0, dev, dtype, dim),
+        type_repr::construct_runtime_id(0, dev, dtype, grid::any_dim), [&] {
+            return std::string(name) + " " + type_repr::get_runtime_device_code(dev) + " " +
+                   type_repr::get_runtime_type_code(dtype) + " dim " + std::to_string(dim);
+        });
+    TORCH_CHECK(fn != nullptr, "no ", name, " kernel for ", dev, " ", dtype, " dim ", dim);
+    return fn;
+}
+
+template <typename Table>
+typename Table::fn_type lookup(const Table &table, const torch::Tensor &w, int dim, const char *name) {
+    return lookup(table, w.device().type(), w.scalar_type(), dim, name);
+}
+
+// for kernels keyed on (device, dtype) only
+template <typename Table>
+typename Table::fn_type lookup_dtype(const Table &table, const torch::Tensor &t, const char *name) {
+    auto fn = table.find(type_repr::construct_runtime_id(0, t.device().type(), t.scalar_type()));
+    TORCH_CHECK(fn != nullptr, "no ", name, " kernel for ", t.device().type(), " ", t.scalar_type());
+    return fn;
+}
+
+// what an entry point's kernel and scratch depend on, the sizes of every
+// argument follow from the shape once they are checked against it, strides
+// are left out since they only decide whether an input is copied
+struct CallKey {
+    torch::DeviceType device;
+    int8_t index;
+    torch::ScalarType dtype;
+    grid::Shape shape;
+    // anything else the plan is derived from, such as a checkpoint stride
+    int64_t extra;
+
+    bool operator==(const CallKey &o) const {
+        return device == o.device && index == o.index && dtype == o.dtype && shape.dim == o.shape.dim &&
+               shape.D == o.shape.D && shape.L == o.shape.L && shape.batch == o.shape.batch && extra == o.extra;
+    }
+};
+
+CallKey call_key(const torch::Tensor &w, const grid::Shape &sh, int64_t extra = 0) {
+    return CallKey{w.device().type(), (int8_t)w.device().index(), w.scalar_type(), sh, extra};
+}
+
+// a resolved call, the kernel and the arena bytes it needs
+template <typename Fn>
+struct Plan {
+    Fn fn = nullptr;
+    size_t scratch = 0;
+    // the checkpoint stride, once derived from the memory budget
+    int stride = 0;
+};
+
+// one per entry point, so a training loop repeating its shapes resolves each
+// once, the GIL is held whenever a site is used, which keeps it consistent,
+// plans are copied out since the GIL is dropped while the kernel runs
+template <typename Fn>
+using CallSite = fn_builder::CallCache<CallKey, Plan<Fn>>;
+
+grid::Shape grid_shape(const torch::Tensor &w, const torch::Tensor &x) {
+    TORCH_CHECK(w.dim() == 4, "w must be [L, D, dim, dim]");
+    TORCH_CHECK(x.dim() == 3, "x must be [D, batch, dim]");
+    return grid::Shape{(int)w.size(3), (int)w.size(1), (int)w.size(0), (int)x.size(1)};
+}
+
+// returns the grid output followed by the h, y and sd buffers backward needs,
+// sd is float for the 16 bit dtypes
+std::vector<torch::Tensor> forward(const torch::Tensor &w, const torch::Tensor &b, const torch::Tensor &x) {
+    const grid::Shape sh = grid_shape(w, x);
+    check_tensor(w, w, {sh.L, sh.D, sh.dim, sh.dim}, "w");
+    check_tensor(b, w, {sh.L, sh.D, sh.dim}, "b");
+    check_tensor(x, w, {sh.D, sh.batch, sh.dim}, "x");
+    static CallSite<grid::forward_fn> site;
+    const auto p = site.get(call_key(w, sh), [&] {
+        return Plan<grid::forward_fn>{lookup(grid::forward_table(), w, sh.dim, "forward"),
+                                      is_mixed(w) ? grid::mixed_scratch_bytes(sh) : 0};
+    });
+
+    const auto opt = utils::like_tensor(w);
+    auto h  = torch::empty({sh.L, sh.D + 2 * grid::pad, sh.batch, sh.dim}, opt);
+    auto y  = torch::empty({sh.L, sh.D, sh.batch, sh.dim}, opt);
+    auto sd = torch::empty({sh.L, sh.D, sh.batch}, opt.dtype(accumulate_type(w)));
+    torch::Tensor storage;
+    utils::Arena arena = scratch_arena(w, p.scratch, storage);
+
+    std::vector<torch::Tensor> keep;
+    grid::ForwardArgs a{input_ptr(w, keep), input_ptr(b, keep), input_ptr(x, keep),
+                        h.data_ptr(), y.data_ptr(), sd.data_ptr(), sh};
+    a.stream = current_stream(w);
+    const auto pool = cpu_pool(w);
+    a.pool = pool.get();
+    a.arena = &arena;
+    {
+        py::gil_scoped_release release;
+        p.fn(a);
+    }
+    return {y[sh.L - 1], h, y, sd};
+}
+
+// the argument checks and kernel of backward_with, which DataParallel runs
+// before it queues any bucket of the pass
+Plan<grid::backward_fn> backward_plan(const torch::Tensor &w, const torch::Tensor &x, const torch::Tensor &h,
+                                      const torch::Tensor &y, const torch::Tensor &sd, const torch::Tensor &grad,
+                                      const torch::Tensor &dw, const torch::Tensor &db) {
+    const grid::Shape sh = grid_shape(w, x);
+    const auto acc = accumulate_type(w);
+    check_tensor(w, w, {sh.L, sh.D, sh.dim, sh.dim}, "w");
+    check_tensor(x, w, {sh.D, sh.batch, sh.dim}, "x");
+    check_tensor(h, w, {sh.L, sh.D + 2 * grid::pad, sh.batch, sh.dim}, "h");
+    check_tensor(y, w, {sh.L, sh.D, sh.batch, sh.dim}, "y");
+    check_tensor(sd, w, acc, {sh.L, sh.D, sh.batch}, "sd");
+    check_tensor(grad, w, {sh.D, sh.batch, sh.dim}, "grad");
+    check_tensor(dw, w, acc, {sh.L, sh.D, sh.dim, sh.dim}, "dw");
+    check_tensor(db, w, acc, {sh.L, sh.D, sh.dim}, "db");
+    static CallSite<grid::backward_fn> site;
+    return site.get(call_key(w, sh), [&] {
+        return Plan<grid::backward_fn>{lookup(grid::backward_table(), w, sh.dim, "backward"),
+                                       is_mixed(w) ? grid::mixed_scratch_bytes(sh) : 0};
+    });
+}
+
+// accumulates into dw and db, which are float for the 16 bit dtypes like
+// sd, returns dL/dx, column_done is called with each column once its dw and
+// db are done
+torch::Tensor backward_with(const torch::Tensor &w, const torch::Tensor &x, const torch::Tensor &h,
+                            const torch::Tensor &y, const torch::Tensor &sd, const torch::Tensor &grad,
+                            torch::Tensor dw, torch::Tensor db, grid::ColumnHook column_done) {
+    const grid::Shape sh = grid_shape(w, x);
+    const auto p = backward_plan(w, x, h, y, sd, grad, dw, db);
+
+    const auto opt = utils::like_tensor(w);
+    auto dx = torch::empty({sh.D, sh.batch, sh.dim}, opt);
+    // the mixed precision kernels keep their float dz in the arena instead
+    auto dz = torch::empty({is_mixed(w) ? 0 : sh.D + 2 * grid::pad, sh.batch, sh.dim}, opt);
+    torch::Tensor storage;
+    utils::Arena arena = scratch_arena(w, p.scratch, storage);
+
+    std::vector<torch::Tensor> keep;
+    grid::BackwardArgs a{input_ptr(w, keep), input_ptr(x, keep), input_ptr(h, keep), input_ptr(y, keep),
+                         input_ptr(sd, keep), input_ptr(grad, keep), dx.data_ptr(),
+                         output_ptr(dw, "dw"), output_ptr(db, "db"), dz.data_ptr(), sh};
+    a.stream = current_stream(w);
+    a.arena = &arena;
+    const auto pool = cpu_pool(w);
+    a.pool = pool.get();
+    a.column_done = column_done;
+    {
+        py::gil_scoped_release release;
+        p.fn(a);
+    }
+    return dx;
+}
+
+torch::Tensor backward(const torch::Tensor &w, const torch::Tensor &x, const torch::Tensor &h, const torch::Tensor &y,
+                       const torch::Tensor &sd, const torch::Tensor &grad, torch::Tensor dw, torch::Tensor db) {
+    return backward_with(w, x, h, y, sd, grad, std::move(dw), std::move(db), {});
+}
+
+// the adjacency of grid/sparse.h from the in-edges of every sum, as int32
+// tensors in_ptr [L * D + 1] and in_idx [edges]
+grid::Graph sparse_graph(const grid::Shape &sh, const torch::Tensor &in_ptr, const torch::Tensor &in_idx) {
+    TORCH_CHECK(in_ptr.dim() == 1 && in_ptr.size(0) == (int64_t)sh.L * sh.D + 1, "in_ptr must be [L * D + 1]");
+    const auto ptr = in_ptr.to(torch::kCPU, torch::kInt).contiguous();
+    const auto idx = in_idx.to(torch::kCPU, torch::kInt).contiguous();
+    TORCH_CHECK(idx.dim() == 1 && idx.size(0) == ptr[-1].item<int>(), "in_idx must hold in_ptr[-1] edges");
+    // malformed edges throw std::invalid_argument, a ValueError in python
+    return grid::Graph::from_csr(sh, ptr.data_ptr<int>(), idx.data_ptr<int>());
+}
+
+// as forward, over the given adjacency, only live cells of h are written
+std::vector<torch::Tensor> sparse_forward(const torch::Tensor &w, const torch::Tensor &b, const torch::Tensor &x,
+                                          const torch::Tensor &in_ptr, const torch::Tensor &in_idx) {
+    const grid::Shape sh = grid_shape(w, x);
+    check_tensor(w, w, {sh.L, sh.D, sh.dim, sh.dim}, "w");
+    check_tensor(b, w, {sh.L, sh.D, sh.dim}, "b");
+    check_tensor(x, w, {sh.D, sh.batch, sh.dim}, "x");
+    static CallSite<grid::sparse_forward_fn> site;
+    const auto fn = site.get(call_key(w, sh), [&] {
+        return Plan<grid::sparse_forward_fn>{lookup(grid::sparse_forward_table(), w, sh.dim, "sparse forward")};
+    }).fn;
+    const grid::Graph graph = sparse_graph(sh, in_ptr, in_idx);
+
+    const auto opt = utils::like_tensor(w);
+    auto h  = torch::zeros({sh.L, sh.D, sh.batch, sh.dim}, opt);
+    auto y  = torch::empty({sh.L, sh.D, sh.batch, sh.dim}, opt);
+    auto sd = torch::empty({sh.L, sh.D, sh.batch}, opt);
+
+    std::vector<torch::Tensor> keep;
+    grid::SparseForwardArgs a{input_ptr(w, keep), input_ptr(b, keep), input_ptr(x, keep),
+                              h.data_ptr(), y.data_ptr(), sd.data_ptr(), graph.view(), sh};
+    const auto pool = cpu_pool(w);
+    a.pool = pool.get();
+    {
+        py::gil_scoped_release release;
+        fn(a);
+    }
+    return {y[sh.L - 1], h, y, sd};
+}
+
+// as backward, over the same adjacency the forward pass used
+torch::Tensor sparse_backward(const torch::Tensor &w, const torch::Tensor &x, const torch::Tensor &h,
+                              const torch::Tensor &y, const torch::Tensor &sd, const torch::Tensor &grad,
+                              torch::Tensor dw, torch::Tensor db,
+                              const torch::Tensor &in_ptr, const torch::Tensor &in_idx) {
+    const grid::Shape sh = grid_shape(w, x);
+    check_tensor(w, w, {sh.L, sh.D, sh.dim, sh.dim}, "w");
+    check_tensor(x, w, {sh.D, sh.batch, sh.dim}, "x");
+    check_tensor(h, w, {sh.L, sh.D, sh.batch, sh.dim}, "h");
+    check_tensor(y, w, {sh.L, sh.D, sh.batch, sh.dim}, "y");
+    check_tensor(sd, w, {sh.L, sh.D, sh.batch}, "sd");
+    check_tensor(grad, w, {sh.D, sh.batch, sh.dim}, "grad");
+    check_tensor(dw, w, {sh.L, sh.D, sh.dim, sh.dim}, "dw");
+    check_tensor(db, w, {sh.L, sh.D, sh.dim}, "db");
+    static CallSite<grid::sparse_backward_fn> site;
+    const auto fn = site.get(call_key(w, sh), [&] {
+        return Plan<grid::sparse_backward_fn>{lookup(grid::sparse_backward_table(), w, sh.dim, "sparse backward")};
+    }).fn;
+    const grid::Graph graph = sparse_graph(sh, in_ptr, in_idx);
+
+    const auto opt = utils::like_tensor(w);
+    auto dx = torch::empty({sh.D, sh.batch, sh.dim}, opt);
+    auto dz = torch::empty({sh.D, sh.batch, sh.dim}, opt);
+
+    std::vector<torch::Tensor> keep;
+    grid::SparseBackwardArgs a{input_ptr(w, keep), input_ptr(x, keep), input_ptr(h, keep), input_ptr(y, keep),
+                               input_ptr(sd, keep), input_ptr(grad, keep), dx.data_ptr(),
+                               output_ptr(dw, "dw"), output_ptr(db, "db"), dz.data_ptr(), graph.view(), sh};
+    const auto pool = cpu_pool(w);
+    a.pool = pool.get();
+    {
+        py::gil_scoped_release release;
+        fn(a);
+    }
+    return dx;
+}
+
+grid::Shape reversible_shape(const torch::Tensor &w, const torch::Tensor &x) {
+    TORCH_CHECK(w.dim() == 5 && w.size(1) == 2, "w must be [L, 2, D, dim / 2, dim / 2]");
+    TORCH_CHECK(x.dim() == 4 && x.size(0) == 2, "x must be [2, D, batch, dim / 2]");
+    return grid::Shape{(int)w.size(4) * 2, (int)w.size(2), (int)w.size(0), (int)x.size(2)};
+}
+
+// only the output is returned, backward rebuilds everything else from it
+torch::Tensor reversible_forward(const torch::Tensor &w, const torch::Tensor &b, const torch::Tensor &x) {
+    const grid::Shape sh = reversible_shape(w, x);
+    const int half = sh.dim / 2;
+    check_tensor(w, w, {sh.L, 2, sh.D, half, half}, "w");
+    check_tensor(b, w, {sh.L, 2, sh.D, half}, "b");
+    check_tensor(x, w, {2, sh.D, sh.batch, half}, "x");
+    static CallSite<grid::reversible_forward_fn> site;
+    const auto p = site.get(call_key(w, sh), [&] {
+        return Plan<grid::reversible_forward_fn>{
+            lookup(grid::reversible_forward_table(), w, sh.dim, "reversible forward"),
+            grid::reversible_scratch_bytes(sh, w.element_size())};
+    });
+
+    auto y = torch::empty_like(x, torch::MemoryFormat::Contiguous);
+    torch::Tensor storage;
+    utils::Arena arena = scratch_arena(w, p.scratch, storage);
+    std::vector<torch::Tensor> keep;
+    grid::ReversibleForwardArgs a{input_ptr(w, keep), input_ptr(b, keep), input_ptr(x, keep), y.data_ptr(), sh};
+    a.stream = current_stream(w);
+    const auto pool = cpu_pool(w);
+    a.pool = pool.get();
+    a.arena = &arena;
+    {
+        py::gil_scoped_release release;
+        p.fn(a);
+    }
+    return y;
+}
+
+// accumulates into dw and db, returns dL/dx
+torch::Tensor reversible_backward(const torch::Tensor &w, const torch::Tensor &b, const torch::Tensor &y,
+                                  const torch::Tensor &grad, torch::Tensor dw, torch::Tensor db) {
+    const grid::Shape sh = reversible_shape(w, y);
+    const int half = sh.dim / 2;
+    check_tensor(w, w, {sh.L, 2, sh.D, half, half}, "w");
+    check_tensor(b, w, {sh.L, 2, sh.D, half}, "b");
+    check_tensor(y, w, {2, sh.D, sh.batch, half}, "y");
+    check_tensor(grad, w, {2, sh.D, sh.batch, half}, "grad");
+    check_tensor(dw, w, {sh.L, 2, sh.D, half, half}, "dw");
+    check_tensor(db, w, {sh.L, 2, sh.D, half}, "db");
+    static CallSite<grid::reversible_backward_fn> site;
+    const auto p = site.get(call_key(w, sh), [&] {
+        return Plan<grid::reversible_backward_fn>{
+            lookup(grid::reversible_backward_table(), w, sh.dim, "reversible backward"),
+            grid::reversible_scratch_bytes(sh, w.element_size())};
+    });
+
+    auto dx = torch::empty({2, sh.D, sh.batch, half}, utils::like_tensor(w));
+    torch::Tensor storage;
+    utils::Arena arena = scratch_arena(w, p.scratch, storage);
+    std::vector<torch::Tensor> keep;
+    grid::ReversibleBackwardArgs a{input_ptr(w, keep), input_ptr(b, keep), input_ptr(y, keep), input_ptr(grad, keep),
+                                   dx.data_ptr(), output_ptr(dw, "dw"), output_ptr(db, "db"), sh};
+    a.stream = current_stream(w);
+    const auto pool = cpu_pool(w);
+    a.pool = pool.get();
+    a.arena = &arena;
+    {
+        py::gil_scoped_release release;
+        p.fn(a);
+    }
+    return dx;
+}
+
+// as forward, with every cell's input scaled by the WeightedSigmoid of its
+// magnitude, gate [L, D, 2] holding {s, b} per cell, samples below the
+// underflow cutoff get h = 0, returns (out, h, y, sd, mag)
+std::vector<torch::Tensor> gated_forward(const torch::Tensor &w, const torch::Tensor &b, const torch::Tensor &x,
+                                         const torch::Tensor &gate, double eps) {
+    const grid::Shape sh = grid_shape(w, x);
+    check_tensor(w, w, {sh.L, sh.D, sh.dim, sh.dim}, "w");
+    check_tensor(b, w, {sh.L, sh.D, sh.dim}, "b");
+    check_tensor(x, w, {sh.D, sh.batch, sh.dim}, "x");
+    check_tensor(gate, w, {sh.L, sh.D, 2}, "gate");
+    static CallSite<grid::gated_forward_fn> site;
+    const auto p = site.get(call_key(w, sh), [&] {
+        return Plan<grid::gated_forward_fn>{lookup(grid::gated_forward_table(), w, sh.dim, "gated forward"),
+                                            grid::gated_scratch_bytes(sh, w.element_size())};
+    });
+
+    const auto opt = utils::like_tensor(w);
+    auto h   = torch::empty({sh.L, sh.D + 2 * grid::pad, sh.batch, sh.dim}, opt);
+    auto y   = torch::empty({sh.L, sh.D, sh.batch, sh.dim}, opt);
+    auto sd  = torch::empty({sh.L, sh.D, sh.batch}, opt);
+    auto mag = torch::empty({sh.L, sh.D, sh.batch}, opt);
+    torch::Tensor storage;
+    utils::Arena arena = scratch_arena(w, p.scratch, storage);
+
+    std::vector<torch::Tensor> keep;
+    grid::GatedForwardArgs a{{input_ptr(w, keep), input_ptr(b, keep), input_ptr(x, keep),
+                              h.data_ptr(), y.data_ptr(), sd.data_ptr(), sh},
+                             input_ptr(gate, keep), mag.data_ptr(), eps};
+    const auto pool = cpu_pool(w);
+    a.grid.pool = pool.get();
+    a.grid.arena = &arena;
+    {
+        py::gil_scoped_release release;
+        p.fn(a);
+    }
+    return {y[sh.L - 1], h, y, sd, mag};
+}
+
+// as backward, with the gate and magnitudes gated_forward used, accumulates
+// into dw, db and dgate, returns dL/dx
+torch::Tensor gated_backward(const torch::Tensor &w, const torch::Tensor &x, const torch::Tensor &h,
+                             const torch::Tensor &y, const torch::Tensor &sd, const torch::Tensor &mag,
+                             const torch::Tensor &gate, const torch::Tensor &grad, torch::Tensor dw, torch::Tensor db,
+                             torch::Tensor dgate, double eps) {
+    const grid::Shape sh = grid_shape(w, x);
+    check_tensor(w, w, {sh.L, sh.D, sh.dim, sh.dim}, "w");
+    check_tensor(x, w, {sh.D, sh.batch, sh.dim}, "x");
+    check_tensor(h, w, {sh.L, sh.D + 2 * grid::pad, sh.batch, sh.dim}, "h");
+    check_tensor(y, w, {sh.L, sh.D, sh.batch, sh.dim}, "y");
+    check_tensor(sd, w, {sh.L, sh.D, sh.batch}, "sd");
+    check_tensor(mag, w, {sh.L, sh.D, sh.batch}, "mag");
+    check_tensor(gate, w, {sh.L, sh.D, 2}, "gate");
+    check_tensor(grad, w, {sh.D, sh.batch, sh.dim}, "grad");
+    check_tensor(dw, w, {sh.L, sh.D, sh.dim, sh.dim}, "dw");
+    check_tensor(db, w, {sh.L, sh.D, sh.dim}, "db");
+    check_tensor(dgate, w, {sh.L, sh.D, 2}, "dgate");
+    static CallSite<grid::gated_backward_fn> site;
+    const auto p = site.get(call_key(w, sh), [&] {
+        return Plan<grid::gated_backward_fn>{lookup(grid::gated_backward_table(), w, sh.dim, "gated backward"),
+                                             grid::gated_scratch_bytes(sh, w.element_size())};
+    });
+
+    auto dx = torch::empty({sh.D, sh.batch, sh.dim}, utils::like_tensor(w));
+    torch::Tensor storage;
+    utils::Arena arena = scratch_arena(w, p.scratch, storage);
+
+    std::vector<torch::Tensor> keep;
+    grid::GatedBackwardArgs a{{input_ptr(w, keep), input_ptr(x, keep), input_ptr(h, keep), input_ptr(y, keep),
+                               input_ptr(sd, keep), input_ptr(grad, keep), dx.data_ptr(),
+                               output_ptr(dw, "dw"), output_ptr(db, "db"), nullptr, sh},
+                              input_ptr(gate, keep), input_ptr(mag, keep), output_ptr(dgate, "dgate"), eps};
+    const auto pool = cpu_pool(w);
+    a.grid.pool = pool.get();
+    a.grid.arena = &arena;
+    {
+        py::gil_scoped_release release;
+        p.fn(a);
+    }
+    return dx;
+}
+
+// the column inputs kept every stride columns and the output, stride 0 derives
+// it from memory_budget, returns (out, checkpoints, stride)
+std::tuple<torch::Tensor, torch::Tensor, int> checkpoint_forward(const torch::Tensor &w, const torch::Tensor &b,
+                                                                 const torch::Tensor &x, int stride,
+                                                                 int64_t memory_budget) {
+    const grid::Shape sh = grid_shape(w, x);
+    check_tensor(w, w, {sh.L, sh.D, sh.dim, sh.dim}, "w");
+    check_tensor(b, w, {sh.L, sh.D, sh.dim}, "b");
+    check_tensor(x, w, {sh.D, sh.batch, sh.dim}, "x");
+    TORCH_CHECK(stride >= 0 && memory_budget >= 0, "stride and memory_budget must be non-negative, got ", stride,
+                " and ", memory_budget);
+    // keyed on the stride asked for, negated, or on the budget it is derived
+    // from, which the check above keeps apart
+    static CallSite<grid::checkpoint_forward_fn> site;
+    const auto p = site.get(call_key(w, sh, stride > 0 ? -(int64_t)stride : memory_budget), [&] {
+        const size_t elem = w.element_size();
+        const int s = stride > 0 ? std::min(stride, sh.L) : grid::checkpoint_stride(sh, elem, (size_t)memory_budget);
+        return Plan<grid::checkpoint_forward_fn>{
+            lookup(grid::checkpoint_forward_table(), w, sh.dim, "checkpoint forward"),
+            grid::checkpoint_scratch_bytes(sh, s, elem), s};
+    });
+
+    stride = p.stride;
+    const auto opt = utils::like_tensor(w);
+    auto out = torch::empty({sh.D, sh.batch, sh.dim}, opt);
+    auto ckpt = torch::empty({grid::checkpoint_segments(sh, stride) - 1, sh.D, sh.batch, sh.dim}, opt);
+    torch::Tensor storage;
+    utils::Arena arena = scratch_arena(w, p.scratch, storage);
+    std::vector<torch::Tensor> keep;
+    grid::CheckpointForwardArgs a{input_ptr(w, keep), input_ptr(b, keep), input_ptr(x, keep), ckpt.data_ptr(),
+                                  out.data_ptr(), sh, stride};
+    a.stream = current_stream(w);
+    const auto pool = cpu_pool(w);
+    a.pool = pool.get();
+    a.arena = &arena;
+    {
+        py::gil_scoped_release release;
+        p.fn(a);
+    }
+    return {out, ckpt, stride};
+}
+
+// recomputes each segment from its checkpoint, accumulates into dw and db,
+// returns dL/dx
+torch::Tensor checkpoint_backward(const torch::Tensor &w, const torch::Tensor &b, const torch::Tensor &x,
+                                  const torch::Tensor &ckpt, const torch::Tensor &grad, torch::Tensor dw,
+                                  torch::Tensor db, int stride) {
+    const grid::Shape sh = grid_shape(w, x);
+    TORCH_CHECK(stride > 0, "stride must be the one checkpoint_forward returned");
+    stride = std::min(stride, sh.L);
+    check_tensor(w, w, {sh.L, sh.D, sh.dim, sh.dim}, "w");
+    check_tensor(b, w, {sh.L, sh.D, sh.dim}, "b");
+    check_tensor(x, w, {sh.D, sh.batch, sh.dim}, "x");
+    check_tensor(ckpt, w, {grid::checkpoint_segments(sh, stride) - 1, sh.D, sh.batch, sh.dim}, "ckpt");
+    check_tensor(grad, w, {sh.D, sh.batch, sh.dim}, "grad");
+    check_tensor(dw, w, {sh.L, sh.D, sh.dim, sh.dim}, "dw");
+    check_tensor(db, w, {sh.L, sh.D, sh.dim}, "db");
+    static CallSite<grid::checkpoint_backward_fn> site;
+    const auto p = site.get(call_key(w, sh, stride), [&] {
+        return Plan<grid::checkpoint_backward_fn>{
+            lookup(grid::checkpoint_backward_table(), w, sh.dim, "checkpoint backward"),
+            grid::checkpoint_scratch_bytes(sh, stride, w.element_size()), stride};
+    });
+
+    auto dx = torch::empty({sh.D, sh.batch, sh.dim}, utils::like_tensor(w));
+    torch::Tensor storage;
+    utils::Arena arena = scratch_arena(w, p.scratch, storage);
+    std::vector<torch::Tensor> keep;
+    grid::CheckpointBackwardArgs a{input_ptr(w, keep), input_ptr(b, keep), input_ptr(x, keep), input_ptr(ckpt, keep),
+                                   input_ptr(grad, keep), dx.data_ptr(), output_ptr(dw, "dw"), output_ptr(db, "db"),
+                                   sh, stride};
+    a.stream = current_stream(w);
+    const auto pool = cpu_pool(w);
+    a.pool = pool.get();
+    a.arena = &arena;
+    {
+        py::gil_scoped_release release;
+        p.fn(a);
+    }
+    return dx;
+}
+
+// the cuda devices of the slabs of a partitioned grid, in the order of the
+// slabs' cells, slabs may share a device, their halos being copied within it
+std::vector<int> slab_devices(const std::vector<torch::Tensor> &w) {
+    TORCH_CHECK(!w.empty(), "a partitioned grid needs at least one slab");
+    std::vector<int> devices;
+    for (const auto &t : w) {
+        TORCH_CHECK(t.is_cuda(), "every slab has to be on a cuda device, one is on ", t.device());
+        devices.push_back(t.device().index());
+    }
+    return devices;
+}
+
+// checks slab s against the first one, which every slab shares dim, L and
+// batch with
+grid::Shape slab_shape(const std::vector<torch::Tensor> &w, const std::vector<torch::Tensor> &x, size_t s) {
+    TORCH_CHECK(x.size() == w.size(), "expected ", w.size(), " slabs of x, got ", x.size());
+    const grid::Shape sh = grid_shape(w[s], x[s]);
+    const grid::Shape first = grid_shape(w[0], x[0]);
+    TORCH_CHECK(sh.dim == first.dim && sh.L == first.L && sh.batch == first.batch,
+                "slab ", s, " differs from the first in dim, L or batch");
+    TORCH_CHECK(w[s].scalar_type() == w[0].scalar_type(), "slab ", s, " has dtype ", w[s].scalar_type());
+    return sh;
+}
+
+// the grid split along D over devices, slab s holding w[s] [L, D_s, dim, dim],
+// b[s] and x[s] [D_s, batch, dim] for consecutive cells, returns per slab the
+// output followed by the h, y and sd of its cells
+std::vector<std::vector<torch::Tensor>> partitioned_forward(const std::vector<torch::Tensor> &w,
+                                                            const std::vector<torch::Tensor> &b,
+                                                            const std::vector<torch::Tensor> &x) {
+    const std::vector<int> devices = slab_devices(w);
+    TORCH_CHECK(b.size() == w.size(), "expected ", w.size(), " slabs of b, got ", b.size());
+    int total = 0;
+    std::vector<grid::Shape> shapes;
+    for (size_t s = 0; s < w.size(); ++s) {
+        const grid::Shape sh = slab_shape(w, x, s);
+        check_tensor(w[s], w[s], {sh.L, sh.D, sh.dim, sh.dim}, "w");
+        check_tensor(b[s], w[s], {sh.L, sh.D, sh.dim}, "b");
+        check_tensor(x[s], w[s], {sh.D, sh.batch, sh.dim}, "x");
+        shapes.push_back(sh);
+        total += sh.D;
+    }
+    const grid::Shape whole{shapes[0].dim, total, shapes[0].L, shapes[0].batch};
+    static CallSite<grid::partitioned_forward_fn> site;
+    const auto fn = site.get(call_key(w[0], whole, (int64_t)w.size()), [&] {
+        return Plan<grid::partitioned_forward_fn>{
+            lookup(grid::partitioned_forward_table(), w[0], whole.dim, "partitioned forward")};
+    }).fn;
+
+    std::vector<std::vector<torch::Tensor>> out;
+    std::vector<grid::ForwardArgs> slabs;
+    std::vector<torch::Tensor> keep;
+    for (size_t s = 0; s < w.size(); ++s) {
+        const grid::Shape &sh = shapes[s];
+        const auto opt = utils::like_tensor(w[s]);
+        auto h  = torch::empty({sh.L, sh.D + 2 * grid::pad, sh.batch, sh.dim}, opt);
+        auto y  = torch::empty({sh.L, sh.D, sh.batch, sh.dim}, opt);
+        auto sd = torch::empty({sh.L, sh.D, sh.batch}, opt);
+        grid::ForwardArgs a{input_ptr(w[s], keep), input_ptr(b[s], keep), input_ptr(x[s], keep),
+                            h.data_ptr(), y.data_ptr(), sd.data_ptr(), sh};
+        a.stream = current_stream(w[s]);
+        slabs.push_back(a);
+        out.push_back({y[sh.L - 1], h, y, sd});
+    }
+    grid::PartitionedForwardArgs a{slabs.data(), devices.data(), (int)slabs.size()};
+    {
+        py::gil_scoped_release release;
+        fn(a);
+    }
+    return out;
+}
+
+// per slab, accumulates into dw[s] and db[s] and returns dx of its cells
+std::vector<torch::Tensor> partitioned_backward(const std::vector<torch::Tensor> &w,
+                                                const std::vector<torch::Tensor> &x,
+                                                const std::vector<torch::Tensor> &h,
+                                                const std::vector<torch::Tensor> &y,
+                                                const std::vector<torch::Tensor> &sd,
+                                                const std::vector<torch::Tensor> &grad, std::vector<torch::Tensor> dw,
+                                                std::vector<torch::Tensor> db) {
+    const std::vector<int> devices = slab_devices(w);
+    for (const std::vector<torch::Tensor> *v : {&h, &y, &sd, &grad, &dw, &db})
+        TORCH_CHECK(v->size() == w.size(), "expected ", w.size(), " slabs of every argument, got ", v->size());
+    int total = 0;
+    std::vector<grid::Shape> shapes;
+    for (size_t s = 0; s < w.size(); ++s) {
+        const grid::Shape sh = slab_shape(w, x, s);
+        check_tensor(w[s], w[s], {sh.L, sh.D, sh.dim, sh.dim}, "w");
+        check_tensor(x[s], w[s], {sh.D, sh.batch, sh.dim}, "x");
+        check_tensor(h[s], w[s], {sh.L, sh.D + 2 * grid::pad, sh.batch, sh.dim}, "h");
+        check_tensor(y[s], w[s], {sh.L, sh.D, sh.batch, sh.dim}, "y");
+        check_tensor(sd[s], w[s], {sh.L, sh.D, sh.batch}, "sd");
+        check_tensor(grad[s], w[s], {sh.D, sh.batch, sh.dim}, "grad");
+        check_tensor(dw[s], w[s], {sh.L, sh.D, sh.dim, sh.dim}, "dw");
+        check_tensor(db[s], w[s], {sh.L, sh.D, sh.dim}, "db");
+        shapes.push_back(sh);
+        total += sh.D;
+    }
+    const grid::Shape whole{shapes[0].dim, total, shapes[0].L, shapes[0].batch};
+    static CallSite<grid::partitioned_backward_fn> site;
+    const auto fn = site.get(call_key(w[0], whole, (int64_t)w.size()), [&] {
+        return Plan<grid::partitioned_backward_fn>{
+            lookup(grid::partitioned_backward_table(), w[0], whole.dim, "partitioned backward")};
+    }).fn;
+
+    std::vector<torch::Tensor> dx, scratch, keep;
+    std::vector<grid::BackwardArgs> slabs;
+    for (size_t s = 0; s < w.size(); ++s) {
+        const grid::Shape &sh = shapes[s];
+        const auto opt = utils::like_tensor(w[s]);
+        dx.push_back(torch::empty({sh.D, sh.batch, sh.dim}, opt));
+        scratch.push_back(torch::empty({(int64_t)grid::partitioned_scratch(sh)}, opt));
+        grid::BackwardArgs a{input_ptr(w[s], keep), input_ptr(x[s], keep), input_ptr(h[s], keep),
+                             input_ptr(y[s], keep), input_ptr(sd[s], keep), input_ptr(grad[s], keep),
+                             dx.back().data_ptr(), output_ptr(dw[s], "dw"), output_ptr(db[s], "db"),
+                             scratch.back().data_ptr(), sh};
+        a.stream = current_stream(w[s]);
+        slabs.push_back(a);
+    }
+    grid::PartitionedBackwardArgs a{slabs.data(), devices.data(), (int)slabs.size()};
+    {
+        py::gil_scoped_release release;
+        fn(a);
+    }
+    return dx;
+}
+
+grid::Shape3D grid3d_shape(const torch::Tensor &w, const torch::Tensor &x, int radius) {
+    TORCH_CHECK(w.dim() == 5, "w must be [L, Dy, Dz, dim, dim]");
+    TORCH_CHECK(x.dim() == 4, "x must be [Dy, Dz, batch, dim]");
+    TORCH_CHECK(radius >= 0, "radius must be non-negative, got ", radius);
+    return grid::Shape3D{(int)w.size(4), (int)w.size(1), (int)w.size(2), (int)w.size(0), (int)x.size(2), radius};
+}
+
+// the plate shape and radius, for the call sites of the 3d grid
+CallKey call_key(const torch::Tensor &w, const grid::Shape3D &sh) {
+    return call_key(w, grid::Shape{sh.dim, sh.Dy, sh.L, sh.batch}, (int64_t)sh.Dz << 32 | sh.radius);
+}
+
+// the 3d grid of grid/grid3d.h, each sum gathering the cells up to radius
+// away in the plate, returns the output followed by h, y and sd
+std::vector<torch::Tensor> forward3d(const torch::Tensor &w, const torch::Tensor &b, const torch::Tensor &x,
+                                     int radius) {
+    const grid::Shape3D sh = grid3d_shape(w, x, radius);
+    check_tensor(w, w, {sh.L, sh.Dy, sh.Dz, sh.dim, sh.dim}, "w");
+    check_tensor(b, w, {sh.L, sh.Dy, sh.Dz, sh.dim}, "b");
+    check_tensor(x, w, {sh.Dy, sh.Dz, sh.batch, sh.dim}, "x");
+    static CallSite<grid::forward3d_fn> site;
+    const auto fn = site.get(call_key(w, sh), [&] {
+        return Plan<grid::forward3d_fn>{lookup(grid::forward3d_table(), w, sh.dim, "forward3d")};
+    }).fn;
+
+    const auto opt = utils::like_tensor(w);
+    auto h  = torch::empty({sh.L, sh.Dy + 2 * radius, sh.Dz + 2 * radius, sh.batch, sh.dim}, opt);
+    auto y  = torch::empty({sh.L, sh.Dy, sh.Dz, sh.batch, sh.dim}, opt);
+    auto sd = torch::empty({sh.L, sh.Dy, sh.Dz, sh.batch}, opt);
+
+    std::vector<torch::Tensor> keep;
+    grid::Forward3DArgs a{input_ptr(w, keep), input_ptr(b, keep), input_ptr(x, keep),
+                          h.data_ptr(), y.data_ptr(), sd.data_ptr(), sh};
+    const auto pool = cpu_pool(w);
+    a.pool = pool.get();
+    {
+        py::gil_scoped_release release;
+        fn(a);
+    }
+    return {y[sh.L - 1], h, y, sd};
+}
+
+// accumulates into dw and db, returns dL/dx
+torch::Tensor backward3d(const torch::Tensor &w, const torch::Tensor &x, const torch::Tensor &h,
+                         const torch::Tensor &y, const torch::Tensor &sd, const torch::Tensor &grad, torch::Tensor dw,
+                         torch::Tensor db, int radius) {
+    const grid::Shape3D sh = grid3d_shape(w, x, radius);
+    check_tensor(w, w, {sh.L, sh.Dy, sh.Dz, sh.dim, sh.dim}, "w");
+    check_tensor(x, w, {sh.Dy, sh.Dz, sh.batch, sh.dim}, "x");
+    check_tensor(h, w, {sh.L, sh.Dy + 2 * radius, sh.Dz + 2 * radius, sh.batch, sh.dim}, "h");
+    check_tensor(y, w, {sh.L, sh.Dy, sh.Dz, sh.batch, sh.dim}, "y");
+    check_tensor(sd, w, {sh.L, sh.Dy, sh.Dz, sh.batch}, "sd");
+    check_tensor(grad, w, {sh.Dy, sh.Dz, sh.batch, sh.dim}, "grad");
+    check_tensor(dw, w, {sh.L, sh.Dy, sh.Dz, sh.dim, sh.dim}, "dw");
+    check_tensor(db, w, {sh.L, sh.Dy, sh.Dz, sh.dim}, "db");
+    static CallSite<grid::backward3d_fn> site;
+    const auto fn = site.get(call_key(w, sh), [&] {
+        return Plan<grid::backward3d_fn>{lookup(grid::backward3d_table(), w, sh.dim, "backward3d")};
+    }).fn;
+
+    const auto opt = utils::like_tensor(w);
+    auto dx = torch::empty({sh.Dy, sh.Dz, sh.batch, sh.dim}, opt);
+    auto dz = torch::empty({sh.Dy + 2 * radius, sh.Dz + 2 * radius, sh.batch, sh.dim}, opt);
+
+    std::vector<torch::Tensor> keep;
+    grid::Backward3DArgs a{input_ptr(w, keep), input_ptr(x, keep), input_ptr(h, keep), input_ptr(y, keep),
+                           input_ptr(sd, keep), input_ptr(grad, keep), dx.data_ptr(),
+                           output_ptr(dw, "dw"), output_ptr(db, "db"), dz.data_ptr(), sh};
+    const auto pool = cpu_pool(w);
+    a.pool = pool.get();
+    {
+        py::gil_scoped_release release;
+        fn(a);
+    }
+    return dx;
+}
+
+// the cell interleaved layout of grid/batched_gemm.h has as many lanes as the
+// widest vector of the dtype, so packing runs on the cpu for float and double only
+template <typename F>
+void with_packed_type(const torch::Tensor &t, const char *name, F &&f) {
+    TORCH_CHECK(t.device().is_cpu(), name, " must be on the cpu, the packed layout is cpu only");
+    if (t.scalar_type() == torch::kF32)
+        f(float{});
+    else if (t.scalar_type() == torch::kF64)
+        f(double{});
+    else
+        TORCH_CHECK(false, name, " must be float or double, got ", t.scalar_type());
+}
+
+// t [cells, ...] into a flat packed buffer, w and b are packed once and reused
+// by every batched_gemm call
+torch::Tensor pack_cells(const torch::Tensor &t) {
+    TORCH_CHECK(t.dim() >= 1 && t.size(0) > 0, "t must be [cells, ...] with at least one cell");
+    torch::Tensor p;
+    with_packed_type(t, "t", [&](auto v) {
+        using T = decltype(v);
+        const int cells = (int)t.size(0);
+        const size_t elems = t.numel() / cells;
+        p = torch::empty({(int64_t)grid::packed_size<T>(cells, elems)}, utils::like_tensor(t));
+        const torch::Tensor src = t.contiguous();
+        grid::pack_cells(src.data_ptr<T>(), p.data_ptr<T>(), cells, elems);
+    });
+    return p;
+}
+
+// the packed p back to a plain tensor of the given sizes, [cells, ...]
+torch::Tensor unpack_cells(const torch::Tensor &p, const std::vector<int64_t> &sizes) {
+    TORCH_CHECK(!sizes.empty() && sizes[0] > 0, "sizes must be [cells, ...] with at least one cell");
+    auto t = torch::empty(sizes, utils::like_tensor(p));
+    with_packed_type(p, "p", [&](auto v) {
+        using T = decltype(v);
+        const int cells = (int)sizes[0];
+        const size_t elems = t.numel() / cells;
+        check_tensor(p, p, {(int64_t)grid::packed_size<T>(cells, elems)}, "p");
+        grid::unpack_cells(p.data_ptr<T>(), t.data_ptr<T>(), cells, elems);
+    });
+    return t;
+}
+
+// y_c = x_c * w_c + b_c for every cell at once, all packed, x and y
+// [cells, batch, dim], w [cells, dim, dim] input major and b [cells, dim]
+torch::Tensor batched_gemm(const torch::Tensor &x, const torch::Tensor &w, const c10::optional<torch::Tensor> &b,
+                           int64_t cells, int64_t dim) {
+    TORCH_CHECK(cells > 0, "batched gemm needs at least one cell");
+    int batch = 0;
+    with_packed_type(x, "x", [&](auto v) {
+        using T = decltype(v);
+        const int64_t row = grid::packed_size<T>((int)cells, dim);
+        TORCH_CHECK(x.dim() == 1 && x.numel() % row == 0, "x must be packed [cells, batch, dim]");
+        batch = (int)(x.numel() / row);
+        check_tensor(w, x, {(int64_t)grid::packed_size<T>((int)cells, dim * dim)}, "w");
+        if (b)
+            check_tensor(*b, x, {row}, "b");
+    });
+    static CallSite<grid::gemm_fn> site;
+    const auto fn = site.get(call_key(x, grid::Shape{(int)dim, (int)cells, 1, batch}), [&] {
+        return Plan<grid::gemm_fn>{lookup(grid::gemm_table(), x, (int)dim, "batched gemm")};
+    }).fn;
+
+    auto y = torch::empty_like(x, torch::MemoryFormat::Contiguous);
+    std::vector<torch::Tensor> keep;
+    grid::GemmArgs a{input_ptr(x, keep), input_ptr(w, keep), b ? input_ptr(*b, keep) : nullptr, y.data_ptr(),
+                     (int)cells, batch};
+    {
+        py::gil_scoped_release release;
+        fn(a);
+    }
+    return y;
+}
+
+// one fused step over flat parameter, gradient and moment buffers, each
+// model tensor is a view into param so the whole model updates in one pass
+void adam_step(torch::Tensor param, torch::Tensor grad, torch::Tensor m, torch::Tensor v, int64_t step,
+               double lr, double beta1, double beta2, double eps, bool zero_grad) {
+    TORCH_CHECK(step >= 1, "adam steps count from 1");
+    const std::vector<int64_t> n = param.sizes().vec();
+    check_tensor(grad, param, n, "grad");
+    check_tensor(m, param, n, "m");
+    check_tensor(v, param, n, "v");
+    static CallSite<optim::adam_fn> site;
+    const auto fn = site.get(call_key(param, grid::Shape{}), [&] {
+        return Plan<optim::adam_fn>{lookup_dtype(optim::adam_table(), param, "adam")};
+    }).fn;
+
+    optim::AdamArgs a{output_ptr(param, "param"), output_ptr(grad, "grad"), output_ptr(m, "m"), output_ptr(v, "v"),
+                      (size_t)param.numel(), lr, beta1, beta2, eps, step};
+    a.zero_grad = zero_grad;
+    a.stream = current_stream(param);
+    const auto pool = cpu_pool(param);
+    a.pool = pool.get();
+    py::gil_scoped_release release;
+    fn(a);
+}
+
+void set_num_threads(int n) {
+    kernel_pool = n == 1 ? nullptr : std::make_shared<utils::ThreadPool>(n);
+}
+
+int get_num_threads() {
+    return kernel_pool ? kernel_pool->size() : 1;
+}
+
+// description of every lookup that missed its specialization to the number
+// of times it did, since the start or the last reset
+py::dict dispatch_misses() {
+    py::dict out;
+    for (const auto &e : fn_builder::misses().snapshot())
+        out[py::str(e.what)] = e.count;
+    return out;
+}
+
+void reset_dispatch_misses() {
+    fn_builder::misses().reset();
+}
+
+// every kernel called since the start or the last reset, with its calls,
+// wall time in ns, the bytes it moved at least and the ns spent resolving
+// the calls to it, empty unless built with GROWNET_COUNTERS
+py::list kernel_counters() {
+    py::list out;
+    for (const auto &e : counters::registry().snapshot()) {
+        py::dict d;
+        d["name"] = e.name;
+        d["key"] = e.key;
+        d["calls"] = e.totals.calls;
+        d["ns"] = e.totals.ns;
+        d["bytes"] = e.totals.bytes;
+        d["resolve_ns"] = e.totals.resolve_ns;
+        out.append(d);
+    }
+    return out;
+}
+
+void reset_kernel_counters() {
+    counters::registry().reset();
+}
+
+data::RecordType record_type(torch::ScalarType t) {
+    TORCH_CHECK(t == torch::kUInt8 || t == torch::kF32, "records hold uint8 or float32, not ", t);
+    return t == torch::kUInt8 ? data::RecordType::u8 : data::RecordType::f32;
+}
+
+torch::ScalarType scalar_type(data::RecordType t) {
+    return t == data::RecordType::u8 ? torch::kUInt8 : torch::kF32;
+}
+
+// writes the rows of data, one record each, and their labels to a record
+// file of data/records.h, meant for a dataset decoded and normalized once
+void write_records(const std::string &path, const torch::Tensor &data, const c10::optional<torch::Tensor> &labels) {
+    TORCH_CHECK(data.device().is_cpu(), "data has to be on the cpu, is on ", data.device());
+    TORCH_CHECK(data.dim() >= 1 && data.dim() <= 1 + data::record_max_rank, "data has to be [n] followed by up to ",
+                data::record_max_rank, " record dims, is ", data.sizes());
+    const auto type = record_type(data.scalar_type());
+    const torch::Tensor src = dense_rows(data);
+    torch::Tensor lab;
+    if (labels) {
+        lab = labels->contiguous();
+        TORCH_CHECK(lab.device().is_cpu() && lab.scalar_type() == torch::kInt64 && lab.dim() == 1 &&
+                        lab.size(0) == src.size(0),
+                    "labels has to be a [", src.size(0), "] int64 cpu tensor");
+    }
+    std::vector<uint64_t> shape(src.sizes().begin() + 1, src.sizes().end());
+    const auto h = data::RecordHeader::make(type, src.size(0), shape.data(), (int)shape.size(), labels.has_value());
+    py::gil_scoped_release release;
+    data::write_records(path, h, src.data_ptr(), src.stride(0) * src.element_size(),
+                        labels ? lab.data_ptr<int64_t>() : nullptr);
+}
+
+// maps a record file, returns its records as an [n, ...] view whose rows are
+// record_align bytes apart and its labels as an [n] int64 view, or None, both
+// reading the page cache directly and keeping the mapping alive, writes only
+// ever change this process's copy
+py::tuple load_records(const std::string &path) {
+    std::shared_ptr<data::Records> r;
+    {
+        py::gil_scoped_release release;
+        r = std::make_shared<data::Records>(path);
+    }
+    const data::RecordHeader &h = r->header();
+    std::vector<int64_t> sizes{r->size()}, strides{(int64_t)(h.stride / data::record_type_size(h.type))};
+    for (uint32_t i = 0; i < h.rank; ++i)
+        sizes.push_back((int64_t)h.shape[i]);
+    strides.resize(sizes.size());
+    for (int64_t i = (int64_t)sizes.size() - 1, n = 1; i >= 1; --i) {
+        strides[i] = n;
+        n *= sizes[i];
+    }
+    const auto keep = [r](void *) {};
+    auto records = torch::from_blob(r->records(), sizes, strides, keep, torch::dtype(scalar_type(h.type)));
+    if (!h.has_labels)
+        return py::make_tuple(records, py::none());
+    return py::make_tuple(records, torch::from_blob(r->labels(), {r->size()}, keep, torch::dtype(torch::kInt64)));
+}
+
+// a trained grid for serving, its kernel resolved once and its scratch kept
+// between calls, each call runs the grid without any of the state backward
+// needs, calls from several threads take turns
+class FrozenGrid {
+public:
+    // with quantize, only the int8 cells of grid/quantize.h are kept of w
+    FrozenGrid(const torch::Tensor &w, const torch::Tensor &b, bool quantize) : b(b.contiguous()) {
+        TORCH_CHECK(w.dim() == 4, "w must be [L, D, dim, dim]");
+        sh = grid::Shape{(int)w.size(3), (int)w.size(1), (int)w.size(0), 0};
+        check_tensor(w, w, {sh.L, sh.D, sh.dim, sh.dim}, "w");
+        check_tensor(b, w, {sh.L, sh.D, sh.dim}, "b");
+        if (!quantize) {
+            this->w = w.contiguous();
+            fn = lookup(grid::infer_table(), w, sh.dim, "infer");
+            return;
+        }
+        TORCH_CHECK(w.is_cpu() && w.scalar_type() == torch::kF32, "quantize needs float cpu weights, got ",
+                    w.device(), " ", w.scalar_type());
+        fn = lookup(grid::infer_table(), torch::kCPU, torch::kQInt8, sh.dim, "infer");
+        cells = torch::empty({(int64_t)grid::quant_bytes(sh)}, torch::TensorOptions().dtype(torch::kUInt8));
+        grid::quantize_cells(w.contiguous().data_ptr<float>(), sh, cells.data_ptr());
+    }
+
+    // the grid output for x [D, batch, dim], into out if given
+    torch::Tensor forward(const torch::Tensor &x, c10::optional<torch::Tensor> out) {
+        TORCH_CHECK(x.dim() == 3, "x must be [D, batch, dim]");
+        grid::Shape s = sh;
+        s.batch = (int)x.size(1);
+        check_tensor(x, b, {s.D, s.batch, s.dim}, "x");
+        torch::Tensor y = out ? *out : torch::empty({s.D, s.batch, s.dim}, utils::like_tensor(b));
+        if (out)
+            check_tensor(y, b, {s.D, s.batch, s.dim}, "out");
+        std::vector<torch::Tensor> keep;
+        const void *wp = cells.defined() ? cells.data_ptr() : w.data_ptr();
+        grid::InferArgs a{wp, b.data_ptr(), input_ptr(x, keep), output_ptr(y, "out"), nullptr, s};
+        const auto pool = cpu_pool(b);
+        a.pool = pool.get();
+        const size_t n = grid::inference_scratch(s, a.pool != nullptr ? a.pool->size() : 1);
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> lock(m);
+        if ((size_t)work.numel() < n) {
+            // allocating needs no GIL
+            work = torch::empty({(int64_t)n}, utils::like_tensor(b));
+        }
+        a.work = work.data_ptr();
+        fn(a);
+        return y;
+    }
+
+private:
+    // the float cells, undefined with quantize, b being of the dtype and
+    // device of w stands in for it in the checks
+    torch::Tensor w;
+    const torch::Tensor b;
+    // the packed int8 cells, undefined without quantize
+    torch::Tensor cells;
+    grid::Shape sh;
+    grid::infer_fn fn;
+    std::mutex m;
+    // grown to the largest call so far
+    torch::Tensor work;
+};
+
+// the host buffers of arenas, all dense and of one dtype and size, device
+// arenas are copied to the host into keep
+std::vector<const void *> host_arenas(const std::vector<torch::Tensor> &arenas, std::vector<torch::Tensor> &keep) {
+    TORCH_CHECK(!arenas.empty(), "no arenas given");
+    std::vector<const void *> out;
+    for (size_t k = 0; k < arenas.size(); ++k) {
+        const torch::Tensor &t = arenas[k];
+        TORCH_CHECK(t.scalar_type() == arenas[0].scalar_type() && t.numel() == arenas[0].numel(), "arena ", k,
+                    " is ", t.numel(), " ", t.scalar_type(), ", expected ", arenas[0].numel(), " ",
+                    arenas[0].scalar_type());
+        output_ptr(t, "every arena");
+        keep.push_back(t.is_cpu() ? t : t.cpu());
+        out.push_back(keep.back().data_ptr());
+    }
+    return out;
+}
+
+// optim::SnapshotWriter over tensors
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(int64_t chunk_elems) : w((size_t)chunk_elems) {
+        TORCH_CHECK(chunk_elems > 0, "chunk_elems has to be positive");
+    }
+
+    void save(const std::string &path, const std::vector<torch::Tensor> &arenas, int64_t step, bool delta) {
+        std::vector<torch::Tensor> keep;
+        const auto ptrs = host_arenas(arenas, keep);
+        py::gil_scoped_release release;
+        w.save(path, ptrs, (size_t)keep[0].numel(), keep[0].element_size(), step, delta);
+    }
+
+    void wait() {
+        py::gil_scoped_release release;
+        w.wait();
+    }
+
+private:
+    optim::SnapshotWriter w;
+};
+
+// applies the snapshot at path to arenas in place, a delta only onto arenas
+// holding the save it follows, of step step, returns the snapshot's step
+int64_t load_snapshot(const std::string &path, const std::vector<torch::Tensor> &arenas, int64_t step) {
+    std::vector<torch::Tensor> keep;
+    const auto ptrs = host_arenas(arenas, keep);
+    int64_t loaded;
+    {
+        py::gil_scoped_release release;
+        const optim::Snapshot snap(path);
+        const auto &h = snap.header();
+        TORCH_CHECK(h.arenas == arenas.size(), path, " holds ", h.arenas, " arenas, ", arenas.size(), " given");
+        TORCH_CHECK(h.kind == optim::SnapshotKind::full || h.parent == step, path, " is a delta onto step ",
+                    h.parent, ", the arenas hold step ", step);
+        for (size_t k = 0; k < ptrs.size(); ++k)
+            snap.apply((int)k, const_cast<void *>(ptrs[k]), (size_t)keep[k].numel(), keep[k].element_size());
+        loaded = h.step;
+    }
+    for (size_t k = 0; k < arenas.size(); ++k)
+        if (!arenas[k].is_cpu())
+            arenas[k].copy_(keep[k]);
+    return loaded;
+}
+
+// the rows of a host tensor in batches of rows, in the order of order, on
+// device, loaded and copied by data::Pipeline while the previous batch is in
+// use, each batch is a view of a pipeline slot, valid until the next is taken,
+// with an augment the rows are [height, width, channels] images, augmented
+// into float batches by data::BatchTransform as they are gathered
+class BatchStream {
+public:
+    BatchStream(const torch::Tensor &data, const torch::Tensor &order, int64_t rows, torch::Device device,
+                const c10::optional<data::Augment> &augment, int threads)
+        : src(dense_rows(data)), idx(order.contiguous()), device(device), rows(rows) {
+        TORCH_CHECK(src.device().is_cpu(), "data has to be on the cpu, is on ", src.device());
+        TORCH_CHECK(src.dim() >= 1 && src.size(0) > 0, "data needs a leading non-empty row dimension");
+        TORCH_CHECK(idx.device().is_cpu() && idx.dim() == 1 && idx.scalar_type() == torch::kInt64,
+                    "order has to be a 1d int64 cpu tensor");
+        TORCH_CHECK(rows > 0, "rows has to be positive");
+#ifndef GROWNET_CUDA
+        TORCH_CHECK(!device.is_cuda(), "built without cuda");
+#endif
+        const int64_t *o = idx.data_ptr<int64_t>();
+        for (int64_t i = 0; i < idx.numel(); ++i)
+            TORCH_CHECK(o[i] >= 0 && o[i] < src.size(0), "order[", i, "] = ", o[i], " is not a row of data");
+        row_shape = src.sizes().vec();
+        row_bytes = src.numel() / src.size(0) * src.element_size();
+        out_type = src.scalar_type();
+        const int64_t n = idx.numel();
+        const size_t src_stride = src.stride(0) * src.element_size();
+        data::fill_fn fill = data::gather_rows(src.data_ptr(), row_bytes, o, n, rows, src_stride);
+        if (augment) {
+            TORCH_CHECK(src.dim() == 4, "an augmented stream takes [n, height, width, channels] images, not ",
+                        src.sizes());
+            const data::ImageShape image{(int)src.size(1), (int)src.size(2), (int)src.size(3)};
+            transform = std::make_unique<data::BatchTransform>(image, record_type(src.scalar_type()), *augment,
+                                                               threads);
+            row_bytes = transform->out_bytes();
+            out_type = torch::kF32;
+            fill = transform->gather(src.data_ptr(), src_stride, o, n, rows);
+        }
+#ifdef GROWNET_CUDA
+        // the pipeline allocates on the current device
+        if (device.is_cuda() && !device.has_index())
+            this->device = torch::Device(torch::kCUDA, c10::cuda::current_device());
+        c10::cuda::OptionalCUDAGuard guard;
+        if (this->device.is_cuda())
+            guard.set_device(this->device);
+#endif
+        pipe = std::make_unique<data::Pipeline>(row_bytes * rows, data::batch_count(n, rows), std::move(fill),
+                                                device.is_cuda());
+    }
+
+    torch::Tensor next() {
+        void *stream = nullptr;
+#ifdef GROWNET_CUDA
+        if (device.is_cuda())
+            stream = c10::cuda::getCurrentCUDAStream(device.index()).stream();
+#endif
+        data::Batch b;
+        bool more;
+        {
+            py::gil_scoped_release release;
+            more = pipe->next(b, stream);
+        }
+        if (!more)
+            throw py::stop_iteration();
+        row_shape[0] = (int64_t)(b.bytes / row_bytes);
+        return torch::from_blob(const_cast<void *>(b.data), row_shape,
+                                torch::TensorOptions().dtype(out_type).device(device));
+    }
+
+    int64_t size() const { return pipe->size(); }
+
+private:
+    // kept alive for the loader thread, which reads them
+    torch::Tensor src, idx;
+    torch::Device device;
+    const int64_t rows;
+    size_t row_bytes;
+    std::vector<int64_t> row_shape;
+    torch::ScalarType out_type;
+    // outlives the pipeline, whose loader thread runs it
+    std::unique_ptr<data::BatchTransform> transform;
+    std::unique_ptr<data::Pipeline> pipe;
+};
+
+// data parallel training over flat param, grad, m and v buffers as adam_step
+// takes them, each replica runs backward through here, the gradients of its
+// columns being averaged over the process group and stepped in buckets of
+// about bucket_bytes while the columns before them are still computed,
+// step then reduces and steps the rest of the arena and waits for all of it
+class DataParallel {
+public:
+    DataParallel(const py::object &group, torch::Tensor param, torch::Tensor grad, torch::Tensor m,
+                 torch::Tensor v, int64_t bucket_bytes, double lr, double beta1, double beta2, double eps)
+        : pg(group.cast<c10::intrusive_ptr<c10d::ProcessGroup>>()), param(std::move(param)),
+          grad(std::move(grad)), m(std::move(m)), v(std::move(v)), lr(lr), beta1(beta1), beta2(beta2), eps(eps),
+          queue([this](const std::vector<optim::Span> &spans) { reduce(spans); }) {
+        TORCH_CHECK(this->param.dim() == 1, "param has to be a flat buffer");
+        const std::vector<int64_t> n = this->param.sizes().vec();
+        check_tensor(this->grad, this->param, n, "grad");
+        check_tensor(this->m, this->param, n, "m");
+        check_tensor(this->v, this->param, n, "v");
+        for (const auto *t : {&this->param, &this->grad, &this->m, &this->v})
+            output_ptr(*t, "every buffer");
+        TORCH_CHECK(bucket_bytes > 0, "bucket_bytes has to be positive");
+        bucket_elems = (size_t)bucket_bytes / this->grad.element_size();
+        adam = lookup_dtype(optim::adam_table(), this->param, "adam");
+    }
+
+    // as backward, dw and db have to be views into grad, each grid runs it
+    // once per step, its buckets are stepped as soon as they are reduced
+    torch::Tensor backward(const torch::Tensor &w, const torch::Tensor &x, const torch::Tensor &h,
+                           const torch::Tensor &y, const torch::Tensor &sd, const torch::Tensor &g, torch::Tensor dw,
+                           torch::Tensor db) {
+        const grid::Shape sh = grid_shape(w, x);
+        const size_t dw_at = offset(dw, (size_t)sh.L * sh.D * sh.dim * sh.dim, "dw");
+        const size_t db_at = offset(db, (size_t)sh.L * sh.D * sh.dim, "db");
+#ifdef GROWNET_CUDA
+        // the reduce thread queues its work on the stream backward ran on
+        if (grad.is_cuda())
+            stream = c10::cuda::getCurrentCUDAStream(grad.device().index());
+#endif
+        // checked first, the spans of a watched pass are only ever reduced
+        // through its hook, so a pass that throws before running would leave
+        // them unreduced, unstepped and uncleared
+        backward_plan(w, x, h, y, sd, g, dw, db);
+        const grid::ColumnHook hook = queue.watch(optim::column_buckets(sh, dw_at, db_at, bucket_elems));
+        return backward_with(w, x, h, y, sd, g, std::move(dw), std::move(db), hook);
+    }
+
+    // reduces and steps what no backward covered and waits for every bucket,
+    // the gradients are cleared for the next step
+    void step() {
+        {
+            py::gil_scoped_release release;
+            queue.finish((size_t)grad.numel());
+        }
+        ++steps;
+    }
+
+    int64_t step_count() const { return steps; }
+
+private:
+    // elements from the start of grad to t, which has to be n of them
+    size_t offset(const torch::Tensor &t, size_t n, const char *name) const {
+        TORCH_CHECK(t.is_contiguous() && t.scalar_type() == grad.scalar_type() && t.device() == grad.device(),
+                    name, " has to be a contiguous ", grad.scalar_type(), " view into grad");
+        const auto *p = static_cast<const char *>(t.data_ptr()), *g = static_cast<const char *>(grad.data_ptr());
+        const int64_t at = (p - g) / (int64_t)grad.element_size();
+        TORCH_CHECK(p >= g && (size_t)t.numel() == n && at + t.numel() <= grad.numel(), name,
+                    " is not a view into grad");
+        return (size_t)at;
+    }
+
+    // on the queue's thread, without the GIL
+    void reduce(const std::vector<optim::Span> &spans) {
+#ifdef GROWNET_CUDA
+        c10::cuda::OptionalCUDAStreamGuard guard;
+        if (grad.is_cuda())
+            guard.reset_stream(*stream);
+#endif
+        std::vector<c10::intrusive_ptr<c10d::Work>> work;
+        std::vector<torch::Tensor> parts;
+        for (const auto &s : spans) {
+            parts.push_back(grad.narrow(0, (int64_t)s.begin, (int64_t)s.n));
+            std::vector<torch::Tensor> t{parts.back()};
+            work.push_back(pg->allreduce(t));
+        }
+        for (size_t i = 0; i < spans.size(); ++i) {
+            work[i]->wait();
+            parts[i].div_(pg->getSize());
+            const size_t at = spans[i].begin * grad.element_size();
+            auto ptr = [&](const torch::Tensor &t) { return static_cast<char *>(t.data_ptr()) + at; };
+            optim::AdamArgs a{ptr(param), ptr(grad), ptr(m), ptr(v), spans[i].n, lr, beta1, beta2, eps, steps + 1};
+            a.stream = current_stream(param);
+            // the pool is the backward pass's meanwhile
+            a.pool = nullptr;
+            adam(a);
+        }
+    }
+
+    const c10::intrusive_ptr<c10d::ProcessGroup> pg;
+    torch::Tensor param, grad, m, v;
+    const double lr, beta1, beta2, eps;
+    size_t bucket_elems;
+    optim::adam_fn adam;
+    // read by the reduce thread only between backward and step
+    int64_t steps = 0;
+#ifdef GROWNET_CUDA
+    c10::optional<c10::cuda::CUDAStream> stream;
+#endif
+    // last, so it is stopped before the rest goes
+    optim::BucketQueue queue;
+};
 
-int test(int n) {
-    return n + 2;
 }
 
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
-    m.def("test", &test, "(CUDA)");
-}
\ No newline at end of file
+    m.def("forward", &forward,
+          "grid forward, returns (out, h, y, sd), float16 and bfloat16 run in float with sd kept as float",
+          py::arg("w"), py::arg("b"), py::arg("x"));
+    m.def("backward", &backward,
+          "grid backward, accumulates into dw and db, float for float16 and bfloat16, returns dx",
+          py::arg("w"), py::arg("x"), py::arg("h"), py::arg("y"), py::arg("sd"), py::arg("grad"),
+          py::arg("dw"), py::arg("db"));
+    m.def("sparse_forward", &sparse_forward,
+          "grid forward over the adjacency given by the in-edges of every sum, in_ptr [L * D + 1] and in_idx, "
+          "returns (out, h, y, sd)",
+          py::arg("w"), py::arg("b"), py::arg("x"), py::arg("in_ptr"), py::arg("in_idx"));
+    m.def("sparse_backward", &sparse_backward,
+          "grid backward over the adjacency of sparse_forward, accumulates into dw and db, returns dx",
+          py::arg("w"), py::arg("x"), py::arg("h"), py::arg("y"), py::arg("sd"), py::arg("grad"),
+          py::arg("dw"), py::arg("db"), py::arg("in_ptr"), py::arg("in_idx"));
+    m.def("gated_forward", &gated_forward,
+          "grid forward with WeightedSigmoid gated cells, gate [L, D, 2] holding {s, b} per cell, skipping samples "
+          "below the underflow cutoff s - eps / b, returns (out, h, y, sd, mag)",
+          py::arg("w"), py::arg("b"), py::arg("x"), py::arg("gate"), py::arg("eps"));
+    m.def("gated_backward", &gated_backward,
+          "gated grid backward, accumulates into dw, db and dgate, returns dx",
+          py::arg("w"), py::arg("x"), py::arg("h"), py::arg("y"), py::arg("sd"), py::arg("mag"), py::arg("gate"),
+          py::arg("grad"), py::arg("dw"), py::arg("db"), py::arg("dgate"), py::arg("eps"));
+    m.def("checkpoint_forward", &checkpoint_forward,
+          "grid forward keeping the input of every stride-th column, stride 0 picks the longest stride whose "
+          "memory fits memory_budget bytes, returns (out, checkpoints, stride)",
+          py::arg("w"), py::arg("b"), py::arg("x"), py::arg("stride") = 0, py::arg("memory_budget") = 0);
+    m.def("checkpoint_backward", &checkpoint_backward,
+          "grid backward recomputing each segment from its checkpoint, accumulates into dw and db, returns dx",
+          py::arg("w"), py::arg("b"), py::arg("x"), py::arg("ckpt"), py::arg("grad"), py::arg("dw"), py::arg("db"),
+          py::arg("stride"));
+    m.def("reversible_forward", &reversible_forward, "additive coupling grid forward, returns the output only",
+          py::arg("w"), py::arg("b"), py::arg("x"));
+    m.def("reversible_backward", &reversible_backward,
+          "additive coupling grid backward from the output alone, accumulates into dw and db, returns dx",
+          py::arg("w"), py::arg("b"), py::arg("y"), py::arg("grad"), py::arg("dw"), py::arg("db"));
+    m.def("partitioned_forward", &partitioned_forward,
+          "grid forward split along D over cuda devices, lists of per slab w, b and x for consecutive cells, "
+          "slabs may share a device, returns per slab (out, h, y, sd)",
+          py::arg("w"), py::arg("b"), py::arg("x"));
+    m.def("partitioned_backward", &partitioned_backward,
+          "backward of partitioned_forward, accumulates into the slabs of dw and db, returns dx per slab",
+          py::arg("w"), py::arg("x"), py::arg("h"), py::arg("y"), py::arg("sd"), py::arg("grad"), py::arg("dw"),
+          py::arg("db"));
+    m.def("forward3d", &forward3d,
+          "3d grid forward over plates of cells, w [L, Dy, Dz, dim, dim], x [Dy, Dz, batch, dim], each sum "
+          "gathering the (2 radius + 1)^2 cells around it, returns (out, h, y, sd)",
+          py::arg("w"), py::arg("b"), py::arg("x"), py::arg("radius") = 1);
+    m.def("backward3d", &backward3d, "3d grid backward, accumulates into dw and db, returns dx",
+          py::arg("w"), py::arg("x"), py::arg("h"), py::arg("y"), py::arg("sd"), py::arg("grad"),
+          py::arg("dw"), py::arg("db"), py::arg("radius") = 1);
+    m.def("pack_cells", &pack_cells,
+          "t [cells, ...] interleaved cell by cell into the flat packed layout of batched_gemm, cpu float and double",
+          py::arg("t"));
+    m.def("unpack_cells", &unpack_cells, "a packed tensor back to a plain tensor of the given [cells, ...] sizes",
+          py::arg("p"), py::arg("sizes"));
+    m.def("batched_gemm", &batched_gemm,
+          "y = x * w + b for every cell at once on pack_cells buffers, x [cells, batch, dim], w [cells, dim, dim] "
+          "input major, b [cells, dim] or None, returns y packed like x",
+          py::arg("x"), py::arg("w"), py::arg("b"), py::arg("cells"), py::arg("dim"));
+    m.def("adam_step", &adam_step, "fused adam step over flat buffers, updates param, m and v in place",
+          py::arg("param"), py::arg("grad"), py::arg("m"), py::arg("v"), py::arg("step"), py::arg("lr"),
+          py::arg("beta1") = 0.9, py::arg("beta2") = 0.999, py::arg("eps") = 1e-8, py::arg("zero_grad") = true);
+    m.def("set_num_threads", &set_num_threads, "cpu threads for the grid kernels, 0 for every hardware thread",
+          py::arg("n"));
+    m.def("get_num_threads", &get_num_threads);
+    m.def("dispatch_misses", &dispatch_misses,
+          "lookups that found no kernel specialized on their dim, and ran the runtime dim fallback where there is "
+          "one, as description to count, a call is looked up again only once its shape is no longer cached");
+    m.def("reset_dispatch_misses", &reset_dispatch_misses, "clears dispatch_misses, each miss is reported again");
+    m.def("kernel_counters", &kernel_counters,
+          "per kernel calls, ns, bytes and resolve_ns since the start or the last reset, as a list of dicts, "
+          "empty unless built with GROWNET_COUNTERS=1, cuda times cover the launch only");
+    m.def("reset_kernel_counters", &reset_kernel_counters, "starts kernel_counters over from zero");
+    m.attr("counters_enabled") = counters::enabled;
+    m.def("write_records", &write_records,
+          "writes the rows of a uint8 or float32 cpu tensor [n, ...] and optional int64 labels [n] to a record "
+          "file, each record aligned for the kernels, to be decoded and normalized beforehand",
+          py::arg("path"), py::arg("data"), py::arg("labels") = py::none());
+    m.def("load_records", &load_records,
+          "maps a record file written by write_records, returns (data, labels) as views of the mapping with no copy, "
+          "labels None if it has none, the pages are shared with every process mapping the file",
+          py::arg("path"));
+    py::class_<FrozenGrid>(m, "FrozenGrid",
+                           "a trained grid for serving, cpu, runs forward without the h, y and sd backward needs, "
+                           "with its kernel and scratch kept between calls, a batch of one runs on the calling thread, "
+                           "quantize keeps w as int8 with a scale per cell, x and y staying float")
+        .def(py::init<const torch::Tensor &, const torch::Tensor &, bool>(), py::arg("w"), py::arg("b"),
+             py::arg("quantize") = false)
+        .def("__call__", &FrozenGrid::forward, "the grid output [D, batch, dim] for x, written to out if given",
+             py::arg("x"), py::arg("out") = py::none());
+    py::class_<SnapshotWriter>(m, "SnapshotWriter",
+                               "saves flat parameter and optimizer arenas, such as adam_step's param, m and v, in the "
+                               "background, save copies them out and returns, a delta save only writes the chunks "
+                               "of chunk_elems elements that changed since the last save")
+        .def(py::init<int64_t>(), py::arg("chunk_elems") = 1 << 14)
+        .def("save", &SnapshotWriter::save, py::arg("path"), py::arg("arenas"), py::arg("step"),
+             py::arg("delta") = false)
+        .def("wait", &SnapshotWriter::wait, "waits for every save to be on disk, raises what a save raised");
+    m.def("load_snapshot", &load_snapshot,
+          "applies a SnapshotWriter file to arenas in place, a full one, then each delta after it in order with "
+          "step the step of the save before, returns the step of the snapshot",
+          py::arg("path"), py::arg("arenas"), py::arg("step") = -1);
+    py::class_<data::Augment>(m, "Augment",
+                              "augmentations a BatchStream of images applies per sample, a random crop of the image "
+                              "padded by crop zeros on each side, a horizontal flip, a zeroed cutout square and "
+                              "(x * input_scale - mean) / std per channel, drawn from seed and the sample's position")
+        .def(py::init<>())
+        .def_readwrite("crop", &data::Augment::crop)
+        .def_readwrite("flip", &data::Augment::flip)
+        .def_readwrite("cutout", &data::Augment::cutout)
+        .def_readwrite("mean", &data::Augment::mean)
+        .def_readwrite("std", &data::Augment::std)
+        .def_readwrite("input_scale", &data::Augment::input_scale)
+        .def_readwrite("seed", &data::Augment::seed);
+    py::class_<BatchStream>(m, "BatchStream",
+                            "batches of rows of a cpu tensor, gathered in the order of order and copied to device "
+                            "in the background while the previous batch is in use, each batch is only valid until "
+                            "the next one is taken, clone it to keep it, with an augment the rows are images "
+                            "augmented into float as they are gathered, on the loader thread alone by default or over "
+                            "threads threads of their own, 0 for every hardware thread")
+        .def(py::init<const torch::Tensor &, const torch::Tensor &, int64_t, torch::Device,
+                      const c10::optional<data::Augment> &, int>(),
+             py::arg("data"), py::arg("order"), py::arg("rows"), py::arg("device"), py::arg("augment") = py::none(),
+             py::arg("threads") = 1)
+        .def("__iter__", [](BatchStream &s) -> BatchStream & { return s; }, py::return_value_policy::reference_internal)
+        .def("__next__", &BatchStream::next)
+        .def("__len__", &BatchStream::size);
+    py::class_<DataParallel>(m, "DataParallel",
+                             "data parallel grid training over the flat buffers of adam_step, every replica calls "
+                             "backward with dw and db viewing grad, which averages and steps the gradients over "
+                             "group in buckets of about bucket_bytes as the backward pass finishes their columns, "
+                             "then step once all of them ran, which also handles the rest of grad")
+        .def(py::init<const py::object &, torch::Tensor, torch::Tensor, torch::Tensor, torch::Tensor, int64_t, double,
+                      double, double, double>(),
+             py::arg("group"), py::arg("param"), py::arg("grad"), py::arg("m"), py::arg("v"),
+             py::arg("bucket_bytes") = 25 << 20, py::arg("lr") = 1e-3, py::arg("beta1") = 0.9,
+             py::arg("beta2") = 0.999, py::arg("eps") = 1e-8)
+        .def("backward", &DataParallel::backward, py::arg("w"), py::arg("x"), py::arg("h"), py::arg("y"),
+             py::arg("sd"), py::arg("grad"), py::arg("dw"), py::arg("db"))
+        .def("step", &DataParallel::step)
+        .def_property_readonly("steps", &DataParallel::step_count);
+}
@@ -0,0 +1,624 @@
+/*
+fused backward pass of the grid, backward and d_normalize! in m1/node.jl
+
+per column, each sum cell turns the incoming gradient into the gradient of
+its un-normalized sum, after which each cell gathers the three sums it fed
+and produces dL/dx, dw and db in a single blocked pass over its weights,
+accumulating straight into the gradient buffers
+*/
+
+#pragma once
+#include <cstring>
+#include <vector>
+
+#include "grid.h"
+#include "forward.h"
+#include "scheduler.h"
+#include "../utils/arena.h"
+
+namespace grid {
+
+namespace detail {
+    // dz[s] = d normalize(z)^T g[s], given the normalized output y and the
+    // standard deviation the forward pass kept
+    template <typename T, int Dim>
+    inline void cell_d_normalize(const T *g, const T *y, const T *sd, T *dz, int s0, int s1) {
+        using row  = simd::Row<T, Dim>;
+        using pack = typename row::pack;
+        for (int s = s0; s < s1; ++s) {
+            const size_t o = (size_t)s * Dim;
+            const row gs = row::load(g + o);
+            const row ys = row::load(y + o);
+            pack dot = pack::zero();
+            for (int k = 0; k < row::N; ++k)
+                dot = fmadd(gs.p[k], ys.p[k], dot);
+            const T sdv = sd[s];
+            const T r = T(1) / (sdv + T(norm_eps));
+            // a constant sum has y = 0, so the std term drops out entirely
+            const T c = sdv > 0 ? dot.sum() / (sdv * (Dim - 1)) : T(0);
+            const pack gm = pack::set1(gs.sum() / Dim);
+            const pack rp = pack::set1(r);
+            const pack cp = pack::set1(c);
+            row out;
+            for (int k = 0; k < row::N; ++k)
+                out.p[k] = rp * (gs.p[k] - gm) - cp * ys.p[k];
+            out.store(dz + o);
+        }
+    }
+
+    // given dz of the sums fed by a cell, summed on load like RowSum,
+    // accumulates dw and db and writes dx, for s in [s0, s1)
+    template <typename T, int Dim, typename Act, typename Rows>
+    inline void cell_backward(const T *w, const T *x, const T *h, const Rows &dz,
+                              T *dw, T *db, T *dx, int s0, int s1) {
+        using row  = simd::Row<T, Dim>;
+        using pack = typename row::pack;
+
+        // w transposed, so dx = dp * w^T runs over contiguous rows like the forward
+        alignas(64) T wt[Dim * Dim];
+        for (int i = 0; i < Dim; ++i)
+            for (int o = 0; o < Dim; ++o)
+                wt[o * Dim + i] = w[i * Dim + o];
+
+        alignas(64) T dp[batch_tile * Dim];
+        for (int t0 = s0; t0 < s1; t0 += batch_tile) {
+            const int t1 = std::min(t0 + batch_tile, s1);
+
+            row dbr = row::load(db);
+            for (int s = t0; s < t1; ++s) {
+                const size_t o = (size_t)s * Dim;
+                const row hs = row::load(h + o);
+                row g;
+                for (int k = 0; k < row::N; ++k) {
+                    g.p[k] = Act::backward(hs.p[k], dz.template load<pack>(o + k * row::W));
+                    dbr.p[k] = dbr.p[k] + g.p[k];
+                }
+                g.store(dp + (s - t0) * Dim);
+
+                row acc = row::set1(T(0));
+                for (int i = 0; i < Dim; ++i) {
+                    const pack gi = pack::set1(dp[(s - t0) * Dim + i]);
+                    for (int k = 0; k < row::N; ++k)
+                        acc.p[k] = fmadd(gi, pack::load(wt + i * Dim + k * row::W), acc.p[k]);
+                }
+                acc.store(dx + o);
+            }
+            dbr.store(db);
+
+            // dw[i] += sum_s x[s][i] * dp[s], one row of dw in registers at a time
+            for (int i = 0; i < Dim; ++i) {
+                row acc = row::load(dw + i * Dim);
+                for (int s = t0; s < t1; ++s) {
+                    const pack xi = pack::set1(x[(size_t)s * Dim + i]);
+                    for (int k = 0; k < row::N; ++k)
+                        acc.p[k] = fmadd(xi, pack::load(dp + (s - t0) * Dim + k * row::W), acc.p[k]);
+                }
+                acc.store(dw + i * Dim);
+            }
+        }
+    }
+} // detail
+
+template <typename T, typename Dim, typename Act = Relu>
+struct Backward {
+    static constexpr int dim = Dim::value;
+
+    static const T *input(const BackwardArgs &a, int l) {
+        if (l == 0)
+            return static_cast<const T *>(a.x);
+        return static_cast<const T *>(a.y) + (l - 1) * a.shape.column_size();
+    }
+
+    // gradient w.r.t. the output of column l
+    static const T *grad_out(const BackwardArgs &a, int l) {
+        if (l == a.shape.L - 1)
+            return static_cast<const T *>(a.grad);
+        return static_cast<const T *>(a.dx);
+    }
+
+    static T *dz_cell(const BackwardArgs &a, int j) {
+        return static_cast<T *>(a.dz) + (j + pad) * a.shape.cell_size();
+    }
+
+    static void zero_pads(const BackwardArgs &a) {
+        std::memset(dz_cell(a, -1), 0, a.shape.cell_size() * sizeof(T));
+        std::memset(dz_cell(a, a.shape.D), 0, a.shape.cell_size() * sizeof(T));
+    }
+
+    // gradients of the neighbour sums [j0, j1) of column l
+    static void sums(const BackwardArgs &a, int l, int j0, int j1, int s0, int s1) {
+        const Shape &sh = a.shape;
+        const T *g  = grad_out(a, l);
+        const T *y  = static_cast<const T *>(a.y) + l * sh.column_size();
+        const T *sd = static_cast<const T *>(a.sd) + (size_t)l * sh.D * sh.batch;
+        for (int j = j0; j < j1; ++j) {
+            const size_t c = j * sh.cell_size();
+            detail::cell_d_normalize<T, dim>(g + c, y + c, sd + (size_t)j * sh.batch, dz_cell(a, j), s0, s1);
+        }
+    }
+
+    // cells [j0, j1) of column l, reads dz of sums [j0 - 1, j1 + 1)
+    static void cells(const BackwardArgs &a, int l, int j0, int j1, int s0, int s1) {
+        const Shape &sh = a.shape;
+        const T *w = static_cast<const T *>(a.w);
+        const T *h = static_cast<const T *>(a.h) + l * sh.padded_column_size();
+        const T *x = input(a, l);
+        T *dw = static_cast<T *>(a.dw);
+        T *db = static_cast<T *>(a.db);
+        T *dx = static_cast<T *>(a.dx);
+        for (int j = j0; j < j1; ++j) {
+            const size_t c = (size_t)l * sh.D + j;
+            const size_t e = j * sh.cell_size();
+            // the cell at j feeds the sums at j - offsets[k]
+            const detail::RowSum<T, 3> dz{{dz_cell(a, j - offsets[0]), dz_cell(a, j - offsets[1]),
+                                           dz_cell(a, j - offsets[2])}};
+            detail::cell_backward<T, dim, Act>(w + c * dim * dim, x + e, h + (j + pad) * sh.cell_size(), dz,
+                                               dw + c * dim * dim, db + c * dim, dx + e, s0, s1);
+        }
+    }
+
+    static void fn(const BackwardArgs &args) {
+        utils::ArenaScope scope(args.arena);
+        BackwardArgs a = args;
+        a.dz = utils::scratch_or<T>(a.dz, a.arena, (a.shape.D + 2 * pad) * a.shape.cell_size());
+        if (a.pool != nullptr && a.pool->size() > 1)
+            return parallel_backward<Backward>(a, *a.pool);
+        const Shape &sh = a.shape;
+        zero_pads(a);
+        for (int l = sh.L - 1; l >= 0; --l) {
+            // dx of cell j may overwrite the incoming gradient of sum j,
+            // as long as sum j + 1 has already been read
+            sums(a, l, 0, 1, 0, sh.batch);
+            for (int j = 0; j < sh.D; ++j) {
+                if (j + 1 < sh.D)
+                    sums(a, l, j + 1, j + 2, 0, sh.batch);
+                cells(a, l, j, j + 1, 0, sh.batch);
+            }
+            a.column_done(l);
+        }
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct Backward3D {
+    static constexpr int dim = Dim::value;
+
+    static const T *input(const Backward3DArgs &a, int l) {
+        if (l == 0)
+            return static_cast<const T *>(a.x);
+        return static_cast<const T *>(a.y) + (l - 1) * a.shape.layer_size();
+    }
+
+    static const T *grad_out(const Backward3DArgs &a, int l) {
+        if (l == a.shape.L - 1)
+            return static_cast<const T *>(a.grad);
+        return static_cast<const T *>(a.dx);
+    }
+
+    static T *dz_cell(const Backward3DArgs &a, int i, int k) {
+        return static_cast<T *>(a.dz) + a.shape.padded_cell(i, k);
+    }
+
+    static void zero_pads(const Backward3DArgs &a) {
+        const Shape3D &sh = a.shape;
+        const int r = sh.radius;
+        for (int i = -r; i < sh.Dy + r; ++i)
+            for (int k = -r; k < sh.Dz + r; ++k)
+                if (i < 0 || i >= sh.Dy || k < 0 || k >= sh.Dz)
+                    std::memset(dz_cell(a, i, k), 0, sh.cell_size() * sizeof(T));
+    }
+
+    // the sum gradients of row i of layer l
+    static void sums(const Backward3DArgs &a, int l, int i, int s0, int s1) {
+        const Shape3D &sh = a.shape;
+        const T *g  = grad_out(a, l);
+        const T *y  = static_cast<const T *>(a.y) + l * sh.layer_size();
+        const T *sd = static_cast<const T *>(a.sd) + (size_t)l * sh.cells() * sh.batch;
+        for (int k = 0; k < sh.Dz; ++k) {
+            const size_t e = (size_t)i * sh.Dz + k;
+            detail::cell_d_normalize<T, dim>(g + e * sh.cell_size(), y + e * sh.cell_size(), sd + e * sh.batch,
+                                             dz_cell(a, i, k), s0, s1);
+        }
+    }
+
+    // the cells of row i of layer l, reads dz of rows [i - radius, i + radius]
+    static void cells(const Backward3DArgs &a, int l, int i, int s0, int s1) {
+        const Shape3D &sh = a.shape;
+        const T *w = static_cast<const T *>(a.w);
+        const T *h = static_cast<const T *>(a.h) + l * sh.padded_layer_size();
+        const T *x = input(a, l);
+        T *dw = static_cast<T *>(a.dw);
+        T *db = static_cast<T *>(a.db);
+        T *dx = static_cast<T *>(a.dx);
+        for (int k = 0; k < sh.Dz; ++k) {
+            const size_t e = (size_t)i * sh.Dz + k;
+            const size_t c = (size_t)l * sh.cells() + e;
+            const detail::StencilRows<T> dz{dz_cell(a, i, k), sh.padded_Dz() * sh.cell_size(), sh.cell_size(),
+                                            sh.radius};
+            detail::cell_backward<T, dim, Act>(w + c * dim * dim, x + e * sh.cell_size(), h + sh.padded_cell(i, k),
+                                               dz, dw + c * dim * dim, db + c * dim, dx + e * sh.cell_size(), s0, s1);
+        }
+    }
+
+    static void fn(const Backward3DArgs &args) {
+        utils::ArenaScope scope(args.arena);
+        Backward3DArgs a = args;
+        const Shape3D &sh = a.shape;
+        a.dz = utils::scratch_or<T>(a.dz, a.arena, sh.padded_layer_size());
+        zero_pads(a);
+        if (a.pool != nullptr && a.pool->size() > 1) {
+            // rows of sums, then rows of cells, which accumulate per cell
+            for (int l = sh.L - 1; l >= 0; --l) {
+                for_range(a.pool, sh.Dy, [&](int i0, int i1) {
+                    for (int i = i0; i < i1; ++i)
+                        sums(a, l, i, 0, sh.batch);
+                });
+                for_range(a.pool, sh.Dy, [&](int i0, int i1) {
+                    for (int i = i0; i < i1; ++i)
+                        cells(a, l, i, 0, sh.batch);
+                });
+            }
+            return;
+        }
+        const int r = sh.radius;
+        const int tile = detail::stencil_tile(sh, sizeof(T));
+        for (int l = sh.L - 1; l >= 0; --l) {
+            for (int s0 = 0; s0 < sh.batch; s0 += tile) {
+                const int s1 = std::min(s0 + tile, sh.batch);
+                // dx of row i may overwrite the incoming gradient of row i,
+                // whose sums are the first radius rows behind
+                for (int i = 0; i < sh.Dy + r; ++i) {
+                    if (i < sh.Dy)
+                        sums(a, l, i, s0, s1);
+                    if (i >= r)
+                        cells(a, l, i - r, s0, s1);
+                }
+            }
+        }
+    }
+};
+
+namespace detail {
+    // cell_d_normalize with the dimension only known at runtime
+    template <typename T>
+    inline void cell_d_normalize_any(const T *g, const T *y, const T *sd, T *dz, int dim, int s0, int s1) {
+        for (int s = s0; s < s1; ++s) {
+            const size_t o = (size_t)s * dim;
+            const T *gs = g + o;
+            const T *ys = y + o;
+            T dot = 0, sum = 0;
+            for (int k = 0; k < dim; ++k) {
+                dot += gs[k] * ys[k];
+                sum += gs[k];
+            }
+            const T sdv = sd[s];
+            const T r = T(1) / (sdv + T(norm_eps));
+            const T c = sdv > 0 ? dot / (sdv * (dim - 1)) : T(0);
+            const T gm = sum / dim;
+            for (int k = 0; k < dim; ++k)
+                dz[o + k] = r * (gs[k] - gm) - c * ys[k];
+        }
+    }
+
+    // cell_backward with the dimension only known at runtime, dp is scratch
+    // for one row of the gradient before the activation
+    template <typename T, typename Act, typename Rows>
+    inline void cell_backward_any(const T *w, const T *x, const T *h, const Rows &dz,
+                                  T *dw, T *db, T *dx, T *dp, int dim, int s0, int s1) {
+        using lane = simd::Pack<T, 1>;
+        for (int s = s0; s < s1; ++s) {
+            const size_t o = (size_t)s * dim;
+            for (int k = 0; k < dim; ++k) {
+                dp[k] = Act::scalar_backward(h[o + k], dz.template load<lane>(o + k).v[0]);
+                db[k] += dp[k];
+            }
+            for (int i = 0; i < dim; ++i) {
+                const T *wi = w + (size_t)i * dim;
+                T *dwi = dw + (size_t)i * dim;
+                const T xi = x[o + i];
+                T acc = 0;
+                for (int k = 0; k < dim; ++k) {
+                    acc += dp[k] * wi[k];
+                    dwi[k] += xi * dp[k];
+                }
+                dx[o + i] = acc;
+            }
+        }
+    }
+} // detail
+
+// the dense grid backward at any dim, the counterpart of RuntimeDimForward
+template <typename T, typename Dim, typename Act = Relu>
+struct RuntimeDimBackward {
+    using dense = Backward<T, Dim, Act>;
+
+    static void zero_pads(const BackwardArgs &a) { dense::zero_pads(a); }
+
+    static void sums(const BackwardArgs &a, int l, int j0, int j1, int s0, int s1) {
+        const Shape &sh = a.shape;
+        const T *g  = dense::grad_out(a, l);
+        const T *y  = static_cast<const T *>(a.y) + l * sh.column_size();
+        const T *sd = static_cast<const T *>(a.sd) + (size_t)l * sh.D * sh.batch;
+        for (int j = j0; j < j1; ++j) {
+            const size_t c = j * sh.cell_size();
+            detail::cell_d_normalize_any<T>(g + c, y + c, sd + (size_t)j * sh.batch, dense::dz_cell(a, j),
+                                            sh.dim, s0, s1);
+        }
+    }
+
+    static void cells(const BackwardArgs &a, int l, int j0, int j1, int s0, int s1) {
+        const Shape &sh = a.shape;
+        const size_t n = sh.dim;
+        const T *w = static_cast<const T *>(a.w);
+        const T *h = static_cast<const T *>(a.h) + l * sh.padded_column_size();
+        const T *x = dense::input(a, l);
+        T *dw = static_cast<T *>(a.dw);
+        T *db = static_cast<T *>(a.db);
+        T *dx = static_cast<T *>(a.dx);
+        std::vector<T> dp(n);
+        for (int j = j0; j < j1; ++j) {
+            const size_t c = (size_t)l * sh.D + j;
+            const size_t e = j * sh.cell_size();
+            const detail::RowSum<T, 3> dz{{dense::dz_cell(a, j - offsets[0]), dense::dz_cell(a, j - offsets[1]),
+                                           dense::dz_cell(a, j - offsets[2])}};
+            detail::cell_backward_any<T, Act>(w + c * n * n, x + e, h + (j + pad) * sh.cell_size(), dz,
+                                              dw + c * n * n, db + c * n, dx + e, dp.data(), sh.dim, s0, s1);
+        }
+    }
+
+    static void fn(const BackwardArgs &args) {
+        utils::ArenaScope scope(args.arena);
+        BackwardArgs a = args;
+        a.dz = utils::scratch_or<T>(a.dz, a.arena, a.shape.padded_column_size());
+        if (a.pool != nullptr && a.pool->size() > 1)
+            return parallel_backward<RuntimeDimBackward>(a, *a.pool);
+        const Shape &sh = a.shape;
+        zero_pads(a);
+        for (int l = sh.L - 1; l >= 0; --l) {
+            // as for the dense grid, dx of cell j overwrites the incoming
+            // gradient of sum j only once sum j + 1 has been read
+            sums(a, l, 0, 1, 0, sh.batch);
+            for (int j = 0; j < sh.D; ++j) {
+                if (j + 1 < sh.D)
+                    sums(a, l, j + 1, j + 2, 0, sh.batch);
+                cells(a, l, j, j + 1, 0, sh.batch);
+            }
+            a.column_done(l);
+        }
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct SparseBackward {
+    static constexpr int dim = Dim::value;
+
+    static void fn(const SparseBackwardArgs &args) {
+        utils::ArenaScope scope(args.arena);
+        const Shape &sh = args.shape;
+        const Adjacency &g = args.adj;
+        const T *w = static_cast<const T *>(args.w);
+        T *dz = utils::scratch_or<T>(args.dz, args.arena, sh.column_size());
+        T *dw = static_cast<T *>(args.dw);
+        T *db = static_cast<T *>(args.db);
+        T *dx = static_cast<T *>(args.dx);
+        for (int l = sh.L - 1; l >= 0; --l) {
+            const T *gr = l == sh.L - 1 ? static_cast<const T *>(args.grad) : dx;
+            const T *x  = l == 0 ? static_cast<const T *>(args.x)
+                                 : static_cast<const T *>(args.y) + (l - 1) * sh.column_size();
+            const T *h  = static_cast<const T *>(args.h) + l * sh.column_size();
+            const T *y  = static_cast<const T *>(args.y) + l * sh.column_size();
+            const T *sd = static_cast<const T *>(args.sd) + (size_t)l * sh.D * sh.batch;
+
+            // every sum is read before any dx is written, so dx may overwrite
+            // the incoming gradient whatever the connectivity
+            for_range(args.pool, sh.D, [&](int j0, int j1) {
+                for (int j = j0; j < j1; ++j) {
+                    if (g.in_ptr[l * sh.D + j + 1] == g.in_ptr[l * sh.D + j])
+                        continue;
+                    const size_t e = j * sh.cell_size();
+                    detail::cell_d_normalize<T, dim>(gr + e, y + e, sd + (size_t)j * sh.batch, dz + e, 0, sh.batch);
+                }
+            });
+            // only live cells are written below
+            if (g.live_ptr[l + 1] - g.live_ptr[l] < sh.D)
+                std::memset(dx, 0, sh.column_size() * sizeof(T));
+            const int *live = g.live + g.live_ptr[l];
+            for_range(args.pool, g.live_ptr[l + 1] - g.live_ptr[l], [&](int k0, int k1) {
+                for (int k = k0; k < k1; ++k) {
+                    const int i = live[k];
+                    const int r = l * sh.D + i;
+                    const size_t c = (size_t)r;
+                    const size_t e = i * sh.cell_size();
+                    const detail::ListedRows<T> dzs{dz, sh.cell_size(), g.out_idx + g.out_ptr[r],
+                                                    g.out_ptr[r + 1] - g.out_ptr[r]};
+                    detail::cell_backward<T, dim, Act>(w + c * dim * dim, x + e, h + e, dzs,
+                                                       dw + c * dim * dim, db + c * dim, dx + e, 0, sh.batch);
+                }
+            });
+        }
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct GatedBackward {
+    static constexpr int dim = Dim::value;
+    using dense = Backward<T, Dim, Act>;
+
+    // the active rows of a cell gathered, as for GatedForward
+    struct Packed {
+        int *idx;
+        T *u;
+        T *h;
+        T *dz;
+        T *du;
+    };
+
+    // cell j of column l, reads dz of sums [j - 1, j + 2)
+    static void cell(const GatedBackwardArgs &args, const BackwardArgs &a, const Packed &p, int l, int j, const T *x) {
+        const Shape &sh = a.shape;
+        const size_t c = (size_t)l * sh.D + j;
+        const size_t e = j * sh.cell_size();
+        const T s = static_cast<const T *>(args.gate)[2 * c];
+        const T b = static_cast<const T *>(args.gate)[2 * c + 1];
+        const T *mag = static_cast<const T *>(args.mag) + c * sh.batch;
+        const T *h = static_cast<const T *>(a.h) + l * sh.padded_column_size() + (j + pad) * sh.cell_size();
+        const detail::RowSum<T, 3> dz{{dense::dz_cell(a, j - offsets[0]), dense::dz_cell(a, j - offsets[1]),
+                                       dense::dz_cell(a, j - offsets[2])}};
+        int *idx = p.idx + (size_t)j * sh.batch;
+        T *u  = p.u + e;
+        T *hp = p.h + e;
+        T *gz = p.dz + e;
+        T *du = p.du + e;
+
+        using row  = simd::Row<T, dim>;
+        using pack = typename row::pack;
+        // the samples the forward pass kept, rebuilt from the kept magnitudes
+        int n = 0;
+        for (int r = 0; r < sh.batch; ++r) {
+            if (WeightedSigmoid::is_underflow(s, b, T(args.eps), mag[r]))
+                continue;
+            const size_t o = (size_t)r * dim;
+            const size_t q = (size_t)n * dim;
+            detail::row_scale<T, dim>(WeightedSigmoid::forward(s, b, mag[r]), x + o, u + q);
+            std::memcpy(hp + q, h + o, dim * sizeof(T));
+            for (int k = 0; k < row::N; ++k)
+                dz.template load<pack>(o + k * row::W).store(gz + q + k * row::W);
+            idx[n++] = r;
+        }
+
+        T *dx = static_cast<T *>(a.dx) + e;
+        if (n < sh.batch)
+            std::memset(dx, 0, sh.cell_size() * sizeof(T));
+        if (n == 0)
+            return;
+        detail::cell_backward<T, dim, Act>(static_cast<const T *>(a.w) + c * dim * dim, u, hp,
+                                           detail::RowSum<T, 1>{{gz}}, static_cast<T *>(a.dw) + c * dim * dim,
+                                           static_cast<T *>(a.db) + c * dim, du, 0, n);
+
+        // du is the gradient w.r.t. the scaled input g(m) x, through both g
+        // and the magnitude m = |x|
+        T ds = 0, dbeta = 0;
+        for (int k = 0; k < n; ++k) {
+            const size_t o = (size_t)idx[k] * dim;
+            const T *duk = du + (size_t)k * dim;
+            const T m = mag[idx[k]];
+            const T g = WeightedSigmoid::forward(s, b, m);
+            const T dg = detail::row_dot<T, dim>(duk, x + o) * g * (T(1) - g);
+            ds += dg * b;
+            dbeta -= dg * (m - s);
+            // dL/dm = -dg * b, spread along x / m
+            const pack gp = pack::set1(g);
+            const pack mp = pack::set1(m > 0 ? -dg * b / m : T(0));
+            for (int i = 0; i < row::N; ++i) {
+                const size_t f = o + i * row::W;
+                (gp * pack::load(duk + i * row::W) + mp * pack::load(x + f)).store(dx + f);
+            }
+        }
+        static_cast<T *>(args.dgate)[2 * c] += ds;
+        static_cast<T *>(args.dgate)[2 * c + 1] += dbeta;
+    }
+
+    static void fn(const GatedBackwardArgs &args) {
+        if (args.grid.arena == nullptr)
+            throw std::invalid_argument("gated grid kernels need an arena");
+        utils::ArenaScope scope(args.grid.arena);
+        BackwardArgs a = args.grid;
+        const Shape &sh = a.shape;
+        a.dz = utils::scratch_or<T>(a.dz, a.arena, sh.padded_column_size());
+        const Packed p{a.arena->reserve<int>((size_t)sh.D * sh.batch), a.arena->reserve<T>(sh.column_size()),
+                       a.arena->reserve<T>(sh.column_size()), a.arena->reserve<T>(sh.column_size()),
+                       a.arena->reserve<T>(sh.column_size())};
+        dense::zero_pads(a);
+        for (int l = sh.L - 1; l >= 0; --l) {
+            // every sum is read before any dx is written, as for the sparse grid
+            for_range(a.pool, sh.D, [&](int j0, int j1) { dense::sums(a, l, j0, j1, 0, sh.batch); });
+            const T *x = dense::input(a, l);
+            for_range(a.pool, sh.D, [&](int j0, int j1) {
+                for (int j = j0; j < j1; ++j)
+                    cell(args, a, p, l, j, x + j * sh.cell_size());
+            });
+        }
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct MixedBackward {
+    static constexpr int dim = Dim::value;
+    // cell_backward transposes w once per call, so it is handed a few tiles
+    static constexpr int tile = 4 * detail::batch_tile;
+    using dense = Backward<T, Dim, Act>;
+
+    template <typename F>
+    static F *dz_cell(F *dz, const Shape &sh, int j) {
+        return dz + (j + pad) * sh.cell_size();
+    }
+
+    // dz of the sums of cell j, from the float gradient g of the column output
+    static void sums(const BackwardArgs &a, int l, int j, const float *g, float *dz) {
+        const Shape &sh = a.shape;
+        const T *y = static_cast<const T *>(a.y) + l * sh.column_size() + j * sh.cell_size();
+        const float *sd = static_cast<const float *>(a.sd) + ((size_t)l * sh.D + j) * sh.batch;
+        alignas(64) float yt[tile * dim];
+        for (int s0 = 0; s0 < sh.batch; s0 += tile) {
+            const int s1 = std::min(s0 + tile, sh.batch);
+            const size_t o = (size_t)s0 * dim;
+            utils::convert(y + o, yt, (size_t)(s1 - s0) * dim);
+            detail::cell_d_normalize<float, dim>(g + j * sh.cell_size() + o, yt, sd + s0, dz_cell(dz, sh, j) + o,
+                                                 0, s1 - s0);
+        }
+    }
+
+    static void cell(const BackwardArgs &a, int l, int j, const float *w, const float *dz, float *dx) {
+        const Shape &sh = a.shape;
+        const size_t c = (size_t)l * sh.D + j;
+        const size_t e = j * sh.cell_size();
+        const T *x = dense::input(a, l) + e;
+        const T *h = static_cast<const T *>(a.h) + l * sh.padded_column_size() + (j + pad) * sh.cell_size();
+        alignas(64) float xt[tile * dim];
+        alignas(64) float ht[tile * dim];
+        for (int s0 = 0; s0 < sh.batch; s0 += tile) {
+            const int s1 = std::min(s0 + tile, sh.batch);
+            const size_t o = (size_t)s0 * dim;
+            const size_t n = (size_t)(s1 - s0) * dim;
+            utils::convert(x + o, xt, n);
+            utils::convert(h + o, ht, n);
+            // the cell at j feeds the sums at j - offsets[k]
+            const detail::RowSum<float, 3> dzs{{dz_cell(dz, sh, j - offsets[0]) + o, dz_cell(dz, sh, j - offsets[1]) + o,
+                                                dz_cell(dz, sh, j - offsets[2]) + o}};
+            detail::cell_backward<float, dim, Act>(w + (size_t)j * dim * dim, xt, ht, dzs,
+                                                   static_cast<float *>(a.dw) + c * dim * dim,
+                                                   static_cast<float *>(a.db) + c * dim, dx + e + o, 0, s1 - s0);
+        }
+    }
+
+    static void fn(const BackwardArgs &a) {
+        if (a.arena == nullptr)
+            throw std::invalid_argument("mixed precision grid kernels need an arena");
+        utils::ArenaScope scope(a.arena);
+        const Shape &sh = a.shape;
+        const size_t nw = (size_t)sh.D * dim * dim;
+        float *w = a.arena->reserve<float>(nw);
+        // the gradient between columns stays float, only dx is narrowed
+        float *g[2] = {a.arena->reserve<float>(sh.column_size()), a.arena->reserve<float>(sh.column_size())};
+        float *dz = a.arena->reserve<float>(sh.padded_column_size());
+        std::memset(dz_cell(dz, sh, -1), 0, sh.cell_size() * sizeof(float));
+        std::memset(dz_cell(dz, sh, sh.D), 0, sh.cell_size() * sizeof(float));
+        MixedForward<T, Dim, Act>::convert(a.pool, static_cast<const T *>(a.grad), g[0], sh.column_size());
+        for (int l = sh.L - 1; l >= 0; --l) {
+            const int k = (sh.L - 1 - l) % 2;
+            MixedForward<T, Dim, Act>::convert(a.pool, static_cast<const T *>(a.w) + l * nw, w, nw);
+            for_range(a.pool, sh.D, [&](int j0, int j1) {
+                for (int j = j0; j < j1; ++j)
+                    sums(a, l, j, g[k], dz);
+            });
+            for_range(a.pool, sh.D, [&](int j0, int j1) {
+                for (int j = j0; j < j1; ++j)
+                    cell(a, l, j, w, dz, g[1 - k]);
+            });
+            a.column_done(l);
+        }
+        MixedForward<T, Dim, Act>::convert(a.pool, g[sh.L % 2], static_cast<T *>(a.dx), sh.column_size());
+    }
+};
+
+} // grid
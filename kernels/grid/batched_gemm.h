@@ -0,0 +1,110 @@
+/*
+strided batched gemm over every cell of a column at once, y_c = x_c * w_c + b_c
+
+for the small dims the grid uses, a single cell's matrix only fills part of a
+vector register, so the cells are packed interleaved instead, lanes consecutive
+cells per group with the cell index innermost,
+    packed[group][r][c][lane] = cell[group * lanes + lane][r][c]
+and each vector instruction then advances lanes cells in lockstep, at full
+width regardless of dim
+*/
+
+#pragma once
+#include <cstring>
+
+#include "grid.h"
+
+namespace grid {
+
+struct GemmArgs {
+    // packed [cells, batch, dim], [cells, dim, dim] (input major like w),
+    // [cells, dim] or null, and [cells, batch, dim]
+    const void *x;
+    const void *w;
+    const void *b;
+    void *y;
+    int cells;
+    int batch;
+};
+
+using gemm_fn = void (*)(const GemmArgs &);
+
+template <typename T>
+constexpr int cell_lanes = simd::max_width<T>;
+
+inline int cell_groups(int cells, int lanes) {
+    return (cells + lanes - 1) / lanes;
+}
+
+// [cells, elems] plain to packed, the cells past the end of the last group are zeroed
+template <typename T>
+void pack_cells(const T *src, T *dst, int cells, size_t elems) {
+    constexpr int lanes = cell_lanes<T>;
+    const int groups = cell_groups(cells, lanes);
+    for (int g = 0; g < groups; ++g) {
+        T *d = dst + g * elems * lanes;
+        for (int lane = 0; lane < lanes; ++lane) {
+            const int c = g * lanes + lane;
+            for (size_t e = 0; e < elems; ++e)
+                d[e * lanes + lane] = c < cells ? src[c * elems + e] : T(0);
+        }
+    }
+}
+
+template <typename T>
+void unpack_cells(const T *src, T *dst, int cells, size_t elems) {
+    constexpr int lanes = cell_lanes<T>;
+    for (int c = 0; c < cells; ++c) {
+        const T *s = src + (c / lanes) * elems * lanes + c % lanes;
+        for (size_t e = 0; e < elems; ++e)
+            dst[c * elems + e] = s[e * lanes];
+    }
+}
+
+template <typename T>
+size_t packed_size(int cells, size_t elems) {
+    return cell_groups(cells, cell_lanes<T>) * cell_lanes<T> * elems;
+}
+
+template <typename T, typename Dim>
+struct BatchedGemm {
+    static constexpr int dim = Dim::value;
+    static constexpr int lanes = cell_lanes<T>;
+    using pack = simd::Pack<T, lanes>;
+    // outputs held in registers per pass over the inputs
+    static constexpr int out_tile = dim < 8 ? dim : 8;
+    static_assert(dim % out_tile == 0, "dim must be a multiple of the output tile");
+
+    static void fn(const GemmArgs &a) {
+        const T *x = static_cast<const T *>(a.x);
+        const T *w = static_cast<const T *>(a.w);
+        const T *b = static_cast<const T *>(a.b);
+        T *y = static_cast<T *>(a.y);
+        const int groups = cell_groups(a.cells, lanes);
+        const size_t xs = (size_t)a.batch * dim * lanes;
+
+        for (int g = 0; g < groups; ++g) {
+            const T *wg = w + (size_t)g * dim * dim * lanes;
+            const T *bg = b ? b + (size_t)g * dim * lanes : nullptr;
+            for (int s = 0; s < a.batch; ++s) {
+                const T *xr = x + g * xs + (size_t)s * dim * lanes;
+                T *yr = y + g * xs + (size_t)s * dim * lanes;
+                for (int o0 = 0; o0 < dim; o0 += out_tile) {
+                    pack acc[out_tile];
+                    for (int t = 0; t < out_tile; ++t)
+                        acc[t] = bg ? pack::load(bg + (o0 + t) * lanes) : pack::zero();
+                    for (int i = 0; i < dim; ++i) {
+                        const pack xi = pack::load(xr + i * lanes);
+                        const T *wi = wg + ((size_t)i * dim + o0) * lanes;
+                        for (int t = 0; t < out_tile; ++t)
+                            acc[t] = fmadd(xi, pack::load(wi + t * lanes), acc[t]);
+                    }
+                    for (int t = 0; t < out_tile; ++t)
+                        acc[t].store(yr + (o0 + t) * lanes);
+                }
+            }
+        }
+    }
+};
+
+} // grid
@@ -0,0 +1,25 @@
+/*
+the few whole buffer operations the drivers built on top of the column
+kernels need, the host versions here, the device ones live in grid.cu,
+ordered on the stream of the kernels around them
+*/
+
+#pragma once
+#include <cstring>
+
+namespace grid {
+
+template <typename T>
+struct HostOps {
+    static void copy(T *dst, const T *src, size_t n, void *stream) {
+        std::memcpy(dst, src, n * sizeof(T));
+    }
+
+    // dst += alpha * src
+    static void add(T *dst, const T *src, T alpha, size_t n, void *stream) {
+        for (size_t i = 0; i < n; ++i)
+            dst[i] += alpha * src[i];
+    }
+};
+
+} // grid
@@ -0,0 +1,219 @@
+/*
+gradient checkpointing for the standard grid, the forward pass only keeps
+the input of every stride-th column, and the backward pass recomputes each
+segment of stride columns from its checkpoint right before taking its
+gradient, so what is kept grows with L / stride and the scratch with stride,
+instead of h, y and sd growing with L
+
+every column is recomputed once whatever the stride, so the stride only
+trades memory, longer segments just hand the column kernels more work per
+call, checkpoint_stride picks the longest one that fits a byte budget
+
+segments are run as grids of their own through the column kernels, with
+ping-pong buffers for the gradient between segments as in grid.cu, so the
+cpu and cuda versions share the driver
+*/
+
+#pragma once
+#include <algorithm>
+
+#include "grid.h"
+#include "buffer_ops.h"
+#include "../utils/arena.h"
+
+namespace grid {
+
+struct CheckpointForwardArgs {
+    const void *w;
+    const void *b;
+    const void *x;
+    // [segments - 1, D, batch, dim] input of columns stride, 2 * stride, ...
+    void *ckpt;
+    // [D, batch, dim] the grid output
+    void *out;
+    Shape shape;
+    // columns per segment, 0 to derive it from budget with checkpoint_stride
+    int stride = 0;
+    size_t budget = 0;
+    void *stream = nullptr;
+    utils::ThreadPool *pool = nullptr;
+    // required, holds one segment, see checkpoint_scratch_bytes
+    utils::Arena *arena = nullptr;
+};
+
+using checkpoint_forward_fn = void (*)(const CheckpointForwardArgs &);
+
+struct CheckpointBackwardArgs {
+    const void *w;
+    const void *b;
+    const void *x;
+    // as written by the forward pass, with the same stride and budget
+    const void *ckpt;
+    // [D, batch, dim] dL/dout
+    const void *grad;
+    // [D, batch, dim] dL/dx
+    void *dx;
+    // accumulated into
+    void *dw;
+    void *db;
+    Shape shape;
+    int stride = 0;
+    size_t budget = 0;
+    void *stream = nullptr;
+    utils::ThreadPool *pool = nullptr;
+    // required, as for the forward pass
+    utils::Arena *arena = nullptr;
+};
+
+using checkpoint_backward_fn = void (*)(const CheckpointBackwardArgs &);
+
+inline int checkpoint_segments(const Shape &sh, int stride) {
+    return (sh.L + stride - 1) / stride;
+}
+
+// arena bytes for a segment of stride columns and its backward
+inline size_t checkpoint_scratch_bytes(const Shape &sh, int stride, size_t elem) {
+    const size_t k = std::min(stride, sh.L);
+    const size_t bufs[] = {
+        k * sh.padded_column_size(),        // h
+        k * sh.column_size(),               // y
+        k * sh.D * sh.batch,                // sd
+        sh.column_size(),                   // gradient between segments
+        sh.padded_column_size(),            // dz of the column backward
+    };
+    size_t bytes = 0;
+    for (size_t n : bufs)
+        bytes += (n * elem + utils::Arena::alignment - 1) / utils::Arena::alignment * utils::Arena::alignment;
+    return bytes;
+}
+
+// checkpoints plus scratch, everything the two passes need besides the
+// weights, x, the output and the gradients
+inline size_t checkpoint_bytes(const Shape &sh, int stride, size_t elem) {
+    return (checkpoint_segments(sh, stride) - 1) * sh.column_size() * elem + checkpoint_scratch_bytes(sh, stride, elem);
+}
+
+// the longest segments whose memory fits the budget, or the stride using
+// the least memory when none does
+inline int checkpoint_stride(const Shape &sh, size_t elem, size_t budget) {
+    int best = 1;
+    for (int k = sh.L; k >= 1; --k) {
+        const size_t bytes = checkpoint_bytes(sh, k, elem);
+        if (bytes <= budget)
+            return k;
+        if (bytes < checkpoint_bytes(sh, best, elem))
+            best = k;
+    }
+    return best;
+}
+
+template <typename Args>
+int resolve_stride(const Args &a, size_t elem) {
+    if (a.stride > 0)
+        return std::min(a.stride, a.shape.L);
+    return checkpoint_stride(a.shape, elem, a.budget);
+}
+
+// Fwd and Bwd are column kernels with the interface of grid::Forward and
+// grid::Backward, Ops the buffer ops of buffer_ops.h
+template <typename T, typename Dim, typename Act,
+          template <class, class, class> class Fwd, template <class, class, class> class Bwd, typename Ops>
+struct CheckpointedGrid {
+    static constexpr int dim = Dim::value;
+    using fwd = Fwd<T, Dim, Act>;
+    using bwd = Bwd<T, Dim, Act>;
+
+    // one segment's worth of kept state
+    struct Segment {
+        T *h;
+        T *y;
+        T *sd;
+
+        static Segment reserve(utils::Arena *arena, const Shape &sh, int stride) {
+            if (arena == nullptr)
+                throw std::invalid_argument("checkpointed grid kernels need an arena");
+            return Segment{arena->reserve<T>(stride * sh.padded_column_size()),
+                           arena->reserve<T>(stride * sh.column_size()),
+                           arena->reserve<T>((size_t)stride * sh.D * sh.batch)};
+        }
+    };
+
+    // columns [l0, l1) run as a grid of their own
+    template <typename Args>
+    static ForwardArgs segment(const Args &a, const Segment &seg, const T *in, int l0, int l1) {
+        const Shape &sh = a.shape;
+        ForwardArgs fa{static_cast<const T *>(a.w) + (size_t)l0 * sh.D * dim * dim,
+                       static_cast<const T *>(a.b) + (size_t)l0 * sh.D * dim,
+                       in, seg.h, seg.y, seg.sd, Shape{dim, sh.D, l1 - l0, sh.batch}};
+        fa.stream = a.stream;
+        fa.pool = a.pool;
+        return fa;
+    }
+
+    static const T *checkpoint(const T *x, const T *ckpt, const Shape &sh, int s) {
+        return s == 0 ? x : ckpt + (size_t)(s - 1) * sh.column_size();
+    }
+
+    static void forward(const CheckpointForwardArgs &a) {
+        utils::ArenaScope scope(a.arena);
+        const Shape &sh = a.shape;
+        const int stride = resolve_stride(a, sizeof(T));
+        const int n_seg = checkpoint_segments(sh, stride);
+        const Segment seg = Segment::reserve(a.arena, sh, stride);
+        const T *x = static_cast<const T *>(a.x);
+        T *ckpt = static_cast<T *>(a.ckpt);
+        for (int s = 0; s < n_seg; ++s) {
+            const int l0 = s * stride;
+            const int l1 = std::min(l0 + stride, sh.L);
+            fwd::fn(segment(a, seg, checkpoint(x, ckpt, sh, s), l0, l1));
+            T *last = s + 1 < n_seg ? ckpt + (size_t)s * sh.column_size() : static_cast<T *>(a.out);
+            Ops::copy(last, seg.y + (size_t)(l1 - l0 - 1) * sh.column_size(), sh.column_size(), a.stream);
+        }
+    }
+
+    static void backward(const CheckpointBackwardArgs &a) {
+        utils::ArenaScope scope(a.arena);
+        const Shape &sh = a.shape;
+        const int stride = resolve_stride(a, sizeof(T));
+        const int n_seg = checkpoint_segments(sh, stride);
+        const Segment seg = Segment::reserve(a.arena, sh, stride);
+        const T *x = static_cast<const T *>(a.x);
+        const T *ckpt = static_cast<const T *>(a.ckpt);
+        // picked so that segment 0 writes dx
+        T *bufs[2] = {static_cast<T *>(a.dx), a.arena->reserve<T>(sh.column_size())};
+        const T *g = static_cast<const T *>(a.grad);
+        for (int s = n_seg - 1; s >= 0; --s) {
+            const int l0 = s * stride;
+            const int l1 = std::min(l0 + stride, sh.L);
+            const T *in = checkpoint(x, ckpt, sh, s);
+            const ForwardArgs fa = segment(a, seg, in, l0, l1);
+            fwd::fn(fa);
+
+            BackwardArgs ba{fa.w, in, seg.h, seg.y, seg.sd, g, bufs[s % 2],
+                            static_cast<T *>(a.dw) + (size_t)l0 * sh.D * dim * dim,
+                            static_cast<T *>(a.db) + (size_t)l0 * sh.D * dim, nullptr, fa.shape};
+            ba.stream = a.stream;
+            ba.pool = a.pool;
+            ba.arena = a.arena;
+            bwd::fn(ba);
+            g = bufs[s % 2];
+        }
+    }
+};
+
+// cpu kernels, instantiated in the cpu shards of grid/shards.h along with Forward and Backward
+template <typename T, typename Dim, typename Act = Relu>
+struct CheckpointForward {
+    static void fn(const CheckpointForwardArgs &a) {
+        CheckpointedGrid<T, Dim, Act, Forward, Backward, HostOps<T>>::forward(a);
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct CheckpointBackward {
+    static void fn(const CheckpointBackwardArgs &a) {
+        CheckpointedGrid<T, Dim, Act, Forward, Backward, HostOps<T>>::backward(a);
+    }
+};
+
+} // grid
@@ -0,0 +1,740 @@
+/*
+fused forward pass of the grid, forward_kernel! in m1/grid.jl
+
+per column, each cell computes h = act(x * w + b) and each sum cell
+the normalized sum of its neighbours, both in one pass over a tile of the
+batch, so the three h rows feeding a sum are still in L1 when they are read
+*/
+
+#pragma once
+#include <algorithm>
+#include <cstring>
+
+#include "grid.h"
+#include "scheduler.h"
+#include "sparse.h"
+#include "gated.h"
+#include "mixed.h"
+#include "grid3d.h"
+#include "inference.h"
+#include "quantize.h"
+#include "../utils/arena.h"
+
+namespace grid {
+
+namespace detail {
+    // samples per cache block, 3 * batch_tile * dim * sizeof(T) should fit in L1
+    constexpr int batch_tile = 32;
+
+    // h[s] = act(x[s] * w + b), for s in [s0, s1)
+    template <typename T, int Dim, typename Act>
+    inline void cell_forward(const T *w, const T *b, const T *x, T *h, int s0, int s1) {
+        using row  = simd::Row<T, Dim>;
+        using pack = typename row::pack;
+        const row bias = row::load(b);
+        for (int s = s0; s < s1; ++s) {
+            const T *xs = x + (size_t)s * Dim;
+            row acc = bias;
+            for (int i = 0; i < Dim; ++i) {
+                const pack xi = pack::set1(xs[i]);
+                const T *wi = w + i * Dim;
+                for (int k = 0; k < row::N; ++k)
+                    acc.p[k] = fmadd(xi, pack::load(wi + k * row::W), acc.p[k]);
+            }
+            for (int k = 0; k < row::N; ++k)
+                acc.p[k] = Act::forward(acc.p[k]);
+            acc.store(h + (size_t)s * Dim);
+        }
+    }
+
+    // samples cell_forward_blocks runs at once, as many as keep their rows
+    // of accumulators within 16 registers
+    template <typename T, int Dim>
+    constexpr int cell_block = std::clamp(16 / simd::Row<T, Dim>::N, 1, 4);
+
+    // cell_forward over cell_block samples at a time, every load of a pack
+    // of w feeding each of them, where cell_forward reloads w per sample and
+    // is bound by the loads, the remainder one at a time, the sums are added
+    // in the same order so h is the same
+    template <typename T, int Dim, typename Act>
+    inline void cell_forward_blocks(const T *w, const T *b, const T *x, T *h, int s0, int s1) {
+        using row  = simd::Row<T, Dim>;
+        using pack = typename row::pack;
+        constexpr int S = cell_block<T, Dim>;
+        const row bias = row::load(b);
+        int s = s0;
+        for (; s + S <= s1; s += S) {
+            const T *xs = x + (size_t)s * Dim;
+            row acc[S];
+            for (int t = 0; t < S; ++t)
+                acc[t] = bias;
+            for (int i = 0; i < Dim; ++i) {
+                pack xi[S];
+                for (int t = 0; t < S; ++t)
+                    xi[t] = pack::set1(xs[t * Dim + i]);
+                const T *wi = w + i * Dim;
+                for (int k = 0; k < row::N; ++k) {
+                    const pack wk = pack::load(wi + k * row::W);
+                    for (int t = 0; t < S; ++t)
+                        acc[t].p[k] = fmadd(xi[t], wk, acc[t].p[k]);
+                }
+            }
+            for (int t = 0; t < S; ++t) {
+                for (int k = 0; k < row::N; ++k)
+                    acc[t].p[k] = Act::forward(acc[t].p[k]);
+                acc[t].store(h + (size_t)(s + t) * Dim);
+            }
+        }
+        cell_forward<T, Dim, Act>(w, b, x, h, s, s1);
+    }
+
+    // rows of a fixed set of cells, summed on load, the three neighbours
+    // feeding a sum of the dense grid
+    template <typename T, int N>
+    struct RowSum {
+        const T *rows[N];
+
+        template <typename P>
+        P load(size_t o) const {
+            P z = P::load(rows[0] + o);
+            for (int k = 1; k < N; ++k)
+                z = z + P::load(rows[k] + o);
+            return z;
+        }
+    };
+
+    // rows base + idx[k] * stride for k in [0, n), n > 0, summed on load
+    // like RowSum, the sources of a sum of the sparse grid
+    template <typename T>
+    struct ListedRows {
+        const T *base;
+        size_t stride;
+        const int *idx;
+        int n;
+
+        template <typename P>
+        P load(size_t o) const {
+            P z = P::load(base + idx[0] * stride + o);
+            for (int k = 1; k < n; ++k)
+                z = z + P::load(base + idx[k] * stride + o);
+            return z;
+        }
+    };
+
+    // the (2 radius + 1)^2 cells of a padded plate around center, plate rows
+    // row_stride apart, summed on load like RowSum, the sources of a sum of
+    // the 3d grid and, the stencil being symmetric, the sums a cell feeds
+    template <typename T>
+    struct StencilRows {
+        const T *center;
+        size_t row_stride;
+        size_t cell;
+        int radius;
+
+        template <typename P>
+        P load(size_t o) const {
+            const int n = 2 * radius + 1;
+            const T *p = center - radius * (row_stride + cell) + o;
+            P z = P::zero();
+            for (int i = 0; i < n; ++i, p += row_stride)
+                for (int k = 0; k < n; ++k)
+                    z = z + P::load(p + k * cell);
+            return z;
+        }
+    };
+
+    // sum of a[i] * b[i] over a row
+    template <typename T, int Dim>
+    inline T row_dot(const T *a, const T *b) {
+        using row  = simd::Row<T, Dim>;
+        using pack = typename row::pack;
+        pack acc = pack::zero();
+        for (int k = 0; k < row::N; ++k)
+            acc = fmadd(pack::load(a + k * row::W), pack::load(b + k * row::W), acc);
+        return acc.sum();
+    }
+
+    // dst = a * src, over a row
+    template <typename T, int Dim>
+    inline void row_scale(T a, const T *src, T *dst) {
+        using row  = simd::Row<T, Dim>;
+        using pack = typename row::pack;
+        const pack ap = pack::set1(a);
+        for (int k = 0; k < row::N; ++k)
+            (ap * pack::load(src + k * row::W)).store(dst + k * row::W);
+    }
+
+    // y[s] = normalize(z[s]), z a sum of rows like RowSum, the sample
+    // standard deviation is kept for the backward pass
+    template <typename T, int Dim, typename Rows>
+    inline void cell_normalize(const Rows &zs, T *y, T *sd, int s0, int s1) {
+        using row  = simd::Row<T, Dim>;
+        using pack = typename row::pack;
+        for (int s = s0; s < s1; ++s) {
+            const size_t o = (size_t)s * Dim;
+            row z;
+            for (int k = 0; k < row::N; ++k)
+                z.p[k] = zs.template load<pack>(o + k * row::W);
+            const pack mu = pack::set1(z.sum() / Dim);
+            pack sq = pack::zero();
+            for (int k = 0; k < row::N; ++k) {
+                z.p[k] = z.p[k] - mu;
+                sq = fmadd(z.p[k], z.p[k], sq);
+            }
+            const T sdv = std::sqrt(sq.sum() / (Dim - 1));
+            const pack r = pack::set1(T(1) / (sdv + T(norm_eps)));
+            for (int k = 0; k < row::N; ++k)
+                z.p[k] = z.p[k] * r;
+            z.store(y + o);
+            sd[s] = sdv;
+        }
+    }
+} // detail
+
+template <typename T, typename Dim, typename Act = Relu>
+struct Forward {
+    static constexpr int dim = Dim::value;
+
+    static const T *input(const ForwardArgs &a, int l) {
+        if (l == 0)
+            return static_cast<const T *>(a.x);
+        return static_cast<const T *>(a.y) + (l - 1) * a.shape.column_size();
+    }
+
+    static T *h_cell(const ForwardArgs &a, int l, int j) {
+        return static_cast<T *>(a.h) + l * a.shape.padded_column_size() + (j + pad) * a.shape.cell_size();
+    }
+
+    static void zero_pads(const ForwardArgs &a, int l) {
+        std::memset(h_cell(a, l, -1), 0, a.shape.cell_size() * sizeof(T));
+        std::memset(h_cell(a, l, a.shape.D), 0, a.shape.cell_size() * sizeof(T));
+    }
+
+    // cells [j0, j1) of column l
+    static void cells(const ForwardArgs &a, int l, int j0, int j1, int s0, int s1) {
+        const Shape &sh = a.shape;
+        const T *w = static_cast<const T *>(a.w);
+        const T *b = static_cast<const T *>(a.b);
+        const T *x = input(a, l);
+        for (int j = j0; j < j1; ++j) {
+            const size_t c = (size_t)l * sh.D + j;
+            detail::cell_forward<T, dim, Act>(
+                w + c * dim * dim, b + c * dim, x + j * sh.cell_size(), h_cell(a, l, j), s0, s1);
+        }
+    }
+
+    // neighbour sums [j0, j1) of column l, reads h of cells [j0 - 1, j1 + 1)
+    static void sums(const ForwardArgs &a, int l, int j0, int j1, int s0, int s1) {
+        const Shape &sh = a.shape;
+        T *y  = static_cast<T *>(a.y) + l * sh.column_size();
+        T *sd = static_cast<T *>(a.sd) + (size_t)l * sh.D * sh.batch;
+        for (int j = j0; j < j1; ++j) {
+            const detail::RowSum<T, 3> z{{h_cell(a, l, j + offsets[0]), h_cell(a, l, j + offsets[1]),
+                                          h_cell(a, l, j + offsets[2])}};
+            detail::cell_normalize<T, dim>(z, y + j * sh.cell_size(), sd + (size_t)j * sh.batch, s0, s1);
+        }
+    }
+
+    static void fn(const ForwardArgs &a) {
+        if (a.pool != nullptr && a.pool->size() > 1)
+            return parallel_forward<Forward>(a, *a.pool);
+        const Shape &sh = a.shape;
+        for (int l = 0; l < sh.L; ++l) {
+            zero_pads(a, l);
+            for (int s0 = 0; s0 < sh.batch; s0 += detail::batch_tile) {
+                const int s1 = std::min(s0 + detail::batch_tile, sh.batch);
+                // the sum at j - 1 is complete once cell j is computed
+                for (int j = 0; j < sh.D; ++j) {
+                    cells(a, l, j, j + 1, s0, s1);
+                    if (j > 0)
+                        sums(a, l, j - 1, j, s0, s1);
+                }
+                sums(a, l, sh.D - 1, sh.D, s0, s1);
+            }
+        }
+    }
+};
+
+namespace detail {
+    // cell_forward with the dimension only known at runtime, plain loops
+    // over the output row which the compiler is left to vectorize
+    template <typename T, typename Act>
+    inline void cell_forward_any(const T *w, const T *b, const T *x, T *h, int dim, int s0, int s1) {
+        for (int s = s0; s < s1; ++s) {
+            const T *xs = x + (size_t)s * dim;
+            T *hs = h + (size_t)s * dim;
+            std::memcpy(hs, b, dim * sizeof(T));
+            for (int i = 0; i < dim; ++i) {
+                const T xi = xs[i];
+                const T *wi = w + (size_t)i * dim;
+                for (int o = 0; o < dim; ++o)
+                    hs[o] += xi * wi[o];
+            }
+            for (int o = 0; o < dim; ++o)
+                hs[o] = Act::scalar_forward(hs[o]);
+        }
+    }
+
+    // cell_normalize with the dimension only known at runtime, the sum is
+    // loaded a lane at a time
+    template <typename T, typename Rows>
+    inline void cell_normalize_any(const Rows &zs, T *y, T *sd, int dim, int s0, int s1) {
+        using lane = simd::Pack<T, 1>;
+        for (int s = s0; s < s1; ++s) {
+            const size_t o = (size_t)s * dim;
+            T *ys = y + o;
+            T sum = 0;
+            for (int k = 0; k < dim; ++k) {
+                ys[k] = zs.template load<lane>(o + k).v[0];
+                sum += ys[k];
+            }
+            const T mu = sum / dim;
+            T sq = 0;
+            for (int k = 0; k < dim; ++k) {
+                ys[k] -= mu;
+                sq += ys[k] * ys[k];
+            }
+            const T sdv = std::sqrt(sq / (dim - 1));
+            const T r = T(1) / (sdv + T(norm_eps));
+            for (int k = 0; k < dim; ++k)
+                ys[k] *= r;
+            sd[s] = sdv;
+        }
+    }
+} // detail
+
+// the dense grid at any dim, at reduced speed, registered under dim 0 as the
+// kernel the tables fall back to for dims without a specialization, see
+// fallback_specs in lib.h
+template <typename T, typename Dim, typename Act = Relu>
+struct RuntimeDimForward {
+    using dense = Forward<T, Dim, Act>;
+
+    static void zero_pads(const ForwardArgs &a, int l) { dense::zero_pads(a, l); }
+
+    static void cells(const ForwardArgs &a, int l, int j0, int j1, int s0, int s1) {
+        const Shape &sh = a.shape;
+        const size_t n = sh.dim;
+        const T *w = static_cast<const T *>(a.w);
+        const T *b = static_cast<const T *>(a.b);
+        const T *x = dense::input(a, l);
+        for (int j = j0; j < j1; ++j) {
+            const size_t c = (size_t)l * sh.D + j;
+            detail::cell_forward_any<T, Act>(w + c * n * n, b + c * n, x + j * sh.cell_size(),
+                                             dense::h_cell(a, l, j), sh.dim, s0, s1);
+        }
+    }
+
+    static void sums(const ForwardArgs &a, int l, int j0, int j1, int s0, int s1) {
+        const Shape &sh = a.shape;
+        T *y  = static_cast<T *>(a.y) + l * sh.column_size();
+        T *sd = static_cast<T *>(a.sd) + (size_t)l * sh.D * sh.batch;
+        for (int j = j0; j < j1; ++j) {
+            const detail::RowSum<T, 3> z{{dense::h_cell(a, l, j + offsets[0]), dense::h_cell(a, l, j + offsets[1]),
+                                          dense::h_cell(a, l, j + offsets[2])}};
+            detail::cell_normalize_any<T>(z, y + j * sh.cell_size(), sd + (size_t)j * sh.batch, sh.dim, s0, s1);
+        }
+    }
+
+    static void fn(const ForwardArgs &a) {
+        if (a.pool != nullptr && a.pool->size() > 1)
+            return parallel_forward<RuntimeDimForward>(a, *a.pool);
+        const Shape &sh = a.shape;
+        for (int l = 0; l < sh.L; ++l) {
+            zero_pads(a, l);
+            for (int s0 = 0; s0 < sh.batch; s0 += detail::batch_tile) {
+                const int s1 = std::min(s0 + detail::batch_tile, sh.batch);
+                cells(a, l, 0, sh.D, s0, s1);
+                sums(a, l, 0, sh.D, s0, s1);
+            }
+        }
+    }
+};
+
+// the dense grid with backward state dropped, grid/inference.h, Dim any_dim
+// runs the runtime dim cells of RuntimeDimForward, T utils::qint8 the int8
+// cells of grid/quantize.h over float x, b and y
+template <typename T, typename Dim, typename Act = Relu>
+struct Inference {
+    static constexpr bool runtime = Dim::value == 0;
+    static constexpr bool quantized = std::is_same_v<T, utils::qint8>;
+    // of everything but w
+    using E = utils::accumulate_t<T>;
+
+    // a column of cells cell elements apart
+    struct Column {
+        E *p;
+        size_t cell;
+    };
+
+    static void cell(const InferArgs &a, int l, int j, const E *x, E *h, int n) {
+        const Shape &sh = a.shape;
+        const size_t c = (size_t)l * sh.D + j, d = sh.dim;
+        const E *b = static_cast<const E *>(a.b) + c * d;
+        if constexpr (quantized) {
+            const QuantCell q = QuantCell::at(a.w, c, sh.dim);
+            if constexpr (runtime)
+                detail::qcell_forward_any<Act>(q, b, x, h, sh.dim, n);
+            else
+                detail::qcell_forward<Dim::value, Act>(q, b, x, h, n);
+        } else {
+            const E *w = static_cast<const E *>(a.w) + c * d * d;
+            if constexpr (runtime)
+                detail::cell_forward_any<E, Act>(w, b, x, h, sh.dim, 0, n);
+            else
+                detail::cell_forward_blocks<E, Dim::value, Act>(w, b, x, h, 0, n);
+        }
+    }
+
+    // the sum at j of the padded column h of cells hc apart
+    static void sum(const Shape &sh, const E *h, size_t hc, int j, E *y, E *sd, int n) {
+        const detail::RowSum<E, 3> z{{h + (j + pad + offsets[0]) * hc, h + (j + pad + offsets[1]) * hc,
+                                      h + (j + pad + offsets[2]) * hc}};
+        if constexpr (runtime)
+            detail::cell_normalize_any<E>(z, y, sd, sh.dim, 0, n);
+        else
+            detail::cell_normalize<E, Dim::value>(z, y, sd, 0, n);
+    }
+
+    // samples [s0, s1) through column l within work, from x or the column
+    // before it in work, into y or the other column in work
+    static void column(const InferArgs &a, E *work, int s0, int s1, int l) {
+        const Shape &sh = a.shape;
+        const int n = s1 - s0;
+        const size_t hc = (size_t)n * sh.dim;
+        E *h = work;
+        E *bufs[2] = {h + (sh.D + 2 * pad) * hc, h + (2 * sh.D + 2 * pad) * hc};
+        E *sd = h + (3 * sh.D + 2 * pad) * hc;
+        if (l == 0) {
+            std::memset(h, 0, hc * sizeof(E));
+            std::memset(h + (sh.D + pad) * hc, 0, hc * sizeof(E));
+        }
+        const Column in = l == 0 ? Column{const_cast<E *>(static_cast<const E *>(a.x)) + (size_t)s0 * sh.dim,
+                                          sh.cell_size()}
+                                 : Column{bufs[(l - 1) % 2], hc};
+        const Column out = l == sh.L - 1 ? Column{static_cast<E *>(a.y) + (size_t)s0 * sh.dim, sh.cell_size()}
+                                         : Column{bufs[l % 2], hc};
+        // the sum at j - 1 is complete once cell j is computed
+        for (int j = 0; j < sh.D; ++j) {
+            cell(a, l, j, in.p + j * in.cell, h + (j + pad) * hc, n);
+            if (j > 0)
+                sum(sh, h, hc, j - 1, out.p + (j - 1) * out.cell, sd, n);
+        }
+        sum(sh, h, hc, sh.D - 1, out.p + (sh.D - 1) * out.cell, sd, n);
+    }
+
+    // the sums [j0, j1) of column l into out, from the cells [j0 - 1, j1 + 1)
+    // computed into h from the column in
+    static void cell_range(const InferArgs &a, int l, int j0, int j1, const E *in, E *out, E *h, E *sd) {
+        const Shape &sh = a.shape;
+        const size_t hc = sh.cell_size();
+        for (int j = j0 - pad; j < j1 + pad; ++j) {
+            E *hj = h + (j - j0 + pad) * hc;
+            if (j < 0 || j >= sh.D)
+                std::memset(hj, 0, hc * sizeof(E));
+            else
+                cell(a, l, j, in + j * hc, hj, sh.batch);
+        }
+        for (int j = j0; j < j1; ++j)
+            sum(sh, h, hc, j - j0, out + j * hc, sd, sh.batch);
+    }
+
+    // every column as one run of the pool over ranges of its cells
+    static void columns(const InferArgs &a, E *work, int ranges) {
+        const Shape &sh = a.shape;
+        E *bufs[2] = {work, work + sh.column_size()};
+        E *scratch = work + 2 * sh.column_size();
+        const size_t per = detail::infer_range_scratch(sh, ranges);
+        const E *in = static_cast<const E *>(a.x);
+        for (int l = 0; l < sh.L; ++l) {
+            E *out = l == sh.L - 1 ? static_cast<E *>(a.y) : bufs[l % 2];
+            a.pool->run(ranges, [&](int k) {
+                const int j0 = (int)((long)sh.D * k / ranges), j1 = (int)((long)sh.D * (k + 1) / ranges);
+                E *h = scratch + k * per;
+                cell_range(a, l, j0, j1, in, out, h, h + (per - sh.batch));
+            });
+            in = out;
+        }
+    }
+
+    static void fn(const InferArgs &args) {
+        utils::ArenaScope scope(args.arena);
+        const Shape &sh = args.shape;
+        const int threads = args.pool != nullptr ? args.pool->size() : 1;
+        E *work = utils::scratch_or<E>(args.work, args.arena, inference_scratch(sh, threads));
+        if (const int ranges = detail::infer_ranges(sh, threads))
+            return columns(args, work, ranges);
+        const int t = detail::infer_tile(sh), tiles = detail::infer_tiles(sh);
+        const size_t per = detail::infer_tile_scratch(sh);
+        auto tile = [&](int i, int l) { column(args, work + i * per, i * t, std::min(i * t + t, sh.batch), l); };
+        if (args.pool != nullptr && tiles > 1)
+            return args.pool->run(tiles, [&](int i) {
+                for (int l = 0; l < sh.L; ++l)
+                    tile(i, l);
+            });
+        // a column of every tile in turn, so the tiles after the first find
+        // the weights of the column in cache
+        for (int l = 0; l < sh.L; ++l)
+            for (int i = 0; i < tiles; ++i)
+                tile(i, l);
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct Forward3D {
+    static constexpr int dim = Dim::value;
+
+    static const T *input(const Forward3DArgs &a, int l) {
+        if (l == 0)
+            return static_cast<const T *>(a.x);
+        return static_cast<const T *>(a.y) + (l - 1) * a.shape.layer_size();
+    }
+
+    static T *h_cell(const Forward3DArgs &a, int l, int i, int k) {
+        return static_cast<T *>(a.h) + l * a.shape.padded_layer_size() + a.shape.padded_cell(i, k);
+    }
+
+    // samples [s0, s1) of the padding of layer l
+    static void zero_pads(const Forward3DArgs &a, int l, int s0, int s1) {
+        const Shape3D &sh = a.shape;
+        const int r = sh.radius;
+        for (int i = -r; i < sh.Dy + r; ++i)
+            for (int k = -r; k < sh.Dz + r; ++k)
+                if (i < 0 || i >= sh.Dy || k < 0 || k >= sh.Dz)
+                    std::memset(h_cell(a, l, i, k) + (size_t)s0 * dim, 0, (size_t)(s1 - s0) * dim * sizeof(T));
+    }
+
+    // the cells of row i of layer l
+    static void cells(const Forward3DArgs &a, int l, int i, int s0, int s1) {
+        const Shape3D &sh = a.shape;
+        const T *w = static_cast<const T *>(a.w);
+        const T *b = static_cast<const T *>(a.b);
+        const T *x = input(a, l);
+        for (int k = 0; k < sh.Dz; ++k) {
+            const size_t e = (size_t)i * sh.Dz + k;
+            const size_t c = (size_t)l * sh.cells() + e;
+            detail::cell_forward<T, dim, Act>(w + c * dim * dim, b + c * dim, x + e * sh.cell_size(),
+                                              h_cell(a, l, i, k), s0, s1);
+        }
+    }
+
+    // the sums of row i of layer l, reads h of rows [i - radius, i + radius]
+    static void sums(const Forward3DArgs &a, int l, int i, int s0, int s1) {
+        const Shape3D &sh = a.shape;
+        T *y  = static_cast<T *>(a.y) + l * sh.layer_size();
+        T *sd = static_cast<T *>(a.sd) + (size_t)l * sh.cells() * sh.batch;
+        for (int k = 0; k < sh.Dz; ++k) {
+            const size_t e = (size_t)i * sh.Dz + k;
+            const detail::StencilRows<T> z{h_cell(a, l, i, k), sh.padded_Dz() * sh.cell_size(), sh.cell_size(),
+                                           sh.radius};
+            detail::cell_normalize<T, dim>(z, y + e * sh.cell_size(), sd + e * sh.batch, s0, s1);
+        }
+    }
+
+    // samples [s0, s1) through every layer, a row of sums is complete once
+    // the row radius below it is computed
+    static void samples(const Forward3DArgs &a, int s0, int s1) {
+        const Shape3D &sh = a.shape;
+        const int r = sh.radius;
+        for (int l = 0; l < sh.L; ++l) {
+            zero_pads(a, l, s0, s1);
+            for (int i = 0; i < sh.Dy; ++i) {
+                cells(a, l, i, s0, s1);
+                if (i >= r)
+                    sums(a, l, i - r, s0, s1);
+            }
+            for (int i = std::max(sh.Dy - r, 0); i < sh.Dy; ++i)
+                sums(a, l, i, s0, s1);
+        }
+    }
+
+    static void fn(const Forward3DArgs &a) {
+        const Shape3D &sh = a.shape;
+        int tile = detail::stencil_tile(sh, sizeof(T));
+        if (a.pool != nullptr && a.pool->size() > 1) {
+            const int want = a.pool->size() * 4;
+            tile = std::min(tile, std::max(8, (sh.batch + want - 1) / want));
+        }
+        // every sample is independent through the whole grid, so tiles of the
+        // batch are the tasks, with no barrier between layers
+        for_range(a.pool, (sh.batch + tile - 1) / tile, [&](int t0, int t1) {
+            for (int t = t0; t < t1; ++t)
+                samples(a, t * tile, std::min((t + 1) * tile, sh.batch));
+        });
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct SparseForward {
+    static constexpr int dim = Dim::value;
+
+    static void fn(const SparseForwardArgs &a) {
+        const Shape &sh = a.shape;
+        const Adjacency &g = a.adj;
+        const T *w = static_cast<const T *>(a.w);
+        const T *b = static_cast<const T *>(a.b);
+        for (int l = 0; l < sh.L; ++l) {
+            const T *x = l == 0 ? static_cast<const T *>(a.x) : static_cast<const T *>(a.y) + (l - 1) * sh.column_size();
+            T *h  = static_cast<T *>(a.h) + l * sh.column_size();
+            T *y  = static_cast<T *>(a.y) + l * sh.column_size();
+            T *sd = static_cast<T *>(a.sd) + (size_t)l * sh.D * sh.batch;
+            const int *live = g.live + g.live_ptr[l];
+
+            for_range(a.pool, g.live_ptr[l + 1] - g.live_ptr[l], [&](int k0, int k1) {
+                for (int k = k0; k < k1; ++k) {
+                    const int i = live[k];
+                    const size_t c = (size_t)l * sh.D + i;
+                    detail::cell_forward<T, dim, Act>(w + c * dim * dim, b + c * dim, x + i * sh.cell_size(),
+                                                      h + i * sh.cell_size(), 0, sh.batch);
+                }
+            });
+            for_range(a.pool, sh.D, [&](int j0, int j1) {
+                for (int j = j0; j < j1; ++j) {
+                    const int r = l * sh.D + j;
+                    const int n = g.in_ptr[r + 1] - g.in_ptr[r];
+                    if (n == 0) {
+                        std::memset(y + j * sh.cell_size(), 0, sh.cell_size() * sizeof(T));
+                        std::memset(sd + (size_t)j * sh.batch, 0, sh.batch * sizeof(T));
+                        continue;
+                    }
+                    const detail::ListedRows<T> z{h, sh.cell_size(), g.in_idx + g.in_ptr[r], n};
+                    detail::cell_normalize<T, dim>(z, y + j * sh.cell_size(), sd + (size_t)j * sh.batch, 0, sh.batch);
+                }
+            });
+        }
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct GatedForward {
+    static constexpr int dim = Dim::value;
+    using dense = Forward<T, Dim, Act>;
+
+    // per column packed rows, strided like the column so cells never share them
+    struct Packed {
+        int *idx;
+        T *u;
+        T *h;
+    };
+
+    // cell j of column l, over the input x of that cell
+    static void cell(const GatedForwardArgs &args, const Packed &p, int l, int j, const T *x) {
+        const ForwardArgs &a = args.grid;
+        const Shape &sh = a.shape;
+        const size_t c = (size_t)l * sh.D + j;
+        const T s = static_cast<const T *>(args.gate)[2 * c];
+        const T b = static_cast<const T *>(args.gate)[2 * c + 1];
+        T *mag = static_cast<T *>(args.mag) + c * sh.batch;
+        int *idx = p.idx + (size_t)j * sh.batch;
+        T *u = p.u + j * sh.cell_size();
+
+        int n = 0;
+        for (int r = 0; r < sh.batch; ++r) {
+            const T *xr = x + (size_t)r * dim;
+            const T m = std::sqrt(detail::row_dot<T, dim>(xr, xr));
+            mag[r] = m;
+            if (WeightedSigmoid::is_underflow(s, b, T(args.eps), m))
+                continue;
+            detail::row_scale<T, dim>(WeightedSigmoid::forward(s, b, m), xr, u + (size_t)n * dim);
+            idx[n++] = r;
+        }
+
+        const T *w = static_cast<const T *>(a.w) + c * dim * dim;
+        const T *bias = static_cast<const T *>(a.b) + c * dim;
+        T *h = dense::h_cell(a, l, j);
+        if (n == sh.batch)
+            return detail::cell_forward<T, dim, Act>(w, bias, u, h, 0, n);
+        std::memset(h, 0, sh.cell_size() * sizeof(T));
+        T *hp = p.h + j * sh.cell_size();
+        detail::cell_forward<T, dim, Act>(w, bias, u, hp, 0, n);
+        for (int k = 0; k < n; ++k)
+            std::memcpy(h + (size_t)idx[k] * dim, hp + (size_t)k * dim, dim * sizeof(T));
+    }
+
+    static void fn(const GatedForwardArgs &args) {
+        const ForwardArgs &a = args.grid;
+        if (a.arena == nullptr)
+            throw std::invalid_argument("gated grid kernels need an arena");
+        utils::ArenaScope scope(a.arena);
+        const Shape &sh = a.shape;
+        const Packed p{a.arena->reserve<int>((size_t)sh.D * sh.batch), a.arena->reserve<T>(sh.column_size()),
+                       a.arena->reserve<T>(sh.column_size())};
+        for (int l = 0; l < sh.L; ++l) {
+            dense::zero_pads(a, l);
+            const T *x = dense::input(a, l);
+            for_range(a.pool, sh.D, [&](int j0, int j1) {
+                for (int j = j0; j < j1; ++j)
+                    cell(args, p, l, j, x + j * sh.cell_size());
+            });
+            for_range(a.pool, sh.D, [&](int j0, int j1) { dense::sums(a, l, j0, j1, 0, sh.batch); });
+        }
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct MixedForward {
+    static constexpr int dim = Dim::value;
+    static constexpr int tile = detail::batch_tile;
+    using dense = Forward<T, Dim, Act>;
+
+    // utils::convert over the pool, for whole columns
+    template <typename S, typename D>
+    static void convert(utils::ThreadPool *pool, const S *src, D *dst, size_t n) {
+        constexpr size_t block = 1 << 14;
+        for_range(pool, (int)((n + block - 1) / block), [&](int i0, int i1) {
+            utils::convert(src + i0 * block, dst + i0 * block, std::min(n, (size_t)i1 * block) - i0 * block);
+        });
+    }
+
+    // samples [s0, s1) of column l through every cell and sum, the float h of
+    // the last three cells kept in a ring, as the dense forward keeps them in L1
+    static void samples(const ForwardArgs &a, const float *w, const float *b, int l, int s0, int s1) {
+        const Shape &sh = a.shape;
+        const int n = (s1 - s0) * dim;
+        const size_t o = (size_t)s0 * dim;
+        const T *x = dense::input(a, l);
+        T *y = static_cast<T *>(a.y) + l * sh.column_size();
+        float *sd = static_cast<float *>(a.sd) + (size_t)l * sh.D * sh.batch;
+
+        alignas(64) float ring[3][tile * dim];
+        alignas(64) float zero[tile * dim] = {};
+        alignas(64) float xt[tile * dim];
+        const auto h = [&](int j) { return j < 0 || j >= sh.D ? zero : ring[j % 3]; };
+        const auto sum = [&](int j) {
+            const detail::RowSum<float, 3> z{{h(j + offsets[0]), h(j + offsets[1]), h(j + offsets[2])}};
+            detail::cell_normalize<float, dim>(z, xt, sd + (size_t)j * sh.batch + s0, 0, s1 - s0);
+            utils::convert(xt, y + j * sh.cell_size() + o, n);
+        };
+        for (int j = 0; j < sh.D; ++j) {
+            utils::convert(x + j * sh.cell_size() + o, xt, n);
+            detail::cell_forward<float, dim, Act>(w + (size_t)j * dim * dim, b + j * dim, xt, h(j), 0, s1 - s0);
+            utils::convert(h(j), dense::h_cell(a, l, j) + o, n);
+            if (j > 0)
+                sum(j - 1);
+        }
+        sum(sh.D - 1);
+    }
+
+    static void fn(const ForwardArgs &a) {
+        if (a.arena == nullptr)
+            throw std::invalid_argument("mixed precision grid kernels need an arena");
+        utils::ArenaScope scope(a.arena);
+        const Shape &sh = a.shape;
+        const size_t nw = (size_t)sh.D * dim * dim;
+        float *w = a.arena->reserve<float>(nw);
+        float *b = a.arena->reserve<float>((size_t)sh.D * dim);
+        for (int l = 0; l < sh.L; ++l) {
+            dense::zero_pads(a, l);
+            convert(a.pool, static_cast<const T *>(a.w) + l * nw, w, nw);
+            convert(a.pool, static_cast<const T *>(a.b) + (size_t)l * sh.D * dim, b, (size_t)sh.D * dim);
+            // every sample is independent within a column, so tiles of the
+            // batch are the tasks
+            for_range(a.pool, (sh.batch + tile - 1) / tile, [&](int t0, int t1) {
+                for (int t = t0; t < t1; ++t)
+                    samples(a, w, b, l, t * tile, std::min((t + 1) * tile, sh.batch));
+            });
+        }
+    }
+};
+
+} // grid
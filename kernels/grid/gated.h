@@ -0,0 +1,81 @@
+/*
+activation sparsity for the grid, the ComputeNode gating of
+grownet_models/src/models/m2.rs, each cell scales every sample's input by a
+learned WeightedSigmoid of its magnitude, and samples whose magnitude is
+below the underflow cutoff are skipped outright, emitting a zero h the way
+a node below the cutoff emits NoResult
+
+per column, each cell builds its list of active samples on the fly and
+gathers their scaled inputs into contiguous rows, so the cell kernels of the
+dense grid run at full width over active rows only, and the results are
+scattered back, the magnitudes are kept so the backward pass rebuilds the
+same lists without storing them, the kernels are GatedForward in forward.h
+and GatedBackward in backward.h, cpu only for now
+*/
+
+#pragma once
+#include <cmath>
+
+#include "grid.h"
+#include "../utils/arena.h"
+
+namespace grid {
+
+// g(m) = 1 / (1 + exp(b (m - s))), per cell, with the parameters kept as
+// gate[l][j] = {s, b}
+struct WeightedSigmoid {
+    template <typename T>
+    static T forward(T s, T b, T m) { return T(1) / (T(1) + std::exp(b * (m - s))); }
+
+    // WeightedSigmoid::underflow_cutoff, magnitudes below it are skipped
+    template <typename T>
+    static T underflow_cutoff(T s, T b, T eps) { return s - eps / b; }
+
+    template <typename T>
+    static bool is_underflow(T s, T b, T eps, T m) { return underflow_cutoff(s, b, eps) > m; }
+};
+
+struct GatedForwardArgs {
+    // as for the dense grid, h is zero for skipped samples
+    ForwardArgs grid;
+    // [L, D, 2] {s, b} of each cell's gate
+    const void *gate;
+    // [L, D, batch] magnitude of each cell's input, kept for the backward pass
+    void *mag;
+    // underflow_epsilon in GlobalParams
+    double eps;
+};
+
+using gated_forward_fn = void (*)(const GatedForwardArgs &);
+
+struct GatedBackwardArgs {
+    // as for the dense grid, with dz from the arena when null
+    BackwardArgs grid;
+    const void *gate;
+    // as kept by the forward pass
+    const void *mag;
+    // [L, D, 2] accumulated into
+    void *dgate;
+    double eps;
+};
+
+using gated_backward_fn = void (*)(const GatedBackwardArgs &);
+
+// arena bytes either pass needs for a shape, the backward needing the most,
+// the gathered rows of every cell of a column and dz when the caller has none
+inline size_t gated_scratch_bytes(const Shape &sh, size_t elem) {
+    const size_t bufs[] = {
+        (size_t)sh.D * sh.batch * sizeof(int),  // active samples
+        sh.column_size() * elem,                // scaled inputs
+        sh.column_size() * elem,                // h
+        sh.column_size() * elem,                // dz
+        sh.column_size() * elem,                // gradient of the scaled inputs
+        sh.padded_column_size() * elem,         // dz of the sums
+    };
+    size_t bytes = 0;
+    for (size_t n : bufs)
+        bytes += (n + utils::Arena::alignment - 1) / utils::Arena::alignment * utils::Arena::alignment;
+    return bytes;
+}
+
+} // grid
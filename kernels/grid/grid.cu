@@ -0,0 +1,729 @@
+/*
+cuda versions of the grid forward and backward kernels, registered under the
+same (device, dtype, dim) keys as the cpu ones
+
+one launch per column, each block owns cells_per_block consecutive cells of
+the column for a tile of the batch, staging each cell's dim x dim weights in
+shared memory, the cells on either end of its range are recomputed by the
+block instead of exchanged, so no launch has to wait on another mid column
+
+the grid partitioned over devices of partition.h can't recompute the cells
+of another device, so it exchanges them instead, through the slab kernels
+below, which split a column into launches a halo can be waited on between
+*/
+
+#include <cuda_runtime.h>
+
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../lib.h"
+#include "../utils/arena.h"
+#include "reversible.h"
+#include "checkpoint.h"
+#include "partition.h"
+
+namespace grid {
+
+namespace cuda {
+
+constexpr int threads = 256;
+constexpr int cells_per_block = 4;
+
+// blocks are (Dim, samples) threads, one thread per element of a tile row
+template <int Dim>
+struct Tile {
+    static_assert(Dim <= threads && threads % Dim == 0, "dim must divide the block size");
+    static constexpr int samples = threads / Dim;
+    // per sample partial sums when a row spans more than one warp
+    static constexpr int parts = Dim > 32 ? Dim / 32 : 1;
+};
+
+// sum of v over the Dim threads of a row, called by every thread of the block
+template <typename T, int Dim>
+__device__ T row_sum(T v, T *scratch) {
+    constexpr int width = Dim < 32 ? Dim : 32;
+    for (int m = width / 2; m > 0; m /= 2)
+        v += __shfl_xor_sync(0xffffffff, v, m, width);
+    if constexpr (Dim > 32) {
+        constexpr int parts = Tile<Dim>::parts;
+        if (threadIdx.x % 32 == 0)
+            scratch[threadIdx.y * parts + threadIdx.x / 32] = v;
+        __syncthreads();
+        v = 0;
+        for (int p = 0; p < parts; ++p)
+            v += scratch[threadIdx.y * parts + p];
+        __syncthreads();
+    }
+    return v;
+}
+
+template <typename T>
+__device__ const T *column_input(const T *x, const T *y, const Shape &sh, int l) {
+    return l == 0 ? x : y + (l - 1) * sh.column_size();
+}
+
+template <typename T, int Dim, typename Act>
+__global__ void forward_column(ForwardArgs a, int l) {
+    constexpr int S = Tile<Dim>::samples;
+    constexpr int C = cells_per_block;
+    __shared__ T ws[Dim * Dim];
+    __shared__ T xs[S * Dim];
+    __shared__ T hs[(C + 2) * S * Dim];
+    __shared__ T red[S * Tile<Dim>::parts];
+
+    const Shape sh = a.shape;
+    const int o = threadIdx.x;
+    const int sl = threadIdx.y;
+    const int tid = sl * Dim + o;
+    const int s = blockIdx.y * S + sl;
+    const bool valid = s < sh.batch;
+    const int j0 = blockIdx.x * C;
+
+    const T *w = static_cast<const T *>(a.w);
+    const T *b = static_cast<const T *>(a.b);
+    const T *x = column_input(static_cast<const T *>(a.x), static_cast<const T *>(a.y), sh, l);
+    T *h = static_cast<T *>(a.h) + l * sh.padded_column_size();
+    T *y = static_cast<T *>(a.y) + l * sh.column_size();
+    T *sd = static_cast<T *>(a.sd) + (size_t)l * sh.D * sh.batch;
+
+    // cells j0 - 1 .. j0 + C, the ends only feed the sums this block owns
+    for (int c = 0; c < C + 2; ++c) {
+        const int j = j0 - 1 + c;
+        T hv = 0;
+        if (j >= 0 && j < sh.D) {
+            const size_t cell = (size_t)l * sh.D + j;
+            for (int e = tid; e < Dim * Dim; e += threads)
+                ws[e] = w[cell * Dim * Dim + e];
+            xs[tid] = valid ? x[((size_t)j * sh.batch + s) * Dim + o] : T(0);
+            __syncthreads();
+
+            T acc = b[cell * Dim + o];
+            for (int i = 0; i < Dim; ++i)
+                acc += xs[sl * Dim + i] * ws[i * Dim + o];
+            hv = Act::scalar_forward(acc);
+            if (valid && c >= 1 && c <= C)
+                h[((size_t)(j + pad) * sh.batch + s) * Dim + o] = hv;
+            __syncthreads();
+        } else if (valid && (j == -1 || j == sh.D)) {
+            h[((size_t)(j + pad) * sh.batch + s) * Dim + o] = T(0);
+        }
+        hs[(c * S + sl) * Dim + o] = hv;
+    }
+    __syncthreads();
+
+    for (int c = 1; c <= C; ++c) {
+        const int j = j0 - 1 + c;
+        if (j >= sh.D)
+            break;
+        const T z = hs[((c - 1) * S + sl) * Dim + o] + hs[(c * S + sl) * Dim + o] + hs[((c + 1) * S + sl) * Dim + o];
+        const T mu = row_sum<T, Dim>(z, red) / Dim;
+        const T d = z - mu;
+        const T sdv = sqrt(row_sum<T, Dim>(d * d, red) / (Dim - 1));
+        if (valid) {
+            y[((size_t)j * sh.batch + s) * Dim + o] = d / (sdv + T(norm_eps));
+            if (o == 0)
+                sd[(size_t)j * sh.batch + s] = sdv;
+        }
+    }
+}
+
+// g is the gradient w.r.t. the output of column l, dx receives the gradient
+// w.r.t. its input, the two never alias so blocks can read g for their halo
+template <typename T, int Dim, typename Act>
+__global__ void backward_column(BackwardArgs a, int l, const T *g, T *dx) {
+    constexpr int S = Tile<Dim>::samples;
+    constexpr int C = cells_per_block;
+    __shared__ T ws[Dim * Dim];
+    __shared__ T xs[S * Dim];
+    __shared__ T dps[S * Dim];
+    __shared__ T dzs[(C + 2) * S * Dim];
+    __shared__ T red[S * Tile<Dim>::parts];
+
+    const Shape sh = a.shape;
+    const int o = threadIdx.x;
+    const int sl = threadIdx.y;
+    const int tid = sl * Dim + o;
+    const int s = blockIdx.y * S + sl;
+    const bool valid = s < sh.batch;
+    const int j0 = blockIdx.x * C;
+
+    const T *w = static_cast<const T *>(a.w);
+    const T *x = column_input(static_cast<const T *>(a.x), static_cast<const T *>(a.y), sh, l);
+    const T *h = static_cast<const T *>(a.h) + l * sh.padded_column_size();
+    const T *y = static_cast<const T *>(a.y) + l * sh.column_size();
+    const T *sd = static_cast<const T *>(a.sd) + (size_t)l * sh.D * sh.batch;
+    T *dw = static_cast<T *>(a.dw);
+    T *db = static_cast<T *>(a.db);
+
+    // gradient of the sums j0 - 1 .. j0 + C
+    for (int c = 0; c < C + 2; ++c) {
+        const int j = j0 - 1 + c;
+        T dz = 0;
+        if (j >= 0 && j < sh.D) {
+            const size_t e = ((size_t)j * sh.batch + s) * Dim + o;
+            const T gv = valid ? g[e] : T(0);
+            const T yv = valid ? y[e] : T(0);
+            const T sdv = valid ? sd[(size_t)j * sh.batch + s] : T(0);
+            const T dot = row_sum<T, Dim>(gv * yv, red);
+            const T gm = row_sum<T, Dim>(gv, red) / Dim;
+            const T cc = sdv > 0 ? dot / (sdv * (Dim - 1)) : T(0);
+            dz = (gv - gm) / (sdv + T(norm_eps)) - cc * yv;
+        }
+        dzs[(c * S + sl) * Dim + o] = dz;
+    }
+    __syncthreads();
+
+    for (int c = 1; c <= C; ++c) {
+        const int j = j0 - 1 + c;
+        if (j >= sh.D)
+            break;
+        const size_t cell = (size_t)l * sh.D + j;
+        const size_t e = ((size_t)j * sh.batch + s) * Dim + o;
+
+        for (int k = tid; k < Dim * Dim; k += threads)
+            ws[k] = w[cell * Dim * Dim + k];
+        const T hv = valid ? h[((size_t)(j + pad) * sh.batch + s) * Dim + o] : T(0);
+        const T gs = dzs[((c - 1) * S + sl) * Dim + o] + dzs[(c * S + sl) * Dim + o] + dzs[((c + 1) * S + sl) * Dim + o];
+        dps[tid] = valid ? Act::scalar_backward(hv, gs) : T(0);
+        xs[tid] = valid ? x[e] : T(0);
+        __syncthreads();
+
+        // dx[s][i] = sum_o w[i][o] * dp[s][o], with o playing the role of i
+        T acc = 0;
+        for (int k = 0; k < Dim; ++k)
+            acc += ws[o * Dim + k] * dps[sl * Dim + k];
+        if (valid)
+            dx[e] = acc;
+
+        // other sample tiles accumulate into the same cell
+        if (tid < Dim) {
+            T dbv = 0;
+            for (int q = 0; q < S; ++q)
+                dbv += dps[q * Dim + tid];
+            atomicAdd(db + cell * Dim + tid, dbv);
+        }
+        for (int k = tid; k < Dim * Dim; k += threads) {
+            const int i = k / Dim;
+            const int oo = k % Dim;
+            T dwv = 0;
+            for (int q = 0; q < S; ++q)
+                dwv += xs[q * Dim + i] * dps[q * Dim + oo];
+            atomicAdd(dw + cell * Dim * Dim + k, dwv);
+        }
+        __syncthreads();
+    }
+}
+
+template <int Dim>
+dim3 launch_grid(const Shape &sh) {
+    return dim3((sh.D + cells_per_block - 1) / cells_per_block, (sh.batch + Tile<Dim>::samples - 1) / Tile<Dim>::samples);
+}
+
+template <typename T, typename Dim, typename Act = Relu>
+struct Forward {
+    static constexpr int dim = Dim::value;
+
+    static void fn(const ForwardArgs &a) {
+        auto stream = static_cast<cudaStream_t>(a.stream);
+        const dim3 block(dim, Tile<dim>::samples);
+        const dim3 grid = launch_grid<dim>(a.shape);
+        for (int l = 0; l < a.shape.L; ++l)
+            forward_column<T, dim, Act><<<grid, block, 0, stream>>>(a, l);
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct Backward {
+    static constexpr int dim = Dim::value;
+
+    static void fn(const BackwardArgs &args) {
+        // the arena only hands out a pointer, the launches below are ordered
+        // on the stream before anything reserved after release can run
+        utils::ArenaScope scope(args.arena);
+        BackwardArgs a = args;
+        a.dz = utils::scratch_or<T>(a.dz, a.arena, (a.shape.D + 2 * pad) * a.shape.cell_size());
+        auto stream = static_cast<cudaStream_t>(a.stream);
+        const dim3 block(dim, Tile<dim>::samples);
+        const dim3 grid = launch_grid<dim>(a.shape);
+        // ping-pong between dx and dz, picked so that column 0 writes dx
+        T *bufs[2] = {static_cast<T *>(a.dx), static_cast<T *>(a.dz)};
+        const T *g = static_cast<const T *>(a.grad);
+        for (int l = a.shape.L - 1; l >= 0; --l) {
+            T *out = bufs[l % 2];
+            backward_column<T, dim, Act><<<grid, block, 0, stream>>>(a, l, g, out);
+            a.column_done(l);
+            g = out;
+        }
+    }
+};
+
+template <typename T>
+__global__ void add_scaled(T *dst, const T *src, T alpha, size_t n) {
+    const size_t i = (size_t)blockIdx.x * blockDim.x + threadIdx.x;
+    if (i < n)
+        dst[i] += alpha * src[i];
+}
+
+// buffer ops on device memory, ordered on the stream like the column kernels
+template <typename T>
+struct DeviceOps {
+    static void copy(T *dst, const T *src, size_t n, void *stream) {
+        cudaMemcpyAsync(dst, src, n * sizeof(T), cudaMemcpyDeviceToDevice, static_cast<cudaStream_t>(stream));
+    }
+
+    static void add(T *dst, const T *src, T alpha, size_t n, void *stream) {
+        const unsigned blocks = (unsigned)((n + threads - 1) / threads);
+        add_scaled<T><<<blocks, threads, 0, static_cast<cudaStream_t>(stream)>>>(dst, src, alpha, n);
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct ReversibleForward {
+    static void fn(const ReversibleForwardArgs &a) {
+        ReversibleColumns<T, Dim, Act, Forward, Backward, DeviceOps<T>>::forward(a);
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct ReversibleBackward {
+    static void fn(const ReversibleBackwardArgs &a) {
+        ReversibleColumns<T, Dim, Act, Forward, Backward, DeviceOps<T>>::backward(a);
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct CheckpointForward {
+    static void fn(const CheckpointForwardArgs &a) {
+        CheckpointedGrid<T, Dim, Act, Forward, Backward, DeviceOps<T>>::forward(a);
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct CheckpointBackward {
+    static void fn(const CheckpointBackwardArgs &a) {
+        CheckpointedGrid<T, Dim, Act, Forward, Backward, DeviceOps<T>>::backward(a);
+    }
+};
+
+// the column kernels of the partitioned grid, over cells [j0, j0 + gridDim.x)
+// of a slab, one block per cell and tile of the batch, so a slab can run its
+// boundary cells, its interior and the sums next to its ends as separate launches
+
+template <typename T, int Dim, typename Act>
+__global__ void slab_cells(ForwardArgs a, int l, int j0) {
+    constexpr int S = Tile<Dim>::samples;
+    __shared__ T ws[Dim * Dim];
+    __shared__ T xs[S * Dim];
+
+    const Shape sh = a.shape;
+    const int o = threadIdx.x;
+    const int sl = threadIdx.y;
+    const int tid = sl * Dim + o;
+    const int s = blockIdx.y * S + sl;
+    const bool valid = s < sh.batch;
+    const int j = j0 + blockIdx.x;
+    const size_t cell = (size_t)l * sh.D + j;
+
+    const T *w = static_cast<const T *>(a.w);
+    const T *b = static_cast<const T *>(a.b);
+    const T *x = column_input(static_cast<const T *>(a.x), static_cast<const T *>(a.y), sh, l);
+    T *h = static_cast<T *>(a.h) + l * sh.padded_column_size();
+
+    for (int e = tid; e < Dim * Dim; e += threads)
+        ws[e] = w[cell * Dim * Dim + e];
+    xs[tid] = valid ? x[((size_t)j * sh.batch + s) * Dim + o] : T(0);
+    __syncthreads();
+
+    T acc = b[cell * Dim + o];
+    for (int i = 0; i < Dim; ++i)
+        acc += xs[sl * Dim + i] * ws[i * Dim + o];
+    if (valid)
+        h[((size_t)(j + pad) * sh.batch + s) * Dim + o] = Act::scalar_forward(acc);
+}
+
+// the sums of cells j - 1 .. j + 1, the halo cells included
+template <typename T, int Dim>
+__global__ void slab_sums(ForwardArgs a, int l, int j0) {
+    constexpr int S = Tile<Dim>::samples;
+    __shared__ T red[S * Tile<Dim>::parts];
+
+    const Shape sh = a.shape;
+    const int o = threadIdx.x;
+    const int s = blockIdx.y * S + threadIdx.y;
+    const bool valid = s < sh.batch;
+    const int j = j0 + blockIdx.x;
+
+    const T *h = static_cast<const T *>(a.h) + l * sh.padded_column_size();
+    T *y = static_cast<T *>(a.y) + l * sh.column_size();
+    T *sd = static_cast<T *>(a.sd) + (size_t)l * sh.D * sh.batch;
+
+    T z = 0;
+    if (valid)
+        for (int k = 0; k < 3; ++k)
+            z += h[((size_t)(j + k) * sh.batch + s) * Dim + o];
+    const T mu = row_sum<T, Dim>(z, red) / Dim;
+    const T d = z - mu;
+    const T sdv = sqrt(row_sum<T, Dim>(d * d, red) / (Dim - 1));
+    if (valid) {
+        y[((size_t)j * sh.batch + s) * Dim + o] = d / (sdv + T(norm_eps));
+        if (o == 0)
+            sd[(size_t)j * sh.batch + s] = sdv;
+    }
+}
+
+// the gradient of sums j into the padded dz, from the gradient g of the column output
+template <typename T, int Dim>
+__global__ void slab_d_sums(BackwardArgs a, int l, int j0, const T *g, T *dz) {
+    constexpr int S = Tile<Dim>::samples;
+    __shared__ T red[S * Tile<Dim>::parts];
+
+    const Shape sh = a.shape;
+    const int o = threadIdx.x;
+    const int s = blockIdx.y * S + threadIdx.y;
+    const bool valid = s < sh.batch;
+    const int j = j0 + blockIdx.x;
+
+    const T *y = static_cast<const T *>(a.y) + l * sh.column_size();
+    const T *sd = static_cast<const T *>(a.sd) + (size_t)l * sh.D * sh.batch;
+
+    const size_t e = ((size_t)j * sh.batch + s) * Dim + o;
+    const T gv = valid ? g[e] : T(0);
+    const T yv = valid ? y[e] : T(0);
+    const T sdv = valid ? sd[(size_t)j * sh.batch + s] : T(0);
+    const T dot = row_sum<T, Dim>(gv * yv, red);
+    const T gm = row_sum<T, Dim>(gv, red) / Dim;
+    const T cc = sdv > 0 ? dot / (sdv * (Dim - 1)) : T(0);
+    if (valid)
+        dz[((size_t)(j + pad) * sh.batch + s) * Dim + o] = (gv - gm) / (sdv + T(norm_eps)) - cc * yv;
+}
+
+// dx, dw and db of cells j, from the gradient of the sums j - 1 .. j + 1 the
+// cell fed, the halo sums included
+template <typename T, int Dim, typename Act>
+__global__ void slab_d_cells(BackwardArgs a, int l, int j0, const T *dz, T *dx) {
+    constexpr int S = Tile<Dim>::samples;
+    __shared__ T ws[Dim * Dim];
+    __shared__ T xs[S * Dim];
+    __shared__ T dps[S * Dim];
+
+    const Shape sh = a.shape;
+    const int o = threadIdx.x;
+    const int sl = threadIdx.y;
+    const int tid = sl * Dim + o;
+    const int s = blockIdx.y * S + sl;
+    const bool valid = s < sh.batch;
+    const int j = j0 + blockIdx.x;
+    const size_t cell = (size_t)l * sh.D + j;
+    const size_t e = ((size_t)j * sh.batch + s) * Dim + o;
+
+    const T *w = static_cast<const T *>(a.w);
+    const T *x = column_input(static_cast<const T *>(a.x), static_cast<const T *>(a.y), sh, l);
+    const T *h = static_cast<const T *>(a.h) + l * sh.padded_column_size();
+    T *dw = static_cast<T *>(a.dw);
+    T *db = static_cast<T *>(a.db);
+
+    for (int k = tid; k < Dim * Dim; k += threads)
+        ws[k] = w[cell * Dim * Dim + k];
+    T gs = 0;
+    if (valid)
+        for (int k = 0; k < 3; ++k)
+            gs += dz[((size_t)(j + k) * sh.batch + s) * Dim + o];
+    const T hv = valid ? h[((size_t)(j + pad) * sh.batch + s) * Dim + o] : T(0);
+    dps[tid] = valid ? Act::scalar_backward(hv, gs) : T(0);
+    xs[tid] = valid ? x[e] : T(0);
+    __syncthreads();
+
+    T acc = 0;
+    for (int k = 0; k < Dim; ++k)
+        acc += ws[o * Dim + k] * dps[sl * Dim + k];
+    if (valid)
+        dx[e] = acc;
+
+    if (tid < Dim) {
+        T dbv = 0;
+        for (int q = 0; q < S; ++q)
+            dbv += dps[q * Dim + tid];
+        atomicAdd(db + cell * Dim + tid, dbv);
+    }
+    for (int k = tid; k < Dim * Dim; k += threads) {
+        const int i = k / Dim;
+        const int oo = k % Dim;
+        T dwv = 0;
+        for (int q = 0; q < S; ++q)
+            dwv += xs[q * Dim + i] * dps[q * Dim + oo];
+        atomicAdd(dw + cell * Dim * Dim + k, dwv);
+    }
+}
+
+inline void check(cudaError_t e, const char *what) {
+    if (e != cudaSuccess)
+        throw std::runtime_error(std::string(what) + " failed, " + cudaGetErrorString(e));
+}
+
+// what a slab sends its halos with, the stream they go out on and the events
+// ordering them, the boundary cells being done and the halos having landed
+struct HaloLinks {
+    int device = -1;
+    cudaStream_t copy = nullptr;
+    cudaEvent_t edges = nullptr;
+    cudaEvent_t sent = nullptr;
+};
+
+// held while a partitioned kernel queues its work, so that the links of a
+// call are only recorded and waited on in the order that call queued them
+inline std::mutex &halo_mutex() {
+    static std::mutex m;
+    return m;
+}
+
+// the links of n slabs, made once per slab position and device, with peer
+// access between neighbouring devices where the hardware has it, otherwise
+// the peer copies are staged by the driver, under halo_mutex
+inline std::vector<HaloLinks> &halo_links(const int *devices, int n) {
+    static std::vector<HaloLinks> links;
+    if ((int)links.size() < n)
+        links.resize(n);
+    for (int s = 0; s < n; ++s) {
+        HaloLinks &k = links[s];
+        if (k.device == devices[s])
+            continue;
+        check(cudaSetDevice(devices[s]), "cudaSetDevice");
+        if (k.device >= 0) {
+            cudaStreamDestroy(k.copy);
+            cudaEventDestroy(k.edges);
+            cudaEventDestroy(k.sent);
+        }
+        check(cudaStreamCreateWithFlags(&k.copy, cudaStreamNonBlocking), "cudaStreamCreate");
+        check(cudaEventCreateWithFlags(&k.edges, cudaEventDisableTiming), "cudaEventCreate");
+        check(cudaEventCreateWithFlags(&k.sent, cudaEventDisableTiming), "cudaEventCreate");
+        k.device = devices[s];
+    }
+    for (int s = 0; s + 1 < n; ++s) {
+        for (int d = 0; d < 2; ++d) {
+            const int from = devices[s + d], to = devices[s + 1 - d];
+            int ok = 0;
+            if (from == to || cudaDeviceCanAccessPeer(&ok, from, to) != cudaSuccess || !ok)
+                continue;
+            check(cudaSetDevice(from), "cudaSetDevice");
+            const cudaError_t e = cudaDeviceEnablePeerAccess(to, 0);
+            if (e == cudaErrorPeerAccessAlreadyEnabled)
+                cudaGetLastError();
+            else
+                check(e, "cudaDeviceEnablePeerAccess");
+        }
+    }
+    return links;
+}
+
+// puts the current device back once the slabs are queued
+struct DeviceRestore {
+    int device = 0;
+    DeviceRestore() { cudaGetDevice(&device); }
+    ~DeviceRestore() { cudaSetDevice(device); }
+};
+
+// slab s sends cell `from` of its padded buffer, one cell of size bytes at
+// base[s], to the halo cell of each neighbour, after its boundary cells are done
+inline void send_halos(std::vector<HaloLinks> &links, const int *devices, int n, int s, char *const *base,
+                       const int *D, size_t bytes) {
+    HaloLinks &k = links[s];
+    check(cudaSetDevice(devices[s]), "cudaSetDevice");
+    cudaStreamWaitEvent(k.copy, k.edges, 0);
+    // its first cell is the right halo of the left neighbour, its last the
+    // left halo of the right one
+    if (s > 0)
+        cudaMemcpyPeerAsync(base[s - 1] + (D[s - 1] + pad) * bytes, devices[s - 1], base[s] + pad * bytes,
+                            devices[s], bytes, k.copy);
+    if (s + 1 < n)
+        cudaMemcpyPeerAsync(base[s + 1], devices[s + 1], base[s] + D[s] * bytes, devices[s], bytes, k.copy);
+    cudaEventRecord(k.sent, k.copy);
+}
+
+// whatever a slab queues next, on its stream, waits for the last halos it
+// sent, which read buffers the caller may free once the call returns
+template <typename Args>
+void join_halos(std::vector<HaloLinks> &links, const Args &p) {
+    for (int s = 0; s < p.n; ++s) {
+        check(cudaSetDevice(p.devices[s]), "cudaSetDevice");
+        cudaStreamWaitEvent(static_cast<cudaStream_t>(p.slabs[s].stream), links[s].sent, 0);
+    }
+}
+
+// the compute stream of slab s waits for the halos of its neighbours
+inline void wait_halos(std::vector<HaloLinks> &links, int n, int s, cudaStream_t stream) {
+    if (s > 0)
+        cudaStreamWaitEvent(stream, links[s - 1].sent, 0);
+    if (s + 1 < n)
+        cudaStreamWaitEvent(stream, links[s + 1].sent, 0);
+}
+
+template <typename T, typename Dim, typename Act = Relu>
+struct PartitionedForward {
+    static constexpr int dim = Dim::value;
+
+    static void fn(const PartitionedForwardArgs &p) {
+        std::lock_guard<std::mutex> lock(halo_mutex());
+        DeviceRestore restore;
+        auto &links = halo_links(p.devices, p.n);
+        const dim3 block(dim, Tile<dim>::samples);
+        const Shape &sh0 = p.slabs[0].shape;
+        const unsigned tiles = (sh0.batch + Tile<dim>::samples - 1) / Tile<dim>::samples;
+        const size_t bytes = sh0.cell_size() * sizeof(T);
+        std::vector<char *> h(p.n);
+        std::vector<int> D(p.n);
+
+        for (int l = 0; l < sh0.L; ++l) {
+            for (int s = 0; s < p.n; ++s) {
+                const ForwardArgs &a = p.slabs[s];
+                auto stream = static_cast<cudaStream_t>(a.stream);
+                D[s] = a.shape.D;
+                h[s] = static_cast<char *>(a.h) + l * a.shape.padded_column_size() * sizeof(T);
+                check(cudaSetDevice(p.devices[s]), "cudaSetDevice");
+                if (s == 0)
+                    cudaMemsetAsync(h[s], 0, bytes, stream);
+                if (s + 1 == p.n)
+                    cudaMemsetAsync(h[s] + (D[s] + pad) * bytes, 0, bytes, stream);
+                slab_cells<T, dim, Act><<<dim3(1, tiles), block, 0, stream>>>(a, l, 0);
+                if (D[s] > 1)
+                    slab_cells<T, dim, Act><<<dim3(1, tiles), block, 0, stream>>>(a, l, D[s] - 1);
+                cudaEventRecord(links[s].edges, stream);
+                if (D[s] > 2) {
+                    slab_cells<T, dim, Act><<<dim3(D[s] - 2, tiles), block, 0, stream>>>(a, l, 1);
+                    slab_sums<T, dim><<<dim3(D[s] - 2, tiles), block, 0, stream>>>(a, l, 1);
+                }
+            }
+            for (int s = 0; s < p.n; ++s)
+                send_halos(links, p.devices, p.n, s, h.data(), D.data(), bytes);
+            for (int s = 0; s < p.n; ++s) {
+                const ForwardArgs &a = p.slabs[s];
+                auto stream = static_cast<cudaStream_t>(a.stream);
+                check(cudaSetDevice(p.devices[s]), "cudaSetDevice");
+                wait_halos(links, p.n, s, stream);
+                slab_sums<T, dim><<<dim3(1, tiles), block, 0, stream>>>(a, l, 0);
+                if (D[s] > 1)
+                    slab_sums<T, dim><<<dim3(1, tiles), block, 0, stream>>>(a, l, D[s] - 1);
+            }
+        }
+        join_halos(links, p);
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct PartitionedBackward {
+    static constexpr int dim = Dim::value;
+
+    static void fn(const PartitionedBackwardArgs &p) {
+        std::lock_guard<std::mutex> lock(halo_mutex());
+        DeviceRestore restore;
+        auto &links = halo_links(p.devices, p.n);
+        const dim3 block(dim, Tile<dim>::samples);
+        const Shape &sh0 = p.slabs[0].shape;
+        const unsigned tiles = (sh0.batch + Tile<dim>::samples - 1) / Tile<dim>::samples;
+        const size_t bytes = sh0.cell_size() * sizeof(T);
+
+        // per slab, dz of the even and odd columns, then the second gradient buffer
+        std::deque<utils::ArenaScope> scopes;
+        std::vector<T *> dz[2], g2(p.n);
+        std::vector<int> D(p.n);
+        for (int s = 0; s < p.n; ++s) {
+            const BackwardArgs &a = p.slabs[s];
+            auto stream = static_cast<cudaStream_t>(a.stream);
+            scopes.emplace_back(a.arena);
+            D[s] = a.shape.D;
+            T *scratch = utils::scratch_or<T>(a.dz, a.arena, partitioned_scratch(a.shape));
+            const size_t padded = a.shape.padded_column_size();
+            dz[0].push_back(scratch);
+            dz[1].push_back(scratch + padded);
+            g2[s] = scratch + 2 * padded;
+            check(cudaSetDevice(p.devices[s]), "cudaSetDevice");
+            for (int c = 0; c < 2; ++c) {
+                if (s == 0)
+                    cudaMemsetAsync(dz[c][s], 0, bytes, stream);
+                if (s + 1 == p.n)
+                    cudaMemsetAsync(reinterpret_cast<char *>(dz[c][s]) + (D[s] + pad) * bytes, 0, bytes, stream);
+            }
+        }
+
+        std::vector<char *> base(p.n);
+        for (int l = sh0.L - 1; l >= 0; --l) {
+            for (int s = 0; s < p.n; ++s) {
+                const BackwardArgs &a = p.slabs[s];
+                auto stream = static_cast<cudaStream_t>(a.stream);
+                // ping-pong between dx and g2, picked so that column 0 writes dx
+                T *bufs[2] = {static_cast<T *>(a.dx), g2[s]};
+                const T *g = l == sh0.L - 1 ? static_cast<const T *>(a.grad) : bufs[(l + 1) % 2];
+                T *d = dz[l % 2][s];
+                base[s] = reinterpret_cast<char *>(d);
+                check(cudaSetDevice(p.devices[s]), "cudaSetDevice");
+                slab_d_sums<T, dim><<<dim3(1, tiles), block, 0, stream>>>(a, l, 0, g, d);
+                if (D[s] > 1)
+                    slab_d_sums<T, dim><<<dim3(1, tiles), block, 0, stream>>>(a, l, D[s] - 1, g, d);
+                cudaEventRecord(links[s].edges, stream);
+                if (D[s] > 2) {
+                    slab_d_sums<T, dim><<<dim3(D[s] - 2, tiles), block, 0, stream>>>(a, l, 1, g, d);
+                    slab_d_cells<T, dim, Act><<<dim3(D[s] - 2, tiles), block, 0, stream>>>(a, l, 1, d, bufs[l % 2]);
+                }
+            }
+            // a halo lands in the dz of this column's parity, which the
+            // neighbour last read two columns ago, before it sent the halos
+            // this slab waited on for the column in between
+            for (int s = 0; s < p.n; ++s)
+                send_halos(links, p.devices, p.n, s, base.data(), D.data(), bytes);
+            for (int s = 0; s < p.n; ++s) {
+                const BackwardArgs &a = p.slabs[s];
+                auto stream = static_cast<cudaStream_t>(a.stream);
+                T *bufs[2] = {static_cast<T *>(a.dx), g2[s]};
+                check(cudaSetDevice(p.devices[s]), "cudaSetDevice");
+                wait_halos(links, p.n, s, stream);
+                slab_d_cells<T, dim, Act><<<dim3(1, tiles), block, 0, stream>>>(a, l, 0, dz[l % 2][s], bufs[l % 2]);
+                if (D[s] > 1)
+                    slab_d_cells<T, dim, Act>
+                        <<<dim3(1, tiles), block, 0, stream>>>(a, l, D[s] - 1, dz[l % 2][s], bufs[l % 2]);
+            }
+        }
+        join_halos(links, p);
+    }
+};
+
+} // cuda
+
+using fn_builder::FnBuilder;
+using fn_builder::Tagged;
+
+void add_cuda_kernels(forward_table_t &table) {
+    FnBuilder<specs<device::cuda>, Tagged<cuda::Forward>::type>::build_table(table, 0);
+}
+
+void add_cuda_kernels(backward_table_t &table) {
+    FnBuilder<specs<device::cuda>, Tagged<cuda::Backward>::type>::build_table(table, 0);
+}
+
+void add_cuda_kernels(reversible_forward_table_t &table) {
+    FnBuilder<specs<device::cuda>, Tagged<cuda::ReversibleForward>::type>::build_table(table, 0);
+}
+
+void add_cuda_kernels(reversible_backward_table_t &table) {
+    FnBuilder<specs<device::cuda>, Tagged<cuda::ReversibleBackward>::type>::build_table(table, 0);
+}
+
+void add_cuda_kernels(checkpoint_forward_table_t &table) {
+    FnBuilder<specs<device::cuda>, Tagged<cuda::CheckpointForward>::type>::build_table(table, 0);
+}
+
+void add_cuda_kernels(checkpoint_backward_table_t &table) {
+    FnBuilder<specs<device::cuda>, Tagged<cuda::CheckpointBackward>::type>::build_table(table, 0);
+}
+
+void add_cuda_kernels(partitioned_forward_table_t &table) {
+    FnBuilder<specs<device::cuda>, Tagged<cuda::PartitionedForward>::type>::build_table(table, 0);
+}
+
+void add_cuda_kernels(partitioned_backward_table_t &table) {
+    FnBuilder<specs<device::cuda>, Tagged<cuda::PartitionedBackward>::type>::build_table(table, 0);
+}
+
+}
@@ -0,0 +1,153 @@
+/*
+shared definitions for the grid kernels, a port of m1/grid.jl
+
+every buffer is dense and row major, with the same memory order as the
+column major arrays in grid.jl, so the same storage can be handed to either
+    w  : [L, D, dim, dim]  w[l][d][i][o] maps input i to output o
+    b  : [L, D, dim]
+    x  : [D, batch, dim]
+the kernels only see raw pointers, so that they can be dispatched through
+fn_builder without pulling in libtorch, the same args are handed to the cpu
+and the cuda kernels, which only differ in where the pointers live
+*/
+
+#pragma once
+#include <cmath>
+#include <cstddef>
+
+#include "../utils/simd.h"
+
+#ifdef __CUDACC__
+#define GROWNET_HD __host__ __device__
+#else
+#define GROWNET_HD
+#endif
+
+namespace utils {
+class ThreadPool;
+class Arena;
+}
+
+namespace grid {
+
+// neighbour_offsets in BaselineGrid2D, each cell pushes to the cells
+// at these offsets in the next column
+constexpr int offsets[3] = {-1, 0, 1};
+constexpr int pad = 1;
+
+constexpr double norm_eps = 1e-6;
+
+struct Shape {
+    int dim;
+    int D;      // cells per column
+    int L;      // number of columns
+    int batch;
+
+    GROWNET_HD size_t cell_size() const { return (size_t)batch * dim; }
+    GROWNET_HD size_t column_size() const { return cell_size() * D; }
+    // sum_buf2 in grid.jl, one zero cell of padding on each end
+    GROWNET_HD size_t padded_column_size() const { return cell_size() * (D + 2 * pad); }
+};
+
+struct ForwardArgs {
+    const void *w;
+    const void *b;
+    const void *x;
+    // [L, D + 2, batch, dim] activated cell outputs, the end cells are zeroed
+    void *h;
+    // [L, D, batch, dim] normalized neighbour sums, y[L-1] is the grid output,
+    // y[l] is the input to column l + 1
+    void *y;
+    // [L, D, batch] standard deviation of each normalized sum
+    void *sd;
+    Shape shape;
+    // cudaStream_t to launch on, null for the default stream, unused on cpu
+    void *stream = nullptr;
+    // runs the columns over the pool if set, unused on cuda
+    utils::ThreadPool *pool = nullptr;
+    // where scratch buffers left null come from, must live on the same device
+    utils::Arena *arena = nullptr;
+};
+
+using forward_fn = void (*)(const ForwardArgs &);
+
+// called with each column l once the backward pass is done with its dw and
+// db, on cuda once their kernels are queued, from the thread running the
+// kernel, so the gradients of a column can be handed off before the rest
+struct ColumnHook {
+    void (*fn)(void *ctx, int l) = nullptr;
+    void *ctx = nullptr;
+
+    void operator()(int l) const {
+        if (fn != nullptr)
+            fn(ctx, l);
+    }
+};
+
+struct BackwardArgs {
+    // as kept by the forward pass
+    const void *w;
+    const void *x;
+    const void *h;
+    const void *y;
+    const void *sd;
+    // [D, batch, dim] dL/dy[L-1]
+    const void *grad;
+    // [D, batch, dim] dL/dx, also holds the gradient between columns
+    void *dx;
+    // [L, D, dim, dim] and [L, D, dim], accumulated into
+    void *dw;
+    void *db;
+    // [D + 2, batch, dim] scratch for the gradient of the neighbour sums,
+    // the cuda kernels use it as a second buffer for the gradient between columns,
+    // reserved from the arena when null
+    void *dz;
+    Shape shape;
+    void *stream = nullptr;
+    utils::ThreadPool *pool = nullptr;
+    utils::Arena *arena = nullptr;
+    // defaulted like the members above, so args built in braces can leave it out
+    ColumnHook column_done = {};
+};
+
+using backward_fn = void (*)(const BackwardArgs &);
+
+// the buffers a call reads and writes once each, dw and db being read and
+// written, with the statistics counted at the storage type, for
+// utils/counters.h
+inline size_t bytes_moved(const ForwardArgs &a, size_t elem) {
+    const Shape &s = a.shape;
+    const size_t params = (size_t)s.L * s.D * s.dim * (s.dim + 1);
+    return elem * (params + s.column_size() + s.L * (s.padded_column_size() + s.column_size() + (size_t)s.D * s.batch));
+}
+
+inline size_t bytes_moved(const BackwardArgs &a, size_t elem) {
+    const Shape &s = a.shape;
+    const size_t w = (size_t)s.L * s.D * s.dim * s.dim, b = (size_t)s.L * s.D * s.dim;
+    return elem * (3 * w + 2 * b + 3 * s.column_size() +
+                   s.L * (s.padded_column_size() + s.column_size() + (size_t)s.D * s.batch));
+}
+
+// the cpu kernels, defined in forward.h and backward.h, declared here for the
+// drivers that are written against them
+template <typename T, typename Dim, typename Act>
+struct Forward;
+template <typename T, typename Dim, typename Act>
+struct Backward;
+
+struct Relu {
+    template <typename P>
+    static P forward(P x) { return max(x, P::zero()); }
+
+    // gradient of the output w.r.t. the input, given the output
+    template <typename P>
+    static P backward(P y, P g) { return mask_positive(y, g); }
+
+    template <typename T>
+    GROWNET_HD static T scalar_forward(T x) { return x > T(0) ? x : T(0); }
+
+    template <typename T>
+    GROWNET_HD static T scalar_backward(T y, T g) { return y > T(0) ? g : T(0); }
+};
+
+} // grid
@@ -0,0 +1,119 @@
+/*
+the grid with cells embedded in R^3, each layer a Dy x Dz plate of cells in
+place of a column, and each sum of a layer the normalized sum of the
+(2 radius + 1)^2 cells around it, the plate counterpart of neighbour_offsets
+
+    w  : [L, Dy, Dz, dim, dim]
+    b  : [L, Dy, Dz, dim]
+    x  : [Dy, Dz, batch, dim]
+
+the stencil is swept one plate row at a time over a tile of the batch sized
+so that the 2 radius + 1 rows of activations a row of sums reads, and the row
+of sums written, stay in L2, the kernels are Forward3D in forward.h and
+Backward3D in backward.h, cpu only for now
+*/
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+
+#include "grid.h"
+
+namespace grid {
+
+struct Shape3D {
+    int dim;
+    int Dy;     // rows of a plate
+    int Dz;     // cells per row
+    int L;      // number of layers
+    int batch;
+    // each sum gathers the cells up to radius away along y and z
+    int radius;
+
+    size_t cell_size() const { return (size_t)batch * dim; }
+    int cells() const { return Dy * Dz; }
+    size_t layer_size() const { return cell_size() * cells(); }
+    // radius zero cells of padding around the plate
+    int padded_Dz() const { return Dz + 2 * radius; }
+    size_t padded_layer_size() const { return cell_size() * (Dy + 2 * radius) * padded_Dz(); }
+    // offset of the cell at row i, column k of a padded plate, both counted
+    // from -radius
+    size_t padded_cell(int i, int k) const {
+        return ((size_t)(i + radius) * padded_Dz() + k + radius) * cell_size();
+    }
+};
+
+struct Forward3DArgs {
+    const void *w;
+    const void *b;
+    const void *x;
+    // [L, Dy + 2 radius, Dz + 2 radius, batch, dim] activated cell outputs,
+    // the padding is zeroed
+    void *h;
+    // [L, Dy, Dz, batch, dim] normalized sums, y[L-1] is the grid output
+    void *y;
+    // [L, Dy, Dz, batch] standard deviation of each normalized sum
+    void *sd;
+    Shape3D shape;
+    void *stream = nullptr;
+    // splits the batch over the pool if set
+    utils::ThreadPool *pool = nullptr;
+    utils::Arena *arena = nullptr;
+};
+
+using forward3d_fn = void (*)(const Forward3DArgs &);
+
+struct Backward3DArgs {
+    // as kept by the forward pass
+    const void *w;
+    const void *x;
+    const void *h;
+    const void *y;
+    const void *sd;
+    // [Dy, Dz, batch, dim] dL/dy[L-1]
+    const void *grad;
+    // [Dy, Dz, batch, dim] dL/dx, also holds the gradient between layers
+    void *dx;
+    // accumulated into
+    void *dw;
+    void *db;
+    // [Dy + 2 radius, Dz + 2 radius, batch, dim] scratch for the gradient of
+    // the sums, reserved from the arena when null
+    void *dz;
+    Shape3D shape;
+    void *stream = nullptr;
+    utils::ThreadPool *pool = nullptr;
+    utils::Arena *arena = nullptr;
+};
+
+using backward3d_fn = void (*)(const Backward3DArgs &);
+
+namespace detail {
+    // what the stencil sweep wants in L2 at once
+    constexpr size_t stencil_budget = 256 << 10;
+
+    // samples per tile of the sweep, so that 2 radius + 1 padded rows of
+    // cells and one row of sums fit the budget
+    inline int stencil_tile(const Shape3D &sh, size_t elem) {
+        const size_t row_cells = (size_t)(2 * sh.radius + 1) * sh.padded_Dz() + sh.Dz;
+        const size_t per_sample = row_cells * sh.dim * elem;
+        return (int)std::clamp<size_t>(stencil_budget / per_sample, 1, std::max(sh.batch, 1));
+    }
+} // detail
+
+// as for the dense grid, for utils/counters.h
+inline size_t bytes_moved(const Forward3DArgs &a, size_t elem) {
+    const Shape3D &s = a.shape;
+    const size_t params = (size_t)s.L * s.cells() * s.dim * (s.dim + 1);
+    return elem * (params + s.layer_size() +
+                   s.L * (s.padded_layer_size() + s.layer_size() + (size_t)s.cells() * s.batch));
+}
+
+inline size_t bytes_moved(const Backward3DArgs &a, size_t elem) {
+    const Shape3D &s = a.shape;
+    const size_t w = (size_t)s.L * s.cells() * s.dim * s.dim, b = (size_t)s.L * s.cells() * s.dim;
+    return elem * (3 * w + 2 * b + 3 * s.layer_size() +
+                   s.L * (s.padded_layer_size() + s.layer_size() + (size_t)s.cells() * s.batch));
+}
+
+} // grid
@@ -0,0 +1,101 @@
+/*
+the dense grid at serving time, forward_kernel! in m1/grid.jl without any of
+the state it keeps for backward, no h of every column, no y between columns
+and no sd of the sums that normalize! leaves in mu_v and sd_v
+
+the samples of a call are cut into tiles, and each tile runs through every
+column on its own as a single task, there being nothing to synchronize
+between tiles, in a scratch of a padded column of h and two columns of sums,
+which stays in cache from one column to the next, the bias is folded into
+the accumulator each cell starts from, and the last column is normalized
+straight into the output, a batch of one is a single task on the calling
+thread, and without a pool the tiles take each column in turn, so that the
+weights of a column are read from memory once for the whole batch
+
+the float cells sum several samples at once, cell_forward_blocks in
+forward.h, each load of the weights feeding all of them, where the training
+forward reloads them per sample
+
+with fewer tiles than threads, a batch of one on a pool, the cells of each
+column are split over the pool instead, each range computing the cells of
+its own sums and the halo cell on each of its ends again, so that a column
+takes one run of the pool where the training forward takes two, the kernel
+is Inference in forward.h, cpu only for now, also over the int8 cells of
+grid/quantize.h
+*/
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+
+#include "grid.h"
+#include "quantize.h"
+
+namespace grid {
+
+struct InferArgs {
+    // the cells packed by quantize_cells under utils::qint8
+    const void *w;
+    const void *b;
+    const void *x;
+    // [D, batch, dim] the grid output
+    void *y;
+    // inference_scratch elements for the pool's size, float under
+    // utils::qint8, reserved from the arena when null
+    void *work;
+    Shape shape;
+    void *stream = nullptr;
+    // runs the tiles over the pool if set and there are several
+    utils::ThreadPool *pool = nullptr;
+    utils::Arena *arena = nullptr;
+};
+
+using infer_fn = void (*)(const InferArgs &);
+
+namespace detail {
+    // samples per task, at most a cache block of Forward
+    inline int infer_tile(const Shape &sh) {
+        return std::clamp(sh.batch, 1, 32);
+    }
+
+    inline int infer_tiles(const Shape &sh) {
+        const int t = infer_tile(sh);
+        return (sh.batch + t - 1) / t;
+    }
+
+    // cell ranges of a column split over threads, none when the tiles keep
+    // them busy or a column is too short to split
+    inline int infer_ranges(const Shape &sh, int threads) {
+        return threads > 1 && infer_tiles(sh) < threads && sh.D >= 2 * threads ? threads : 0;
+    }
+
+    // elements of the scratch of a tile, h of a padded column, two columns of
+    // sums and the deviations of a column's sums, thrown away
+    inline size_t infer_tile_scratch(const Shape &sh) {
+        const size_t cell = (size_t)infer_tile(sh) * sh.dim;
+        return (3 * (size_t)sh.D + 2 * pad) * cell + infer_tile(sh);
+    }
+
+    // of a cell range, h of its cells and their halo, and deviations
+    inline size_t infer_range_scratch(const Shape &sh, int ranges) {
+        return ((size_t)(sh.D + ranges - 1) / ranges + 2 * pad) * sh.cell_size() + sh.batch;
+    }
+} // detail
+
+// elements of InferArgs::work, for a pool of threads, 1 without one
+inline size_t inference_scratch(const Shape &sh, int threads) {
+    const size_t tiles = (size_t)detail::infer_tiles(sh) * detail::infer_tile_scratch(sh);
+    const int r = detail::infer_ranges(sh, threads);
+    return r ? std::max(tiles, 2 * sh.column_size() + r * detail::infer_range_scratch(sh, r)) : tiles;
+}
+
+// reads the parameters and the input once and writes the output once, an
+// elem of 1 being the int8 cells with everything else float
+inline size_t bytes_moved(const InferArgs &a, size_t elem) {
+    const Shape &s = a.shape;
+    if (elem == sizeof(utils::qint8))
+        return quant_bytes(s) + sizeof(float) * ((size_t)s.L * s.D * s.dim + 2 * s.column_size());
+    return elem * ((size_t)s.L * s.D * s.dim * (s.dim + 1) + 2 * s.column_size());
+}
+
+} // grid
@@ -0,0 +1,41 @@
+/*
+mixed precision grid, w, b, x, h and y stored as 16 bit floats, utils::half
+or utils::bfloat16, with everything computed in float, which halves the
+traffic of the bandwidth bound cells
+
+the float cell kernels run over tiles of the batch small enough for L1, each
+tile widened on load and narrowed on store, so the 16 bit buffers are the only
+ones that go to memory besides a column of weights widened once, only what is
+kept between the passes is rounded, and the next column reads y back from its
+16 bit storage like the backward pass does, so both see the same inputs
+
+sd, dw and db are float, being statistics and accumulated gradients, and so
+is the gradient between columns, only dx is narrowed, the kernels are
+MixedForward in forward.h and MixedBackward in backward.h, registered in the
+forward and backward tables under the 16 bit dtypes, cpu only for now
+*/
+
+#pragma once
+#include "grid.h"
+#include "../utils/arena.h"
+#include "../utils/half.h"
+
+namespace grid {
+
+// arena bytes either pass needs for a shape, the backward needing the most,
+// every buffer is float whatever the storage type
+inline size_t mixed_scratch_bytes(const Shape &sh) {
+    const size_t bufs[] = {
+        (size_t)sh.D * sh.dim * sh.dim,     // w of a column
+        (size_t)sh.D * sh.dim,              // b of a column
+        sh.column_size(),                   // gradient between columns,
+        sh.column_size(),                   // in two buffers
+        sh.padded_column_size(),            // dz of the sums
+    };
+    size_t bytes = 0;
+    for (size_t n : bufs)
+        bytes += (n * sizeof(float) + utils::Arena::alignment - 1) / utils::Arena::alignment * utils::Arena::alignment;
+    return bytes;
+}
+
+} // grid
@@ -0,0 +1,53 @@
+/*
+the dense grid split along D over several cuda devices, each holding a slab
+of consecutive cells of every column, its own w, b and x and the h, y and sd
+of its cells, as a grid of its own D
+
+a sum only reads the cells next to it, so per column each slab only needs the
+one boundary cell of each neighbour, the h of it in the forward pass and the
+gradient of its sum in the backward one, a slab computes its two boundary
+cells first and sends them off on a stream of its own, peer to peer, while it
+computes its interior, then finishes the two sums or cells next to its ends
+once the neighbours' halos have landed
+
+the halos land in the padding cells of h and dz, which on the ends of the
+grid stay zero as on a single device, slabs may share a device, the halos
+then being copied within it, the kernels are in grid.cu
+*/
+
+#pragma once
+#include <cstddef>
+
+#include "grid.h"
+
+namespace grid {
+
+struct PartitionedForwardArgs {
+    // one per slab, in the order of their cells, each with its slab's shape,
+    // D being the cells it holds, and h padded by a halo cell on each end
+    const ForwardArgs *slabs;
+    // the cuda device of each slab
+    const int *devices;
+    int n;
+};
+
+using partitioned_forward_fn = void (*)(const PartitionedForwardArgs &);
+
+struct PartitionedBackwardArgs {
+    // as for the forward, the dz of a slab holds partitioned_scratch of its
+    // shape, or is reserved from its arena when null
+    const BackwardArgs *slabs;
+    const int *devices;
+    int n;
+};
+
+using partitioned_backward_fn = void (*)(const PartitionedBackwardArgs &);
+
+// elements of the backward scratch of a slab, the gradient of its sums for
+// two columns at a time, so a halo for the next column can land while the
+// last is still read, and a second buffer for the gradient between columns
+inline size_t partitioned_scratch(const Shape &slab) {
+    return (2 * ((size_t)slab.D + 2 * pad) + slab.D) * slab.cell_size();
+}
+
+} // grid
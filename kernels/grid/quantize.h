@@ -0,0 +1,241 @@
+/*
+int8 cells for serving, post training quantization of a trained float grid
+for the kernels of grid/inference.h, the w of each cell is scaled by its
+largest magnitude into [-127, 127] with one float scale per cell, so the
+weights, which is most of the traffic of the bandwidth bound cells, are 4x
+smaller and a grid 4x larger stays in cache
+
+the input row of a cell is quantized the same way for each sample and
+shifted by 128 into a uint8, a cell then sums uint8 inputs times int8
+weights in int32, 4 inputs per output lane at a time, with vpdpbusd under
+avx512 vnni or avx vnni and with pairs of madd under avx2 alone, 128 times
+the weights of an output summed is taken back off, and the bias and the
+activation are applied in float as before
+
+    weights : int8 [ceil(dim / 4)][dim][4], w[i][o] at group i / 4,
+              output o, byte i % 4, the inputs past dim zero
+    offsets : int32 [dim], 128 times the weights of output o summed
+    scale   : float
+
+cells are packed in the [L, D] order of the float ones, quant_cell_bytes
+apart, the kernels are Inference in forward.h registered under
+utils::qint8, cpu only, with x and y float
+*/
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "grid.h"
+#include "../utils/int8.h"
+#include "../utils/simd.h"
+
+namespace grid {
+
+inline size_t quant_groups(int dim) {
+    return ((size_t)dim + 3) / 4;
+}
+
+// from one packed cell to the next, a multiple of a cache line
+inline size_t quant_cell_bytes(int dim) {
+    const size_t n = quant_groups(dim) * 4 * dim + (size_t)dim * sizeof(int32_t) + sizeof(float);
+    return (n + 63) / 64 * 64;
+}
+
+// of every cell of a shape
+inline size_t quant_bytes(const Shape &sh) {
+    return (size_t)sh.L * sh.D * quant_cell_bytes(sh.dim);
+}
+
+// cell c of cells packed by quantize_cells
+struct QuantCell {
+    const int8_t *w;
+    const int32_t *offsets;
+    float scale;
+
+    static QuantCell at(const void *cells, size_t c, int dim) {
+        const char *p = static_cast<const char *>(cells) + c * quant_cell_bytes(dim);
+        const size_t wb = quant_groups(dim) * 4 * dim;
+        float s;
+        std::memcpy(&s, p + wb + dim * sizeof(int32_t), sizeof(s));
+        return {reinterpret_cast<const int8_t *>(p), reinterpret_cast<const int32_t *>(p + wb), s};
+    }
+};
+
+// packs the float cells w [L, D, dim, dim] into quant_bytes(sh) at out
+inline void quantize_cells(const float *w, const Shape &sh, void *out) {
+    const int d = sh.dim;
+    const size_t bytes = quant_cell_bytes(d), wb = quant_groups(d) * 4 * d;
+    std::vector<int32_t> sums(d);
+    for (size_t c = 0; c < (size_t)sh.L * sh.D; ++c) {
+        const float *wc = w + c * d * d;
+        char *p = static_cast<char *>(out) + c * bytes;
+        std::memset(p, 0, bytes);
+        float m = 0;
+        for (size_t k = 0; k < (size_t)d * d; ++k)
+            m = std::max(m, std::fabs(wc[k]));
+        const float scale = m / 127, inv = m > 0 ? 127 / m : 0;
+        std::fill(sums.begin(), sums.end(), 0);
+        int8_t *q = reinterpret_cast<int8_t *>(p);
+        for (int i = 0; i < d; ++i)
+            for (int o = 0; o < d; ++o) {
+                const long v = std::clamp(std::lrint(wc[(size_t)i * d + o] * inv), -127l, 127l);
+                q[(size_t)(i / 4) * d * 4 + o * 4 + i % 4] = (int8_t)v;
+                sums[o] += (int32_t)v;
+            }
+        for (int o = 0; o < d; ++o)
+            sums[o] *= 128;
+        std::memcpy(p + wb, sums.data(), d * sizeof(int32_t));
+        std::memcpy(p + wb + d * sizeof(int32_t), &scale, sizeof(scale));
+    }
+}
+
+namespace detail {
+    // h[s] = act(x[s] * w + b) over n samples for a packed cell of any dim,
+    // x quantized as by quantize_row but the shift undone, so the products
+    // are summed in float, exactly for any dim below a thousand
+    template <typename Act>
+    inline void qcell_forward_any(const QuantCell &c, const float *b, const float *x, float *h, int dim, int n) {
+        for (int s = 0; s < n; ++s) {
+            const float *xs = x + (size_t)s * dim;
+            float *hs = h + (size_t)s * dim;
+            float m = 0;
+            for (int i = 0; i < dim; ++i)
+                m = std::max(m, std::fabs(xs[i]));
+            const float inv = m > 0 ? 127 / m : 0, f = m / 127 * c.scale;
+            std::fill(hs, hs + dim, 0.0f);
+            for (int i = 0; i < dim; ++i) {
+                const float xi = (float)std::lrint(xs[i] * inv);
+                const int8_t *wi = c.w + (size_t)(i / 4) * dim * 4 + i % 4;
+                for (int o = 0; o < dim; ++o)
+                    hs[o] += xi * wi[o * 4];
+            }
+            for (int o = 0; o < dim; ++o)
+                hs[o] = Act::scalar_forward(hs[o] * f + b[o]);
+        }
+    }
+
+#if defined(__AVX2__)
+    // the row x of Dim quantized by its largest magnitude and shifted into
+    // uint8, 4 to a word as in a group of the weights, returns its scale
+    template <int Dim>
+    inline float quantize_row(const float *x, uint32_t *xq) {
+        const __m256 abs = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        __m256 m = _mm256_setzero_ps();
+        for (int k = 0; k < Dim; k += 8)
+            m = _mm256_max_ps(m, _mm256_and_ps(_mm256_loadu_ps(x + k), abs));
+        // the largest in every lane, kept in registers on the way to inv
+        m = _mm256_max_ps(m, _mm256_permute2f128_ps(m, m, 1));
+        m = _mm256_max_ps(m, _mm256_permute_ps(m, 0x4e));
+        m = _mm256_max_ps(m, _mm256_permute_ps(m, 0xb1));
+        const __m256 inv = _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(127), m),
+                                         _mm256_cmp_ps(m, _mm256_setzero_ps(), _CMP_GT_OQ));
+        const __m256i shift = _mm256_set1_epi32(128);
+        for (int k = 0; k < Dim; k += 8) {
+            const __m256i v = _mm256_add_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(x + k), inv)), shift);
+            // packing within the 128 bit halves leaves lanes 0 to 3 in the
+            // low word of the first half and 4 to 7 in that of the second
+            const __m256i p = _mm256_packus_epi32(v, v);
+            const __m256i q = _mm256_packus_epi16(p, p);
+            xq[k / 4] = (uint32_t)_mm256_cvtsi256_si32(q);
+            xq[k / 4 + 1] = (uint32_t)_mm256_extract_epi32(q, 4);
+        }
+        return _mm256_cvtss_f32(m) / 127;
+    }
+
+    // int32 sums of 8 outputs, each adding the 4 uint8 of a word times the
+    // 4 int8 of its lane at a time
+    struct Dot8 {
+#if (defined(__AVX512VNNI__) && defined(__AVX512VL__)) || defined(__AVXVNNI__)
+        using word = __m256i;
+        __m256i acc = _mm256_setzero_si256();
+
+        static word broadcast(uint32_t x) { return _mm256_set1_epi32((int)x); }
+
+        void add(word x, const int8_t *w) {
+            const __m256i wv = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w));
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+            acc = _mm256_dpbusd_epi32(acc, x, wv);
+#else
+            acc = _mm256_dpbusd_avx_epi32(acc, x, wv);
+#endif
+        }
+
+        __m256i sum() const { return acc; }
+#else
+        // widened to int16, madd sums pairs, leaving the two halves of
+        // outputs 0 to 3 in lo and of 4 to 7 in hi
+        using word = __m256i;
+        __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+
+        static word broadcast(uint32_t x) { return _mm256_cvtepu8_epi16(_mm_set1_epi32((int)x)); }
+
+        void add(word x, const int8_t *w) {
+            const __m128i *p = reinterpret_cast<const __m128i *>(w);
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128(p)), x));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128(p + 1)), x));
+        }
+
+        // hadd leaves outputs 0, 1, 4, 5 in the first half and 2, 3, 6, 7
+        // in the second
+        __m256i sum() const { return _mm256_permute4x64_epi64(_mm256_hadd_epi32(lo, hi), 0xd8); }
+#endif
+    };
+
+    // the sums of acc less the offsets as floats, W / 8 Dot8 to a pack of
+    // the width simd::Row gives the float cells, whose sums load h in packs
+    // of that width, so the stores of h can be forwarded to them
+    template <int W>
+    inline simd::Pack<float, W> dequantize(const Dot8 *acc, const int32_t *off) {
+        if constexpr (W == 16) {
+#if defined(__AVX512F__)
+            // joined by a shuffle and converted masked, gcc 12 warns of the
+            // undefined vector the insert and the plain convert start from,
+            // see simd.h
+            const __m512i z = (__m512i)__builtin_shufflevector((__v4di)acc[0].sum(), (__v4di)acc[1].sum(), 0, 1, 2,
+                                                               3, 4, 5, 6, 7);
+            return {_mm512_maskz_cvtepi32_ps(0xffff, _mm512_sub_epi32(z, _mm512_loadu_si512(off)))};
+#endif
+        } else {
+            static_assert(W == 8, "int8 cells are summed 8 outputs at a time");
+            const __m256i o = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(off));
+            return {_mm256_cvtepi32_ps(_mm256_sub_epi32(acc[0].sum(), o))};
+        }
+    }
+#endif
+
+    // qcell_forward_any at a compile time dim, in simd for a multiple of 8
+    template <int Dim, typename Act>
+    inline void qcell_forward(const QuantCell &c, const float *b, const float *x, float *h, int n) {
+#if defined(__AVX2__)
+        if constexpr (Dim % 8 == 0) {
+            using pack = typename simd::Row<float, Dim>::pack;
+            constexpr int G = Dim / 4, N = Dim / 8, W = pack::width;
+            uint32_t xq[G];
+            for (int s = 0; s < n; ++s) {
+                const float f = quantize_row<Dim>(x + (size_t)s * Dim, xq) * c.scale;
+                Dot8 acc[N];
+                for (int g = 0; g < G; ++g) {
+                    const Dot8::word xg = Dot8::broadcast(xq[g]);
+                    const int8_t *wg = c.w + g * Dim * 4;
+                    for (int k = 0; k < N; ++k)
+                        acc[k].add(xg, wg + k * 32);
+                }
+                float *hs = h + (size_t)s * Dim;
+                for (int k = 0; k < Dim; k += W) {
+                    const pack z = dequantize<W>(acc + k / 8, c.offsets + k);
+                    Act::forward(fmadd(z, pack::set1(f), pack::load(b + k))).store(hs + k);
+                }
+            }
+            return;
+        }
+#endif
+        qcell_forward_any<Act>(c, b, x, h, Dim, n);
+    }
+} // detail
+
+} // grid
@@ -0,0 +1,211 @@
+/*
+reversible grid, each column is an additive coupling of two half width grid
+columns over the two halves of every cell's state,
+    y1 = x1 + F(x2)
+    y2 = x2 + G(y1)
+where F and G are the usual cell, neighbour sum and normalize column at dim / 2,
+so the inverse is exact,
+    x2 = y2 - G(y1)
+    x1 = y1 - F(x2)
+and the backward pass rebuilds each column's input from its output instead of
+keeping h, y and sd for every column, only the grid output is kept and the
+scratch needed is that of a single column, whatever L is
+
+the state is kept with the halves split, [2, D, batch, dim / 2], so each half
+is a dense buffer the half width column kernels run over directly, as
+    w  : [L, 2, D, dim / 2, dim / 2]  F then G of each column
+    b  : [L, 2, D, dim / 2]
+the driver is written against the column kernels and a few buffer ops, so the
+cpu and cuda versions share it, with the cuda one instantiated in grid.cu
+
+the reconstruction is exact in exact arithmetic only, in floating point the
+rebuilt inputs drift by a few ulps per column, which is the usual trade of
+reversible networks
+*/
+
+#pragma once
+#include <type_traits>
+
+#include "grid.h"
+#include "buffer_ops.h"
+#include "../utils/arena.h"
+
+namespace grid {
+
+struct ReversibleForwardArgs {
+    const void *w;
+    const void *b;
+    // [2, D, batch, dim / 2]
+    const void *x;
+    // [2, D, batch, dim / 2] the grid output, the only activation kept
+    void *y;
+    // dim is the full width of a cell, split in two halves
+    Shape shape;
+    void *stream = nullptr;
+    utils::ThreadPool *pool = nullptr;
+    // required, holds the scratch of one column, see reversible_scratch_bytes
+    utils::Arena *arena = nullptr;
+};
+
+using reversible_forward_fn = void (*)(const ReversibleForwardArgs &);
+
+struct ReversibleBackwardArgs {
+    const void *w;
+    const void *b;
+    // as written by the forward pass
+    const void *y;
+    // [2, D, batch, dim / 2] dL/dy
+    const void *grad;
+    // [2, D, batch, dim / 2] dL/dx, also holds the gradient between columns
+    void *dx;
+    // [L, 2, D, dim / 2, dim / 2] and [L, 2, D, dim / 2], accumulated into
+    void *dw;
+    void *db;
+    Shape shape;
+    void *stream = nullptr;
+    utils::ThreadPool *pool = nullptr;
+    // required, as for the forward pass
+    utils::Arena *arena = nullptr;
+};
+
+using reversible_backward_fn = void (*)(const ReversibleBackwardArgs &);
+
+// arena bytes either pass needs for a shape, the backward needing the most
+inline size_t reversible_scratch_bytes(const Shape &sh, size_t elem) {
+    const size_t half = (size_t)sh.batch * (sh.dim / 2);
+    const size_t bufs[] = {
+        (sh.D + 2 * pad) * half,    // h
+        sh.D * half,                // normalized column output
+        (size_t)sh.D * sh.batch,    // sd
+        2 * sh.D * half,            // state being rebuilt
+        sh.D * half,                // gradient through one half
+        (sh.D + 2 * pad) * half,    // dz of the column backward
+    };
+    size_t bytes = 0;
+    for (size_t n : bufs)
+        bytes += (n * elem + utils::Arena::alignment - 1) / utils::Arena::alignment * utils::Arena::alignment;
+    return bytes;
+}
+
+// Fwd and Bwd are column kernels with the interface of grid::Forward and
+// grid::Backward, run here as single column grids of width dim / 2
+template <typename T, typename Dim, typename Act,
+          template <class, class, class> class Fwd, template <class, class, class> class Bwd, typename Ops>
+struct ReversibleColumns {
+    static constexpr int dim = Dim::value;
+    static constexpr int half = dim / 2;
+    static_assert(dim % 2 == 0, "reversible cells split their state in two halves");
+
+    using half_t = std::integral_constant<int, half>;
+    using fwd = Fwd<T, half_t, Act>;
+    using bwd = Bwd<T, half_t, Act>;
+
+    // what one half width column leaves behind for its backward
+    struct Column {
+        T *h;
+        T *y;
+        T *sd;
+
+        static Column reserve(utils::Arena *arena, const Shape &hs) {
+            if (arena == nullptr)
+                throw std::invalid_argument("reversible grid kernels need an arena");
+            return Column{arena->reserve<T>(hs.padded_column_size()), arena->reserve<T>(hs.column_size()),
+                          arena->reserve<T>((size_t)hs.D * hs.batch)};
+        }
+    };
+
+    static Shape half_shape(const Shape &sh) {
+        return Shape{half, sh.D, 1, sh.batch};
+    }
+
+    // sub layer k of column l, 0 for F and 1 for G
+    static size_t layer(const Shape &sh, int l, int k) {
+        return (size_t)(2 * l + k) * sh.D;
+    }
+
+    // c.y = layer(in), the normalized neighbour sums of the half column
+    template <typename Args>
+    static void apply(const Args &a, int l, int k, const T *in, const Column &c) {
+        const Shape hs = half_shape(a.shape);
+        const size_t cell = layer(a.shape, l, k);
+        ForwardArgs fa{static_cast<const T *>(a.w) + cell * half * half, static_cast<const T *>(a.b) + cell * half,
+                       in, c.h, c.y, c.sd, hs};
+        fa.stream = a.stream;
+        fa.pool = a.pool;
+        fwd::fn(fa);
+    }
+
+    // out = d layer(in)^T g, accumulating the layer's dw and db, after apply
+    static void vjp(const ReversibleBackwardArgs &a, int l, int k, const T *in, const Column &c, const T *g, T *out) {
+        const Shape hs = half_shape(a.shape);
+        const size_t cell = layer(a.shape, l, k);
+        BackwardArgs ba{static_cast<const T *>(a.w) + cell * half * half, in, c.h, c.y, c.sd, g, out,
+                        static_cast<T *>(a.dw) + cell * half * half, static_cast<T *>(a.db) + cell * half,
+                        nullptr, hs};
+        ba.stream = a.stream;
+        ba.pool = a.pool;
+        ba.arena = a.arena;
+        bwd::fn(ba);
+    }
+
+    static void forward(const ReversibleForwardArgs &a) {
+        utils::ArenaScope scope(a.arena);
+        const Shape hs = half_shape(a.shape);
+        const size_t n = hs.column_size();
+        const Column c = Column::reserve(a.arena, hs);
+        T *y1 = static_cast<T *>(a.y);
+        T *y2 = y1 + n;
+        Ops::copy(y1, static_cast<const T *>(a.x), 2 * n, a.stream);
+        for (int l = 0; l < a.shape.L; ++l) {
+            apply(a, l, 0, y2, c);
+            Ops::add(y1, c.y, T(1), n, a.stream);
+            apply(a, l, 1, y1, c);
+            Ops::add(y2, c.y, T(1), n, a.stream);
+        }
+    }
+
+    static void backward(const ReversibleBackwardArgs &a) {
+        utils::ArenaScope scope(a.arena);
+        const Shape hs = half_shape(a.shape);
+        const size_t n = hs.column_size();
+        const Column c = Column::reserve(a.arena, hs);
+        T *s1 = a.arena->reserve<T>(2 * n);
+        T *s2 = s1 + n;
+        T *t = a.arena->reserve<T>(n);
+        T *d1 = static_cast<T *>(a.dx);
+        T *d2 = d1 + n;
+        Ops::copy(s1, static_cast<const T *>(a.y), 2 * n, a.stream);
+        Ops::copy(d1, static_cast<const T *>(a.grad), 2 * n, a.stream);
+
+        // s holds the output of column l and d the gradient w.r.t. it, both
+        // are turned into those of its input
+        for (int l = a.shape.L - 1; l >= 0; --l) {
+            apply(a, l, 1, s1, c);
+            Ops::add(s2, c.y, T(-1), n, a.stream);
+            vjp(a, l, 1, s1, c, d2, t);
+            Ops::add(d1, t, T(1), n, a.stream);
+
+            apply(a, l, 0, s2, c);
+            Ops::add(s1, c.y, T(-1), n, a.stream);
+            vjp(a, l, 0, s2, c, d1, t);
+            Ops::add(d2, t, T(1), n, a.stream);
+        }
+    }
+};
+
+// cpu kernels, instantiated in the cpu shards of grid/shards.h along with Forward and Backward
+template <typename T, typename Dim, typename Act = Relu>
+struct ReversibleForward {
+    static void fn(const ReversibleForwardArgs &a) {
+        ReversibleColumns<T, Dim, Act, Forward, Backward, HostOps<T>>::forward(a);
+    }
+};
+
+template <typename T, typename Dim, typename Act = Relu>
+struct ReversibleBackward {
+    static void fn(const ReversibleBackwardArgs &a) {
+        ReversibleColumns<T, Dim, Act, Forward, Backward, HostOps<T>>::backward(a);
+    }
+};
+
+} // grid
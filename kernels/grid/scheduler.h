@@ -0,0 +1,102 @@
+/*
+column wavefront scheduling of the grid kernels over a thread pool
+
+every cell of a column only depends on the previous column, so each column
+is split into tasks over ranges of cells and samples, with the pool acting as
+a barrier between the cell phase and the neighbour sum phase of each column
+*/
+
+#pragma once
+#include <algorithm>
+
+#include "grid.h"
+#include "../utils/thread_pool.h"
+
+namespace grid {
+
+struct Partition {
+    int cell_chunks;
+    int batch_chunks;
+    int D;
+    int batch;
+
+    // aims for a few tasks per thread to even out imbalance, only splits the
+    // batch when there are not enough cells, and never when split_batch is
+    // false, for phases that accumulate per cell
+    static Partition make(const Shape &sh, int threads, bool split_batch) {
+        const int want = threads * 4;
+        const int cells = std::min(sh.D, want);
+        int batches = 1;
+        if (split_batch && cells < want) {
+            const int tiles = (sh.batch + 31) / 32;
+            batches = std::min(tiles, (want + cells - 1) / cells);
+        }
+        return Partition{cells, batches, sh.D, sh.batch};
+    }
+
+    int tasks() const { return cell_chunks * batch_chunks; }
+
+    struct Range {
+        int j0, j1, s0, s1;
+    };
+
+    Range range(int t) const {
+        const int c = t % cell_chunks;
+        const int s = t / cell_chunks;
+        return Range{
+            (int)((long)D * c / cell_chunks), (int)((long)D * (c + 1) / cell_chunks),
+            (int)((long)batch * s / batch_chunks), (int)((long)batch * (s + 1) / batch_chunks)};
+    }
+};
+
+// K is a kernel with the cells/sums phases of grid::Forward
+template <typename K>
+void parallel_forward(const ForwardArgs &a, utils::ThreadPool &pool) {
+    const Partition p = Partition::make(a.shape, pool.size(), true);
+    for (int l = 0; l < a.shape.L; ++l) {
+        K::zero_pads(a, l);
+        pool.run(p.tasks(), [&](int t) {
+            const auto r = p.range(t);
+            K::cells(a, l, r.j0, r.j1, r.s0, r.s1);
+        });
+        pool.run(p.tasks(), [&](int t) {
+            const auto r = p.range(t);
+            K::sums(a, l, r.j0, r.j1, r.s0, r.s1);
+        });
+    }
+}
+
+// K is a kernel with the sums/cells phases of grid::Backward, the cell phase
+// is only split over cells since it accumulates dw and db per cell
+template <typename K>
+void parallel_backward(const BackwardArgs &a, utils::ThreadPool &pool) {
+    const Partition ps = Partition::make(a.shape, pool.size(), true);
+    const Partition pc = Partition::make(a.shape, pool.size(), false);
+    K::zero_pads(a);
+    for (int l = a.shape.L - 1; l >= 0; --l) {
+        pool.run(ps.tasks(), [&](int t) {
+            const auto r = ps.range(t);
+            K::sums(a, l, r.j0, r.j1, r.s0, r.s1);
+        });
+        pool.run(pc.tasks(), [&](int t) {
+            const auto r = pc.range(t);
+            K::cells(a, l, r.j0, r.j1, r.s0, r.s1);
+        });
+        a.column_done(l);
+    }
+}
+
+// f(i0, i1) over [0, n) split into a few ranges per thread of the pool, or
+// all at once without one, for the phases of the sparse grid, where the
+// work is a list of live cells rather than a column
+template <typename F>
+void for_range(utils::ThreadPool *pool, int n, const F &f) {
+    if (pool == nullptr || pool->size() == 1 || n < 2)
+        return f(0, n);
+    const int tasks = std::min(n, pool->size() * 4);
+    pool->run(tasks, [&](int t) {
+        f((int)((long)n * t / tasks), (int)((long)n * (t + 1) / tasks));
+    });
+}
+
+} // grid
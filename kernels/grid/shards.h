@@ -0,0 +1,86 @@
+/*
+the members of CpuShard in lib.h, one shard of the cpu kernels of every
+table, included by the translation units in grid/shards, each of which
+explicitly instantiates a single CpuShard, so that the kernels of a shard are
+only ever instantiated by its own unit and the units compile in parallel
+
+the shards split every list of specializations the same way, through
+fn_builder::shard, a table is built by adding every shard to it in lib.cc
+*/
+
+#pragma once
+#include "../lib.h"
+#include "forward.h"
+#include "backward.h"
+
+namespace grid {
+
+namespace detail {
+    template <typename Seq, int Shard>
+    using cpu_part = fn_builder::shard<Seq, Shard, cpu_shards>;
+
+    template <int Shard, template <class ...> class Fn, typename Table>
+    void add_part(Table &table) {
+        fn_builder::build_into<cpu_part<specs<device::cpu>, Shard>, fn_builder::Tagged<Fn>::template type>(table);
+    }
+} // detail
+
+template <int Shard>
+void CpuShard<Shard>::add(forward_table_t &table) {
+    using fn_builder::Tagged;
+    detail::add_part<Shard, Forward>(table);
+    fn_builder::build_into<detail::cpu_part<mixed_specs<device::cpu>, Shard>, Tagged<MixedForward>::type>(table);
+    fn_builder::build_into<detail::cpu_part<fallback_specs<device::cpu>, Shard>, Tagged<RuntimeDimForward>::type>(table);
+}
+
+template <int Shard>
+void CpuShard<Shard>::add(backward_table_t &table) {
+    using fn_builder::Tagged;
+    detail::add_part<Shard, Backward>(table);
+    fn_builder::build_into<detail::cpu_part<mixed_specs<device::cpu>, Shard>, Tagged<MixedBackward>::type>(table);
+    fn_builder::build_into<detail::cpu_part<fallback_specs<device::cpu>, Shard>, Tagged<RuntimeDimBackward>::type>(table);
+}
+
+template <int Shard>
+void CpuShard<Shard>::add(sparse_forward_table_t &table) { detail::add_part<Shard, SparseForward>(table); }
+
+template <int Shard>
+void CpuShard<Shard>::add(sparse_backward_table_t &table) { detail::add_part<Shard, SparseBackward>(table); }
+
+template <int Shard>
+void CpuShard<Shard>::add(gated_forward_table_t &table) { detail::add_part<Shard, GatedForward>(table); }
+
+template <int Shard>
+void CpuShard<Shard>::add(gated_backward_table_t &table) { detail::add_part<Shard, GatedBackward>(table); }
+
+template <int Shard>
+void CpuShard<Shard>::add(gemm_table_t &table) { detail::add_part<Shard, BatchedGemm>(table); }
+
+template <int Shard>
+void CpuShard<Shard>::add(reversible_forward_table_t &table) { detail::add_part<Shard, ReversibleForward>(table); }
+
+template <int Shard>
+void CpuShard<Shard>::add(reversible_backward_table_t &table) { detail::add_part<Shard, ReversibleBackward>(table); }
+
+template <int Shard>
+void CpuShard<Shard>::add(checkpoint_forward_table_t &table) { detail::add_part<Shard, CheckpointForward>(table); }
+
+template <int Shard>
+void CpuShard<Shard>::add(checkpoint_backward_table_t &table) { detail::add_part<Shard, CheckpointBackward>(table); }
+
+template <int Shard>
+void CpuShard<Shard>::add(forward3d_table_t &table) { detail::add_part<Shard, Forward3D>(table); }
+
+template <int Shard>
+void CpuShard<Shard>::add(backward3d_table_t &table) { detail::add_part<Shard, Backward3D>(table); }
+
+template <int Shard>
+void CpuShard<Shard>::add(infer_table_t &table) {
+    using fn_builder::Tagged;
+    detail::add_part<Shard, Inference>(table);
+    fn_builder::build_into<detail::cpu_part<quant_specs<device::cpu>, Shard>, Tagged<Inference>::type>(table);
+    fn_builder::build_into<detail::cpu_part<fallback_specs<device::cpu>, Shard>, Tagged<Inference>::type>(table);
+    fn_builder::build_into<detail::cpu_part<quant_fallback_specs<device::cpu>, Shard>, Tagged<Inference>::type>(table);
+}
+
+} // grid
@@ -0,0 +1,4 @@
+// shard 2 of the cpu kernels, see grid/shards.h
+#include "../shards.h"
+
+template struct grid::CpuShard<2>;
@@ -0,0 +1,161 @@
+/*
+grid with an arbitrary, prunable connectivity in place of the fixed
+neighbour_offsets of BaselineGrid2D, each sum of column l is the normalized
+sum of whichever cells of column l feed it
+
+the adjacency is kept in compressed form per column, the in-edges of every
+sum for the forward pass and their transpose, the out-edges of every cell,
+for the backward one, along with the compacted list of live cells, those
+with any out-edge, so dead cells are never computed and pruned edges never
+read, and the work scales with live cells and edges instead of D * L * 3
+
+a sum with no in-edges has y = 0 and sd = 0, the same as a constant sum in
+the dense grid, dead cells get dx = 0, the kernels are SparseForward in
+forward.h and SparseBackward in backward.h, cpu only for now
+*/
+
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "grid.h"
+
+namespace grid {
+
+// what the kernels read, indices are cells within a column, and rows are
+// column major, l * D + j
+struct Adjacency {
+    // [L * D + 1] sources in_idx[in_ptr[r] .. in_ptr[r + 1]) of sum r
+    const int *in_ptr;
+    const int *in_idx;
+    // [L * D + 1] targets out_idx[out_ptr[r] .. out_ptr[r + 1]) of cell r
+    const int *out_ptr;
+    const int *out_idx;
+    // [L + 1] live cells live[live_ptr[l] .. live_ptr[l + 1]) of column l
+    const int *live_ptr;
+    const int *live;
+};
+
+// owns an adjacency built on the host
+class Graph {
+public:
+    // from the in-edges of every sum, in_ptr has L * D + 1 entries
+    static Graph from_csr(const Shape &sh, const int *in_ptr, const int *in_idx) {
+        Graph g;
+        const int rows = sh.L * sh.D;
+        if (in_ptr[0] != 0)
+            throw std::invalid_argument("in_ptr must start at 0");
+        // every row has to lie within [0, in_ptr[rows]] before in_idx is read
+        for (int r = 0; r < rows; ++r)
+            if (in_ptr[r + 1] < in_ptr[r])
+                throw std::invalid_argument("in_ptr must be non decreasing");
+        g.in_ptr.assign(in_ptr, in_ptr + rows + 1);
+        g.in_idx.assign(in_idx, in_idx + in_ptr[rows]);
+        for (int e = 0; e < in_ptr[rows]; ++e)
+            if (in_idx[e] < 0 || in_idx[e] >= sh.D)
+                throw std::invalid_argument("edge source " + std::to_string(in_idx[e]) + " is outside the column");
+        g.transpose(sh);
+        return g;
+    }
+
+    // the neighbour_offsets stencil of the dense grid with the edges whose
+    // entry of keep, [L, D, 3] by source cell and offset, is 0 pruned, a null
+    // keep keeps every edge
+    static Graph stencil(const Shape &sh, const uint8_t *keep) {
+        std::vector<int> ptr(1, 0), idx;
+        for (int l = 0; l < sh.L; ++l) {
+            for (int j = 0; j < sh.D; ++j) {
+                // the sum at j is fed by the cells at j - offsets[k], in the
+                // order the dense grid adds them
+                for (int k = 2; k >= 0; --k) {
+                    const int i = j - offsets[k];
+                    if (i >= 0 && i < sh.D && (keep == nullptr || keep[((size_t)l * sh.D + i) * 3 + k]))
+                        idx.push_back(i);
+                }
+                ptr.push_back((int)idx.size());
+            }
+        }
+        return from_csr(sh, ptr.data(), idx.data());
+    }
+
+    Adjacency view() const {
+        return Adjacency{in_ptr.data(), in_idx.data(), out_ptr.data(), out_idx.data(), live_ptr.data(), live.data()};
+    }
+
+    size_t edges() const { return in_idx.size(); }
+    size_t live_cells() const { return live.size(); }
+
+    std::vector<int> in_ptr, in_idx, out_ptr, out_idx, live_ptr, live;
+
+private:
+    void transpose(const Shape &sh) {
+        const int rows = sh.L * sh.D;
+        out_ptr.assign(rows + 1, 0);
+        for (int l = 0; l < sh.L; ++l)
+            for (int e = in_ptr[l * sh.D]; e < in_ptr[(l + 1) * sh.D]; ++e)
+                ++out_ptr[l * sh.D + in_idx[e] + 1];
+        for (int r = 0; r < rows; ++r)
+            out_ptr[r + 1] += out_ptr[r];
+        out_idx.resize(in_idx.size());
+        std::vector<int> fill(out_ptr.begin(), out_ptr.end() - 1);
+        for (int l = 0; l < sh.L; ++l)
+            for (int j = 0; j < sh.D; ++j)
+                for (int e = in_ptr[l * sh.D + j]; e < in_ptr[l * sh.D + j + 1]; ++e)
+                    out_idx[fill[l * sh.D + in_idx[e]]++] = j;
+
+        live_ptr.assign(1, 0);
+        for (int l = 0; l < sh.L; ++l) {
+            for (int i = 0; i < sh.D; ++i)
+                if (out_ptr[l * sh.D + i + 1] > out_ptr[l * sh.D + i])
+                    live.push_back(i);
+            live_ptr.push_back((int)live.size());
+        }
+    }
+};
+
+struct SparseForwardArgs {
+    const void *w;
+    const void *b;
+    const void *x;
+    // [L, D, batch, dim] cell outputs, only written for live cells
+    void *h;
+    // [L, D, batch, dim] and [L, D, batch] as for the dense grid
+    void *y;
+    void *sd;
+    Adjacency adj;
+    Shape shape;
+    void *stream = nullptr;
+    utils::ThreadPool *pool = nullptr;
+    utils::Arena *arena = nullptr;
+};
+
+using sparse_forward_fn = void (*)(const SparseForwardArgs &);
+
+struct SparseBackwardArgs {
+    // as kept by the forward pass
+    const void *w;
+    const void *x;
+    const void *h;
+    const void *y;
+    const void *sd;
+    // [D, batch, dim] dL/dy[L-1]
+    const void *grad;
+    // [D, batch, dim] dL/dx, also holds the gradient between columns
+    void *dx;
+    // accumulated into, only for live cells
+    void *dw;
+    void *db;
+    // [D, batch, dim] scratch for the gradient of the sums, from the arena when null
+    void *dz;
+    Adjacency adj;
+    Shape shape;
+    void *stream = nullptr;
+    utils::ThreadPool *pool = nullptr;
+    utils::Arena *arena = nullptr;
+};
+
+using sparse_backward_fn = void (*)(const SparseBackwardArgs &);
+
+} // grid
@@ -1,4 +1,210 @@
 /*
 Common functions for both the python extension and stand-alone executable
 Should not touch libtorch for fast compile times
-*/
\ No newline at end of file
+*/
+
+#include <utility>
+
+#include "lib.h"
+#include "grid/forward.h"
+#include "grid/backward.h"
+
+namespace grid {
+
+using fn_builder::FnBuilder;
+using fn_builder::Tagged;
+
+namespace {
+    // the kernels are only declared here, CpuShard<i> is instantiated in
+    // grid/shards/shard_<i>.cc
+    template <typename Table, int... Shards>
+    void add_cpu_shards(Table &table, std::integer_sequence<int, Shards...>) {
+        (CpuShard<Shards>::add(table), ...);
+    }
+
+    template <typename Table>
+    Table cpu_table() {
+        Table table;
+        add_cpu_shards(table, std::make_integer_sequence<int, cpu_shards>{});
+        return table;
+    }
+}
+
+std::vector<fn_builder::Signature> signatures() {
+    auto sigs = FnBuilder<specs<device::cpu>, Tagged<Forward>::type>::signatures();
+#ifdef GROWNET_CUDA
+    for (auto &s : FnBuilder<specs<device::cuda>, Tagged<Forward>::type>::signatures())
+        sigs.push_back(std::move(s));
+#endif
+    for (auto &s : FnBuilder<mixed_specs<device::cpu>, Tagged<MixedForward>::type>::signatures())
+        sigs.push_back(std::move(s));
+    return sigs;
+}
+
+std::vector<fn_builder::Signature> fallback_signatures() {
+    return FnBuilder<fallback_specs<device::cpu>, Tagged<RuntimeDimForward>::type>::signatures();
+}
+
+std::vector<fn_builder::Signature> quant_signatures() {
+    auto sigs = FnBuilder<quant_specs<device::cpu>, Tagged<Inference>::type>::signatures();
+    for (auto &s : FnBuilder<quant_fallback_specs<device::cpu>, Tagged<Inference>::type>::signatures())
+        sigs.push_back(std::move(s));
+    return sigs;
+}
+
+const forward_table_t &forward_table() {
+    static const forward_table_t table = [] {
+        auto t = cpu_table<forward_table_t>();
+#ifdef GROWNET_CUDA
+        add_cuda_kernels(t);
+#endif
+        return t;
+    }();
+    return table;
+}
+
+const backward_table_t &backward_table() {
+    static const backward_table_t table = [] {
+        auto t = cpu_table<backward_table_t>();
+#ifdef GROWNET_CUDA
+        add_cuda_kernels(t);
+#endif
+        return t;
+    }();
+    return table;
+}
+
+const reversible_forward_table_t &reversible_forward_table() {
+    static const reversible_forward_table_t table = [] {
+        auto t = cpu_table<reversible_forward_table_t>();
+#ifdef GROWNET_CUDA
+        add_cuda_kernels(t);
+#endif
+        return t;
+    }();
+    return table;
+}
+
+const reversible_backward_table_t &reversible_backward_table() {
+    static const reversible_backward_table_t table = [] {
+        auto t = cpu_table<reversible_backward_table_t>();
+#ifdef GROWNET_CUDA
+        add_cuda_kernels(t);
+#endif
+        return t;
+    }();
+    return table;
+}
+
+const checkpoint_forward_table_t &checkpoint_forward_table() {
+    static const checkpoint_forward_table_t table = [] {
+        auto t = cpu_table<checkpoint_forward_table_t>();
+#ifdef GROWNET_CUDA
+        add_cuda_kernels(t);
+#endif
+        return t;
+    }();
+    return table;
+}
+
+const checkpoint_backward_table_t &checkpoint_backward_table() {
+    static const checkpoint_backward_table_t table = [] {
+        auto t = cpu_table<checkpoint_backward_table_t>();
+#ifdef GROWNET_CUDA
+        add_cuda_kernels(t);
+#endif
+        return t;
+    }();
+    return table;
+}
+
+const sparse_forward_table_t &sparse_forward_table() {
+    static const sparse_forward_table_t table = cpu_table<sparse_forward_table_t>();
+    return table;
+}
+
+const sparse_backward_table_t &sparse_backward_table() {
+    static const sparse_backward_table_t table = cpu_table<sparse_backward_table_t>();
+    return table;
+}
+
+const gated_forward_table_t &gated_forward_table() {
+    static const gated_forward_table_t table = cpu_table<gated_forward_table_t>();
+    return table;
+}
+
+const gated_backward_table_t &gated_backward_table() {
+    static const gated_backward_table_t table = cpu_table<gated_backward_table_t>();
+    return table;
+}
+
+const forward3d_table_t &forward3d_table() {
+    static const forward3d_table_t table = cpu_table<forward3d_table_t>();
+    return table;
+}
+
+const backward3d_table_t &backward3d_table() {
+    static const backward3d_table_t table = cpu_table<backward3d_table_t>();
+    return table;
+}
+
+const infer_table_t &infer_table() {
+    static const infer_table_t table = cpu_table<infer_table_t>();
+    return table;
+}
+
+const partitioned_forward_table_t &partitioned_forward_table() {
+    static const partitioned_forward_table_t table = [] {
+        partitioned_forward_table_t t;
+#ifdef GROWNET_CUDA
+        add_cuda_kernels(t);
+#endif
+        return t;
+    }();
+    return table;
+}
+
+const partitioned_backward_table_t &partitioned_backward_table() {
+    static const partitioned_backward_table_t table = [] {
+        partitioned_backward_table_t t;
+#ifdef GROWNET_CUDA
+        add_cuda_kernels(t);
+#endif
+        return t;
+    }();
+    return table;
+}
+
+const gemm_table_t &gemm_table() {
+    static const gemm_table_t table = cpu_table<gemm_table_t>();
+    return table;
+}
+
+}
+
+namespace optim {
+
+using fn_builder::FnBuilder;
+using fn_builder::Tagged;
+
+std::vector<fn_builder::Signature> signatures() {
+    auto sigs = FnBuilder<specs<device::cpu>, Tagged<Adam>::type>::signatures();
+#ifdef GROWNET_CUDA
+    for (auto &s : FnBuilder<specs<device::cuda>, Tagged<Adam>::type>::signatures())
+        sigs.push_back(std::move(s));
+#endif
+    return sigs;
+}
+
+const adam_table_t &adam_table() {
+    static const adam_table_t table = [] {
+        auto t = FnBuilder<specs<device::cpu>, Tagged<Adam>::type>::build_table();
+#ifdef GROWNET_CUDA
+        add_cuda_kernels(t);
+#endif
+        return t;
+    }();
+    return table;
+}
+
+}
@@ -0,0 +1,189 @@
+/*
+Declarations for the kernels built in lib.cc, shared by the python extension
+and the stand-alone executable, does not include libtorch
+*/
+
+#pragma once
+#include "utils/func_constructor.h"
+#include "grid/grid.h"
+#include "grid/batched_gemm.h"
+#include "grid/reversible.h"
+#include "grid/checkpoint.h"
+#include "grid/sparse.h"
+#include "grid/gated.h"
+#include "grid/mixed.h"
+#include "grid/grid3d.h"
+#include "grid/partition.h"
+#include "grid/inference.h"
+#include "optim/adam.h"
+
+namespace grid {
+
+namespace mpl = boost::mpl;
+
+// the axes the grid kernels are specialized over, dims in increasing order
+using dims = mpl::list<mpl::int_<8>, mpl::int_<16>, mpl::int_<32>, mpl::int_<64>>;
+using dtypes = mpl::list<float, double>;
+
+// (device, dtype, dim) specializations of every grid kernel, the same set
+// is instantiated for each device the build supports
+template <typename Dev>
+using specs = fn_builder::product<mpl::list<Dev>, dtypes, dims>;
+
+// 16 bit storage with float arithmetic, grid/mixed.h, held by the forward and
+// backward tables alongside specs, cpu only for now
+template <typename Dev>
+using mixed_specs = fn_builder::product<mpl::list<Dev>, mpl::list<utils::half, utils::bfloat16>, dims>;
+
+// the int8 cells of grid/quantize.h, held by the inference table alongside
+// specs, cpu only
+template <typename Dev>
+using quant_specs = fn_builder::product<mpl::list<Dev>, mpl::list<utils::qint8>, dims>;
+
+// the dim the runtime dim kernels are registered under, the key a lookup
+// falls back to when its own dim has no specialization
+constexpr int any_dim = 0;
+
+// RuntimeDimForward and RuntimeDimBackward, held by the forward and backward
+// tables under any_dim, cpu only for now
+template <typename Dev>
+using fallback_specs = fn_builder::product<mpl::list<Dev>, dtypes, mpl::list<mpl::int_<any_dim>>>;
+
+// the runtime dim kernel over int8 cells, held by the inference table
+template <typename Dev>
+using quant_fallback_specs =
+    fn_builder::product<mpl::list<Dev>, mpl::list<utils::qint8>, mpl::list<mpl::int_<any_dim>>>;
+
+// every (device, dtype, dim) the tables below hold, with the gemm table
+// holding the cpu ones only, and the mixed_specs ones only found in the
+// forward and backward tables, the fallbacks are left out
+std::vector<fn_builder::Signature> signatures();
+
+// the fallbacks of fallback_specs, under any_dim, the forward, backward and
+// inference tables hold
+std::vector<fn_builder::Signature> fallback_signatures();
+
+// the int8 specializations of quant_specs the inference table holds, left
+// out of signatures(), and their fallback of quant_fallback_specs
+std::vector<fn_builder::Signature> quant_signatures();
+
+// keyed on (device, dtype, dim)
+using forward_table_t = fn_builder::DispatchTable<forward_fn>;
+const forward_table_t &forward_table();
+
+using backward_table_t = fn_builder::DispatchTable<backward_fn>;
+const backward_table_t &backward_table();
+
+// cpu only, the grid over an arbitrary adjacency of grid/sparse.h
+using sparse_forward_table_t = fn_builder::DispatchTable<sparse_forward_fn>;
+const sparse_forward_table_t &sparse_forward_table();
+
+using sparse_backward_table_t = fn_builder::DispatchTable<sparse_backward_fn>;
+const sparse_backward_table_t &sparse_backward_table();
+
+// cpu only, the grid with the WeightedSigmoid gated cells of grid/gated.h
+using gated_forward_table_t = fn_builder::DispatchTable<gated_forward_fn>;
+const gated_forward_table_t &gated_forward_table();
+
+using gated_backward_table_t = fn_builder::DispatchTable<gated_backward_fn>;
+const gated_backward_table_t &gated_backward_table();
+
+// cpu only, all cells of a column in the packed layout of grid/batched_gemm.h
+using gemm_table_t = fn_builder::DispatchTable<gemm_fn>;
+const gemm_table_t &gemm_table();
+
+// the additive coupling grid of grid/reversible.h, keyed the same way
+using reversible_forward_table_t = fn_builder::DispatchTable<reversible_forward_fn>;
+const reversible_forward_table_t &reversible_forward_table();
+
+using reversible_backward_table_t = fn_builder::DispatchTable<reversible_backward_fn>;
+const reversible_backward_table_t &reversible_backward_table();
+
+// the grid with activations kept every few columns, grid/checkpoint.h
+using checkpoint_forward_table_t = fn_builder::DispatchTable<checkpoint_forward_fn>;
+const checkpoint_forward_table_t &checkpoint_forward_table();
+
+using checkpoint_backward_table_t = fn_builder::DispatchTable<checkpoint_backward_fn>;
+const checkpoint_backward_table_t &checkpoint_backward_table();
+
+// cpu only, the grid over plates of cells of grid/grid3d.h
+using forward3d_table_t = fn_builder::DispatchTable<forward3d_fn>;
+const forward3d_table_t &forward3d_table();
+
+using backward3d_table_t = fn_builder::DispatchTable<backward3d_fn>;
+const backward3d_table_t &backward3d_table();
+
+// cpu only, the dense grid without backward state of grid/inference.h, with
+// the runtime dim kernel under any_dim, and the quant_specs of utils::qint8
+using infer_table_t = fn_builder::DispatchTable<infer_fn>;
+const infer_table_t &infer_table();
+
+// cuda only, the grid split along D over devices of grid/partition.h, empty
+// without GROWNET_CUDA
+using partitioned_forward_table_t = fn_builder::DispatchTable<partitioned_forward_fn>;
+const partitioned_forward_table_t &partitioned_forward_table();
+
+using partitioned_backward_table_t = fn_builder::DispatchTable<partitioned_backward_fn>;
+const partitioned_backward_table_t &partitioned_backward_table();
+
+// the cpu kernels of every table above, instantiated over cpu_shards
+// translation units so that they compile in parallel, CpuShard<i> adds the
+// specializations shard i of the specs holds, its members are defined in
+// grid/shards.h and explicitly instantiated in grid/shards/shard_<i>.cc
+constexpr int cpu_shards = 4;
+
+template <int Shard>
+struct CpuShard {
+    static void add(forward_table_t &table);
+    static void add(backward_table_t &table);
+    static void add(sparse_forward_table_t &table);
+    static void add(sparse_backward_table_t &table);
+    static void add(gated_forward_table_t &table);
+    static void add(gated_backward_table_t &table);
+    static void add(gemm_table_t &table);
+    static void add(reversible_forward_table_t &table);
+    static void add(reversible_backward_table_t &table);
+    static void add(checkpoint_forward_table_t &table);
+    static void add(checkpoint_backward_table_t &table);
+    static void add(forward3d_table_t &table);
+    static void add(backward3d_table_t &table);
+    static void add(infer_table_t &table);
+};
+
+#ifdef GROWNET_CUDA
+// defined in grid/grid.cu
+void add_cuda_kernels(forward_table_t &table);
+void add_cuda_kernels(backward_table_t &table);
+void add_cuda_kernels(reversible_forward_table_t &table);
+void add_cuda_kernels(reversible_backward_table_t &table);
+void add_cuda_kernels(checkpoint_forward_table_t &table);
+void add_cuda_kernels(checkpoint_backward_table_t &table);
+void add_cuda_kernels(partitioned_forward_table_t &table);
+void add_cuda_kernels(partitioned_backward_table_t &table);
+#endif
+
+}
+
+namespace optim {
+
+namespace mpl = boost::mpl;
+
+// (device, dtype) specializations of the optimizer steps
+template <typename Dev>
+using specs = mpl::list<
+    mpl::list<Dev, float>,
+    mpl::list<Dev, double>
+>;
+
+std::vector<fn_builder::Signature> signatures();
+
+// keyed on (device, dtype)
+using adam_table_t = fn_builder::DispatchTable<adam_fn>;
+const adam_table_t &adam_table();
+
+#ifdef GROWNET_CUDA
+// defined in optim/adam.cu
+void add_cuda_kernels(adam_table_t &table);
+#endif
+
+}
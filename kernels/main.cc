@@ -2,16 +2,316 @@
 Entrance file for the entire operation, contains only the logic for
 the standalone executable portion. Should not include libtorch for
 faster compile times.
+
+Benchmarks every kernel registered in the tables of lib.h, for each
+(device, dtype, dim) they hold, over a sweep of grid sizes and batch sizes
+
+    main [--kernels name,...] [--dims 8,16,32,64]
+         [--grids 16x16,64x32] [--batches 1,32,256] [--threads n]
+         [--reps n] [--warmup n] [--peak-gflops x] [--peak-gbps x]
+         [--prune p] [--json path|-] [--check n] [--reference reps]
+         [--baseline path] [--threshold x]
+
+kernels are forward, backward, gemm, ckpt_fwd, ckpt_bwd, sparse_fwd,
+sparse_bwd, gated_fwd, gated_bwd, rev_fwd, rev_bwd, 3d_fwd, 3d_bwd, infer,
+infer_q8, adam, part_fwd and part_bwd, all of them by default, the last two
+cuda only and only checked, grids are D x L, the 3d grids
+being on square plates of about D cells, --prune is the fraction of edges
+the sparse grid drops and of cells the gated grid skips, --json - writes
+the report to stdout and the table to stderr, forward, backward, infer and
+infer_q8 also run their runtime dim fallback at every dim of the sweep
+
+--check first checks every kernel, the grids against the port of
+simple_grid.jl in bench/reference.h, the sparse ones on the full stencil,
+the gated ones with their gates shut or fully open, the reversible ones
+through half width columns of it and the 3d ones on plates of a single row
+and of a single column, where they compute its grid, and the runtime dim
+fallbacks at a dim without a specialization, n coordinates of each gradient
+by finite differences, of the kernel's own forward in double for the sparse
+backward on a stencil with a --prune fraction of its edges pruned and for
+the gated and reversible backward, gemm against a plain loop, adam against
+the bias corrected update and the partitioned grid, split in two slabs on
+one device, against the single device kernels, --reference times
+that port too and reports each forward's speedup over it, --baseline reads
+a report of an earlier --json and fails the run if any p50 grew by more than
+--threshold, 0.1 by default, over it, a failed check or a regression exits
+1, --reps 0 only runs the checks
 */
 
+#include <array>
+#include <fstream>
 #include <iostream>
-//#include "utils/utils.h"
-//#include "net-v1/model.h"
-#include <torch/torch.h>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "lib.h"
+#include "bench/baseline.h"
+#include "bench/check.h"
+#include "bench/grid_bench.h"
+#include "bench/optim_bench.h"
+#include "utils/thread_pool.h"
+
+namespace {
+
+std::vector<std::string> split(const std::string &s, char sep) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    for (std::string item; std::getline(ss, item, sep);)
+        if (!item.empty())
+            out.push_back(item);
+    return out;
+}
+
+std::vector<int> ints(const std::string &s) {
+    std::vector<int> out;
+    for (auto &v : split(s, ','))
+        out.push_back(std::stoi(v));
+    return out;
+}
+
+bool contains(const std::vector<std::string> &v, const std::string &s) {
+    for (auto &e : v)
+        if (e == s)
+            return true;
+    return false;
+}
+
+// the signatures with the runtime dim fallbacks after them
+std::vector<fn_builder::Signature> with_fallbacks() {
+    auto sigs = grid::signatures();
+    for (auto &s : grid::fallback_signatures())
+        sigs.push_back(std::move(s));
+    return sigs;
+}
+
+bool contains(const std::vector<int> &v, int x) {
+    for (int e : v)
+        if (e == x)
+            return true;
+    return false;
+}
+
+struct Cli {
+    std::vector<std::string> kernels{"forward", "backward", "gemm", "ckpt_fwd", "ckpt_bwd", "sparse_fwd", "sparse_bwd",
+                                     "gated_fwd", "gated_bwd", "rev_fwd", "rev_bwd", "3d_fwd", "3d_bwd", "infer", "infer_q8",
+                                     "adam", "part_fwd", "part_bwd"};
+    std::vector<int> dims;
+    std::vector<bench::Problem> grids{{16, 16, 0}, {64, 32, 0}};
+    std::vector<int> batches{1, 32, 256};
+    int threads = 1;
+    std::string json;
+    int check = 0;
+    int reference = 0;
+    std::string baseline;
+    double threshold = 0.1;
+    bench::Options opt;
+    bench::Peaks peaks;
+
+    Cli(int argc, char **argv) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string flag = argv[i];
+            if (i + 1 >= argc)
+                throw std::invalid_argument("missing value for " + flag);
+            const std::string v = argv[++i];
+            if (flag == "--kernels")
+                kernels = split(v, ',');
+            else if (flag == "--dims")
+                dims = ints(v);
+            else if (flag == "--grids")
+                grids = parse_grids(v);
+            else if (flag == "--batches")
+                batches = ints(v);
+            else if (flag == "--threads")
+                threads = std::stoi(v);
+            else if (flag == "--reps")
+                opt.reps = std::stoi(v);
+            else if (flag == "--warmup")
+                opt.warmup = std::stoi(v);
+            else if (flag == "--peak-gflops")
+                peaks.gflops = std::stod(v);
+            else if (flag == "--peak-gbps")
+                peaks.gbps = std::stod(v);
+            else if (flag == "--prune")
+                opt.prune = std::stod(v);
+            else if (flag == "--json")
+                json = v;
+            else if (flag == "--check")
+                check = std::stoi(v);
+            else if (flag == "--reference")
+                reference = std::stoi(v);
+            else if (flag == "--baseline")
+                baseline = v;
+            else if (flag == "--threshold")
+                threshold = std::stod(v);
+            else
+                throw std::invalid_argument("unknown flag " + flag);
+        }
+    }
+
+    static std::vector<bench::Problem> parse_grids(const std::string &s) {
+        std::vector<bench::Problem> out;
+        for (auto &g : split(s, ',')) {
+            auto dl = split(g, 'x');
+            if (dl.size() != 2)
+                throw std::invalid_argument("grid sizes are D x L, got " + g);
+            out.push_back({std::stoi(dl[0]), std::stoi(dl[1]), 0});
+        }
+        return out;
+    }
+};
+
+using runner = bench::Result (*)(const bench::Spec &, const bench::Problem &, const bench::Options &);
+using checker = bench::Check (*)(const bench::Spec &, const bench::Options &, int);
+
+template <typename Table>
+bool registered(const Table &table, uint64_t key) {
+    return table.find(key) != nullptr;
+}
+
+}
+
+int main(int argc, char **argv) {
+    try {
+        Cli cli(argc, argv);
+        std::unique_ptr<utils::ThreadPool> pool;
+        if (cli.threads != 1) {
+            pool = std::make_unique<utils::ThreadPool>(cli.threads);
+            cli.opt.pool = pool.get();
+        }
+
+        // kernels keyed without a dim are run at the parameter count of each
+        // grid size, for every dim of the sweep, and once rather than per batch,
+        // the runtime dim ones under grid::any_dim at every dim of the sweep
+        // too, each with its check of bench/check.h, those without a run
+        // are only checked
+        struct Kernel {
+            const char *name;
+            runner run;
+            std::vector<fn_builder::Signature> (*sigs)();
+            bool (*has)(uint64_t);
+            checker check = nullptr;
+            // timed against the reference, computing the same output
+            bool vs_reference = false;
+        };
+        const Kernel kernels[] = {
+            {"forward", bench::run_forward, with_fallbacks,
+             [](uint64_t k) { return registered(grid::forward_table(), k); }, bench::check_forward, true},
+            {"backward", bench::run_backward, with_fallbacks,
+             [](uint64_t k) { return registered(grid::backward_table(), k); }, bench::check_backward},
+            {"gemm", bench::run_gemm, grid::signatures,
+             [](uint64_t k) { return registered(grid::gemm_table(), k); }, bench::check_gemm},
+            {"ckpt_fwd", bench::run_checkpoint_forward, grid::signatures,
+             [](uint64_t k) { return registered(grid::checkpoint_forward_table(), k); },
+             bench::check_checkpoint_forward, true},
+            {"ckpt_bwd", bench::run_checkpoint_backward, grid::signatures,
+             [](uint64_t k) { return registered(grid::checkpoint_backward_table(), k); },
+             bench::check_checkpoint_backward},
+            {"sparse_fwd", bench::run_sparse_forward, grid::signatures,
+             [](uint64_t k) { return registered(grid::sparse_forward_table(), k); }, bench::check_sparse_forward},
+            {"sparse_bwd", bench::run_sparse_backward, grid::signatures,
+             [](uint64_t k) { return registered(grid::sparse_backward_table(), k); }, bench::check_sparse_backward},
+            {"gated_fwd", bench::run_gated_forward, grid::signatures,
+             [](uint64_t k) { return registered(grid::gated_forward_table(), k); }, bench::check_gated_forward},
+            {"gated_bwd", bench::run_gated_backward, grid::signatures,
+             [](uint64_t k) { return registered(grid::gated_backward_table(), k); }, bench::check_gated_backward},
+            {"rev_fwd", bench::run_reversible_forward, grid::signatures,
+             [](uint64_t k) { return registered(grid::reversible_forward_table(), k); },
+             bench::check_reversible_forward},
+            {"rev_bwd", bench::run_reversible_backward, grid::signatures,
+             [](uint64_t k) { return registered(grid::reversible_backward_table(), k); },
+             bench::check_reversible_backward},
+            {"3d_fwd", bench::run_forward3d, grid::signatures,
+             [](uint64_t k) { return registered(grid::forward3d_table(), k); }, bench::check_forward3d},
+            {"3d_bwd", bench::run_backward3d, grid::signatures,
+             [](uint64_t k) { return registered(grid::backward3d_table(), k); }, bench::check_backward3d},
+            {"infer", bench::run_infer, with_fallbacks,
+             [](uint64_t k) { return registered(grid::infer_table(), k); }, bench::check_infer, true},
+            {"infer_q8", bench::run_infer, grid::quant_signatures,
+             [](uint64_t k) { return registered(grid::infer_table(), k); }, bench::check_infer, true},
+            {"adam", bench::run_adam, optim::signatures,
+             [](uint64_t k) { return registered(optim::adam_table(), k); }, bench::check_adam},
+            {"part_fwd", nullptr, grid::signatures,
+             [](uint64_t k) { return registered(grid::partitioned_forward_table(), k); },
+             bench::check_partitioned_forward},
+            {"part_bwd", nullptr, grid::signatures,
+             [](uint64_t k) { return registered(grid::partitioned_backward_table(), k); },
+             bench::check_partitioned_backward},
+        };
+        const std::vector<int> param_dims = cli.dims.empty() ? std::vector<int>{32} : cli.dims;
+
+        // the reference is timed once per problem, whichever kernels and
+        // dtypes are put against it
+        std::map<std::array<int, 4>, double> reference_times;
+        const auto reference_time = [&](const bench::Result &r) {
+            const std::array<int, 4> key{r.dim, r.D, r.L, r.batch};
+            auto it = reference_times.find(key);
+            if (it == reference_times.end())
+                it = reference_times.emplace(key, bench::time_reference({r.dim, r.D, r.L, r.batch}, cli.opt,
+                                                                         cli.reference)).first;
+            return it->second;
+        };
+
+        // read up front, so a bad path fails before the sweep and --json may
+        // overwrite the baseline it was compared with
+        const std::vector<bench::Result> baseline =
+            cli.baseline.empty() ? std::vector<bench::Result>{} : bench::read_json(cli.baseline);
 
-//namespace ut = utils;
+        std::ostream &table = cli.json == "-" ? std::cerr : std::cout;
+        std::vector<bench::Result> results;
+        std::vector<bench::Check> checks;
+        for (const Kernel &k : kernels) {
+            if (!contains(cli.kernels, k.name))
+                continue;
+            for (const auto &sig : k.sigs()) {
+                const bench::Spec spec = bench::Spec::of(sig);
+                if (!k.has(spec.key) || (spec.dim != 0 && !cli.dims.empty() && !contains(cli.dims, spec.dim)))
+                    continue;
+                if (cli.check > 0 && k.check != nullptr) {
+                    checks.push_back(k.check(spec, cli.opt, cli.check));
+                    bench::write_check(table, checks.back());
+                }
+                if (cli.opt.reps == 0 || k.run == nullptr)
+                    continue;
+                for (int dim : spec.dim != 0 ? std::vector<int>{spec.dim} : param_dims) {
+                    bench::Spec sp = spec;
+                    sp.dim = dim;
+                    for (bench::Problem p : cli.grids) {
+                        for (int batch : spec.dim != 0 || spec.any_dim ? cli.batches : std::vector<int>{0}) {
+                            p.batch = batch;
+                            results.push_back(k.run(sp, p, cli.opt));
+                            if (cli.reference > 0 && k.vs_reference)
+                                results.back().reference = reference_time(results.back());
+                            bench::write_table(table, results.back(), cli.peaks);
+                        }
+                    }
+                }
+            }
+        }
 
+        if (cli.json == "-") {
+            bench::write_json(std::cout, results, cli.peaks);
+        } else if (!cli.json.empty()) {
+            std::ofstream out(cli.json);
+            bench::write_json(out, results, cli.peaks);
+        }
 
-int main() {
-    std::cout << torch::cuda::is_available() << torch::cuda::cudnn_is_available();
-}
\ No newline at end of file
+        size_t failed = 0;
+        for (const auto &c : checks)
+            failed += !c.ok;
+        const auto regressed = bench::regressions(results, baseline, cli.threshold);
+        for (const auto &g : regressed)
+            bench::write_regression(std::cerr, g);
+        if (failed > 0)
+            std::cerr << failed << " of " << checks.size() << " checks failed\n";
+        if (!regressed.empty())
+            std::cerr << regressed.size() << " runs regressed by more than " << 100 * cli.threshold << "%\n";
+        if (failed > 0 || !regressed.empty())
+            return 1;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,55 @@
+/*
+cuda version of the fused adam step, one grid stride launch over the whole
+parameter arena regardless of how many tensors it holds
+*/
+
+#include <cuda_runtime.h>
+
+#include "../lib.h"
+
+namespace optim {
+
+namespace cuda {
+
+constexpr int threads = 256;
+// enough blocks to fill the device, the stride loop covers the rest
+constexpr int max_blocks = 4096;
+
+template <typename T>
+__global__ void adam_step(AdamArgs a, AdamScalars c) {
+    T *p = static_cast<T *>(a.param);
+    T *g = static_cast<T *>(a.grad);
+    T *m = static_cast<T *>(a.m);
+    T *v = static_cast<T *>(a.v);
+    const T b1 = T(c.beta1), b2 = T(c.beta2), alpha = T(c.alpha), eps = T(c.eps_hat);
+    const size_t stride = (size_t)gridDim.x * blockDim.x;
+    for (size_t i = (size_t)blockIdx.x * blockDim.x + threadIdx.x; i < a.n; i += stride) {
+        const T gi = g[i];
+        const T mi = b1 * m[i] + (T(1) - b1) * gi;
+        const T vi = b2 * v[i] + (T(1) - b2) * gi * gi;
+        m[i] = mi;
+        v[i] = vi;
+        p[i] -= alpha * mi / (sqrt(vi) + eps);
+        if (a.zero_grad)
+            g[i] = T(0);
+    }
+}
+
+template <typename T>
+struct Adam {
+    static void fn(const AdamArgs &a) {
+        if (a.n == 0)
+            return;
+        const size_t want = (a.n + threads - 1) / threads;
+        const int blocks = (int)(want < max_blocks ? want : max_blocks);
+        adam_step<T><<<blocks, threads, 0, static_cast<cudaStream_t>(a.stream)>>>(a, AdamScalars::of(a));
+    }
+};
+
+} // cuda
+
+void add_cuda_kernels(adam_table_t &table) {
+    fn_builder::FnBuilder<specs<device::cuda>, fn_builder::Tagged<cuda::Adam>::type>::build_table(table, 0);
+}
+
+}
@@ -0,0 +1,114 @@
+/*
+fused adam step over a flat parameter arena, Adam::apply_grad in
+grownet_models/src/models/m1.rs
+
+every parameter of the model lives in one contiguous buffer, with the
+gradients and both moments in buffers of the same layout, so a step is a
+single streaming pass that reads param, grad, m and v once and writes them
+back, instead of one small loop per tensor
+*/
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "../utils/simd.h"
+#include "../utils/thread_pool.h"
+
+namespace optim {
+
+struct AdamArgs {
+    // [n] each, param, m and v are updated in place
+    void *param;
+    void *grad;
+    void *m;
+    void *v;
+    size_t n;
+    double lr;
+    double beta1;
+    double beta2;
+    double eps;
+    // 1 based, for the bias correction
+    int64_t step;
+    // gradients are cleared in the same pass, as apply_grad does
+    bool zero_grad = true;
+    // cudaStream_t for the cuda kernel, null for the default stream
+    void *stream = nullptr;
+    // cpu only, the arena is split into contiguous chunks over the pool
+    utils::ThreadPool *pool = nullptr;
+};
+
+using adam_fn = void (*)(const AdamArgs &);
+
+// param, m and v read and written, grad read and cleared, for utils/counters.h
+inline size_t bytes_moved(const AdamArgs &a, size_t elem) {
+    return elem * a.n * (a.zero_grad ? 8 : 7);
+}
+
+// the bias corrections folded into the step size and epsilon, so the update
+// is p -= alpha * m / (sqrt(v) + eps_hat), the same as dividing m and v by
+// (1 - beta1^t) and (1 - beta2^t) first
+struct AdamScalars {
+    double beta1, beta2, alpha, eps_hat;
+
+    static AdamScalars of(const AdamArgs &a) {
+        const double t = (double)std::max<int64_t>(a.step, 1);
+        const double c1 = 1 - std::pow(a.beta1, t);
+        const double c2 = std::sqrt(1 - std::pow(a.beta2, t));
+        return AdamScalars{a.beta1, a.beta2, a.lr * c2 / c1, a.eps * c2};
+    }
+};
+
+template <typename T>
+struct Adam {
+    static constexpr int W = simd::max_width<T>;
+    using pack = simd::Pack<T, W>;
+    // chunks handed to the pool, in elements, a multiple of the lane count
+    static constexpr size_t chunk = 1 << 14;
+
+    static void range(const AdamArgs &a, const AdamScalars &c, size_t i0, size_t i1) {
+        T *p = static_cast<T *>(a.param);
+        T *g = static_cast<T *>(a.grad);
+        T *m = static_cast<T *>(a.m);
+        T *v = static_cast<T *>(a.v);
+        const pack b1 = pack::set1(T(c.beta1)), nb1 = pack::set1(T(1 - c.beta1));
+        const pack b2 = pack::set1(T(c.beta2)), nb2 = pack::set1(T(1 - c.beta2));
+        const pack alpha = pack::set1(T(c.alpha)), eps = pack::set1(T(c.eps_hat));
+        const pack zero = pack::zero();
+
+        size_t i = i0;
+        for (; i + W <= i1; i += W) {
+            const pack gi = pack::load(g + i);
+            const pack mi = fmadd(nb1, gi, b1 * pack::load(m + i));
+            const pack vi = fmadd(nb2, gi * gi, b2 * pack::load(v + i));
+            const pack pi = pack::load(p + i) - alpha * mi / (sqrt(vi) + eps);
+            mi.store(m + i);
+            vi.store(v + i);
+            pi.store(p + i);
+            if (a.zero_grad)
+                zero.store(g + i);
+        }
+        for (; i < i1; ++i) {
+            const T gi = g[i];
+            m[i] = T(c.beta1) * m[i] + T(1 - c.beta1) * gi;
+            v[i] = T(c.beta2) * v[i] + T(1 - c.beta2) * gi * gi;
+            p[i] -= T(c.alpha) * m[i] / (std::sqrt(v[i]) + T(c.eps_hat));
+            if (a.zero_grad)
+                g[i] = T(0);
+        }
+    }
+
+    static void fn(const AdamArgs &a) {
+        const AdamScalars c = AdamScalars::of(a);
+        const int tasks = (int)((a.n + chunk - 1) / chunk);
+        if (a.pool == nullptr || a.pool->size() == 1 || tasks < 2)
+            return range(a, c, 0, a.n);
+        a.pool->run(tasks, [&](int t) {
+            range(a, c, (size_t)t * chunk, std::min(a.n, (size_t)(t + 1) * chunk));
+        });
+    }
+};
+
+} // optim
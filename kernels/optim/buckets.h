@@ -0,0 +1,184 @@
+/*
+data parallel training over the flat parameter arena of adam.h, the
+gradients of every replica are reduced in buckets, each handed off as soon as
+the backward pass is done with what it covers, so that the reduction and
+optimizer step of one bucket overlap with the backward of the rest
+
+a grid's dw and db are bucketed by consecutive columns, the backward pass runs
+columns last to first and reports each through grid::ColumnHook, and a
+bucket is queued once its first column is done, whatever of the arena no
+bucket covers is queued last, when the step is finished
+
+reducing is left to the caller, the extension hands buckets to a torch
+process group, so every backend torch has, nccl included, works as is
+*/
+
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../grid/grid.h"
+
+namespace optim {
+
+// elements [begin, begin + n) of the arena
+struct Span {
+    size_t begin;
+    size_t n;
+};
+
+struct Bucket {
+    // columns [c0, c1) of a grid, complete once column c0 is
+    int c0, c1;
+    // their rows of dw and db
+    std::vector<Span> spans;
+};
+
+// buckets of about bucket_elems elements of dw and db, for a grid whose dw
+// and db start at dw_at and db_at in the arena, last columns first, a
+// bucket holding at least one column
+inline std::vector<Bucket> column_buckets(const grid::Shape &sh, size_t dw_at, size_t db_at, size_t bucket_elems) {
+    const size_t w = (size_t)sh.D * sh.dim * sh.dim, b = (size_t)sh.D * sh.dim;
+    const int per = (int)std::max<size_t>(1, bucket_elems / (w + b));
+    std::vector<Bucket> out;
+    for (int c1 = sh.L; c1 > 0; c1 -= per) {
+        const int c0 = std::max(c1 - per, 0);
+        const size_t n = c1 - c0;
+        out.push_back(Bucket{c0, c1, {Span{dw_at + c0 * w, n * w}, Span{db_at + c0 * b, n * b}}});
+    }
+    return out;
+}
+
+// the parts of [0, n) the spans leave out, in order
+inline std::vector<Span> uncovered(std::vector<Span> covered, size_t n) {
+    std::sort(covered.begin(), covered.end(), [](const Span &a, const Span &b) { return a.begin < b.begin; });
+    std::vector<Span> out;
+    size_t at = 0;
+    for (const Span &s : covered) {
+        if (s.begin > at)
+            out.push_back(Span{at, s.begin - at});
+        at = std::max(at, s.begin + s.n);
+    }
+    if (at < n)
+        out.push_back(Span{at, n - at});
+    return out;
+}
+
+// runs reduce on a thread of its own over the spans queued to it, in the
+// order they were queued, the buckets of a grid being queued by the hook of
+// its backward pass
+class BucketQueue {
+public:
+    // reduces and steps spans of the arena, on the queue's thread
+    using reduce_fn = std::function<void(const std::vector<Span> &)>;
+
+    explicit BucketQueue(reduce_fn reduce) : reduce(std::move(reduce)), worker([this] { work(); }) {}
+
+    ~BucketQueue() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stop = true;
+        }
+        changed.notify_all();
+        worker.join();
+    }
+
+    BucketQueue(const BucketQueue &) = delete;
+    BucketQueue &operator=(const BucketQueue &) = delete;
+
+    // the hook queueing buckets, which cover columns of one backward pass,
+    // as it completes them, valid until the step is finished
+    grid::ColumnHook watch(std::vector<Bucket> buckets) {
+        std::lock_guard<std::mutex> lock(m);
+        for (const Bucket &b : buckets)
+            for (const Span &s : b.spans)
+                covered.push_back(s);
+        groups.push_back(Group{this, std::move(buckets)});
+        return grid::ColumnHook{&Group::done, &groups.back()};
+    }
+
+    void push(std::vector<Span> spans) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            queue.push_back(std::move(spans));
+        }
+        changed.notify_all();
+    }
+
+    // queues what no bucket covered, waits for every span queued to be
+    // reduced, and starts the next step, rethrows what reduce threw, arena
+    // holds n elements
+    void finish(size_t n) {
+        std::unique_lock<std::mutex> lock(m);
+        queue.push_back(uncovered(covered, n));
+        changed.notify_all();
+        changed.wait(lock, [&] { return (queue.empty() && !busy) || error; });
+        groups.clear();
+        covered.clear();
+        if (error) {
+            queue.clear();
+            changed.wait(lock, [&] { return !busy; });
+            std::rethrow_exception(std::exchange(error, nullptr));
+        }
+    }
+
+private:
+    struct Group {
+        BucketQueue *q;
+        std::vector<Bucket> buckets;
+
+        static void done(void *ctx, int l) {
+            Group *g = static_cast<Group *>(ctx);
+            for (const Bucket &b : g->buckets)
+                if (b.c0 == l)
+                    g->q->push(b.spans);
+        }
+    };
+
+    void work() {
+        std::unique_lock<std::mutex> lock(m);
+        while (true) {
+            changed.wait(lock, [&] { return stop || !queue.empty(); });
+            if (stop)
+                return;
+            std::vector<Span> spans = std::move(queue.front());
+            queue.pop_front();
+            busy = true;
+            lock.unlock();
+            std::exception_ptr e;
+            try {
+                if (!spans.empty())
+                    reduce(spans);
+            } catch (...) {
+                e = std::current_exception();
+            }
+            lock.lock();
+            busy = false;
+            if (e && !error)
+                error = e;
+            changed.notify_all();
+        }
+    }
+
+    const reduce_fn reduce;
+    std::mutex m;
+    std::condition_variable changed;
+    std::deque<std::vector<Span>> queue;
+    // of the current step, deque so the hooks' contexts stay put
+    std::deque<Group> groups;
+    std::vector<Span> covered;
+    bool busy = false;
+    bool stop = false;
+    std::exception_ptr error;
+    std::thread worker;
+};
+
+} // optim
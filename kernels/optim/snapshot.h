@@ -0,0 +1,352 @@
+/*
+training snapshots of the flat arenas of adam.h, param, m and v or any other
+buffers of one layout, saved as one file so a save is a few large writes
+instead of a serialization of every cell's w and b and adam's mt and vt
+
+    header : SnapshotHeader, padded to a page
+    full   : each arena whole, page aligned, so a mapped full snapshot holds
+             the arenas as they were
+    delta  : per arena the ids of the chunks that changed since the save
+             before, then those chunks, chunk_elems elements each but the
+             last of an arena
+
+a save copies what it writes out of the arenas, so training goes on as soon
+as it returns, and leaves the writing to a thread of its own, an arena is cut
+into chunks, each with a hash of what it held at the last save, a delta only
+copies and writes the chunks whose hash changed, which for a pruned grid
+leaves out the dead cells
+
+loading applies a full snapshot and then each delta after it in order, a
+delta names the step of the save before it, which is checked
+*/
+
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../utils/files.h"
+
+namespace optim {
+
+constexpr char snapshot_magic[8] = {'G', 'N', 'S', 'N', 'A', 'P', 'S', 'H'};
+constexpr uint32_t snapshot_version = 1;
+constexpr size_t snapshot_header_bytes = 4096;
+constexpr int snapshot_max_arenas = 8;
+
+enum class SnapshotKind : uint32_t { full = 0, delta = 1 };
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    SnapshotKind kind;
+    int64_t step;
+    // the step of the save a delta applies to
+    int64_t parent;
+    uint64_t elem_bytes;
+    // elements of every arena
+    uint64_t n;
+    uint64_t chunk_elems;
+    uint32_t arenas;
+    uint32_t reserved;
+    struct Section {
+        // chunks stored, every one of them for a full snapshot
+        uint64_t chunks;
+        // from the start of the file, ids is 0 for a full snapshot
+        uint64_t ids_at;
+        uint64_t data_at;
+    } sections[snapshot_max_arenas];
+
+    // rounded up without adding to n, which comes from the file
+    uint64_t chunk_count() const { return n / chunk_elems + (n % chunk_elems != 0); }
+
+    // of chunk c of an arena
+    uint64_t chunk_bytes(uint64_t c) const {
+        return std::min<uint64_t>(chunk_elems, n - c * chunk_elems) * elem_bytes;
+    }
+};
+
+static_assert(sizeof(SnapshotHeader) <= snapshot_header_bytes);
+
+namespace detail {
+    // a word at a time, over whole chunks, multiply xor in the manner of
+    // fnv, the tail bytes folded into the last word
+    inline uint64_t chunk_hash(const char *p, size_t bytes) {
+        uint64_t h = 0xcbf29ce484222325ull ^ bytes;
+        size_t i = 0;
+        for (; i + 8 <= bytes; i += 8) {
+            uint64_t w;
+            std::memcpy(&w, p + i, 8);
+            h = (h ^ w) * 0x100000001b3ull;
+            h ^= h >> 29;
+        }
+        uint64_t w = 0;
+        std::memcpy(&w, p + i, bytes - i);
+        return ((h ^ w) * 0x100000001b3ull) ^ (h >> 32);
+    }
+} // detail
+
+// a snapshot file mapped copy on write
+class Snapshot {
+public:
+    explicit Snapshot(const std::string &path) : file(path) {
+        if (file.size() < snapshot_header_bytes)
+            utils::file_error(path, "is too short for a snapshot header");
+        std::memcpy(&h, file.data(), sizeof(h));
+        validate();
+    }
+
+    const SnapshotHeader &header() const { return h; }
+
+    // arena k of a full snapshot, in place in the mapping
+    void *arena(int k) const {
+        if (h.kind != SnapshotKind::full)
+            utils::file_error(file.path, "is a delta, it holds no whole arenas");
+        return file.data() + h.sections[k].data_at;
+    }
+
+    // writes arena k into dst, n elements of elem_bytes, all of it or the
+    // chunks of a delta
+    void apply(int k, void *dst, size_t n, size_t elem_bytes) const {
+        if (n != h.n || elem_bytes != h.elem_bytes)
+            utils::file_error(file.path, "holds arenas of " + std::to_string(h.n) + " elements of " +
+                                             std::to_string(h.elem_bytes) + " bytes, not " + std::to_string(n) +
+                                             " of " + std::to_string(elem_bytes));
+        const auto &s = h.sections[k];
+        char *out = static_cast<char *>(dst);
+        if (h.kind == SnapshotKind::full)
+            return (void)std::memcpy(out, file.data() + s.data_at, n * elem_bytes);
+        const uint64_t *ids = reinterpret_cast<const uint64_t *>(file.data() + s.ids_at);
+        const char *in = file.data() + s.data_at;
+        const size_t chunk = h.chunk_elems * elem_bytes;
+        for (uint64_t i = 0; i < s.chunks; ++i)
+            std::memcpy(out + ids[i] * chunk, in + i * chunk, h.chunk_bytes(ids[i]));
+    }
+
+private:
+    void validate() const {
+        const std::string &path = file.path;
+        if (std::memcmp(h.magic, snapshot_magic, sizeof(h.magic)) != 0)
+            utils::file_error(path, "is not a snapshot");
+        if (h.version != snapshot_version)
+            utils::file_error(path, "has snapshot version " + std::to_string(h.version) + ", expected " +
+                                        std::to_string(snapshot_version));
+        if (h.arenas > (uint32_t)snapshot_max_arenas || h.chunk_elems == 0 || h.elem_bytes == 0 ||
+            (h.kind != SnapshotKind::full && h.kind != SnapshotKind::delta))
+            utils::file_error(path, "has an inconsistent snapshot header");
+        // every product is checked, a header read from disk can make any of them wrap
+        uint64_t arena = 0, chunk = 0;
+        if (!utils::checked_mul(h.n, h.elem_bytes, arena) || !utils::checked_mul(h.chunk_elems, h.elem_bytes, chunk))
+            utils::file_error(path, "has an inconsistent snapshot header");
+        const uint64_t count = h.chunk_count();
+        for (uint32_t k = 0; k < h.arenas; ++k) {
+            const auto &s = h.sections[k];
+            uint64_t data = arena, ids = 0;
+            bool ok = s.chunks <= count && s.data_at >= sizeof(SnapshotHeader);
+            if (ok && h.kind == SnapshotKind::delta)
+                ok = utils::checked_mul(s.chunks, chunk, data) && utils::checked_mul(s.chunks, sizeof(uint64_t), ids) &&
+                     s.ids_at >= sizeof(SnapshotHeader) && s.ids_at % alignof(uint64_t) == 0 &&
+                     utils::within(s.ids_at, ids, file.size());
+            ok = ok && utils::within(s.data_at, data, file.size());
+            if (ok && h.kind == SnapshotKind::delta) {
+                const uint64_t *id = reinterpret_cast<const uint64_t *>(file.data() + s.ids_at);
+                for (uint64_t i = 0; ok && i < s.chunks; ++i)
+                    ok = id[i] < count;
+            }
+            if (!ok)
+                utils::file_error(path, "is cut short or has an inconsistent section " + std::to_string(k));
+        }
+    }
+
+    utils::MappedFile file;
+    SnapshotHeader h;
+};
+
+// saves snapshots in the background, one save is written while the next is
+// staged, a save beyond that waits for the one before to be written
+class SnapshotWriter {
+public:
+    // arenas are cut into chunks of chunk_elems for the deltas
+    explicit SnapshotWriter(size_t chunk_elems) : chunk_elems(chunk_elems) {
+        if (chunk_elems == 0)
+            throw std::invalid_argument("snapshot: chunk_elems has to be positive");
+        writer = std::thread([this] { work(); });
+    }
+
+    ~SnapshotWriter() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stop = true;
+        }
+        changed.notify_all();
+        writer.join();
+    }
+
+    SnapshotWriter(const SnapshotWriter &) = delete;
+    SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+    // stages the arenas, n elements of elem_bytes each, and queues them to be
+    // written to path, all of them, or as a delta of the chunks changed since
+    // the last save, the arenas can change once it returns, rethrows what the
+    // last write threw
+    void save(const std::string &path, const std::vector<const void *> &arenas, size_t n, size_t elem_bytes,
+              int64_t step, bool delta) {
+        if (arenas.empty() || arenas.size() > (size_t)snapshot_max_arenas)
+            throw std::invalid_argument("snapshot: between 1 and " + std::to_string(snapshot_max_arenas) +
+                                        " arenas, not " + std::to_string(arenas.size()));
+        {
+            std::unique_lock<std::mutex> lock(m);
+            changed.wait(lock, [&] { return queue.empty() || error; });
+            rethrow();
+        }
+        if (delta && (hashes.empty() || hashes.size() != arenas.size() || n != last_n || elem_bytes != last_elem))
+            throw std::invalid_argument("snapshot: a delta needs an earlier save of the same arenas");
+
+        Job job;
+        job.path = path;
+        SnapshotHeader &h = job.h;
+        h = SnapshotHeader{};
+        std::memcpy(h.magic, snapshot_magic, sizeof(h.magic));
+        h.version = snapshot_version;
+        h.kind = delta ? SnapshotKind::delta : SnapshotKind::full;
+        h.step = step;
+        h.parent = delta ? last_step : step;
+        h.elem_bytes = elem_bytes;
+        h.n = n;
+        h.chunk_elems = chunk_elems;
+        h.arenas = (uint32_t)arenas.size();
+        const uint64_t count = h.chunk_count(), chunk = chunk_elems * elem_bytes;
+        hashes.resize(arenas.size());
+        job.ids.resize(arenas.size());
+        job.data.resize(arenas.size());
+        for (size_t k = 0; k < arenas.size(); ++k) {
+            const char *a = static_cast<const char *>(arenas[k]);
+            std::vector<uint64_t> &seen = hashes[k];
+            seen.resize(count);
+            std::vector<char> &out = job.data[k];
+            if (!delta)
+                out.assign(a, a + n * elem_bytes);
+            for (uint64_t c = 0; c < count; ++c) {
+                const uint64_t hc = detail::chunk_hash(a + c * chunk, h.chunk_bytes(c));
+                if (delta && hc != seen[c]) {
+                    job.ids[k].push_back(c);
+                    out.insert(out.end(), a + c * chunk, a + c * chunk + h.chunk_bytes(c));
+                    // the chunks are chunk bytes apart in the file
+                    out.resize(job.ids[k].size() * chunk);
+                }
+                seen[c] = hc;
+            }
+        }
+        last_step = step;
+        last_n = n;
+        last_elem = elem_bytes;
+
+        // laid out once the sizes are known
+        uint64_t at = snapshot_header_bytes;
+        for (size_t k = 0; k < arenas.size(); ++k) {
+            auto &s = h.sections[k];
+            s.chunks = delta ? job.ids[k].size() : count;
+            if (delta) {
+                s.ids_at = at;
+                at += s.chunks * sizeof(uint64_t);
+            }
+            s.data_at = at = utils::align_up(at, snapshot_header_bytes);
+            at += job.data[k].size();
+        }
+        {
+            std::lock_guard<std::mutex> lock(m);
+            queue.push_back(std::move(job));
+        }
+        changed.notify_all();
+    }
+
+    // waits for every save queued to be written, rethrows what a write threw
+    void wait() {
+        std::unique_lock<std::mutex> lock(m);
+        changed.wait(lock, [&] { return (queue.empty() && !busy) || error; });
+        rethrow();
+    }
+
+private:
+    struct Job {
+        std::string path;
+        SnapshotHeader h;
+        std::vector<std::vector<uint64_t>> ids;
+        std::vector<std::vector<char>> data;
+    };
+
+    static void write(const Job &job) {
+        utils::FileWriter f(job.path);
+        f.put(&job.h, sizeof(job.h));
+        for (uint32_t k = 0; k < job.h.arenas; ++k) {
+            const auto &s = job.h.sections[k];
+            if (job.h.kind == SnapshotKind::delta) {
+                f.pad_to(s.ids_at);
+                f.put(job.ids[k].data(), job.ids[k].size() * sizeof(uint64_t));
+            }
+            f.pad_to(s.data_at);
+            f.put(job.data[k].data(), job.data[k].size());
+        }
+        f.commit();
+    }
+
+    void work() {
+        std::unique_lock<std::mutex> lock(m);
+        while (true) {
+            changed.wait(lock, [&] { return stop || !queue.empty(); });
+            if (queue.empty())
+                return;
+            Job job = std::move(queue.front());
+            queue.pop_front();
+            busy = true;
+            changed.notify_all();
+            lock.unlock();
+            std::exception_ptr e;
+            try {
+                write(job);
+            } catch (...) {
+                e = std::current_exception();
+            }
+            lock.lock();
+            busy = false;
+            if (e && !error)
+                error = e;
+            changed.notify_all();
+        }
+    }
+
+    // under m
+    void rethrow() {
+        if (error) {
+            // the hashes are of a save that never made it to disk
+            hashes.clear();
+            std::rethrow_exception(std::exchange(error, nullptr));
+        }
+    }
+
+    const size_t chunk_elems;
+    // per arena and chunk, of the last save, touched by save alone
+    std::vector<std::vector<uint64_t>> hashes;
+    int64_t last_step = 0;
+    size_t last_n = 0, last_elem = 0;
+
+    std::mutex m;
+    std::condition_variable changed;
+    std::deque<Job> queue;
+    bool busy = false;
+    bool stop = false;
+    std::exception_ptr error;
+    std::thread writer;
+};
+
+} // optim
@@ -5,8 +5,11 @@ from setuptools import setup, Extension
 from torch.utils import cpp_extension
 
 
+# build the cuda kernels whenever a toolkit is around, GROWNET_CUDA=0 opts out
+use_cuda = cpp_extension.CUDA_HOME is not None and os.environ.get('GROWNET_CUDA', '1') != '0'
+
 def filter_filename(filename):
-    accepted_extensions = ['.cu', '.cc']#, '.h', '.hpp', '.cuh']
+    accepted_extensions = ['.cu', '.cc'] if use_cuda else ['.cc']#, '.h', '.hpp', '.cuh']
     for ext in accepted_extensions:
         if filename.endswith(ext):
             return True
@@ -22,13 +25,27 @@ def get_files(dirs):
     return files
 
 source_dir = os.getcwd()
-include_dirs = ['utils']
+include_dirs = ['utils', 'grid', 'optim']
 include_dirs = [os.path.join(source_dir, f) for f in include_dirs]
-source_files = get_files(include_dirs) + ["extension.cc"]
+source_files = get_files(include_dirs) + ["extension.cc", "lib.cc"]
+extra_compile_args = ['-O3', '-march=native']
+# GROWNET_COUNTERS=1 wraps every kernel in the counters of utils/counters.h
+define_macros = [('GROWNET_COUNTERS', None)] if os.environ.get('GROWNET_COUNTERS', '0') != '0' else []
 print(source_files)
 
+if use_cuda:
+    extension = cpp_extension.CUDAExtension(
+        'GrowNet', source_files,
+        define_macros=define_macros + [('GROWNET_CUDA', None)],
+        extra_compile_args={'cxx': extra_compile_args, 'nvcc': ['-O3']})
+else:
+    extension = cpp_extension.CppExtension('GrowNet', source_files, define_macros=define_macros,
+                                           extra_compile_args=extra_compile_args)
+
 
+# ninja compiles the units in parallel, the cpu kernels are split over the
+# ones in grid/shards for that, MAX_JOBS caps how many run at once
 setup(name='GrowNet',
-      ext_modules=[cpp_extension.CppExtension('GrowNet', source_files)],
-      cmdclass={'build_ext': cpp_extension.BuildExtension})
+      ext_modules=[extension],
+      cmdclass={'build_ext': cpp_extension.BuildExtension.with_options(use_ninja=True)})
 
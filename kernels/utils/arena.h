@@ -0,0 +1,106 @@
+/*
+bump allocator for per step scratch memory, the C++ side of GeneralCtx in
+m1/node.jl and ArrayAllocator in grownet_models/src/allocator.rs
+
+views are reserved for the duration of a step and all released at once by
+clear, which is O(1), the arena can either own host memory or be laid over a
+single allocation made elsewhere, such as one device allocation, since it
+only ever does pointer arithmetic on its base and never touches the memory
+*/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+namespace utils {
+
+class Arena {
+public:
+    static constexpr size_t alignment = 64;
+
+    // non-owning, over [base, base + bytes), which may be device memory,
+    // base should be aligned to at least alignment
+    Arena(void *base, size_t bytes) : base(static_cast<char *>(base)), cap(bytes), owned(false) {}
+
+    // owns bytes of host memory
+    explicit Arena(size_t bytes)
+        : base(static_cast<char *>(::operator new(bytes, std::align_val_t(alignment)))), cap(bytes), owned(true) {}
+
+    ~Arena() {
+        if (owned)
+            ::operator delete(base, std::align_val_t(alignment));
+    }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // n uninitialized elements of T, aligned to a cache line, valid until
+    // the next clear or release past this point
+    template <typename T>
+    T *reserve(size_t n) {
+        const size_t start = align_up(offset);
+        const size_t end = start + n * sizeof(T);
+        if (end > cap)
+            throw std::runtime_error("arena out of memory, " + std::to_string(end) +
+                                     " bytes needed of " + std::to_string(cap));
+        offset = end;
+        peak_ = end > peak_ ? end : peak_;
+        return reinterpret_cast<T *>(base + start);
+    }
+
+    // scoped reservations, release(mark()) frees everything reserved since
+    using Mark = size_t;
+    Mark mark() const { return offset; }
+    void release(Mark m) { offset = m; }
+
+    void clear() { offset = 0; }
+
+    size_t used() const { return offset; }
+    // the most ever reserved at once, for sizing the arena after a first step
+    size_t peak() const { return peak_; }
+    size_t capacity() const { return cap; }
+    void *data() const { return base; }
+
+private:
+    static size_t align_up(size_t n) {
+        return (n + alignment - 1) & ~(alignment - 1);
+    }
+
+    char *base;
+    size_t cap;
+    bool owned;
+    size_t offset = 0;
+    size_t peak_ = 0;
+};
+
+// releases everything reserved within its lifetime, a null arena is allowed
+class ArenaScope {
+public:
+    explicit ArenaScope(Arena *arena) : arena(arena), m(arena ? arena->mark() : 0) {}
+    ~ArenaScope() {
+        if (arena)
+            arena->release(m);
+    }
+
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+private:
+    Arena *arena;
+    Arena::Mark m;
+};
+
+// buf if the caller provided it, otherwise n elements from the arena
+template <typename T>
+T *scratch_or(void *buf, Arena *arena, size_t n) {
+    if (buf != nullptr)
+        return static_cast<T *>(buf);
+    if (arena == nullptr)
+        throw std::invalid_argument("kernel needs a scratch buffer or an arena");
+    return arena->reserve<T>(n);
+}
+
+} // utils
@@ -0,0 +1,208 @@
+/*
+per specialization counters around every kernel registered by fn_builder,
+calls, wall time, the bytes the call has to move at least and the time spent
+resolving the call to its kernel, compiled in with GROWNET_COUNTERS and absent
+otherwise, the tables then hold the kernels themselves
+
+counts are kept per thread, each thread only ever writes its own cells, so a
+call adds to them with plain relaxed stores and no locked instruction or
+shared cache line, readers sum the cells of every thread, which outlive their
+thread, reset moves a baseline instead of touching the cells
+
+cuda kernels return once they are queued, so their time is the launch alone
+*/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace counters {
+
+#ifdef GROWNET_COUNTERS
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+struct Totals {
+    uint64_t calls = 0;
+    uint64_t ns = 0;
+    uint64_t bytes = 0;
+    // in the lookups preceding the calls, call site cache hits included
+    uint64_t resolve_ns = 0;
+};
+
+struct Entry {
+    // the kernel template and its arguments, such as "grid::Forward cpu f 8"
+    std::string name;
+    uint64_t key;
+    Totals totals;
+};
+
+class Registry {
+public:
+    // cells are allocated per thread in chunks as ids are handed out
+    static constexpr int chunk = 64;
+    static constexpr int max_chunks = 256;
+
+    struct Cell {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> ns{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> resolve_ns{0};
+    };
+
+    int add(std::string name, uint64_t key) {
+        std::lock_guard<std::mutex> lock(m);
+        if (names.size() == (size_t)chunk * max_chunks)
+            throw std::length_error("counters: more than " + std::to_string(chunk * max_chunks) + " kernels");
+        names.push_back(std::move(name));
+        keys.push_back(key);
+        baseline.emplace_back();
+        return (int)names.size() - 1;
+    }
+
+    // the calling thread's cell for id
+    Cell &cell(int id) {
+        Block &b = local();
+        Cell *c = b.chunks[id / chunk].load(std::memory_order_relaxed);
+        if (c == nullptr) {
+            c = new Cell[chunk];
+            b.chunks[id / chunk].store(c, std::memory_order_release);
+        }
+        return c[id % chunk];
+    }
+
+    // every kernel called since the last reset
+    std::vector<Entry> snapshot() const {
+        std::lock_guard<std::mutex> lock(m);
+        std::vector<Entry> out;
+        for (size_t i = 0; i < names.size(); ++i) {
+            const Totals now = sum((int)i), &base = baseline[i];
+            if (now.calls == base.calls)
+                continue;
+            out.push_back(Entry{names[i], keys[i],
+                                Totals{now.calls - base.calls, now.ns - base.ns, now.bytes - base.bytes,
+                                       now.resolve_ns - base.resolve_ns}});
+        }
+        return out;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(m);
+        for (size_t i = 0; i < names.size(); ++i)
+            baseline[i] = sum((int)i);
+    }
+
+private:
+    struct Block {
+        std::atomic<Cell *> chunks[max_chunks] = {};
+
+        ~Block() {
+            for (auto &c : chunks)
+                delete[] c.load();
+        }
+    };
+
+    Block &local() {
+        thread_local std::shared_ptr<Block> b;
+        if (!b) {
+            b = std::make_shared<Block>();
+            std::lock_guard<std::mutex> lock(m);
+            blocks.push_back(b);
+        }
+        return *b;
+    }
+
+    // under m
+    Totals sum(int id) const {
+        Totals t;
+        for (const auto &b : blocks) {
+            const Cell *c = b->chunks[id / chunk].load(std::memory_order_acquire);
+            if (c == nullptr)
+                continue;
+            const Cell &e = c[id % chunk];
+            t.calls += e.calls.load(std::memory_order_relaxed);
+            t.ns += e.ns.load(std::memory_order_relaxed);
+            t.bytes += e.bytes.load(std::memory_order_relaxed);
+            t.resolve_ns += e.resolve_ns.load(std::memory_order_relaxed);
+        }
+        return t;
+    }
+
+    mutable std::mutex m;
+    std::vector<std::string> names;
+    std::vector<uint64_t> keys;
+    std::vector<Totals> baseline;
+    // every thread's cells, kept once the thread is gone
+    std::vector<std::shared_ptr<Block>> blocks;
+};
+
+inline Registry &registry() {
+    static Registry r;
+    return r;
+}
+
+// for a cell only its own thread writes to
+inline void bump(std::atomic<uint64_t> &c, uint64_t n) {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline uint64_t since(std::chrono::steady_clock::time_point t0) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0)
+        .count();
+}
+
+// resolution time of this thread not yet attributed to a kernel
+inline uint64_t &pending_resolve() {
+    thread_local uint64_t ns = 0;
+    return ns;
+}
+
+// times a lookup, the time goes to the next kernel this thread calls, which
+// is the one the lookup found, nothing without GROWNET_COUNTERS
+class Resolve {
+public:
+#ifdef GROWNET_COUNTERS
+    Resolve() : t0(std::chrono::steady_clock::now()) {}
+    ~Resolve() { pending_resolve() += since(t0); }
+
+private:
+    std::chrono::steady_clock::time_point t0;
+#endif
+};
+
+// the least a call with args a moves in and out of memory, given the size of
+// its elements, overloaded next to the args of the kernels that declare it
+template <typename Args>
+size_t bytes_moved(const Args &, size_t) {
+    return 0;
+}
+
+// stands in for K::fn in the tables, counting every call under id
+template <typename K, typename Args>
+struct Counted {
+    static inline int id = -1;
+    static inline size_t elem = 0;
+
+    static void fn(const Args &a) {
+        const auto t0 = std::chrono::steady_clock::now();
+        K::fn(a);
+        const uint64_t ns = since(t0);
+        Registry::Cell &c = registry().cell(id);
+        bump(c.calls, 1);
+        bump(c.ns, ns);
+        bump(c.bytes, bytes_moved(a, elem));
+        bump(c.resolve_ns, pending_resolve());
+        pending_resolve() = 0;
+    }
+};
+
+} // counters
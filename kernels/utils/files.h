@@ -0,0 +1,153 @@
+/*
+the file handling of the on disk formats, data/records.h and
+optim/snapshot.h, a file mapped copy on write, whose pages are shared with
+every other process mapping it until written, and a writer that goes through
+a temporary next to the target and renames it over the target once complete,
+so a reader never maps a half written file
+*/
+
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace utils {
+
+[[noreturn]] inline void file_error(const std::string &path, const std::string &what) {
+    throw std::runtime_error(path + ": " + what);
+}
+
+[[noreturn]] inline void file_errno(const std::string &path, const char *call) {
+    file_error(path, std::string(call) + " failed, " + std::strerror(errno));
+}
+
+inline size_t align_up(size_t n, size_t a) {
+    return (n + a - 1) / a * a;
+}
+
+// for sizes and offsets read from a header, which a corrupt file can make
+// wrap, false where they would instead of a wrapped out
+inline bool checked_mul(uint64_t a, uint64_t b, uint64_t &out) {
+    return !__builtin_mul_overflow(a, b, &out);
+}
+
+inline bool checked_add(uint64_t a, uint64_t b, uint64_t &out) {
+    return !__builtin_add_overflow(a, b, &out);
+}
+
+// whether bytes from offset at end within a file of size bytes
+inline bool within(uint64_t at, uint64_t bytes, uint64_t size) {
+    return at <= size && bytes <= size - at;
+}
+
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path) : path(path) {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            file_errno(path, "open");
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            file_errno(path, "fstat");
+        }
+        n = (size_t)st.st_size;
+        if (n != 0)
+            base = ::mmap(nullptr, n, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        // the mapping keeps the file open
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            base = nullptr;
+            file_errno(path, "mmap");
+        }
+    }
+
+    ~MappedFile() {
+        if (base != nullptr)
+            ::munmap(base, n);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    char *data() const { return static_cast<char *>(base); }
+    size_t size() const { return n; }
+
+    // hints that the file will be read in order, the kernel then reads ahead
+    void advise_sequential() const {
+        if (base != nullptr)
+            ::madvise(base, n, MADV_SEQUENTIAL);
+    }
+
+    const std::string path;
+
+private:
+    void *base = nullptr;
+    size_t n = 0;
+};
+
+class FileWriter {
+public:
+    explicit FileWriter(std::string path) : path(std::move(path)), tmp(this->path + ".tmp") {
+        f = std::fopen(tmp.c_str(), "wb");
+        if (f == nullptr)
+            file_errno(tmp, "fopen");
+    }
+
+    // a writer dropped before commit leaves the target as it was
+    ~FileWriter() {
+        if (f != nullptr) {
+            std::fclose(f);
+            std::remove(tmp.c_str());
+        }
+    }
+
+    FileWriter(const FileWriter &) = delete;
+    FileWriter &operator=(const FileWriter &) = delete;
+
+    void put(const void *p, size_t bytes) {
+        if (bytes != 0 && std::fwrite(p, 1, bytes, f) != bytes)
+            file_errno(tmp, "fwrite");
+        at += bytes;
+    }
+
+    // zeros up to offset to
+    void pad_to(size_t to) {
+        static const char zeros[4096] = {};
+        while (at < to)
+            put(zeros, std::min(to - at, sizeof(zeros)));
+    }
+
+    size_t offset() const { return at; }
+
+    // replaces the target with what was written
+    void commit() {
+        FILE *g = f;
+        f = nullptr;
+        if (std::fclose(g) != 0) {
+            std::remove(tmp.c_str());
+            file_errno(tmp, "fclose");
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            file_errno(path, "rename");
+        }
+    }
+
+private:
+    const std::string path, tmp;
+    FILE *f = nullptr;
+    size_t at = 0;
+};
+
+} // utils
@@ -16,12 +16,28 @@ template meta-programming classes for convenience in kernel specialization
 #include <boost/mpl/insert.hpp>
 #include <boost/mpl/int.hpp>
 #include <boost/mpl/size.hpp>
+#include <boost/mpl/push_front.hpp>
+#include <boost/mpl/at.hpp>
 
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <unordered_map>
 #include <map>
+#include <mutex>
 #include <iostream>
 
+#ifdef GROWNET_COUNTERS
+#include <cstdlib>
+#include <typeinfo>
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+#endif
+
+#include "counters.h"
+#include "half.h"
+#include "int8.h"
 
 // list of standard conversions from the type to a string
 // for hashing during dynamic dispatch
@@ -32,25 +48,89 @@ std::string to_std_type_str() {
 }
 
 template <>
-std::string to_std_type_str<double>() {
+inline std::string to_std_type_str<double>() {
     return std::string("d");
 }
 template <>
-std::string to_std_type_str<float>() {
+inline std::string to_std_type_str<float>() {
     return std::string("f");
 }
 template <>
-std::string to_std_type_str<int>() {
+inline std::string to_std_type_str<int>() {
     return std::string("i");
 }
 template <>
-std::string to_std_type_str<long long>() {
+inline std::string to_std_type_str<long long>() {
     return std::string("l");
 }
 template <>
-std::string to_std_type_str<unsigned int>() {
+inline std::string to_std_type_str<unsigned int>() {
     return std::string("ui");
 }
+template <>
+inline std::string to_std_type_str<utils::half>() {
+    return std::string("h");
+}
+template <>
+inline std::string to_std_type_str<utils::bfloat16>() {
+    return std::string("bf");
+}
+
+} // type_repr
+
+// tags for the device a kernel runs on, so that the device can be part of
+// the dispatch key like any other type argument
+namespace device {
+struct cpu {};
+struct cuda {};
+}
+
+namespace type_repr {
+
+// the same codes as above, but usable in constant expressions,
+// so that dispatch keys can be folded at compile time
+template <typename T>
+struct type_code;
+
+template <> struct type_code<double>       { static constexpr const char *value = "d"; };
+template <> struct type_code<float>        { static constexpr const char *value = "f"; };
+template <> struct type_code<int>          { static constexpr const char *value = "i"; };
+template <> struct type_code<long long>    { static constexpr const char *value = "l"; };
+template <> struct type_code<unsigned int> { static constexpr const char *value = "ui"; };
+template <> struct type_code<utils::half>     { static constexpr const char *value = "h"; };
+template <> struct type_code<utils::bfloat16> { static constexpr const char *value = "bf"; };
+template <> struct type_code<utils::qint8>    { static constexpr const char *value = "q8"; };
+template <> struct type_code<device::cpu>  { static constexpr const char *value = "cpu"; };
+template <> struct type_code<device::cuda> { static constexpr const char *value = "cuda"; };
+
+// 64 bit FNV-1a fold over a stream of tokens, type tokens are their code
+// followed by a terminator, integer tokens are a tag followed by their bytes,
+// so no two parameter lists can produce the same stream
+namespace key {
+    constexpr uint64_t basis = 14695981039346656037ull;
+    constexpr uint64_t prime = 1099511628211ull;
+
+    constexpr uint64_t fold_byte(uint64_t h, unsigned char c) {
+        return (h ^ c) * prime;
+    }
+
+    constexpr uint64_t fold_code(uint64_t h, const char *code) {
+        while (*code)
+            h = fold_byte(h, static_cast<unsigned char>(*code++));
+        return fold_byte(h, 0);
+    }
+
+    constexpr uint64_t fold_int(uint64_t h, long long v) {
+        h = fold_byte(h, '#');
+        for (int i = 0; i < 8; ++i)
+            h = fold_byte(h, static_cast<unsigned char>(static_cast<unsigned long long>(v) >> (8 * i)));
+        return h;
+    }
+
+    constexpr uint64_t init(int ver) {
+        return fold_int(basis, ver);
+    }
+} // key
 
 } // type_repr
 
@@ -59,6 +139,140 @@ namespace fn_builder {
 
 namespace mpl = boost::mpl;
 
+// open addressed table from dispatch key to function pointer, keys are
+// already well mixed hashes so the low bits index directly, lookups are
+// a handful of compares over one contiguous array with no allocation
+template <typename FnPtr>
+class DispatchTable {
+public:
+    using fn_type = FnPtr;
+
+    struct Slot {
+        uint64_t key;
+        FnPtr fn;
+    };
+
+    DispatchTable() : slots(8, Slot{0, nullptr}), mask(7), n(0) {}
+
+    void insert_or_assign(uint64_t key, FnPtr fn) {
+        if (2 * (n + 1) > slots.size())
+            grow();
+        Slot &s = probe(key);
+        if (s.fn == nullptr)
+            n++;
+        s.key = key;
+        s.fn = fn;
+    }
+
+    // returns nullptr on a miss
+    FnPtr find(uint64_t key) const {
+        size_t i = key & mask;
+        while (slots[i].fn != nullptr) {
+            if (slots[i].key == key)
+                return slots[i].fn;
+            i = (i + 1) & mask;
+        }
+        return nullptr;
+    }
+
+    bool contains(uint64_t key) const { return find(key) != nullptr; }
+    size_t size() const { return n; }
+
+    template <typename F>
+    void for_each(F &&f) const {
+        for (auto const &s : slots)
+            if (s.fn != nullptr)
+                f(s.key, s.fn);
+    }
+
+private:
+    Slot &probe(uint64_t key) {
+        size_t i = key & mask;
+        while (slots[i].fn != nullptr && slots[i].key != key)
+            i = (i + 1) & mask;
+        return slots[i];
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots.size() * 2, Slot{0, nullptr});
+        old.swap(slots);
+        mask = slots.size() - 1;
+        for (auto const &s : old)
+            if (s.fn != nullptr)
+                probe(s.key) = s;
+    }
+
+    std::vector<Slot> slots;
+    size_t mask;
+    size_t n;
+};
+
+// lookups that found no specialization, counted per description, the first
+// miss of each is reported once on stderr, so that long runs name the shapes
+// worth adding a specialization for without stopping over them
+class MissLog {
+public:
+    struct Entry {
+        std::string what;
+        uint64_t count;
+        bool fell_back;
+    };
+
+    void record(const std::string &what, bool fell_back) {
+        std::lock_guard<std::mutex> lock(m);
+        for (auto &e : entries) {
+            if (e.what == what) {
+                e.count++;
+                return;
+            }
+        }
+        entries.push_back(Entry{what, 1, fell_back});
+        std::cerr << "fn_builder: no specialization for " << what
+                  << (fell_back ? ", running the fallback kernel\n" : ", and no fallback\n");
+    }
+
+    std::vector<Entry> snapshot() const {
+        std::lock_guard<std::mutex> lock(m);
+        return entries;
+    }
+
+    // the next miss of each description is reported again
+    void reset() {
+        std::lock_guard<std::mutex> lock(m);
+        entries.clear();
+    }
+
+private:
+    mutable std::mutex m;
+    std::vector<Entry> entries;
+};
+
+// shared by every table of the process
+inline MissLog &misses() {
+    static MissLog log;
+    return log;
+}
+
+// table.find(key), or on a miss the kernel registered under fallback_key,
+// such as the runtime dim kernels keyed on a dim of 0, with the miss recorded
+// under describe(), which is only called on a miss, nullptr when neither is
+// registered
+template <typename Table, typename Describe>
+typename Table::fn_type find_or_fallback(const Table &table, uint64_t key, uint64_t fallback_key, Describe &&describe) {
+    if (auto fn = table.find(key))
+        return fn;
+    auto fn = table.find(fallback_key);
+    misses().record(describe(), fn != nullptr);
+    return fn;
+}
+
+// a registered specialization, its key and the arguments it was built from,
+// type codes for types and decimal values for integers, in key order
+struct Signature {
+    uint64_t key;
+    std::vector<std::string> args;
+};
+
 // helper utilities
 namespace aux {
 
@@ -76,31 +290,34 @@ namespace aux {
 
 
     template <typename T>
-    std::string type_repr(std::false_type) {
-        return type_repr::to_std_type_str<T>();
+    constexpr uint64_t fold_static(uint64_t h, std::false_type) {
+        return type_repr::key::fold_code(h, type_repr::type_code<T>::value);
     }
 
     template <typename T>
-    std::string type_repr(std::true_type) {
-        return std::to_string(T::value);
+    constexpr uint64_t fold_static(uint64_t h, std::true_type) {
+        return type_repr::key::fold_int(h, T::value);
     }
 
     template <typename Seq>
-    std::string get_default_str() {
+    struct DefaultId {
         using front = typename mpl::front<Seq>::type;
         using back  = typename mpl::pop_front<Seq>::type;
-        return type_repr<front>(has_value<front>{}) + get_default_str<back>();   
-    }
+        static constexpr uint64_t fold(uint64_t h) {
+            return DefaultId<back>::fold(fold_static<front>(h, has_value<front>{}));
+        }
+    };
 
     template <>
-    std::string get_default_str<mpl::l_end>() {
-        return std::string("");
-    }
+    struct DefaultId<mpl::l_end> {
+        static constexpr uint64_t fold(uint64_t h) { return h; }
+    };
 
+    // folded at compile time, type_repr::construct_runtime_id must
+    // produce the same key from the runtime values
     template <typename Seq>
-    size_t get_default_id(int ver) {
-        std::hash<std::string> hasher;
-        return hasher(std::to_string(ver) + get_default_str<Seq>());
+    constexpr uint64_t get_default_id(int ver) {
+        return DefaultId<Seq>::fold(type_repr::key::init(ver));
     }
 
     template <typename Seq, template <class ...> class C, class... ArgsSoFar>
@@ -116,22 +333,109 @@ namespace aux {
     };
 
     template <typename Fn, typename Seq>
-    size_t id_switcher(std::true_type, int ver) {
+    uint64_t id_switcher(std::true_type, int ver) {
         return Fn::get_id();
     }
 
     template <typename Fn, typename Seq>
-    size_t id_switcher(std::false_type, int ver) {
+    uint64_t id_switcher(std::false_type, int ver) {
         return get_default_id<Seq>(ver);
     }
 
+    template <typename T>
+    std::string arg_repr(std::false_type) {
+        return type_repr::type_code<T>::value;
+    }
+
+    template <typename T>
+    std::string arg_repr(std::true_type) {
+        return std::to_string(T::value);
+    }
+
+    template <typename Seq>
+    struct ArgReprs_ {
+        static void push(std::vector<std::string> &args) {
+            using front = typename mpl::front<Seq>::type;
+            args.push_back(arg_repr<front>(has_value<front>{}));
+            ArgReprs_<typename mpl::pop_front<Seq>::type>::push(args);
+        }
+    };
+
+    template <>
+    struct ArgReprs_<mpl::l_end> {
+        static void push(std::vector<std::string> &args) {}
+    };
+
+    template <typename Seq, template <class ...> class Fn>
+    struct Describe_ {
+        static void push(std::vector<Signature> &sigs, int ver) {
+            using front = typename mpl::front<Seq>::type;
+            using fn_t  = typename ApplyArgs<front, Fn>::type;
+            Signature sig{id_switcher<fn_t, front>(has_id_fn<fn_t>{}, ver), {}};
+            ArgReprs_<front>::push(sig.args);
+            sigs.push_back(std::move(sig));
+            Describe_<typename mpl::pop_front<Seq>::type, Fn>::push(sigs, ver);
+        }
+    };
+
+    template <template <class ...> class Fn>
+    struct Describe_<mpl::l_end, Fn> {
+        static void push(std::vector<Signature> &sigs, int ver) {}
+    };
+
+#ifdef GROWNET_COUNTERS
+    template <typename Args>
+    Args arg_of(void (*)(const Args &));
+
+    // the name of the kernel template of fn_t, Fn of Tagged<Fn>::type
+    template <typename fn_t>
+    std::string template_name() {
+        std::string s = typeid(fn_t).name();
+#if defined(__GNUG__)
+        int status = 0;
+        char *d = abi::__cxa_demangle(s.c_str(), nullptr, nullptr, &status);
+        if (status == 0)
+            s = d;
+        std::free(d);
+#endif
+        const std::string tagged = "fn_builder::Tagged<";
+        const size_t end = s.find(">::type<");
+        if (s.compare(0, tagged.size(), tagged) == 0 && end != std::string::npos)
+            return s.substr(tagged.size(), end - tagged.size());
+        return s.substr(0, s.find('<'));
+    }
+#endif
+
+    // what the tables hold for fn_t, the kernel itself, or with
+    // GROWNET_COUNTERS the kernel wrapped in counters::Counted, registered
+    // the first time it is added to a table, the argument after the device
+    // tag is the element type, as in every table of lib.h
+    template <typename fn_t, typename Seq>
+    auto table_entry(uint64_t id) {
+#ifdef GROWNET_COUNTERS
+        using C = counters::Counted<fn_t, decltype(arg_of(&fn_t::fn))>;
+        if (C::id < 0) {
+            std::vector<std::string> args;
+            ArgReprs_<Seq>::push(args);
+            std::string name = template_name<fn_t>();
+            for (auto const &a : args)
+                name += " " + a;
+            C::elem = sizeof(typename mpl::at_c<Seq, 1>::type);
+            C::id = counters::registry().add(std::move(name), id);
+        }
+        return &C::fn;
+#else
+        return &fn_t::fn;
+#endif
+    }
+
     template <typename Seq, typename Map, int N, template <class ...> class Fn>
     struct BuildFn_ {
         static void build_func_(Map &map, int ver) {
             using front = typename mpl::front<Seq>::type;
             using fn_t  = typename ApplyArgs<front, Fn>::type;
-            size_t id = id_switcher<fn_t, front>(has_id_fn<fn_t>{}, ver);            
-            map[id] = &fn_t::fn;
+            uint64_t id = id_switcher<fn_t, front>(has_id_fn<fn_t>{}, ver);
+            map.insert_or_assign(id, table_entry<fn_t, front>(id));
 
             using back = typename mpl::pop_front<Seq>::type;
             BuildFn_<back, Map, N+1, Fn>::build_func_(map, ver);
@@ -150,6 +454,168 @@ namespace aux {
 }
 
 
+// the last few distinct keys a call site resolved, each with the entry it
+// resolved it to, such as the kernel and the scratch it needs, so calls that
+// repeat a key skip the lookup and whatever was derived along with it, keys
+// only need ==, not thread safe, a call site guards its own
+template <typename Key, typename Entry, int Ways = 4>
+class CallCache {
+public:
+    // the entry for key, from make() on a miss, in place of the oldest one,
+    // nothing is kept if make throws, timed as the resolution of the next
+    // kernel called with GROWNET_COUNTERS
+    template <typename Make>
+    const Entry &get(const Key &key, Make &&make) {
+        counters::Resolve timer;
+        for (int i = 0; i < n; ++i)
+            if (keys[i] == key)
+                return entries[i];
+        Entry e = make();
+        const int i = n < Ways ? n++ : next;
+        next = (i + 1) % Ways;
+        keys[i] = key;
+        entries[i] = std::move(e);
+        return entries[i];
+    }
+
+    void clear() { n = next = 0; }
+
+private:
+    Key keys[Ways];
+    Entry entries[Ways];
+    int n = 0;
+    int next = 0;
+};
+
+// generating and splitting lists of specializations, built as chains of
+// mpl::push_front onto mpl::l_end, so they are not bounded by the mpl list size
+// limit and an empty result is one the builders above accept
+namespace aux {
+    template <typename... Ts>
+    struct types {};
+
+    // the elements of an mpl sequence as types<...>
+    template <typename Seq, typename Acc = types<>, bool = mpl::empty<Seq>::value>
+    struct Unpack {
+        using type = Acc;
+    };
+
+    template <typename Seq, typename... Acc>
+    struct Unpack<Seq, types<Acc...>, false> {
+        using type = typename Unpack<typename mpl::pop_front<Seq>::type,
+                                     types<Acc..., typename mpl::front<Seq>::type>>::type;
+    };
+
+    template <typename Types>
+    struct ToList;
+
+    template <>
+    struct ToList<types<>> {
+        using type = mpl::l_end;
+    };
+
+    template <typename T, typename... Ts>
+    struct ToList<types<T, Ts...>> {
+        using type = typename mpl::push_front<typename ToList<types<Ts...>>::type, T>::type;
+    };
+
+    template <typename... Ls>
+    struct Concat {
+        using type = types<>;
+    };
+
+    template <typename... A, typename... Ls>
+    struct Concat<types<A...>, Ls...> {
+        using type = typename Concat<types<A...>, typename Concat<Ls...>::type>::type;
+    };
+
+    template <typename... A, typename... B>
+    struct Concat<types<A...>, types<B...>> {
+        using type = types<A..., B...>;
+    };
+
+    // X in front of every tuple
+    template <typename X, typename Tuples>
+    struct Prepend;
+
+    template <typename X, typename... Tuples>
+    struct Prepend<X, types<Tuples...>> {
+        template <typename Tuple>
+        struct one;
+        template <typename... Ts>
+        struct one<types<Ts...>> {
+            using type = types<X, Ts...>;
+        };
+        using type = types<typename one<Tuples>::type...>;
+    };
+
+    // tuples of types<...>, the last axis varying fastest
+    template <typename... Axes>
+    struct Product {
+        using type = types<types<>>;
+    };
+
+    template <typename... A, typename... Rest>
+    struct Product<types<A...>, Rest...> {
+        using tail = typename Product<Rest...>::type;
+        using type = typename Concat<typename Prepend<A, tail>::type...>::type;
+    };
+
+    template <typename Tuples>
+    struct TuplesToList;
+
+    template <typename... Tuples>
+    struct TuplesToList<types<Tuples...>> {
+        using type = typename ToList<types<typename ToList<Tuples>::type...>>::type;
+    };
+
+    // which of Shards the element at position I is dealt to, back and forth
+    // so that neither end of an ordered list piles up in one shard
+    constexpr int deal(int I, int Shards) {
+        return (I / Shards) % 2 == 0 ? I % Shards : Shards - 1 - I % Shards;
+    }
+
+    // the elements dealt to Shard, from position I on
+    template <typename Types, int Shard, int Shards, int I = 0>
+    struct Every {
+        using type = types<>;
+    };
+
+    template <typename T, typename... Ts, int Shard, int Shards, int I>
+    struct Every<types<T, Ts...>, Shard, Shards, I> {
+        using rest = typename Every<types<Ts...>, Shard, Shards, I + 1>::type;
+        using type = std::conditional_t<deal(I, Shards) == Shard, typename Concat<types<T>, rest>::type, rest>;
+    };
+}
+
+// every argument list of the cartesian product of the axes, each an mpl
+// sequence such as the devices, dtypes or dims to specialize on, in order
+// with the last axis varying fastest, ready for FnBuilder
+template <typename... Axes>
+using product = typename aux::TuplesToList<typename aux::Product<typename aux::Unpack<Axes>::type...>::type>::type;
+
+// the argument lists of Seq dealt to Shard of Shards, so a large set of
+// specializations can be instantiated over Shards translation units, dealt
+// back and forth so that with the dims varying fastest each shard gets a
+// spread of them rather than all of the largest
+template <typename Seq, int Shard, int Shards>
+using shard = typename aux::ToList<typename aux::Every<typename aux::Unpack<Seq>::type, Shard, Shards>::type>::type;
+
+// adds Fn over Seq to an existing table like FnBuilder::build_table, but
+// also for an empty Seq, such as a shard with nothing left in it
+template <typename Seq, template <class ...> class Fn, typename Table>
+void build_into(Table &table, int ver = 0) {
+    aux::BuildFn_<Seq, Table, 0, Fn>::build_func_(table, ver);
+}
+
+// registers Fn<Args...> under the key (Tag, Args...), for tags such as
+// the device which select the kernel but are not parameters of it
+template <template <class ...> class Fn>
+struct Tagged {
+    template <typename Tag, typename... Args>
+    struct type : Fn<Args...> {};
+};
+
 template <typename Seq, template <class ...> class Fn>
 struct FnBuilder {
     const static int size = mpl::size<Seq>::value;
@@ -157,7 +623,8 @@ struct FnBuilder {
     using fn_t  = typename aux::ApplyArgs<front, Fn>::type;
     using fn_ptr = decltype(&fn_t::fn);
 
-    using map_t = std::map<size_t, fn_ptr>;
+    using map_t = std::map<uint64_t, fn_ptr>;
+    using table_t = DispatchTable<fn_ptr>;
 
     static map_t build_fn(int ver) {
         map_t map;
@@ -176,6 +643,28 @@ struct FnBuilder {
     static void build_fn(map_t &map) {
         build_fn(map, 0);
     }
+
+    // same keys as build_fn, but hashed instead of tree lookup
+    static table_t build_table(int ver) {
+        table_t table;
+        aux::BuildFn_<Seq, table_t, 0, Fn>::build_func_(table, ver);
+        return table;
+    }
+
+    static void build_table(table_t &table, int ver) {
+        aux::BuildFn_<Seq, table_t, 0, Fn>::build_func_(table, ver);
+    }
+
+    static table_t build_table() {
+        return build_table(0);
+    }
+
+    // what build_fn/build_table register, for enumerating the specializations
+    static std::vector<Signature> signatures(int ver = 0) {
+        std::vector<Signature> sigs;
+        aux::Describe_<Seq, Fn>::push(sigs, ver);
+        return sigs;
+    }
 };
 
 }
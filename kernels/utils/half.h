@@ -0,0 +1,154 @@
+/*
+16 bit storage types, IEEE binary16 and bfloat16, bit compatible with
+torch::kF16 and torch::kBFloat16 so tensor storage can be handed over as is,
+without pulling in libtorch or cuda_fp16.h
+
+they are storage only, kernels widen them to float, do all arithmetic and
+accumulation in float and narrow the results once on the way out, narrowing
+rounds to nearest even like the torch conversions
+*/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace utils {
+
+struct half {
+    uint16_t bits;
+
+    static half of(float f) {
+        uint32_t x;
+        std::memcpy(&x, &f, 4);
+        const uint32_t sign = (x >> 16) & 0x8000u;
+        const uint32_t a = x & 0x7fffffffu;
+        // inf and nan, keeping nans quiet
+        if (a >= 0x7f800000u)
+            return half{(uint16_t)(sign | 0x7c00u | (a > 0x7f800000u ? 0x200u : 0u))};
+        // overflows to inf, the largest half is 65504
+        if (a >= 0x477ff000u)
+            return half{(uint16_t)(sign | 0x7c00u)};
+        // subnormal or zero, rounded by the float add, which aligns the
+        // mantissa to the half subnormal step of 2^-24
+        if (a < 0x38800000u) {
+            float r;
+            std::memcpy(&r, &a, 4);
+            r += 0.5f;
+            uint32_t b;
+            std::memcpy(&b, &r, 4);
+            return half{(uint16_t)(sign | (b - 0x3f000000u))};
+        }
+        // normal, rebias the exponent and round the 13 dropped bits to even
+        const uint32_t odd = (a >> 13) & 1u;
+        return half{(uint16_t)(sign | ((a + 0xc8000fffu + odd) >> 13))};
+    }
+
+    operator float() const {
+        const uint32_t sign = (uint32_t)(bits & 0x8000u) << 16;
+        const uint32_t e = (bits >> 10) & 0x1fu;
+        const uint32_t m = bits & 0x3ffu;
+        uint32_t x;
+        if (e == 0x1f) {
+            x = sign | 0x7f800000u | (m << 13);
+        } else if (e != 0) {
+            x = sign | ((e + 112) << 23) | (m << 13);
+        } else {
+            // subnormal, m * 2^-24
+            float f = (float)m * 5.9604644775390625e-8f;
+            std::memcpy(&x, &f, 4);
+            x |= sign;
+        }
+        float f;
+        std::memcpy(&f, &x, 4);
+        return f;
+    }
+};
+
+struct bfloat16 {
+    uint16_t bits;
+
+    static bfloat16 of(float f) {
+        uint32_t x;
+        std::memcpy(&x, &f, 4);
+        if ((x & 0x7fffffffu) > 0x7f800000u)
+            return bfloat16{(uint16_t)((x >> 16) | 0x40u)};
+        return bfloat16{(uint16_t)((x + 0x7fffu + ((x >> 16) & 1u)) >> 16)};
+    }
+
+    operator float() const {
+        const uint32_t x = (uint32_t)bits << 16;
+        float f;
+        std::memcpy(&f, &x, 4);
+        return f;
+    }
+};
+
+static_assert(sizeof(half) == 2 && sizeof(bfloat16) == 2, "16 bit storage types must be packed");
+
+// the type a storage type is computed and accumulated in
+template <typename T>
+struct accumulate {
+    using type = T;
+};
+template <> struct accumulate<half>     { using type = float; };
+template <> struct accumulate<bfloat16> { using type = float; };
+
+template <typename T>
+using accumulate_t = typename accumulate<T>::type;
+
+// dst[i] = src[i] converted, for buffers of either type
+template <typename S, typename D>
+inline void convert(const S *src, D *dst, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = (D)src[i];
+}
+
+template <>
+inline void convert(const float *src, half *dst, size_t n) {
+    size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+    for (; i < n; ++i)
+        dst[i] = half::of(src[i]);
+}
+
+template <>
+inline void convert(const half *src, float *dst, size_t n) {
+    size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i))));
+#endif
+    for (; i < n; ++i)
+        dst[i] = src[i];
+}
+
+template <>
+inline void convert(const bfloat16 *src, float *dst, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t x = (uint32_t)src[i].bits << 16;
+        std::memcpy(dst + i, &x, 4);
+    }
+}
+
+// bfloat16::of without the branch, which the compiler vectorizes
+template <>
+inline void convert(const float *src, bfloat16 *dst, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t x;
+        std::memcpy(&x, src + i, 4);
+        const uint32_t r = (x + 0x7fffu + ((x >> 16) & 1u)) >> 16;
+        const uint32_t q = (x >> 16) | 0x40u;
+        dst[i].bits = (uint16_t)((x & 0x7fffffffu) > 0x7f800000u ? q : r);
+    }
+}
+
+} // utils
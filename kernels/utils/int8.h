@@ -0,0 +1,22 @@
+/*
+8 bit storage of quantized weights, a tag for the dispatch key like the 16
+bit types of half.h, kernels over it read float inputs against int8 weights
+of a per cell scale, as packed by grid/quantize.h, and compute in float
+*/
+
+#pragma once
+#include <cstdint>
+
+#include "half.h"
+
+namespace utils {
+
+struct qint8 {
+    int8_t v;
+};
+
+static_assert(sizeof(qint8) == 1, "8 bit storage types must be packed");
+
+template <> struct accumulate<qint8> { using type = float; };
+
+} // utils
@@ -0,0 +1,233 @@
+/*
+thin wrappers over the vector registers available at compile time, so kernels
+can be written once against Pack<T, W> and specialized on the widest lane count
+that evenly divides their compile time dimension
+*/
+
+#pragma once
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX__) || defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace simd {
+
+#if defined(__AVX512F__)
+constexpr int register_bytes = 64;
+#elif defined(__AVX__)
+constexpr int register_bytes = 32;
+#else
+constexpr int register_bytes = 16;
+#endif
+
+template <typename T>
+constexpr int max_width = register_bytes / sizeof(T);
+
+// largest power of two lane count that is available and divides dim,
+// a dim of 0 means the dimension is only known at runtime
+template <typename T, int Dim>
+constexpr int width_for() {
+    if (Dim <= 0)
+        return 1;
+    int w = max_width<T>;
+    while (w > 1 && Dim % w != 0)
+        w /= 2;
+    return w;
+}
+
+// generic fallback, plain arrays which the compiler is free to vectorize
+template <typename T, int W>
+struct Pack {
+    static constexpr int width = W;
+    T v[W];
+
+    static Pack load(const T *p) {
+        Pack r;
+        for (int i = 0; i < W; ++i) r.v[i] = p[i];
+        return r;
+    }
+    static Pack set1(T a) {
+        Pack r;
+        for (int i = 0; i < W; ++i) r.v[i] = a;
+        return r;
+    }
+    static Pack zero() { return set1(T(0)); }
+    void store(T *p) const {
+        for (int i = 0; i < W; ++i) p[i] = v[i];
+    }
+    T sum() const {
+        T s = 0;
+        for (int i = 0; i < W; ++i) s += v[i];
+        return s;
+    }
+
+    friend Pack operator+(Pack a, Pack b) { for (int i = 0; i < W; ++i) a.v[i] += b.v[i]; return a; }
+    friend Pack operator-(Pack a, Pack b) { for (int i = 0; i < W; ++i) a.v[i] -= b.v[i]; return a; }
+    friend Pack operator*(Pack a, Pack b) { for (int i = 0; i < W; ++i) a.v[i] *= b.v[i]; return a; }
+    friend Pack operator/(Pack a, Pack b) { for (int i = 0; i < W; ++i) a.v[i] /= b.v[i]; return a; }
+    friend Pack sqrt(Pack a) { for (int i = 0; i < W; ++i) a.v[i] = std::sqrt(a.v[i]); return a; }
+    // a * b + c
+    friend Pack fmadd(Pack a, Pack b, Pack c) { for (int i = 0; i < W; ++i) c.v[i] += a.v[i] * b.v[i]; return c; }
+    friend Pack max(Pack a, Pack b) { for (int i = 0; i < W; ++i) a.v[i] = std::max(a.v[i], b.v[i]); return a; }
+    // 1 where a > 0, 0 otherwise, times b
+    friend Pack mask_positive(Pack a, Pack b) { for (int i = 0; i < W; ++i) b.v[i] = a.v[i] > 0 ? b.v[i] : T(0); return b; }
+};
+
+#if defined(__AVX__)
+template <>
+struct Pack<float, 8> {
+    static constexpr int width = 8;
+    __m256 v;
+
+    static Pack load(const float *p) { return {_mm256_loadu_ps(p)}; }
+    static Pack set1(float a) { return {_mm256_set1_ps(a)}; }
+    static Pack zero() { return {_mm256_setzero_ps()}; }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+    float sum() const {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+
+    friend Pack operator+(Pack a, Pack b) { return {_mm256_add_ps(a.v, b.v)}; }
+    friend Pack operator-(Pack a, Pack b) { return {_mm256_sub_ps(a.v, b.v)}; }
+    friend Pack operator*(Pack a, Pack b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    friend Pack operator/(Pack a, Pack b) { return {_mm256_div_ps(a.v, b.v)}; }
+    friend Pack sqrt(Pack a) { return {_mm256_sqrt_ps(a.v)}; }
+#if defined(__FMA__)
+    friend Pack fmadd(Pack a, Pack b, Pack c) { return {_mm256_fmadd_ps(a.v, b.v, c.v)}; }
+#else
+    friend Pack fmadd(Pack a, Pack b, Pack c) { return {_mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v)}; }
+#endif
+    friend Pack max(Pack a, Pack b) { return {_mm256_max_ps(a.v, b.v)}; }
+    friend Pack mask_positive(Pack a, Pack b) {
+        return {_mm256_and_ps(_mm256_cmp_ps(a.v, _mm256_setzero_ps(), _CMP_GT_OQ), b.v)};
+    }
+};
+
+template <>
+struct Pack<double, 4> {
+    static constexpr int width = 4;
+    __m256d v;
+
+    static Pack load(const double *p) { return {_mm256_loadu_pd(p)}; }
+    static Pack set1(double a) { return {_mm256_set1_pd(a)}; }
+    static Pack zero() { return {_mm256_setzero_pd()}; }
+    void store(double *p) const { _mm256_storeu_pd(p, v); }
+    double sum() const {
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+        s = _mm_add_sd(s, _mm_unpackhi_pd(s, s));
+        return _mm_cvtsd_f64(s);
+    }
+
+    friend Pack operator+(Pack a, Pack b) { return {_mm256_add_pd(a.v, b.v)}; }
+    friend Pack operator-(Pack a, Pack b) { return {_mm256_sub_pd(a.v, b.v)}; }
+    friend Pack operator*(Pack a, Pack b) { return {_mm256_mul_pd(a.v, b.v)}; }
+    friend Pack operator/(Pack a, Pack b) { return {_mm256_div_pd(a.v, b.v)}; }
+    friend Pack sqrt(Pack a) { return {_mm256_sqrt_pd(a.v)}; }
+#if defined(__FMA__)
+    friend Pack fmadd(Pack a, Pack b, Pack c) { return {_mm256_fmadd_pd(a.v, b.v, c.v)}; }
+#else
+    friend Pack fmadd(Pack a, Pack b, Pack c) { return {_mm256_add_pd(_mm256_mul_pd(a.v, b.v), c.v)}; }
+#endif
+    friend Pack max(Pack a, Pack b) { return {_mm256_max_pd(a.v, b.v)}; }
+    friend Pack mask_positive(Pack a, Pack b) {
+        return {_mm256_and_pd(_mm256_cmp_pd(a.v, _mm256_setzero_pd(), _CMP_GT_OQ), b.v)};
+    }
+};
+#endif
+
+#if defined(__AVX512F__)
+template <>
+struct Pack<float, 16> {
+    static constexpr int width = 16;
+    // sqrt and max through their masked forms, the plain ones start from an
+    // undefined vector too, with every lane set they compile the same
+    static constexpr __mmask16 all = 0xffff;
+    __m512 v;
+
+    static Pack load(const float *p) { return {_mm512_loadu_ps(p)}; }
+    static Pack set1(float a) { return {_mm512_set1_ps(a)}; }
+    static Pack zero() { return {_mm512_setzero_ps()}; }
+    void store(float *p) const { _mm512_storeu_ps(p, v); }
+    // halved by shuffles, gcc 12 warns of the undefined vector that
+    // _mm512_reduce_add_ps and even _mm512_castps512_ps256 start from
+    float sum() const {
+        const __m256 lo = __builtin_shufflevector(v, v, 0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256 hi = __builtin_shufflevector(v, v, 8, 9, 10, 11, 12, 13, 14, 15);
+        return Pack<float, 8>{_mm256_add_ps(lo, hi)}.sum();
+    }
+
+    friend Pack operator+(Pack a, Pack b) { return {_mm512_add_ps(a.v, b.v)}; }
+    friend Pack operator-(Pack a, Pack b) { return {_mm512_sub_ps(a.v, b.v)}; }
+    friend Pack operator*(Pack a, Pack b) { return {_mm512_mul_ps(a.v, b.v)}; }
+    friend Pack operator/(Pack a, Pack b) { return {_mm512_div_ps(a.v, b.v)}; }
+    friend Pack sqrt(Pack a) { return {_mm512_maskz_sqrt_ps(all, a.v)}; }
+    friend Pack fmadd(Pack a, Pack b, Pack c) { return {_mm512_fmadd_ps(a.v, b.v, c.v)}; }
+    friend Pack max(Pack a, Pack b) { return {_mm512_maskz_max_ps(all, a.v, b.v)}; }
+    friend Pack mask_positive(Pack a, Pack b) {
+        return {_mm512_maskz_mov_ps(_mm512_cmp_ps_mask(a.v, _mm512_setzero_ps(), _CMP_GT_OQ), b.v)};
+    }
+};
+
+template <>
+struct Pack<double, 8> {
+    static constexpr int width = 8;
+    static constexpr __mmask8 all = 0xff;
+    __m512d v;
+
+    static Pack load(const double *p) { return {_mm512_loadu_pd(p)}; }
+    static Pack set1(double a) { return {_mm512_set1_pd(a)}; }
+    static Pack zero() { return {_mm512_setzero_pd()}; }
+    void store(double *p) const { _mm512_storeu_pd(p, v); }
+    // halved by hand, as for Pack<float, 16>
+    double sum() const {
+        const __m256d lo = __builtin_shufflevector(v, v, 0, 1, 2, 3), hi = __builtin_shufflevector(v, v, 4, 5, 6, 7);
+        return Pack<double, 4>{_mm256_add_pd(lo, hi)}.sum();
+    }
+
+    friend Pack operator+(Pack a, Pack b) { return {_mm512_add_pd(a.v, b.v)}; }
+    friend Pack operator-(Pack a, Pack b) { return {_mm512_sub_pd(a.v, b.v)}; }
+    friend Pack operator*(Pack a, Pack b) { return {_mm512_mul_pd(a.v, b.v)}; }
+    friend Pack operator/(Pack a, Pack b) { return {_mm512_div_pd(a.v, b.v)}; }
+    friend Pack sqrt(Pack a) { return {_mm512_maskz_sqrt_pd(all, a.v)}; }
+    friend Pack fmadd(Pack a, Pack b, Pack c) { return {_mm512_fmadd_pd(a.v, b.v, c.v)}; }
+    friend Pack max(Pack a, Pack b) { return {_mm512_maskz_max_pd(all, a.v, b.v)}; }
+    friend Pack mask_positive(Pack a, Pack b) {
+        return {_mm512_maskz_mov_pd(_mm512_cmp_pd_mask(a.v, _mm512_setzero_pd(), _CMP_GT_OQ), b.v)};
+    }
+};
+#endif
+
+// a row of Dim elements held entirely in registers
+template <typename T, int Dim>
+struct Row {
+    static constexpr int W = width_for<T, Dim>();
+    static constexpr int N = Dim / W;
+    using pack = Pack<T, W>;
+    pack p[N];
+
+    static Row load(const T *a) {
+        Row r;
+        for (int k = 0; k < N; ++k) r.p[k] = pack::load(a + k * W);
+        return r;
+    }
+    static Row set1(T a) {
+        Row r;
+        for (int k = 0; k < N; ++k) r.p[k] = pack::set1(a);
+        return r;
+    }
+    void store(T *a) const {
+        for (int k = 0; k < N; ++k) p[k].store(a + k * W);
+    }
+    T sum() const {
+        pack s = p[0];
+        for (int k = 1; k < N; ++k) s = s + p[k];
+        return s.sum();
+    }
+};
+
+} // simd
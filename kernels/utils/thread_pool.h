@@ -0,0 +1,122 @@
+/*
+fixed size pool of worker threads for parallel-for style work, the calling
+thread takes part in every run, and run returns only once every task is done,
+so consecutive runs act as a barrier between phases, runs from several threads
+take turns, each of them getting the whole pool
+
+a task that throws makes the tasks not yet started be skipped, and run
+rethrows the first exception once every task in flight is done, on whichever
+thread it was thrown
+*/
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace utils {
+
+class ThreadPool {
+public:
+    // n_threads counts the calling thread, 0 uses every hardware thread
+    explicit ThreadPool(int n_threads = 0) {
+        if (n_threads <= 0)
+            n_threads = std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 1; i < n_threads; ++i)
+            workers.emplace_back([this] { work(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stop = true;
+        }
+        start.notify_all();
+        for (auto &t : workers)
+            t.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int size() const { return (int)workers.size() + 1; }
+
+    // calls f(i) for i in [0, n_tasks), f must not run on this pool itself
+    void run(int n_tasks, const std::function<void(int)> &f) {
+        if (workers.empty() || n_tasks <= 1) {
+            for (int i = 0; i < n_tasks; ++i)
+                f(i);
+            return;
+        }
+        std::lock_guard<std::mutex> turn(running);
+        {
+            std::lock_guard<std::mutex> lock(m);
+            job = &f;
+            tasks = n_tasks;
+            next.store(0, std::memory_order_relaxed);
+            active.store((int)workers.size(), std::memory_order_relaxed);
+            error = nullptr;
+            generation++;
+        }
+        start.notify_all();
+        drain();
+        // every task is taken by now, but a worker that has not woken up yet
+        // still has to wake and find none left, so this can spin for as long
+        // as a wake up takes, yielding to it, f and job stay valid till then
+        while (active.load(std::memory_order_acquire) != 0)
+            std::this_thread::yield();
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+private:
+    void drain() {
+        for (int i = next.fetch_add(1); i < tasks; i = next.fetch_add(1)) {
+            try {
+                (*job)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m);
+                if (!error)
+                    error = std::current_exception();
+                next.store(tasks);
+            }
+        }
+    }
+
+    void work() {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                start.wait(lock, [&] { return stop || generation != seen; });
+                if (stop)
+                    return;
+                seen = generation;
+            }
+            drain();
+            active.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    std::vector<std::thread> workers;
+    // held by the run in progress
+    std::mutex running;
+    std::mutex m;
+    std::condition_variable start;
+    const std::function<void(int)> *job = nullptr;
+    int tasks = 0;
+    std::atomic<int> next{0};
+    std::atomic<int> active{0};
+    // the first exception of the run in progress, under m
+    std::exception_ptr error;
+    uint64_t generation = 0;
+    bool stop = false;
+};
+
+} // utils
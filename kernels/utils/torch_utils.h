@@ -5,11 +5,14 @@ building with it is extremely slow
 
 #pragma once
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <torch/types.h>
 
+#include "func_constructor.h"
+
 namespace utils {
-    auto like_tensor(const torch::Tensor &a) {
+    inline auto like_tensor(const torch::Tensor &a) {
         auto opt = torch::TensorOptions().device(a.device()).dtype(a.dtype());
         return opt;
     }
@@ -22,38 +25,99 @@ namespace utils {
 }
 
 namespace type_repr {
-std::string get_runtime_type_str(torch::Dtype t) {
+constexpr const char *get_runtime_type_code(torch::Dtype t) {
     switch (t) {
         case torch::kInt:
-            return std::string("i");
+            return "i";
         case torch::kF16:
-            return std::string("h");
+            return "h";
+        case torch::kBFloat16:
+            return "bf";
         case torch::kF32:
-            return std::string("f");
+            return "f";
         case torch::kF64:
-            return std::string("d");
+            return "d";
+        case torch::kQInt8:
+            return "q8";
+        default:
+            return "unknown";
     }
-    return std::string("unknown");
 }
 
-std::string get_runtime_type_str(int t) {
-    return std::to_string(t);
+constexpr const char *get_runtime_device_code(torch::DeviceType t) {
+    switch (t) {
+        case torch::kCPU:
+            return "cpu";
+        case torch::kCUDA:
+            return "cuda";
+        default:
+            return "unknown";
+    }
+}
+
+constexpr uint64_t fold_runtime_key(uint64_t h, torch::DeviceType t) {
+    return key::fold_code(h, get_runtime_device_code(t));
+}
+
+inline uint64_t fold_runtime_key(uint64_t h, const torch::Device &d) {
+    return fold_runtime_key(h, d.type());
 }
 
-std::string construct_runtime_str() {
-    return std::string("");
+constexpr uint64_t fold_runtime_key(uint64_t h, torch::Dtype t) {
+    return key::fold_code(h, get_runtime_type_code(t));
 }
 
-template <typename T, typename... Args>
-std::string construct_runtime_str(T val, Args... args) {
-    return get_runtime_type_str(val) + construct_runtime_str(args...);
+constexpr uint64_t fold_runtime_key(uint64_t h, int t) {
+    return key::fold_int(h, t);
 }
 
+// runtime counterpart of fn_builder::aux::get_default_id, folds each
+// argument into the key in place, so there is no heap traffic per dispatch
 template <typename... Args>
-size_t construct_runtime_id(int ver, Args... args) {
-    std::hash<std::string> hasher;
-    return hasher(std::to_string(ver) + construct_runtime_str(args...));
+constexpr uint64_t construct_runtime_id(int ver, Args... args) {
+    uint64_t h = key::init(ver);
+    ((h = fold_runtime_key(h, args)), ...);
+    return h;
 }
 
+// compile-time and runtime keys must always agree, otherwise lookups
+// silently miss, so check every code and a spread of parameter lists here
+namespace checks {
+    namespace mpl = boost::mpl;
+    using fn_builder::aux::get_default_id;
 
-}
\ No newline at end of file
+    constexpr bool same_code(const char *a, const char *b) {
+        return std::string_view(a) == std::string_view(b);
+    }
+
+    static_assert(same_code(type_code<int>::value, get_runtime_type_code(torch::kInt)));
+    static_assert(same_code(type_code<float>::value, get_runtime_type_code(torch::kF32)));
+    static_assert(same_code(type_code<double>::value, get_runtime_type_code(torch::kF64)));
+    static_assert(same_code(type_code<utils::half>::value, get_runtime_type_code(torch::kF16)));
+    static_assert(same_code(type_code<utils::bfloat16>::value, get_runtime_type_code(torch::kBFloat16)));
+    static_assert(same_code(type_code<utils::qint8>::value, get_runtime_type_code(torch::kQInt8)));
+    static_assert(same_code(type_code<device::cpu>::value, get_runtime_device_code(torch::kCPU)));
+    static_assert(same_code(type_code<device::cuda>::value, get_runtime_device_code(torch::kCUDA)));
+
+    static_assert(get_default_id<mpl::list<float>>(0) == construct_runtime_id(0, torch::kF32));
+    static_assert(get_default_id<mpl::list<double, mpl::int_<16>>>(0) == construct_runtime_id(0, torch::kF64, 16));
+    static_assert(get_default_id<mpl::list<float, mpl::int_<-1>, mpl::int_<7>>>(3) ==
+                  construct_runtime_id(3, torch::kF32, -1, 7));
+    static_assert(get_default_id<mpl::list<int, float, mpl::int_<1 << 30>>>(1) ==
+                  construct_runtime_id(1, torch::kInt, torch::kF32, 1 << 30));
+    static_assert(get_default_id<mpl::list<device::cuda, double, mpl::int_<32>>>(0) ==
+                  construct_runtime_id(0, torch::kCUDA, torch::kF64, 32));
+    static_assert(get_default_id<mpl::list<device::cpu, utils::qint8, mpl::int_<16>>>(0) ==
+                  construct_runtime_id(0, torch::kCPU, torch::kQInt8, 16));
+
+    // keys must also separate what they should
+    static_assert(construct_runtime_id(0, torch::kF32, 8) != construct_runtime_id(1, torch::kF32, 8));
+    static_assert(construct_runtime_id(0, torch::kF32, 8) != construct_runtime_id(0, torch::kF64, 8));
+    static_assert(construct_runtime_id(0, torch::kF32, 8) != construct_runtime_id(0, torch::kF32, 16));
+    static_assert(construct_runtime_id(0, torch::kF32, 1, 2) != construct_runtime_id(0, torch::kF32, 2, 1));
+    static_assert(construct_runtime_id(0, torch::kF16) != construct_runtime_id(0, torch::kF32));
+    static_assert(construct_runtime_id(0, torch::kF16) != construct_runtime_id(0, torch::kBFloat16));
+    static_assert(construct_runtime_id(0, torch::kCPU, torch::kF32) != construct_runtime_id(0, torch::kCUDA, torch::kF32));
+} // checks
+
+}